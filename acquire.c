@@ -0,0 +1,597 @@
+/************************************************************************
+
+  Acquisition loops shared by histomode and the benchmark harness.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "adapt.h"
+
+
+int doapicall(int retcode, char* callstr, int line)
+{
+    if (retcode < 0)
+    {
+        char errorstring[100] = { 0 };
+        MH_GetErrorString(errorstring, retcode);
+        printf("\nThe API call %s at line %d\nreturned error %d (%s)\n", callstr, line, retcode, errorstring);
+    }
+    return retcode;
+}
+
+
+// channel rows per frame
+int sel_rows(const readsel_t* s)
+{
+    int ch, n = 0;
+
+    if (s->roilen <= 0)
+        return s->numchannels;
+    for (ch = 0; ch < s->numchannels && ch < 64; ch++)
+        n += (s->chanmask >> ch) & 1;
+    return n;
+}
+
+// fills in the row to channel map and picks the kernels for the frame geometry
+void sel_prepare(readsel_t* s)
+{
+    int ch, row = 0;
+
+    for (ch = 0; ch < s->numchannels && ch < 64; ch++)
+        if ((s->chanmask >> ch) & 1)
+            s->chans[row++] = ch;
+    s->kern = fk_select(sel_rows(s), s->roilen > 0 ? s->roilen : s->histlen);
+}
+
+size_t sel_framewords(const readsel_t* s)
+{
+    return (size_t)sel_rows(s) * (s->roilen > 0 ? s->roilen : s->histlen);
+}
+
+
+// times both readout paths on the idle device and sets s->mode to the faster one
+int acq_choosereadout(int devidx, readsel_t* s)
+{
+    unsigned int* buf;
+    double t0, tall, tchan;
+    int ch, i;
+
+    if (s->histlen < READ_MINCHANLEN && s->mode != READ_ALL)
+    {
+        printf("\nReadout: histogram length %d is too short for MH_GetHistogram, using MH_GetAllHistograms", s->histlen);
+        s->mode = READ_ALL;
+    }
+    if (s->mode != READ_AUTO)
+        return 0;
+    buf = (unsigned int*)malloc((size_t)s->numchannels * s->histlen * sizeof(unsigned int));
+    if (buf == NULL)
+        return -1;
+    t0 = mh_timems();
+    for (i = 0; i < 3; i++)
+        if (APICALL(MH_GetAllHistograms(devidx, buf)) < 0) goto fail;
+    tall = (mh_timems() - t0) / 3;
+    t0 = mh_timems();
+    for (i = 0; i < 3; i++)
+        for (ch = 0; ch < s->numchannels; ch++)
+            if ((s->chanmask >> ch) & 1)
+                if (APICALL(MH_GetHistogram(devidx, buf, ch)) < 0) goto fail;
+    tchan = (mh_timems() - t0) / 3;
+    free(buf);
+    s->mode = tchan < tall ? READ_CHANNELS : READ_ALL;
+    printf("\nReadout: all channels %1.2f ms, %d selected channels %1.2f ms, using %s", tall, sel_rows(s), tchan,
+        s->mode == READ_CHANNELS ? "MH_GetHistogram" : "MH_GetAllHistograms");
+    return 0;
+
+fail:
+    free(buf);
+    return -1;
+}
+
+// picks binning and stored bins from the sync period, which needs a
+// valid sync rate reading (100 ms after MH_Initialize or a sync change);
+// r->bins is 0 if there is no sync or the offset lies beyond its period
+int acq_autorange(int devidx, int binning, int offset, int maxbins, autorange_t* r)
+{
+    double period, window;
+    int binsteps;
+
+    memset(r, 0, sizeof(*r));
+    if (APICALL(MH_GetSyncPeriod(devidx, &period)) < 0) return -1;
+    if (APICALL(MH_GetBaseResolution(devidx, &r->baseres, &binsteps)) < 0) return -1;
+    r->period = period * 1e12;
+    r->offset = offset;
+    r->binning = binning;
+    window = r->period - offset * 1000.0;
+    if (window <= 0 || r->baseres <= 0)
+        return 0;
+    while (r->binning < binsteps - 1 && window / (r->baseres * (1 << r->binning)) > maxbins)
+        r->binning++;
+    r->bins = (int)ceil(window / (r->baseres * (1 << r->binning)));
+    if (r->bins > MAXHISTLEN)
+        r->bins = MAXHISTLEN; // even the coarsest binning does not get there
+    return 0;
+}
+
+// reads the selected part of the device histograms into counts; scratch must
+// hold numchannels*histlen words unless every channel is stored in full,
+// s must have been through sel_prepare
+int acq_readout(int devidx, const readsel_t* s, unsigned int* counts, unsigned int* scratch)
+{
+    int row, rows;
+
+    if (s->roilen <= 0)
+        return APICALL(MH_GetAllHistograms(devidx, counts)); // straight into the frame
+    rows = sel_rows(s);
+    if (s->mode == READ_CHANNELS)
+    {
+        for (row = 0; row < rows; row++)
+        {
+            if (APICALL(MH_GetHistogram(devidx, scratch, s->chans[row])) < 0) return -1;
+            memcpy(counts + (size_t)row * s->roilen, scratch + s->roistart, s->roilen * sizeof(unsigned int));
+        }
+        return 0;
+    }
+    if (APICALL(MH_GetAllHistograms(devidx, scratch)) < 0) return -1;
+    s->kern->gather(counts, scratch, s->chans, s->histlen, s->roistart, rows, s->roilen);
+    return 0;
+}
+
+
+// waits for the end of a measurement of tacq ms started at host time tstart (ms);
+// every sleep is announced to tele as a window the telemetry thread may poll in
+int acq_waitctc(int devidx, int tacq, double tstart, const ctcwait_t* w, telemetry_t* tele, acqstats_t* st)
+{
+    int ctcstatus = 0;
+    int refined = 0;
+    double tend = tstart + tacq; // host time the device is expected to finish
+    double now, left, elapsed;
+
+    if (w->spin)
+    {
+        while (ctcstatus == 0)
+        {
+            if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) return -1;
+            st->ctcpolls++;
+        }
+        return 0;
+    }
+
+    for (;;)
+    {
+        now = mh_timems();
+        left = tend - w->guardms - now;
+        if (left > 0)
+        {
+            // long sleep in slices, checking whether the device stopped early
+            tele_quiet(tele, now + (left < w->slicems ? left : w->slicems));
+            mh_sleepms(left < w->slicems ? left : w->slicems);
+            tele_quiet(tele, TELE_BUSY);
+            if (left > w->slicems)
+            {
+                if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) return -1;
+                st->ctcpolls++;
+                if (ctcstatus)
+                    return 0;
+            }
+            continue;
+        }
+        if (refined)
+            break;
+        // the host clock only approximates the device start, ask the device how far it is
+        if (APICALL(MH_GetElapsedMeasTime(devidx, &elapsed)) < 0) return -1;
+        now = mh_timems();
+        tend = now + (tacq - elapsed);
+        refined = 1;
+        mh_sleepms(tend - now - w->pollus / 1000.0);
+        break;
+    }
+
+    for (;;)
+    {
+        if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) return -1;
+        st->ctcpolls++;
+        if (ctcstatus)
+            break;
+        mh_sleepms(w->pollus / 1000.0);
+    }
+    if (refined)
+    {
+        left = mh_timems() - tend;
+        st->latecount++;
+        st->latesum += left;
+        if (left > st->latemax)
+            st->latemax = left;
+    }
+    return 0;
+}
+
+
+// waits for the end of a frame armed at host time tarm that starts on C1: the
+// start is not known, so the elapsed time is checked a few times per tacq
+// until the frame runs (it tells the start exactly, however late it is seen),
+// then a CTC stopped frame is waited for like any other and only a C2 stopped
+// one is polled to its end; -2 if it has not ended after timeout ms
+static int waittrigger(int devidx, double tarm, int tacq, int ctcstop, double timeout, const ctcwait_t* w,
+    telemetry_t* tele, acqstats_t* st)
+{
+    int ctcstatus = 0;
+    double now, elapsed;
+    double step = tacq / 4.0;   // seen well before the frame ends
+
+    if (step > w->slicems)
+        step = w->slicems;
+    if (step < w->pollus / 1000.0)
+        step = w->pollus / 1000.0;
+    for (;;)
+    {
+        if (APICALL(MH_GetElapsedMeasTime(devidx, &elapsed)) < 0) return -1;
+        st->ctcpolls++;
+        now = mh_timems();
+        if (elapsed > 0)
+            break;
+        if (now - tarm > timeout)
+            return -2;
+        tele_quiet(tele, now + step);
+        mh_sleepms(step);
+        tele_quiet(tele, TELE_BUSY);
+    }
+    if (ctcstop)
+        return acq_waitctc(devidx, tacq, now - elapsed, w, tele, st);
+    for (;;)
+    {
+        if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) return -1;
+        st->ctcpolls++;
+        if (ctcstatus)
+            return 0;
+        now = mh_timems();
+        if (now - tarm > timeout)
+            return -2;
+        tele_quiet(tele, now + w->pollus / 1000.0);
+        mh_sleepms(w->pollus / 1000.0);
+        tele_quiet(tele, TELE_BUSY);
+    }
+}
+
+static int cmpdouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// period, span and missed triggers from the device start times of n frames:
+// unless the trigger period is given it is the median of the gaps up to 1.5
+// times the shortest (a steady miss of every other trigger then looks like
+// half the trigger rate); a gap of k periods missed k - 1 triggers
+static void trigstats(acqstats_t* st, const unsigned long long* tdev, int n, double period)
+{
+    double* gap = (double*)malloc((size_t)n * sizeof(double));
+    double k;
+    int i, m = 0, near;
+
+    if (gap == NULL)
+        return;
+    for (i = 1; i < n; i++)
+        if (tdev[i] > tdev[i - 1] && tdev[i - 1] > 0)
+            gap[m++] = (tdev[i] - tdev[i - 1]) / 1e9;
+    if (m > 0)
+    {
+        st->devspan = (tdev[n - 1] - tdev[0]) / 1e9;
+        qsort(gap, m, sizeof(double), cmpdouble);
+        for (near = 1; near < m && gap[near] < 1.5 * gap[0]; near++)
+            ;
+        st->trigperiod = near % 2 ? gap[near / 2] : (gap[near / 2 - 1] + gap[near / 2]) / 2;
+        if (period > 0)
+            st->trigperiod = period;
+        for (i = 0; i < m; i++)
+        {
+            k = floor(gap[i] / st->trigperiod + 0.5);
+            if (k > 1)
+                st->missed += (long long)k - 1;
+        }
+    }
+    free(gap);
+}
+
+
+// how far the counts of a frame may exceed the metered rates before the
+// telemetry overflow check looks at the bins
+#define OVFL_HEADROOM 8.0
+
+
+// largest value a number with the bits of acc can have
+static double bitbound(unsigned int acc)
+{
+    acc |= acc >> 1;
+    acc |= acc >> 2;
+    acc |= acc >> 4;
+    acc |= acc >> 8;
+    acc |= acc >> 16;
+    return (double)acc;
+}
+
+// histogramming loop: numrep frames of tacq ms each, every frame is read
+// into a pipeline buffer and handed to the writer thread
+int acq_histo(int devidx, const acqopts_t* o, pipeline_t* p, acqstats_t* st)
+{
+    frame_t* frame = NULL;
+    unsigned int* scratch = NULL;
+    unsigned int* cum = NULL;   // differential readout: this and the previous cumulative histograms
+    unsigned int* prev = NULL;
+    unsigned int* swap;
+    readsel_t sel = o->sel;
+    adapt_t ctl;
+    telesnap_t snap;
+    double runstart = 0, prevstart = 0, dead, cpu0, t;
+    double peak = 0, step = 0;  // bounds of the largest cumulative bin and of the largest frame bin
+    double tframe = 0;          // what the last frame measured
+    double most;                // bound of the largest bin of a frame
+    size_t cumbytes = p->framewords * sizeof(unsigned int);
+    int tacq = o->tacq;
+    int why = o->target ? ADAPT_FIRST : ADAPT_FIXED;
+    unsigned int ovfl = o->target ? 0 : 0xFFFFFFFFu;   // what a bin holds when the device flags an overflow
+    unsigned int dw[3];         // device start time, most significant word first
+    unsigned long long* tdevs = NULL;   // C1 started frames: the device start of each, for the missed triggers
+    int c1start = o->trigger == MEASCTRL_C1_START_CTC_STOP || o->trigger == MEASCTRL_C1_START_C2_STOP;
+    int armed = 0;              // the frame was armed after the readout of the one before
+    double tarm = 0, tready = 0;
+    int flags, ret;
+    int rep;
+
+    memset(st, 0, sizeof(*st));
+    st->deadmin = 1e9;
+    st->diff = o->diff;
+    st->adaptive = o->target > 0;
+    st->tacqmin = st->tacqmax = tacq;
+    st->trigger = o->trigger;
+    sel_prepare(&sel);
+    if (c1start && (tdevs = (unsigned long long*)calloc(o->numrep, sizeof(unsigned long long))) == NULL)
+        return -1;
+    if (sel.roilen > 0)
+    {
+        scratch = (unsigned int*)malloc((size_t)sel.numchannels * sel.histlen * sizeof(unsigned int));
+        if (scratch == NULL)
+            goto fail;
+    }
+    if (o->diff)
+    {
+        // the device histograms are cleared before the run (histomode, mhbench) and then only on overflow
+        cum = (unsigned int*)mh_alignedalloc(64, cumbytes);
+        prev = (unsigned int*)mh_alignedalloc(64, cumbytes);
+        if (cum == NULL || prev == NULL)
+            goto fail;
+        memset(cum, 0, cumbytes);
+        memset(prev, 0, cumbytes);
+    }
+    if (o->target)
+    {
+        // a rising flux ends a frame early instead of saturating it
+        adapt_init(&ctl, o->target, o->tmin, o->tmax, sel.chanmask);
+        ovfl = adapt_stopcount(&ctl);
+        if (APICALL(MH_SetStopOverflow(devidx, 1, ovfl)) < 0) goto fail;
+    }
+    tele_quiet(o->tele, TELE_BUSY);
+    cpu0 = mh_threadcpums();
+    t = mh_timems();
+    for (rep = 0; rep < o->numrep; rep++) {
+        frame = pipe_getfree(p); // only blocks if the writer falls behind by the whole pool
+        frame->rep = rep;
+        t = trace_lap(o->trace, rep, PH_BUFFER, t);
+        if (armed)
+            frame->tstart = tarm; // waiting for its trigger since the last readout
+        else if (o->align && o->armfirst)
+        {
+            if (APICALL(MH_StartMeas(devidx, tacq)) < 0) goto fail; // armed, waits for the master
+            if (mhbarrier_wait(o->align) < 0) goto fail;
+            frame->tstart = mh_timems();
+        }
+        else
+        {
+            if (o->align && mhbarrier_wait(o->align) < 0) goto fail; // another device failed
+            frame->tstart = mh_timems();
+            if (APICALL(MH_StartMeas(devidx, tacq)) < 0) goto fail; //Tacq in ms
+        }
+        t = trace_lap(o->trace, rep, PH_START, t);
+        if (o->tstarts)
+            o->tstarts[rep] = frame->tstart;
+        if (rep == 0)
+            runstart = frame->tstart;
+        else
+        {
+            dead = frame->tstart - prevstart - tframe; // gap between frames not covered by Tacq
+            if (dead < st->deadmin) st->deadmin = dead;
+            if (dead > st->deadmax) st->deadmax = dead;
+        }
+        prevstart = frame->tstart;
+        if (c1start)
+        {
+            if ((ret = waittrigger(devidx, frame->tstart, tacq, o->trigger == MEASCTRL_C1_START_CTC_STOP,
+                (double)o->trigtimeout + tacq, &o->wait, o->tele, st)) == -2)
+            {
+                // no trigger came, the run ends here
+                if (APICALL(MH_StopMeas(devidx)) < 0) goto fail;
+                pipe_release(p, frame);
+                st->notrigger = 1;
+                break;
+            }
+            if (ret < 0) goto fail;
+        }
+        else if (acq_waitctc(devidx, tacq, frame->tstart, &o->wait, o->tele, st) < 0) goto fail;
+        t = trace_lap(o->trace, rep, PH_WAIT, t);
+        if (APICALL(MH_StopMeas(devidx)) < 0) goto fail;
+        tframe = tacq;
+        if (o->trigger == MEASCTRL_C1_START_C2_STOP) // C2 ended it
+            if (APICALL(MH_GetElapsedMeasTime(devidx, &tframe)) < 0) goto fail;
+        frame->tread0 = t = trace_lap(o->trace, rep, PH_STOP, t);
+        if (acq_readout(devidx, &sel, o->diff ? cum : frame->counts, scratch) < 0) goto fail;
+        if (o->diff)
+        {
+            // the frame is what the cumulative histograms gained since the last readout
+            step = bitbound(p->kern->diff(frame->counts, cum, prev, p->rows, p->bins));
+            peak += step;
+            swap = prev;
+            prev = cum;
+            cum = swap;
+        }
+        frame->tread1 = t = trace_lap(o->trace, rep, PH_READ, t);
+        st->readms += frame->tread1 - frame->tread0;
+        frame->teleseq = 0;
+        frame->tdev = 0;
+        if (o->stamp || o->trigger != MEASCTRL_SINGLESHOT_CTC)
+        {
+            // ps since the device epoch, the low 64 bits last 213 days
+            if (APICALL(MH_GetStartTime(devidx, &dw[0], &dw[1], &dw[2])) < 0) goto fail;
+            frame->tdev = (unsigned long long)dw[1] << 32 | dw[2];
+            if (tdevs)
+                tdevs[rep] = frame->tdev;
+        }
+        if (o->target)
+            frame->peak = p->kern->peak(frame->counts, p->rows, p->bins);
+        if (o->tele)
+        {
+            // no device call: the flags and rates are the newest snapshot's, the overflow is a
+            // stored bin at the overflow value; the frame is only scanned for one if a bound
+            // of its largest bin gets there (without a stop count that takes a long frame)
+            if (tele_read(o->tele, &snap) < 0) goto fail;
+            flags = snap.flags & ~FLAG_OVERFLOW;
+            if (o->target)
+                most = frame->peak;
+            else if (o->diff)
+                most = peak;
+            else
+                most = OVFL_HEADROOM * tele_rate(&snap, ~0ULL) * tacq / 1000.0;
+            if (most >= ovfl && (o->target || p->kern->peak(o->diff ? prev : frame->counts, p->rows, p->bins) >= ovfl))
+                flags |= FLAG_OVERFLOW;
+            frame->teleseq = snap.seq;
+            frame->syncrate = snap.syncrate;
+            frame->rate = tele_rate(&snap, sel.chanmask);
+            frame->warnings = snap.warnings;
+        }
+        else if (APICALL(MH_GetFlags(devidx, &flags)) < 0) goto fail;
+        if ((flags & FLAG_OVERFLOW) && !o->target) printf("\n  Overflow.");
+        frame->flags = flags;
+        frame->tacq = tacq;
+        frame->tmeas = tframe;
+        frame->why = why;
+        if (o->target)
+        {
+            // the frame's own peak and, every rate meter period, the rates choose the next duration
+            if (flags & FLAG_OVERFLOW)
+            {
+                if (APICALL(MH_GetElapsedMeasTime(devidx, &tframe)) < 0) goto fail;
+                frame->tmeas = tframe;
+                st->early++;
+            }
+            if (rep + 1 < o->numrep)
+            {
+                if (adapt_rates(&ctl, devidx, o->tele ? &snap : NULL) < 0) goto fail;
+                why = adapt_next(&ctl, &tacq, frame->peak, (double)p->kern->sum(frame->counts, p->rows, p->bins), tframe);
+                if (tacq < st->tacqmin) st->tacqmin = tacq;
+                if (tacq > st->tacqmax) st->tacqmax = tacq;
+            }
+        }
+        st->acqms += tframe;
+        t = trace_lap(o->trace, rep, PH_FLAGS, t);
+        // a differential run clears only before a bin could saturate, two more frames like
+        // the largest so far must still fit; a bin at STOPCNTMAX is no longer counting
+        if (!o->diff || (flags & FLAG_OVERFLOW) || peak + 2 * step >= STOPCNTMAX)
+        {
+            if (APICALL(MH_ClearHistMem(devidx)) < 0) goto fail;
+            if (o->diff)
+            {
+                memset(prev, 0, cumbytes);
+                peak = 0;
+                st->clears++;
+            }
+        }
+        if (o->trigger != MEASCTRL_SINGLESHOT_CTC && rep + 1 < o->numrep)
+        {
+            // the next frame waits for its trigger while this one goes to the writer
+            tarm = mh_timems();
+            if (APICALL(MH_StartMeas(devidx, tacq)) < 0) goto fail;
+            armed = 1;
+        }
+        frame->tready = tready = t = trace_lap(o->trace, rep, PH_CLEAR, t);
+        pipe_submit(p, frame); // the writer thread does the fwrite
+        t = trace_lap(o->trace, rep, PH_SUBMIT, t);
+        st->frames++;
+    }
+
+    if (st->frames > 0)
+    {
+        st->wallms = tready - runstart;
+        st->deadms = st->wallms - st->acqms;
+    }
+    if (st->frames < 2)
+        st->deadmin = 0;
+    if (tdevs && st->frames > 1)
+        trigstats(st, tdevs, st->frames, o->trigperiod);
+    st->cpums = mh_threadcpums() - cpu0;
+    tele_quiet(o->tele, TELE_IDLE);
+    if (o->trace)
+    {
+        o->trace->frames = st->frames;
+        o->trace->acqms = st->acqms;
+    }
+    free(scratch);
+    free(tdevs);
+    mh_alignedfree(cum);
+    mh_alignedfree(prev);
+    return 0;
+
+fail:
+    tele_quiet(o->tele, TELE_IDLE);
+    if (o->trace)
+    {
+        o->trace->frames = st->frames;
+        o->trace->acqms = st->acqms;
+    }
+    free(scratch);
+    free(tdevs);
+    mh_alignedfree(cum);
+    mh_alignedfree(prev);
+    return -1;
+}
+
+
+void acq_report(const acqstats_t* st, const pipeline_t* p)
+{
+    if (st->notrigger && st->frames < 1)
+        printf("\nTrigger: no trigger came");
+    if (st->frames < 1)
+        return;
+    printf("\nRun: %d frames in %1.1f ms, dead time %1.2f ms/frame (min %1.2f, max %1.2f), %1.1f%% of wall time",
+        st->frames, st->wallms, st->deadms / st->frames, st->deadmin, st->deadmax,
+        100.0 * st->deadms / st->wallms);
+    printf("\nReadout: %1.2f ms/frame", st->readms / st->frames);
+    if (st->diff)
+        printf(", differential, %d histogram clears", st->clears);
+    if (st->adaptive)
+        printf("\nAdaptive: frames of %d..%d ms, mean %1.1f ms, %d stopped on the stop count, %1.0f counts/s of wall time",
+            st->tacqmin, st->tacqmax, st->acqms / st->frames, st->early, p->total / st->wallms * 1000.0);
+    if (st->trigger == MEASCTRL_C1_START_CTC_STOP || st->trigger == MEASCTRL_C1_START_C2_STOP)
+    {
+        printf("\nTrigger: %d frames started by C1", st->frames);
+        if (st->trigperiod > 0)
+            printf(" every %1.3f ms, %lld triggers missed, %1.1f%% of the triggers made a frame, %1.2f frames/s",
+                st->trigperiod, st->missed, 100.0 * st->frames / (st->frames + st->missed),
+                (st->frames - 1) * 1000.0 / st->devspan);
+        if (st->notrigger)
+            printf(", then no trigger came");
+    }
+    if (st->trigger == MEASCTRL_C1_GATED) // software starts, the gates fall anywhere inside the frames
+        printf("\nTrigger: %d frames gated by C1, started by software, no missed trigger count", st->frames);
+    printf("\nCTC wait: %1.1f status polls/frame, acquisition thread CPU %1.1f%%", (double)st->ctcpolls / st->frames,
+        100.0 * st->cpums / st->wallms);
+    if (st->latecount > 0)
+        printf(", end detected %1.3f ms (max %1.3f ms) after predicted device end",
+            st->latesum / st->latecount, st->latemax);
+    pipe_report(p);
+}
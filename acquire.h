@@ -0,0 +1,124 @@
+/************************************************************************
+
+  Acquisition loops shared by histomode and the benchmark harness.
+
+************************************************************************/
+
+#ifndef ACQUIRE_H
+#define ACQUIRE_H
+
+#include "pipeline.h"
+#include "trace.h"
+#include "telemetry.h"
+
+
+// helper macro and associated function for API calls with error check
+// the stringize operator # makes a printable string from the macro's input argument
+#define APICALL(call) doapicall(call, #call, __LINE__)
+int doapicall(int retcode, char* callstr, int line);
+
+
+// completion wait after MH_StartMeas: sleep for most of the acquisition time,
+// re-predict the end from MH_GetElapsedMeasTime, then poll MH_CTCStatus tightly
+typedef struct ctcwait {
+    int spin;               // 1 = old behaviour, poll MH_CTCStatus back to back
+    double guardms;         // wake up this long before the predicted end (default 2)
+    double pollus;          // interval between status polls near the end, 0 = no sleep (default 50)
+    double slicems;         // longest sleep without a status check, bounds the reaction
+                            // to a measurement that stops early on overflow (default 25)
+} ctcwait_t;
+
+#define CTCWAIT_DEFAULT { 0, 2.0, 50.0, 25.0 }
+
+// which part of the device histograms goes into a frame: the channels in
+// chanmask, one row each in channel order, bins roistart..roistart+roilen-1;
+// roilen = 0 stores every channel at the full histogram length
+#define READ_ALL      0     // MH_GetAllHistograms, then keep the selection
+#define READ_CHANNELS 1     // MH_GetHistogram for every selected channel, histlen >= READ_MINCHANLEN
+#define READ_AUTO     2     // whichever acq_choosereadout measures to be faster
+#define READ_MINCHANLEN 4096 // MH_GetHistogram needs lencode >= 2
+
+typedef struct readsel {
+    int numchannels;        // device input channels
+    int histlen;            // device histogram length
+    unsigned long long chanmask;    // bit i = channel i
+    int roistart;
+    int roilen;
+    int mode;               // READ_ALL, READ_CHANNELS or READ_AUTO
+    int chans[64];          // channel of every row, set by sel_prepare
+    const framekern_t* kern;    // gather kernel for rows x roilen, set by sel_prepare
+} readsel_t;
+
+// the bins that cover the sync period from the histogram offset on and no
+// more, at the finest binning from the one asked for on that needs at most
+// maxbins; see acq_autorange
+typedef struct autorange {
+    double period;          // ps, MH_GetSyncPeriod, with the sync divider
+    double baseres;         // ps, MH_GetBaseResolution
+    int binning;            // MH_SetBinning code chosen
+    int offset;             // ns, the window starts here
+    int bins;               // bins from the offset to the end of the period, 0 = no window
+} autorange_t;
+
+typedef struct acqopts {
+    int numrep;             // frames per run
+    int tacq;               // acquisition time per frame (ms)
+    ctcwait_t wait;
+    readsel_t sel;
+    mhbarrier_t* align;     // NULL or barrier all devices pass before every MH_StartMeas
+    int armfirst;           // 1 = call MH_StartMeas before the barrier (White Rabbit slave,
+                            // the measurement really starts when the master starts)
+    double* tstarts;        // NULL or numrep entries, host time of every MH_StartMeas
+    trace_t* trace;         // NULL or a table for numrep frames, see trace.h
+    int diff;               // 1 = differential readout: no MH_ClearHistMem between frames, each frame
+                            // is the cumulative histogram minus the previous one; needs stop on overflow off
+    unsigned int target;    // 0 = every frame tacq ms, else the peak count the frame durations aim at
+                            // (adapt.h), tacq is the first one; switches stop on overflow on, not with diff
+    int tmin, tmax;         // bounds of the adaptive durations (ms)
+    telemetry_t* tele;      // NULL or the device's telemetry thread: flags, rates and warnings come from its
+                            // snapshots instead of device calls, FLAG_OVERFLOW from the frame's own peak
+    int stamp;              // 1 = read the device start time of every frame (MH_GetStartTime)
+    int trigger;            // MEASCTRL_ the device was set to (MH_SetMeasControl); with any other than
+                            // MEASCTRL_SINGLESHOT_CTC the next frame is armed right after the readout of
+                            // the last one and every frame is stamped; not with diff or target
+    int trigtimeout;        // ms an armed frame may wait for its C1 start before the run ends
+    double trigperiod;      // ms between C1 triggers if known, 0 = estimated from the frame starts
+} acqopts_t;
+
+typedef struct acqstats {
+    int frames;             // frames completed
+    double wallms;          // first MH_StartMeas to last frame handed to the writer
+    double deadms;          // part of wallms not covered by the acquisition time
+    double deadmin;         // shortest gap between consecutive frames (ms)
+    double deadmax;         // longest gap between consecutive frames (ms)
+    double readms;          // total time spent in the histogram readout
+    double cpums;           // CPU time of the acquisition thread
+    int ctcpolls;           // MH_CTCStatus calls
+    int latecount;          // frames with a known device end time
+    double latesum;         // sum and maximum of the delay between the predicted
+    double latemax;         // device end and the detection of the end (ms)
+    int diff;               // run used the differential readout
+    int clears;             // MH_ClearHistMem calls of a differential run
+    double acqms;           // acquisition time of all frames, as measured
+    int adaptive;           // run chose the frame durations
+    int tacqmin, tacqmax;   // shortest and longest frame duration given
+    int early;              // frames that stopped on the stop count
+    int trigger;            // MEASCTRL_ of the run
+    int notrigger;          // 1 = the run ended waiting for a C1 start
+    long long missed;       // C1 starts that found no frame armed, from the device start times
+    double trigperiod;      // median time between frame starts (ms, device clock)
+    double devspan;         // first to last frame start (ms, device clock)
+} acqstats_t;
+
+
+int sel_rows(const readsel_t* s);
+void sel_prepare(readsel_t* s);
+size_t sel_framewords(const readsel_t* s);
+int acq_choosereadout(int devidx, readsel_t* s);
+int acq_autorange(int devidx, int binning, int offset, int maxbins, autorange_t* r);
+int acq_readout(int devidx, const readsel_t* s, unsigned int* counts, unsigned int* scratch);
+int acq_waitctc(int devidx, int tacq, double tstart, const ctcwait_t* w, telemetry_t* tele, acqstats_t* st);
+int acq_histo(int devidx, const acqopts_t* o, pipeline_t* p, acqstats_t* st);
+void acq_report(const acqstats_t* st, const pipeline_t* p);
+
+#endif
@@ -0,0 +1,107 @@
+/************************************************************************
+
+  Adaptive frame duration, see adapt.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "adapt.h"
+
+
+static const char* whyname[] = { "fixed", "first", "rate", "frame", "grown", "min", "max" };
+
+
+void adapt_init(adapt_t* a, unsigned int target, int tmin, int tmax, unsigned long long chanmask)
+{
+    memset(a, 0, sizeof(*a));
+    a->target = target;
+    a->tmin = tmin < ACQTMIN ? ACQTMIN : tmin;
+    a->tmax = tmax < a->tmin ? a->tmin : tmax;
+    a->chanmask = chanmask;
+}
+
+unsigned int adapt_stopcount(const adapt_t* a)
+{
+    unsigned long long stop = (unsigned long long)a->target * ADAPT_HEADROOM;
+    return stop > STOPCNTMAX ? STOPCNTMAX : (unsigned int)stop;
+}
+
+// reads the rate meters if they have a new value since the last reading;
+// with telemetry the newest snapshot s stands in for the device call
+int adapt_rates(adapt_t* a, int devidx, const telesnap_t* s)
+{
+    int rates[MAXINPCHAN];
+    int syncrate, ch;
+    double now = mh_timems();
+
+    if (s)
+    {
+        if (s->tpoll <= a->tread)
+            return 0;
+        a->tread = s->tpoll;
+        a->rate = tele_rate(s, a->chanmask);
+        a->fresh = 1;
+        return 0;
+    }
+    if (a->tread > 0 && now - a->tread < ADAPT_RATEMS)
+        return 0;
+    if (APICALL(MH_GetAllCountRates(devidx, &syncrate, rates)) < 0) return -1;
+    a->tread = now;
+    a->rate = 0;
+    for (ch = 0; ch < MAXINPCHAN && ch < 64; ch++)
+        if ((a->chanmask >> ch) & 1)
+            a->rate += rates[ch];
+    a->fresh = 1;
+    return 0;
+}
+
+// the duration of the next frame from the last one, which measured tframe ms,
+// had total counts and its largest bin at peak; returns the ADAPT_ reason
+int adapt_next(adapt_t* a, int* tacq, unsigned int peak, double total, double tframe)
+{
+    double pk = 0, t;
+    int why = ADAPT_GROWN; // nothing counted, try longer
+
+    if (peak > 0 && total > 0)
+        a->shape = peak / total;
+    if (a->fresh && a->shape > 0 && a->rate > 0)
+    {
+        pk = a->shape * a->rate / 1000.0; // peak counts per ms
+        why = ADAPT_RATE;
+    }
+    else if (peak > 0 && tframe > 0)
+    {
+        pk = peak / tframe;
+        why = ADAPT_FRAME;
+    }
+    a->fresh = 0;
+    t = pk > 0 ? a->target / pk : 1e12;
+    if (t > ADAPT_GROW * tframe)
+    {
+        t = ADAPT_GROW * tframe;
+        why = ADAPT_GROWN;
+    }
+    if (t < a->tmin)
+    {
+        t = a->tmin;
+        why = ADAPT_MIN;
+    }
+    if (t > a->tmax)
+    {
+        t = a->tmax;
+        why = ADAPT_MAX;
+    }
+    *tacq = (int)(t + 0.5);
+    return why;
+}
+
+const char* adapt_name(int why)
+{
+    return why >= 0 && why < (int)(sizeof(whyname) / sizeof(whyname[0])) ? whyname[why] : "?";
+}
@@ -0,0 +1,65 @@
+/************************************************************************
+
+  Adaptive frame duration
+
+  A fixed acquisition time either overflows bins when the flux is high
+  or wastes wall time on nearly empty frames when it is low. With a
+  target peak count the histogramming loop instead picks the duration
+  of every frame so that its largest bin should just reach the target:
+
+    next = target / expected peak rate
+
+  The expected peak rate is the count rate over the stored channels
+  from MH_GetAllCountRates times the peak share of the last frame
+  (peak bin / all counts, the shape of the decay). The rate meters
+  update only every 100 ms, so they are read at most that often (or
+  taken from the telemetry snapshot, telemetry.h); in between, the last
+  frame's own peak per ms is used. The next frame may be at most
+  ADAPT_GROW times longer than the last (a frame with few counts gives
+  a noisy estimate) and stays within tmin..tmax.
+
+  The hardware stop count is set to ADAPT_HEADROOM times the target, so
+  a sudden rise of the flux ends the frame early (FLAG_OVERFLOW) rather
+  than saturating it; its real duration comes from
+  MH_GetElapsedMeasTime. Every frame logs the duration it was given,
+  the time it really measured, its peak and the reason for its duration.
+
+************************************************************************/
+
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include "telemetry.h"
+
+
+#define ADAPT_GROW      4.0     // longest next frame relative to the last one
+#define ADAPT_HEADROOM  2       // stop count = target * ADAPT_HEADROOM
+#define ADAPT_RATEMS    100.0   // rate meter period, shortest time between readings
+
+// why a frame got its duration
+#define ADAPT_FIXED 0           // no controller, the configured tacq
+#define ADAPT_FIRST 1           // first frame of a run, the configured tacq
+#define ADAPT_RATE  2           // from the rate meters and the last frame's shape
+#define ADAPT_FRAME 3           // from the last frame's peak per ms
+#define ADAPT_GROWN 4           // limited to ADAPT_GROW times the last frame
+#define ADAPT_MIN   5           // limited to tmin
+#define ADAPT_MAX   6           // limited to tmax
+
+typedef struct adapt {
+    unsigned int target;    // peak bin count a frame should reach
+    int tmin, tmax;         // duration bounds (ms)
+    unsigned long long chanmask;    // channels whose rates count
+    double shape;           // peak / total counts of the last frame with counts
+    double rate;            // counts per s over the channels, last meter reading
+    double tread;           // host time of that reading, 0 = none yet
+    int fresh;              // 1 = read since the last frame
+} adapt_t;
+
+
+void adapt_init(adapt_t* a, unsigned int target, int tmin, int tmax, unsigned long long chanmask);
+unsigned int adapt_stopcount(const adapt_t* a);
+int adapt_rates(adapt_t* a, int devidx, const telesnap_t* s);
+int adapt_next(adapt_t* a, int* tacq, unsigned int peak, double total, double tframe);
+const char* adapt_name(int why);
+
+#endif
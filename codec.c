@@ -0,0 +1,419 @@
+/************************************************************************
+
+  Lossless frame codec for FileData.dat, see codec.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhthread.h"
+#include "codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODEC_SSE2
+#endif
+
+
+#define ROW_ZERO   0
+#define ROW_BIN    1
+#define ROW_FRAME  2
+#define ROW_SPARSE 3
+
+#define NBLOCKS(n) (((n) + CODEC_BLOCK - 1) / CODEC_BLOCK)
+
+
+static int bitwidth(unsigned int v)
+{
+    int b = 0;
+    while (v)
+    {
+        b++;
+        v >>= 1;
+    }
+    return b;
+}
+
+static size_t varintlen(unsigned int v)
+{
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+        n++;
+        v >>= 7;
+    }
+    return n;
+}
+
+static unsigned char* putvarint(unsigned char* p, unsigned int v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static const unsigned char* getvarint(const unsigned char* p, const unsigned char* end, unsigned int* v)
+{
+    unsigned int x = 0;
+    int shift = 0;
+    while (p < end && shift < 35)
+    {
+        x |= (unsigned int)(*p & 0x7F) << shift;
+        if (!(*p++ & 0x80))
+        {
+            *v = x;
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static void putu32(unsigned char* p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int getu32(const unsigned char* p)
+{
+    return p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+
+// zigzag residuals x[i] - ref[i] (ref = NULL: x[i] - x[i-1]), returns the OR of
+// every block in blockor so the bit widths follow without a second pass
+static void residuals(const unsigned int* x, const unsigned int* ref, int n, unsigned int* res, unsigned int* blockor)
+{
+    unsigned int d, acc;
+    int i = 0, b, end;
+
+    for (b = 0; i < n; b++)
+    {
+        end = i + CODEC_BLOCK < n ? i + CODEC_BLOCK : n;
+        acc = 0;
+#ifdef CODEC_SSE2
+        if (i > 0 || ref) // the first bin of a bin difference row has no left neighbour
+        {
+            __m128i vacc = _mm_setzero_si128(), vd;
+            for (; i + 4 <= end; i += 4)
+            {
+                vd = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(x + i)),
+                    _mm_loadu_si128((const __m128i*)(ref ? ref + i : x + i - 1)));
+                vd = _mm_xor_si128(_mm_slli_epi32(vd, 1), _mm_srai_epi32(vd, 31));
+                _mm_storeu_si128((__m128i*)(res + i), vd);
+                vacc = _mm_or_si128(vacc, vd);
+            }
+            vacc = _mm_or_si128(vacc, _mm_shuffle_epi32(vacc, _MM_SHUFFLE(1, 0, 3, 2)));
+            vacc = _mm_or_si128(vacc, _mm_shuffle_epi32(vacc, _MM_SHUFFLE(2, 3, 0, 1)));
+            acc = (unsigned int)_mm_cvtsi128_si32(vacc);
+        }
+#endif
+        for (; i < end; i++)
+        {
+            d = x[i] - (ref ? ref[i] : i > 0 ? x[i - 1] : 0);
+            d = (d << 1) ^ (unsigned int)((int)d >> 31);
+            res[i] = d;
+            acc |= d;
+        }
+        blockor[b] = acc;
+    }
+}
+
+static size_t packedlen(const unsigned int* blockor, int n)
+{
+    size_t len = 0;
+    int b, nb = NBLOCKS(n), m;
+
+    for (b = 0; b < nb; b++)
+    {
+        m = b < nb - 1 ? CODEC_BLOCK : n - b * CODEC_BLOCK;
+        len += 1 + ((size_t)m * bitwidth(blockor[b]) + 7) / 8;
+    }
+    return len;
+}
+
+static unsigned char* pack(unsigned char* p, const unsigned int* res, const unsigned int* blockor, int n)
+{
+    unsigned long long acc;
+    int b, nb = NBLOCKS(n), i, m, w, nbits;
+
+    for (b = 0; b < nb; b++)
+    {
+        m = b < nb - 1 ? CODEC_BLOCK : n - b * CODEC_BLOCK;
+        w = bitwidth(blockor[b]);
+        *p++ = (unsigned char)w;
+        if (w == 0)
+            continue;
+        acc = 0;
+        nbits = 0;
+        for (i = 0; i < m; i++)
+        {
+            acc |= (unsigned long long)res[b * CODEC_BLOCK + i] << nbits;
+            nbits += w;
+            if (nbits >= 32)
+            {
+                putu32(p, (unsigned int)acc);
+                p += 4;
+                acc >>= 32;
+                nbits -= 32;
+            }
+        }
+        while (nbits > 0)
+        {
+            *p++ = (unsigned char)acc;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+    return p;
+}
+
+static const unsigned char* unpack(const unsigned char* p, const unsigned char* end, unsigned int* res, int n)
+{
+    unsigned long long acc;
+    unsigned int mask;
+    int b, nb = NBLOCKS(n), i, m, w, nbits;
+    size_t len;
+
+    for (b = 0; b < nb; b++)
+    {
+        m = b < nb - 1 ? CODEC_BLOCK : n - b * CODEC_BLOCK;
+        if (p >= end || (w = *p++) > 32)
+            return NULL;
+        if (w == 0)
+        {
+            memset(res + b * CODEC_BLOCK, 0, m * sizeof(unsigned int));
+            continue;
+        }
+        len = ((size_t)m * w + 7) / 8;
+        if ((size_t)(end - p) < len)
+            return NULL;
+        mask = w == 32 ? 0xFFFFFFFFu : (1u << w) - 1;
+        acc = 0;
+        nbits = 0;
+        for (i = 0; i < m; i++)
+        {
+            while (nbits < w)
+            {
+                acc |= (unsigned long long)*p++ << nbits;
+                nbits += 8;
+            }
+            res[b * CODEC_BLOCK + i] = (unsigned int)acc & mask;
+            acc >>= w;
+            nbits -= w;
+        }
+    }
+    return p;
+}
+
+
+int codec_open(codec_t* c, int numdet, int numbin, int keyint)
+{
+    memset(c, 0, sizeof(*c));
+    if (numdet < 1 || numbin < 1 || numbin > 65536)
+        return -1;
+    c->numdet = numdet;
+    c->numbin = numbin;
+    c->keyint = keyint > 0 ? keyint : CODEC_KEYINT;
+    c->sincekey = -1;
+    // worst case: every row bit packed at 32 bits
+    c->outsize = 9 + (size_t)numdet * (1 + NBLOCKS(numbin) + (size_t)numbin * sizeof(unsigned int));
+    c->prev = (unsigned int*)calloc((size_t)numdet * numbin, sizeof(unsigned int));
+    c->res[0] = (unsigned int*)mh_alignedalloc(16, (size_t)numbin * sizeof(unsigned int));
+    c->res[1] = (unsigned int*)mh_alignedalloc(16, (size_t)numbin * sizeof(unsigned int));
+    c->out = (unsigned char*)malloc(c->outsize);
+    if (!c->prev || !c->res[0] || !c->res[1] || !c->out)
+    {
+        codec_close(c);
+        return -1;
+    }
+    return 0;
+}
+
+void codec_close(codec_t* c)
+{
+    free(c->prev);
+    mh_alignedfree(c->res[0]);
+    mh_alignedfree(c->res[1]);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+}
+
+void codec_resetstats(codec_t* c)
+{
+    c->rawbytes = 0;
+    c->outbytes = 0;
+    c->ms = 0;
+}
+
+
+// encodes one frame into c->out, returns its length including the length field
+size_t codec_encode(codec_t* c, const unsigned int* counts, int rep)
+{
+    unsigned int blockor[2][NBLOCKS(65536)];
+    const unsigned int* x;
+    unsigned int* prow;
+    unsigned char* p = c->out;
+    size_t len[2], sparse, best;
+    double t0 = mh_timems();
+    int key, r, i, nnz, type, last;
+
+    key = c->sincekey < 0 || c->sincekey + 1 >= c->keyint;
+    c->sincekey = key ? 0 : c->sincekey + 1;
+    putu32(p + 4, (unsigned int)rep);
+    p[8] = (unsigned char)key;
+    p += 9;
+
+    for (r = 0; r < c->numdet; r++)
+    {
+        x = counts + (size_t)r * c->numbin;
+        prow = c->prev + (size_t)r * c->numbin;
+
+        residuals(x, NULL, c->numbin, c->res[0], blockor[0]);
+        len[0] = packedlen(blockor[0], c->numbin);
+        if (len[0] == (size_t)NBLOCKS(c->numbin)) // all bit widths 0, the row is empty
+        {
+            *p++ = ROW_ZERO;
+            memset(prow, 0, c->numbin * sizeof(unsigned int));
+            continue;
+        }
+        len[1] = (size_t)-1;
+        if (!key)
+        {
+            residuals(x, prow, c->numbin, c->res[1], blockor[1]);
+            len[1] = packedlen(blockor[1], c->numbin);
+        }
+        type = len[1] < len[0] ? ROW_FRAME : ROW_BIN;
+        best = len[1] < len[0] ? len[1] : len[0];
+
+        // sparse list, only worth looking at for rows with few entries
+        nnz = 0;
+        for (i = 0; i < c->numbin; i++)
+            nnz += x[i] != 0;
+        if (nnz < c->numbin / 8)
+        {
+            sparse = varintlen(nnz);
+            for (i = 0, last = -1; i < c->numbin; i++)
+                if (x[i])
+                {
+                    sparse += varintlen(i - last - 1) + varintlen(x[i]);
+                    last = i;
+                }
+            if (sparse < best)
+                type = ROW_SPARSE;
+        }
+
+        *p++ = (unsigned char)type;
+        if (type == ROW_SPARSE)
+        {
+            p = putvarint(p, nnz);
+            for (i = 0, last = -1; i < c->numbin; i++)
+                if (x[i])
+                {
+                    p = putvarint(p, i - last - 1);
+                    p = putvarint(p, x[i]);
+                    last = i;
+                }
+        }
+        else if (type == ROW_FRAME)
+            p = pack(p, c->res[1], blockor[1], c->numbin);
+        else
+            p = pack(p, c->res[0], blockor[0], c->numbin);
+        memcpy(prow, x, c->numbin * sizeof(unsigned int));
+    }
+
+    putu32(c->out, (unsigned int)(p - c->out - 4));
+    c->rawbytes += (double)c->numdet * c->numbin * sizeof(unsigned int);
+    c->outbytes += (double)(p - c->out);
+    c->ms += mh_timems() - t0;
+    return (size_t)(p - c->out);
+}
+
+
+// decodes one frame (without its length field), frames must come in file order
+int codec_decode(codec_t* c, const unsigned char* in, size_t len, unsigned int* counts, int* rep)
+{
+    const unsigned char* p = in + 5;
+    const unsigned char* end = in + len;
+    unsigned int* x;
+    unsigned int* prow;
+    unsigned int v, gap, nnz, k;
+    int key, r, i, type;
+
+    if (len < 5)
+        return -1;
+    *rep = (int)getu32(in);
+    key = in[4];
+    if (!key && c->sincekey < 0)
+        return -1; // no key frame seen yet
+    c->sincekey = key ? 0 : c->sincekey + 1;
+
+    for (r = 0; r < c->numdet; r++)
+    {
+        x = counts + (size_t)r * c->numbin;
+        prow = c->prev + (size_t)r * c->numbin;
+        if (p >= end)
+            return -1;
+        type = *p++;
+        switch (type)
+        {
+        case ROW_ZERO:
+            memset(x, 0, c->numbin * sizeof(unsigned int));
+            break;
+        case ROW_BIN:
+        case ROW_FRAME:
+            if ((p = unpack(p, end, c->res[0], c->numbin)) == NULL)
+                return -1;
+            for (i = 0; i < c->numbin; i++)
+            {
+                v = c->res[0][i];
+                v = (v >> 1) ^ (0u - (v & 1)); // undo the zigzag mapping
+                x[i] = v + (type == ROW_FRAME ? prow[i] : i > 0 ? x[i - 1] : 0);
+            }
+            break;
+        case ROW_SPARSE:
+            memset(x, 0, c->numbin * sizeof(unsigned int));
+            if ((p = getvarint(p, end, &nnz)) == NULL)
+                return -1;
+            for (k = 0, i = -1; k < nnz; k++)
+            {
+                if ((p = getvarint(p, end, &gap)) == NULL || (p = getvarint(p, end, &v)) == NULL)
+                    return -1;
+                if (gap >= (unsigned int)(c->numbin - 1 - i))
+                    return -1; // past the row, checked before adding so a corrupt gap cannot wrap
+                i += gap + 1;
+                x[i] = v;
+            }
+            break;
+        default:
+            return -1;
+        }
+        memcpy(prow, x, c->numbin * sizeof(unsigned int));
+    }
+    return p == end ? 0 : -1;
+}
+
+
+// reads and decodes the next frame of a file, returns 1, 0 at the end or -1 if corrupt
+int codec_readframe(codec_t* c, FILE* fp, unsigned int* counts, int* rep)
+{
+    unsigned char lenbuf[4];
+    size_t len;
+
+    if (fread(lenbuf, 1, 4, fp) != 4)
+        return 0;
+    len = getu32(lenbuf);
+    if (len + 4 > c->outsize)
+        return -1;
+    if (fread(c->out, 1, len, fp) != len)
+        return -1;
+    return codec_decode(c, c->out, len, counts, rep) < 0 ? -1 : 1;
+}
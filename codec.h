@@ -0,0 +1,70 @@
+/************************************************************************
+
+  Lossless frame codec for FileData.dat
+
+  TCSPC histograms are mostly zeros and small counts that change slowly
+  from bin to bin and from frame to frame. Every channel row of a frame
+  is stored in whichever of these forms is shortest:
+
+    ROW_ZERO    nothing, the row is empty
+    ROW_BIN     difference to the previous bin
+    ROW_FRAME   difference to the same bin of the previous frame
+    ROW_SPARSE  list of (gap, count) pairs for rows with few entries
+
+  Differences are zigzag mapped to unsigned values and bit packed in
+  blocks of CODEC_BLOCK values, each block with its own bit width, so a
+  run of zero differences costs one byte per block. The residuals are
+  computed with SSE2 where available.
+
+  Every CODEC_KEYINT-th frame is a key frame that does not use
+  ROW_FRAME, so a reader can resynchronize without the whole file.
+
+  Frame layout (little endian):
+
+    u32 length of the rest of the frame in bytes
+    u32 rep
+    u8  1 = key frame
+    numdet rows: u8 row type, then
+      ROW_BIN, ROW_FRAME: per block u8 bit width + packed values
+      ROW_SPARSE: varint number of entries, varint (gap, count) pairs
+
+************************************************************************/
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+#define CODEC_NONE   0      // raw frames, version sub 1 or the codec field of 3 and 4
+#define CODEC_PACK   1      // this codec: version sub 3 headers (4 in a container, 2 in older files)
+
+#define CODEC_BLOCK  128    // values per bit packed block
+#define CODEC_KEYINT 64     // frames between key frames
+
+typedef struct codec {
+    int numdet;
+    int numbin;
+    int keyint;
+    int sincekey;           // frames since the last key frame, -1 = next is a key frame
+    unsigned int* prev;     // previous frame as written / decoded
+    unsigned int* res[2];   // zigzag residuals of the bin and the frame difference
+    unsigned char* out;     // last encoded frame
+    size_t outsize;
+
+    // statistics, reset by codec_resetstats()
+    double rawbytes;        // bytes in
+    double outbytes;        // bytes out
+    double ms;              // time spent encoding
+} codec_t;
+
+
+int codec_open(codec_t* c, int numdet, int numbin, int keyint);
+void codec_close(codec_t* c);
+size_t codec_encode(codec_t* c, const unsigned int* counts, int rep);
+int codec_decode(codec_t* c, const unsigned char* in, size_t len, unsigned int* counts, int* rep);
+int codec_readframe(codec_t* c, FILE* fp, unsigned int* counts, int* rep);
+void codec_resetstats(codec_t* c);
+
+#endif
@@ -0,0 +1,524 @@
+/************************************************************************
+
+  Runtime settings of histomode, see config.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "mhdefin.h"
+#include "acquire.h"
+#include "t3stream.h"
+#include "t2corr.h"
+#include "multidev.h"
+#include "evfilter.h"
+#include "rtmode.h"
+#include "config.h"
+
+
+#define CFG_INT  0
+#define CFG_MASK 1          // unsigned long long, hex or decimal
+#define CFG_STR  2
+#define CFG_NAME 3          // int given by one of names, in the order of values
+#define CFG_LIST 4          // string that may be empty
+
+typedef struct cfgkey {
+    const char* key;
+    int type;
+    size_t offset;
+    const char* names;      // CFG_NAME: comma separated
+    const int* values;
+    const char* help;
+} cfgkey_t;
+
+static const int modevalues[] = { MODE_HIST, MODE_T2, MODE_T3 };
+static const int readvalues[] = { READ_ALL, READ_CHANNELS, READ_AUTO };
+static const int alignvalues[] = { ALIGN_NONE, ALIGN_HOST, ALIGN_WR };
+static const int cutvalues[] = { T3CUT_TIME, T3CUT_MARKER };
+static const int lagvalues[] = { T2LAG_LINEAR, T2LAG_LOG };
+static const int filtervalues[] = { EVF_OFF, EVF_COINC, EVF_ROWCOINC, EVF_ANTI };
+static const int trigvalues[] = { MEASCTRL_SINGLESHOT_CTC, MEASCTRL_C1_GATED, MEASCTRL_C1_START_CTC_STOP,
+    MEASCTRL_C1_START_C2_STOP };
+
+#define KEY(name, type, field, names, values, help) { name, type, offsetof(mhconfig_t, field), names, values, help }
+
+static const cfgkey_t keys[] = {
+    KEY("mode", CFG_NAME, mode, "hist,t2,t3", modevalues,
+        "one device histogram per frame, the T2 stream correlated or the T3 stream binned on the host"),
+    KEY("numrep", CFG_INT, numrep, NULL, NULL, "frames per run"),
+    KEY("tacq", CFG_INT, tacq, NULL, NULL, "acquisition time per frame (ms), of the first one if adaptive"),
+    KEY("target", CFG_INT, target, NULL, NULL, "0 = fixed tacq, else the peak count frame durations aim at (adapt.h)"),
+    KEY("tmin", CFG_INT, tmin, NULL, NULL, "shortest adaptive frame (ms)"),
+    KEY("tmax", CFG_INT, tmax, NULL, NULL, "longest adaptive frame (ms)"),
+    KEY("numbuf", CFG_INT, numbuf, NULL, NULL, "frame buffers per device"),
+    KEY("datafile", CFG_STR, datafile, NULL, NULL, "frame file, _<serial> is added with several devices"),
+    KEY("timefile", CFG_STR, timefile, NULL, NULL, "timing file, _<serial> is added with several devices"),
+    KEY("trace", CFG_INT, trace, NULL, NULL, "1 = time every phase of every frame, histogram mode"),
+    KEY("tracefile", CFG_STR, tracefile, NULL, NULL, "phase trace file, _<serial> is added with several devices"),
+    KEY("moments", CFG_INT, moments, NULL, NULL, "1 = counts, mean time and spread per channel of every frame"),
+    KEY("momentsfile", CFG_STR, momentsfile, NULL, NULL, "moments file, _<serial> is added with several devices"),
+    KEY("live", CFG_INT, live, NULL, NULL, "ms between console lines of the moments, 0 = none"),
+    KEY("telemetry", CFG_INT, telemetry, NULL, NULL, "1 = poll rates, warnings and flags in the background, histogram mode"),
+    KEY("telefile", CFG_STR, telefile, NULL, NULL, "telemetry log, _<serial> is added with several devices"),
+    KEY("publish", CFG_INT, publish, NULL, NULL, "1 = publish every frame to shared memory for live viewers (shmring.h)"),
+    KEY("shmname", CFG_STR, shmname, NULL, NULL, "shared memory name, _<serial> is added with several devices"),
+    KEY("shmslots", CFG_INT, shmslots, NULL, NULL, "frames the shared memory ring holds"),
+    KEY("chanmask", CFG_MASK, chanmask, NULL, NULL, "channels stored, bit i = channel i"),
+    KEY("roistart", CFG_INT, roistart, NULL, NULL, "first histogram bin stored"),
+    KEY("roilen", CFG_INT, roilen, NULL, NULL, "bins stored per channel"),
+    KEY("readmode", CFG_NAME, readmode, "all,channels,auto", readvalues, "histogram readout call, auto = measured at startup"),
+    KEY("autorange", CFG_INT, autorange, NULL, NULL, "1 = store one sync period from offset on, binning and bins chosen to fit"),
+    KEY("autobins", CFG_INT, autobins, NULL, NULL, "most bins per channel autorange may choose, it coarsens the binning to fit"),
+    KEY("diffread", CFG_INT, diffread, NULL, NULL, "1 = frames are differences of cumulative histograms, no clear per frame"),
+    KEY("align", CFG_NAME, align, "none,host,wr", alignvalues, "frame start alignment of several devices"),
+    KEY("compress", CFG_INT, compress, NULL, NULL, "1 = lossless compressed frames (codec.h)"),
+    KEY("mapped", CFG_INT, mapped, NULL, NULL, "1 = memory-mapped frame file (mapout.h)"),
+    KEY("spin", CFG_INT, spin, NULL, NULL, "1 = poll MH_CTCStatus back to back"),
+    KEY("rebin", CFG_INT, rebin, NULL, NULL, "sum every rebin bins before writing, a power of two (reduce.h)"),
+    KEY("gates", CFG_LIST, gates, NULL, NULL, "start:length,... write the gate sums instead of the bins"),
+    KEY("accumulate", CFG_INT, accumulate, NULL, NULL, "1 = write only the sum of all frames of a run"),
+    KEY("container", CFG_INT, container, NULL, NULL, "1 = indexed frame file with settings and per-frame records (mhfile.h)"),
+    KEY("script", CFG_LIST, script, NULL, NULL, "file of runs to do one after the other without asking, see config.h"),
+    KEY("runlog", CFG_STR, runlog, NULL, NULL, "setup time and calls of every run, _<serial> is added with several devices"),
+    KEY("serve", CFG_LIST, serve, NULL, NULL, "socket (pipe on Windows) to take runs from, keeping the devices open (jobsock.h)"),
+    KEY("serials", CFG_LIST, serials, NULL, NULL, "serial,... devices to use, empty = every device found"),
+    KEY("setcache", CFG_INT, setcache, NULL, NULL, "1 = only settings that changed go to the device (devstate.h)"),
+    KEY("rt", CFG_INT, rt, NULL, NULL, "1 = acquisition threads pinned and SCHED_FIFO, memory locked (rtmode.h)"),
+    KEY("rtcpu", CFG_INT, rtcpu, NULL, NULL, "core of the first device's acquisition thread, the next devices follow; -1 = the last cores"),
+    KEY("rtprio", CFG_INT, rtprio, NULL, NULL, "SCHED_FIFO priority of the acquisition threads, 1..99"),
+    KEY("hugepages", CFG_INT, hugepages, NULL, NULL, "1 = frame buffers on huge pages if reserved (vm.nr_hugepages)"),
+    KEY("binning", CFG_INT, binning, NULL, NULL, "MH_SetBinning code"),
+    KEY("offset", CFG_INT, offset, NULL, NULL, "MH_SetOffset (ns)"),
+    KEY("syncdiv", CFG_INT, syncdiv, NULL, NULL, "sync divider"),
+    KEY("syncedge", CFG_INT, syncedge, NULL, NULL, "sync trigger edge, 0 or 1"),
+    KEY("synclevel", CFG_INT, synclevel, NULL, NULL, "sync trigger level (mV)"),
+    KEY("syncoffset", CFG_INT, syncoffset, NULL, NULL, "sync channel offset (ps)"),
+    KEY("inputedge", CFG_INT, inputedge, NULL, NULL, "input trigger edge, 0 or 1"),
+    KEY("inputlevel", CFG_INT, inputlevel, NULL, NULL, "input trigger level (mV)"),
+    KEY("inputoffset", CFG_INT, inputoffset, NULL, NULL, "input channel offset of all channels (ps)"),
+    KEY("trigger", CFG_NAME, trigger, "off,gated,c1ctc,c1c2", trigvalues,
+        "frames started by software, gated by C1, started by C1 or started by C1 and stopped by C2"),
+    KEY("trigstart", CFG_INT, trigstart, NULL, NULL, "C1 edge, 1 = rising, 0 = falling"),
+    KEY("trigstop", CFG_INT, trigstop, NULL, NULL, "C2 edge, 1 = rising, 0 = falling"),
+    KEY("trigtimeout", CFG_INT, trigtimeout, NULL, NULL, "ms an armed frame waits for C1 before the run ends"),
+    KEY("trigperiod", CFG_INT, trigperiod, NULL, NULL, "us between C1 triggers for the missed trigger count, 0 = estimate"),
+    KEY("workers", CFG_INT, workers, NULL, NULL, "T3 binning or T2 correlator threads"),
+    KEY("cut", CFG_NAME, cut, "time,marker", cutvalues, "T3 frame cut by device time or by markers"),
+    KEY("markermask", CFG_INT, markermask, NULL, NULL, "T3 markers that start a frame, bit 0 = marker 1"),
+    KEY("pairs", CFG_LIST, pairs, NULL, NULL, "a:b,... T2 channel pairs correlated, lag = time of b - time of a (t2corr.h)"),
+    KEY("lagscale", CFG_NAME, lagscale, "linear,log", lagvalues, "T2 lag bins of lagwidth, or multi-tau doubling"),
+    KEY("lagwidth", CFG_INT, lagwidth, NULL, NULL, "T2 lag bin width (ps), of the first level if log"),
+    KEY("lagmax", CFG_INT, lagmax, NULL, NULL, "largest T2 lag (ps), both signs"),
+    KEY("lagfile", CFG_STR, lagfile, NULL, NULL, "lag of every T2 bin, _<serial> is added with several devices"),
+    KEY("filter", CFG_NAME, filter, "off,coinc,rowcoinc,anti", filtervalues,
+        "T2/T3 device event filter: none, events with partners, partners within a row, events without (evfilter.h)"),
+    KEY("filterchans", CFG_MASK, filterchans, NULL, NULL, "channels the event filter uses, bit i = channel i"),
+    KEY("filterpass", CFG_MASK, filterpass, NULL, NULL, "channels that always pass the event filter"),
+    KEY("filtersync", CFG_INT, filtersync, NULL, NULL, "1 = the T2 sync passes the event filter, 0 = dropped"),
+    KEY("filterrange", CFG_INT, filterrange, NULL, NULL, "event filter coincidence window (ps)"),
+    KEY("filtermatch", CFG_INT, filtermatch, NULL, NULL, "other events within filterrange an event needs"),
+    KEY("filtercal", CFG_INT, filtercal, NULL, NULL, "1 = show the rates in front of and behind the event filter, then exit"),
+};
+
+#define NKEYS ((int)(sizeof(keys) / sizeof(keys[0])))
+
+
+void cfg_defaults(mhconfig_t* c)
+{
+    memset(c, 0, sizeof(*c));
+    c->mode = MODE_HIST;
+    c->numrep = NUMREP;
+    c->tacq = ACQTIME;
+    c->target = 0;
+    c->tmin = 1;
+    c->tmax = 10 * ACQTIME;
+    c->numbuf = NUMBUF;
+    strcpy(c->datafile, FILEDATA);
+    strcpy(c->timefile, FILETIME);
+    c->trace = 0;
+    strcpy(c->tracefile, FILETRACE);
+    c->moments = 0;
+    strcpy(c->momentsfile, FILEMOMENTS);
+    c->live = 1000;
+    c->telemetry = 0;
+    strcpy(c->telefile, FILETELE);
+    c->publish = 0;
+    strcpy(c->shmname, SHM_NAME);
+    c->shmslots = SHM_SLOTS;
+    c->chanmask = ~0ULL;
+    c->roistart = 0;
+    c->roilen = NUMBIN;
+    c->readmode = READ_AUTO;
+    c->autorange = 0;
+    c->autobins = NUMBIN;
+    c->diffread = 0;
+    c->align = ALIGN_HOST;
+    c->compress = 0;
+    c->mapped = 0;
+    c->spin = 0;
+    c->rebin = 1;
+    c->gates[0] = 0;
+    c->accumulate = 0;
+    c->container = 0;
+    c->script[0] = 0;
+    strcpy(c->runlog, FILERUNS);
+    c->serve[0] = 0;
+    c->serials[0] = 0;
+    c->setcache = 1;
+    c->rt = 0;
+    c->rtcpu = -1;
+    c->rtprio = RT_PRIORITY;
+    c->hugepages = 0;
+    c->binning = 0;
+    c->offset = 0;
+    c->syncdiv = 1;
+    c->syncedge = 0;
+    c->synclevel = -50;
+    c->syncoffset = 0;
+    c->inputedge = 0;
+    c->inputlevel = -50;
+    c->inputoffset = 0;
+    c->trigger = MEASCTRL_SINGLESHOT_CTC;
+    c->trigstart = EDGE_RISING;
+    c->trigstop = EDGE_RISING;
+    c->trigtimeout = 1000;
+    c->trigperiod = 0;
+    c->workers = 4;
+    c->cut = T3CUT_TIME;
+    c->markermask = 0x1;
+    strcpy(c->pairs, "0:1");
+    c->lagscale = T2LAG_LINEAR;
+    c->lagwidth = 100;
+    c->lagmax = 10000;
+    strcpy(c->lagfile, FILELAGS);
+    c->filter = EVF_OFF;
+    c->filterchans = ~0ULL;
+    c->filterpass = 0;
+    c->filtersync = 1;
+    c->filterrange = 5000;
+    c->filtermatch = 1;
+    c->filtercal = 0;
+}
+
+
+// index of value in the comma separated list names, -1 if not there
+static int findname(const char* names, const char* value)
+{
+    size_t len = strlen(value);
+    int i = 0;
+
+    while (*names)
+    {
+        if (strncmp(names, value, len) == 0 && (names[len] == ',' || names[len] == 0))
+            return i;
+        while (*names && *names != ',')
+            names++;
+        if (*names == ',')
+            names++;
+        i++;
+    }
+    return -1;
+}
+
+int cfg_set(mhconfig_t* c, const char* key, const char* value)
+{
+    const cfgkey_t* k;
+    char* end;
+    char* field;
+    int i, n;
+
+    for (i = 0; i < NKEYS; i++)
+        if (strcmp(keys[i].key, key) == 0)
+            break;
+    if (i == NKEYS)
+    {
+        printf("\nunknown setting %s", key);
+        return -1;
+    }
+    k = &keys[i];
+    field = (char*)c + k->offset;
+    switch (k->type)
+    {
+    case CFG_INT:
+        *(int*)field = (int)strtol(value, &end, 0);
+        break;
+    case CFG_MASK:
+        *(unsigned long long*)field = strtoull(value, &end, 0);
+        break;
+    case CFG_STR:
+    case CFG_LIST:
+        if (strlen(value) >= CFG_MAXPATH || (*value == 0 && k->type == CFG_STR))
+        {
+            printf("\nbad %s for %s", k->type == CFG_STR ? "file name" : "value", key);
+            return -1;
+        }
+        strcpy(field, value);
+        return 0;
+    default:
+        if ((n = findname(k->names, value)) < 0)
+        {
+            printf("\n%s must be one of %s", key, k->names);
+            return -1;
+        }
+        *(int*)field = k->values[n];
+        return 0;
+    }
+    if (end == value || *end != 0)
+    {
+        printf("\nbad number %s for %s", value, key);
+        return -1;
+    }
+    return 0;
+}
+
+
+// reads key = value lines, # starts a comment
+int cfg_load(mhconfig_t* c, const char* name)
+{
+    FILE* fp = fopen(name, "r");
+    char line[512];
+    char* key;
+    char* value;
+    char* p;
+    int lineno = 0, ret = 0;
+
+    if (fp == NULL)
+    {
+        printf("\ncannot open settings file %s", name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if ((p = strchr(line, '#')) != NULL)
+            *p = 0;
+        for (p = line + strlen(line); p > line && isspace((unsigned char)p[-1]); p--)
+            p[-1] = 0;
+        for (key = line; isspace((unsigned char)*key); key++)
+            ;
+        if (*key == 0)
+            continue;
+        if ((value = strchr(key, '=')) == NULL)
+        {
+            printf("\n%s:%d: expected key = value", name, lineno);
+            ret = -1;
+            continue;
+        }
+        for (p = value; p > key && isspace((unsigned char)p[-1]); p--)
+            ;
+        *p = 0;
+        for (value++; isspace((unsigned char)*value); value++)
+            ;
+        if (cfg_set(c, key, value) < 0)
+        {
+            printf(" (%s:%d)", name, lineno);
+            ret = -1;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+
+// -f <file> loads a settings file, key=value sets one key, -h lists the keys;
+// returns 1 if the program should only exit, -1 on errors
+int cfg_args(mhconfig_t* c, int argc, char* argv[])
+{
+    char arg[CFG_MAXPATH + 32];
+    char* value;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            if (cfg_load(c, argv[++i]) < 0)
+                return -1;
+        }
+        else if (strcmp(argv[i], "-h") == 0)
+        {
+            printf("\nusage: histomode [-f settings.cfg] [key=value ...]\n");
+            cfg_print(c, stdout);
+            return 1;
+        }
+        else if (strlen(argv[i]) < sizeof(arg) && (value = strchr(strcpy(arg, argv[i]), '=')) != NULL)
+        {
+            *value++ = 0;
+            if (cfg_set(c, arg, value) < 0)
+                return -1;
+        }
+        else
+        {
+            printf("\nunknown argument %s, try -h", argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+// writes the settings in the format cfg_load reads
+void cfg_print(const mhconfig_t* c, FILE* fp)
+{
+    const cfgkey_t* k;
+    const char* field;
+    const char* names;
+    int i, n, len;
+
+    for (i = 0; i < NKEYS; i++)
+    {
+        k = &keys[i];
+        field = (const char*)c + k->offset;
+        fprintf(fp, "%-10s = ", k->key);
+        switch (k->type)
+        {
+        case CFG_INT:
+            len = fprintf(fp, "%d", *(const int*)field);
+            break;
+        case CFG_MASK:
+            len = fprintf(fp, "0x%llX", *(const unsigned long long*)field);
+            break;
+        case CFG_STR:
+        case CFG_LIST:
+            len = fprintf(fp, "%s", field);
+            break;
+        default:
+            // the name that goes with the value
+            for (names = k->names, n = 0; *names && k->values[n] != *(const int*)field; n++)
+                names += strcspn(names, ",") + (names[strcspn(names, ",")] == ',');
+            len = (int)strcspn(names, ",");
+            fprintf(fp, "%.*s", len, names);
+            break;
+        }
+        fprintf(fp, "%*s# %s\n", len < 18 ? 18 - len : 1, "", k->help);
+    }
+}
+
+
+static int inrange(const char* key, int v, int lo, int hi, char* why, int whylen)
+{
+    if (v >= lo && v <= hi)
+        return 1;
+    snprintf(why, whylen, "%s must be %d..%d", key, lo, hi);
+    return 0;
+}
+
+// one run: the base settings with the key=value pairs of line applied, only
+// keys of CFG_RUNKEYS, each within the limits of mhdefin.h so that a job
+// from a client cannot take a setter call down; returns 0, or -1 with the
+// first problem in why
+int cfg_runline(const mhconfig_t* base, const char* line, cfgrun_t* run, char* why, int whylen)
+{
+    char buf[CFG_MAXPATH];
+    char* tok;
+    char* value;
+
+    run->cfg = *base;
+    snprintf(run->line, sizeof(run->line), "%s", line);
+    strcpy(buf, run->line);
+    for (tok = strtok(buf, " \t"); tok; tok = strtok(NULL, " \t"))
+    {
+        if ((value = strchr(tok, '=')) == NULL)
+        {
+            snprintf(why, whylen, "expected key=value, not %s", tok);
+            return -1;
+        }
+        *value++ = 0;
+        if (findname(CFG_RUNKEYS, tok) < 0)
+        {
+            snprintf(why, whylen, "%s cannot change between runs, only %s", tok, CFG_RUNKEYS);
+            return -1;
+        }
+        if (cfg_set(&run->cfg, tok, value) < 0)
+        {
+            snprintf(why, whylen, "bad value for %s", tok);
+            return -1;
+        }
+    }
+    if (run->cfg.numrep < 1 || run->cfg.tacq < 1)
+    {
+        snprintf(why, whylen, "numrep and tacq must be positive");
+        return -1;
+    }
+    if (!inrange("tacq", run->cfg.tacq, ACQTMIN, ACQTMAX, why, whylen)
+        || !inrange("binning", run->cfg.binning, 0, MAXBINSTEPS - 1, why, whylen)
+        || !inrange("offset", run->cfg.offset, OFFSETMIN, OFFSETMAX, why, whylen)
+        || !inrange("syncdiv", run->cfg.syncdiv, SYNCDIVMIN, SYNCDIVMAX, why, whylen)
+        || !inrange("syncedge", run->cfg.syncedge, 0, 1, why, whylen)
+        || !inrange("synclevel", run->cfg.synclevel, TRGLVLMIN, TRGLVLMAX, why, whylen)
+        || !inrange("syncoffset", run->cfg.syncoffset, CHANOFFSMIN, CHANOFFSMAX, why, whylen)
+        || !inrange("inputedge", run->cfg.inputedge, 0, 1, why, whylen)
+        || !inrange("inputlevel", run->cfg.inputlevel, TRGLVLMIN, TRGLVLMAX, why, whylen)
+        || !inrange("inputoffset", run->cfg.inputoffset, CHANOFFSMIN, CHANOFFSMAX, why, whylen))
+        return -1;
+    if (base->container && run->cfg.binning != base->binning)
+    {
+        snprintf(why, whylen, "binning cannot change between runs with container=1, the header holds one resolution");
+        return -1;
+    }
+    return 0;
+}
+
+// the runs of a script, every line the base settings with its keys applied;
+// returns the number of runs (in a new array) or -1
+int cfg_script(const mhconfig_t* base, const char* name, cfgrun_t** runs)
+{
+    FILE* fp = fopen(name, "r");
+    cfgrun_t* grown;
+    char line[CFG_MAXPATH + 2];
+    char why[CFG_MAXPATH];
+    char* p;
+    int n = 0, cap = 0, lineno = 0, ret = 0;
+
+    *runs = NULL;
+    if (fp == NULL)
+    {
+        printf("\ncannot open script %s", name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if ((p = strchr(line, '#')) != NULL)
+            *p = 0;
+        for (p = line + strlen(line); p > line && isspace((unsigned char)p[-1]); p--)
+            p[-1] = 0;
+        for (p = line; isspace((unsigned char)*p); p++)
+            ;
+        if (*p == 0)
+            continue;
+        if (n == cap)
+        {
+            cap = cap ? 2 * cap : 16;
+            if ((grown = (cfgrun_t*)realloc(*runs, cap * sizeof(cfgrun_t))) == NULL)
+            {
+                ret = -1;
+                break;
+            }
+            *runs = grown;
+        }
+        if (cfg_runline(base, p, &(*runs)[n], why, sizeof(why)) < 0)
+        {
+            printf("\n%s:%d: %s", name, lineno, why);
+            ret = -1;
+        }
+        n++;
+    }
+    fclose(fp);
+    if (ret == 0 && n == 0)
+    {
+        printf("\nscript %s has no runs", name);
+        ret = -1;
+    }
+    if (ret < 0)
+    {
+        free(*runs);
+        *runs = NULL;
+        return -1;
+    }
+    return n;
+}
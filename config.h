@@ -0,0 +1,139 @@
+/************************************************************************
+
+  Runtime settings of histomode
+
+  Everything that used to be edited in the source (frame geometry,
+  frames per run, acquisition time, file names, input settings) has a
+  default here and can be changed without rebuilding, from a settings
+  file and from the command line, later ones winning:
+
+    histomode -f mysetup.cfg tacq=20 roilen=1024
+
+  A settings file holds one key = value per line, # starts a comment.
+  histomode -h lists the keys with their current values.
+
+  With script=<file> the program runs headless through a list of runs
+  instead of asking before each one. Every line of the script is one
+  run, key=value pairs separated by blanks that change the settings
+  above for that run only; only the keys of CFG_RUNKEYS may appear,
+  the others fix the frame geometry and the output files:
+
+    numrep=50 tacq=10 binning=0
+    binning=1                   # numrep and tacq as set outside the script
+    binning=2 offset=1000
+
+  With serve=<name> the runs come from clients instead (mhjob.c), one
+  line in the same format per job, while the devices stay open and
+  initialized between jobs.
+
+************************************************************************/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdio.h>
+
+
+#define NUMBIN 4096 // bins per channel of the legacy file layout
+#define NUMREP 100
+#define ACQTIME 100 // in ms
+#define NUMBUF 8 // frame buffers cycled between acquisition and writer thread
+#define FILEDATA "FileData.dat"
+#define FILETIME "FileTime.txt"
+#define FILETRACE "FileTrace.txt"
+#define FILEMOMENTS "FileMoments.txt"
+#define FILETELE "FileTele.txt"
+#define FILERUNS "FileRuns.txt"
+#define FILELAGS "FileLags.txt"
+#define CFG_MAXPATH 256
+#define CFG_RUNKEYS "numrep,tacq,syncdiv,synclevel,syncedge,syncoffset,inputlevel,inputedge,inputoffset,binning,offset"
+
+typedef struct mhconfig {
+    int mode;               // MODE_HIST, MODE_T2 or MODE_T3
+    int numrep;             // frames per run
+    int tacq;               // acquisition time per frame (ms), of the first one if adaptive
+    unsigned int target;    // 0 = fixed tacq, else the peak count adaptive frame durations aim at
+    int tmin, tmax;         // bounds of the adaptive durations (ms)
+    int numbuf;             // frame buffers per device
+    char datafile[CFG_MAXPATH];
+    char timefile[CFG_MAXPATH];
+    int trace;              // 1 = per-phase latency trace of every frame
+    char tracefile[CFG_MAXPATH];
+    int moments;            // 1 = per-channel counts, mean time and spread of every frame
+    char momentsfile[CFG_MAXPATH];
+    int live;               // ms between console lines of the moments, 0 = none
+    int telemetry;          // 1 = rates, warnings and flags from a background thread (telemetry.h)
+    char telefile[CFG_MAXPATH];
+    int publish;            // 1 = every frame also goes to a shared-memory ring for live viewers (shmring.h)
+    char shmname[CFG_MAXPATH];
+    int shmslots;           // frames the ring holds
+    unsigned long long chanmask;    // channels stored, bit i = channel i
+    int roistart;           // first histogram bin stored
+    int roilen;             // bins stored per channel
+    int readmode;           // READ_ALL, READ_CHANNELS or READ_AUTO
+    int autorange;          // 1 = binning and bins stored from the sync period, replaces roistart and roilen
+    int autobins;           // most bins per channel autorange may choose
+    int diffread;           // 1 = no histogram clear between frames, frames are differences
+    int align;              // ALIGN_NONE, ALIGN_HOST or ALIGN_WR
+    int compress;           // 1 = lossless compressed output
+    int mapped;             // 1 = memory-mapped output
+    int spin;               // 1 = poll MH_CTCStatus back to back
+    int rebin;              // bins summed into one before writing, 1 = none
+    char gates[CFG_MAXPATH];    // start:length,... time gates written instead of the bins, empty = none
+    int accumulate;         // 1 = only the sum of the frames of a run is written
+    int container;          // 1 = indexed container with settings and per-frame records (mhfile.h)
+    char script[CFG_MAXPATH];   // runs to do without asking, empty = interactive
+    char runlog[CFG_MAXPATH];
+    char serve[CFG_MAXPATH];    // socket or pipe to take runs from, empty = none
+    char serials[CFG_MAXPATH];  // serial,... of the devices to use, empty = all
+    int setcache;           // 1 = setter calls only for settings that changed (devstate.h)
+    int rt;                 // 1 = acquisition threads pinned and SCHED_FIFO, memory locked (rtmode.h)
+    int rtcpu;              // core of the first device's acquisition thread, -1 = the last cores
+    int rtprio;             // SCHED_FIFO priority
+    int hugepages;          // 1 = frame buffers on huge pages
+    int binning;
+    int offset;
+    int syncdiv;
+    int syncedge;           // 0 or 1
+    int synclevel;          // mV
+    int syncoffset;         // ps
+    int inputedge;          // 0 or 1
+    int inputlevel;         // mV
+    int inputoffset;        // ps, all channels
+    int trigger;            // MEASCTRL_ that starts the frames, MEASCTRL_SINGLESHOT_CTC = software
+    int trigstart;          // C1 edge, EDGE_RISING or EDGE_FALLING
+    int trigstop;           // C2 edge
+    int trigtimeout;        // ms an armed frame waits for C1 before the run ends
+    int trigperiod;         // us between C1 triggers, 0 = unknown
+    int workers;            // T3 binning or T2 correlator threads
+    int cut;                // T3CUT_TIME or T3CUT_MARKER
+    int markermask;         // T3 markers that start a frame
+    char pairs[CFG_MAXPATH];    // a:b,... T2 channel pairs correlated, one row each
+    int lagscale;           // T2LAG_LINEAR or T2LAG_LOG
+    int lagwidth;           // ps, T2 lag bin width, of the first level if log
+    int lagmax;             // ps, largest T2 lag
+    char lagfile[CFG_MAXPATH];
+    int filter;             // EVF_ preset of the device event filter, T2/T3 (evfilter.h)
+    unsigned long long filterchans; // channels the filter uses
+    unsigned long long filterpass;  // channels that always pass it
+    int filtersync;         // 1 = the T2 sync passes the main filter
+    int filterrange;        // ps
+    int filtermatch;        // other events needed within filterrange
+    int filtercal;          // 1 = show the rates in front of and behind the filter, then exit
+} mhconfig_t;
+
+typedef struct cfgrun {
+    mhconfig_t cfg;         // the settings with the run's keys applied
+    char line[CFG_MAXPATH]; // the keys as the script has them
+} cfgrun_t;
+
+
+void cfg_defaults(mhconfig_t* c);
+int cfg_set(mhconfig_t* c, const char* key, const char* value);
+int cfg_load(mhconfig_t* c, const char* name);
+int cfg_args(mhconfig_t* c, int argc, char* argv[]);
+void cfg_print(const mhconfig_t* c, FILE* fp);
+int cfg_runline(const mhconfig_t* base, const char* line, cfgrun_t* run, char* why, int whylen);
+int cfg_script(const mhconfig_t* base, const char* name, cfgrun_t** runs);
+
+#endif
@@ -0,0 +1,190 @@
+/************************************************************************
+
+  Host-side cache of the device settings, see devstate.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhthread.h"
+#include "acquire.h"
+#include "devstate.h"
+
+
+// 1 if the device already has the setting, the call saved is counted
+static int unchanged(devstate_t* s, int same)
+{
+    if (!s->cache || !same)
+        return 0;
+    s->saved++;
+    return 1;
+}
+
+// books one device call that started at t0, returns ret
+static int issued(devstate_t* s, double t0, int ret)
+{
+    s->calls++;
+    s->ms += mh_timems() - t0;
+    return ret;
+}
+
+
+// everything unknown, as after MH_Initialize
+void ds_init(devstate_t* s, int devidx, int cache)
+{
+    int ch;
+
+    memset(s, 0, sizeof(*s));
+    s->devidx = devidx;
+    s->cache = cache;
+    s->syncdiv = s->synclevel = s->syncedge = s->syncoffset = DS_UNKNOWN;
+    for (ch = 0; ch < MAXINPCHAN; ch++)
+        s->inputlevel[ch] = s->inputedge[ch] = s->inputoffset[ch] = s->enable[ch] = DS_UNKNOWN;
+    s->lencode = s->histlen = DS_UNKNOWN;
+    s->binning = s->offset = DS_UNKNOWN;
+}
+
+int ds_syncdiv(devstate_t* s, int div)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->syncdiv == div))
+        return 0;
+    s->syncdiv = DS_UNKNOWN; // unless the call succeeds
+    if (issued(s, t0, APICALL(MH_SetSyncDiv(s->devidx, div))) < 0)
+        return -1;
+    s->syncdiv = div;
+    return 0;
+}
+
+int ds_syncedge(devstate_t* s, int level, int edge)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->synclevel == level && s->syncedge == edge))
+        return 0;
+    s->synclevel = s->syncedge = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetSyncEdgeTrg(s->devidx, level, edge))) < 0)
+        return -1;
+    s->synclevel = level;
+    s->syncedge = edge;
+    return 0;
+}
+
+int ds_syncoffset(devstate_t* s, int offset)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->syncoffset == offset))
+        return 0;
+    s->syncoffset = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetSyncChannelOffset(s->devidx, offset))) < 0)
+        return -1;
+    s->syncoffset = offset;
+    return 0;
+}
+
+int ds_inputedge(devstate_t* s, int ch, int level, int edge)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->inputlevel[ch] == level && s->inputedge[ch] == edge))
+        return 0;
+    s->inputlevel[ch] = s->inputedge[ch] = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetInputEdgeTrg(s->devidx, ch, level, edge))) < 0)
+        return -1;
+    s->inputlevel[ch] = level;
+    s->inputedge[ch] = edge;
+    return 0;
+}
+
+int ds_inputoffset(devstate_t* s, int ch, int offset)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->inputoffset[ch] == offset))
+        return 0;
+    s->inputoffset[ch] = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetInputChannelOffset(s->devidx, ch, offset))) < 0)
+        return -1;
+    s->inputoffset[ch] = offset;
+    return 0;
+}
+
+int ds_inputenable(devstate_t* s, int ch, int enable)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->enable[ch] == enable))
+        return 0;
+    s->enable[ch] = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetInputChannelEnable(s->devidx, ch, enable))) < 0)
+        return -1;
+    s->enable[ch] = enable;
+    return 0;
+}
+
+int ds_histolen(devstate_t* s, int lencode, int* histlen)
+{
+    double t0 = mh_timems();
+
+    if (!unchanged(s, s->lencode == lencode))
+    {
+        s->lencode = DS_UNKNOWN;
+        if (issued(s, t0, APICALL(MH_SetHistoLen(s->devidx, lencode, &s->histlen))) < 0)
+            return -1;
+        s->lencode = lencode;
+    }
+    *histlen = s->histlen;
+    return 0;
+}
+
+int ds_binning(devstate_t* s, int binning)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->binning == binning))
+        return 0;
+    s->binning = DS_UNKNOWN;
+    s->resolution = 0;
+    if (issued(s, t0, APICALL(MH_SetBinning(s->devidx, binning))) < 0)
+        return -1;
+    s->binning = binning;
+    return 0;
+}
+
+int ds_offset(devstate_t* s, int offset)
+{
+    double t0 = mh_timems();
+
+    if (unchanged(s, s->offset == offset))
+        return 0;
+    s->offset = DS_UNKNOWN;
+    if (issued(s, t0, APICALL(MH_SetOffset(s->devidx, offset))) < 0)
+        return -1;
+    s->offset = offset;
+    return 0;
+}
+
+// read once per binning
+int ds_resolution(devstate_t* s, double* resolution)
+{
+    double t0 = mh_timems();
+
+    if (!unchanged(s, s->resolution > 0))
+        if (issued(s, t0, APICALL(MH_GetResolution(s->devidx, &s->resolution))) < 0)
+            return -1;
+    *resolution = s->resolution;
+    return 0;
+}
+
+void ds_resetstats(devstate_t* s)
+{
+    s->calls = 0;
+    s->saved = 0;
+    s->ms = 0;
+}
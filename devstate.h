@@ -0,0 +1,57 @@
+/************************************************************************
+
+  Host-side cache of the device settings
+
+  Every setter call is a device transaction. Setting up a device issues
+  a few dozen of them (sync, then trigger level, edge, offset and enable
+  of every input channel, histogram length, binning, offset), and a
+  sweep that changes one value between runs would pay for all of them
+  again. devstate_t remembers what was last set on the device and the
+  ds_ setters only call MHLib when the value differs; after
+  MH_Initialize everything is unknown (ds_init) and is set once.
+
+  The resolution follows from the binning, so it is read again only
+  after the binning has changed. With cache 0 every setter is issued,
+  the old behaviour, to compare against. Every call issued or saved and
+  the time spent in the calls are counted for the run log.
+
+************************************************************************/
+
+#ifndef DEVSTATE_H
+#define DEVSTATE_H
+
+#include "mhdefin.h"
+
+
+#define DS_UNKNOWN  (-2147483647 - 1)   // no setting takes this value
+
+typedef struct devstate {
+    int devidx;
+    int cache;              // 0 = issue every setter call
+    int syncdiv, synclevel, syncedge, syncoffset;
+    int inputlevel[MAXINPCHAN], inputedge[MAXINPCHAN], inputoffset[MAXINPCHAN], enable[MAXINPCHAN];
+    int lencode, histlen;
+    int binning, offset;
+    double resolution;      // 0 = to be read
+
+    // statistics, reset by ds_resetstats()
+    int calls;              // device calls issued
+    int saved;              // setter calls the cache left out
+    double ms;              // time spent in them
+} devstate_t;
+
+
+void ds_init(devstate_t* s, int devidx, int cache);
+int ds_syncdiv(devstate_t* s, int div);
+int ds_syncedge(devstate_t* s, int level, int edge);
+int ds_syncoffset(devstate_t* s, int offset);
+int ds_inputedge(devstate_t* s, int ch, int level, int edge);
+int ds_inputoffset(devstate_t* s, int ch, int offset);
+int ds_inputenable(devstate_t* s, int ch, int enable);
+int ds_histolen(devstate_t* s, int lencode, int* histlen);
+int ds_binning(devstate_t* s, int binning);
+int ds_offset(devstate_t* s, int offset);
+int ds_resolution(devstate_t* s, double* resolution);
+void ds_resetstats(devstate_t* s);
+
+#endif
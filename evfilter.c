@@ -0,0 +1,166 @@
+/************************************************************************
+
+  Event filter presets, see evfilter.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "evfilter.h"
+
+
+static unsigned long long devmask(int nchannels)
+{
+    return nchannels < 64 ? (1ULL << nchannels) - 1 : ~0ULL;
+}
+
+static int bits(unsigned long long m)
+{
+    int n = 0;
+
+    for (; m; m &= m - 1)
+        n++;
+    return n;
+}
+
+// 8 bit masks of one row
+static int rowbits(unsigned long long m, int row)
+{
+    return (int)((m >> (8 * row)) & 0xFF);
+}
+
+// 0, or -1 with the problem in why
+int evf_check(const evfopts_t* o, int mode, int nchannels, char* why, int whylen)
+{
+    unsigned long long chans = o->chans & devmask(nchannels);
+    int row, best = 0;
+
+    if (o->preset == EVF_OFF)
+        return 0;
+    if (mode != MODE_T2 && mode != MODE_T3)
+    {
+        snprintf(why, whylen, "event filters act on the T2 and T3 streams only");
+        return -1;
+    }
+    if (o->range < TIMERANGEMIN || o->range > TIMERANGEMAX)
+    {
+        snprintf(why, whylen, "filterrange must be %d..%d ps", TIMERANGEMIN, TIMERANGEMAX);
+        return -1;
+    }
+    if (o->match < MATCHCNTMIN || o->match > MATCHCNTMAX)
+    {
+        snprintf(why, whylen, "filtermatch must be %d..%d", MATCHCNTMIN, MATCHCNTMAX);
+        return -1;
+    }
+    if (o->pass & ~devmask(nchannels))
+    {
+        snprintf(why, whylen, "filterpass has channels the device does not have");
+        return -1;
+    }
+    if (chans == 0)
+    {
+        snprintf(why, whylen, "filterchans has no channel of the device");
+        return -1;
+    }
+    // a coincidence needs match partners on channels in use
+    for (row = 0; row < (nchannels + 7) / 8; row++)
+        if (bits(rowbits(chans, row)) > best)
+            best = bits(rowbits(chans, row));
+    if (o->preset == EVF_COINC && bits(chans) <= o->match)
+    {
+        snprintf(why, whylen, "filtermatch %d needs at least %d channels in filterchans", o->match, o->match + 1);
+        return -1;
+    }
+    if (o->preset == EVF_ROWCOINC && best <= o->match)
+    {
+        snprintf(why, whylen, "filtermatch %d needs a row of 8 channels with at least %d in filterchans", o->match, o->match + 1);
+        return -1;
+    }
+    return 0;
+}
+
+// sets the preset up in the device, nothing for EVF_OFF
+int evf_apply(int devidx, const evfopts_t* o, int mode, int nchannels)
+{
+    unsigned long long chans = o->chans & devmask(nchannels);
+    int rows = (nchannels + 7) / 8;
+    int row, sync;
+
+    if (o->preset == EVF_OFF)
+        return 0;
+    if (o->preset == EVF_ROWCOINC)
+    {
+        for (row = 0; row < rows; row++)
+        {
+            if (APICALL(MH_SetRowEventFilter(devidx, row, o->range, o->match, 0,
+                rowbits(chans, row), rowbits(o->pass, row))) < 0) return -1;
+            if (APICALL(MH_EnableRowEventFilter(devidx, row, 1)) < 0) return -1;
+        }
+        return 0;
+    }
+    if (APICALL(MH_SetMainEventFilterParams(devidx, o->range, o->match, o->preset == EVF_ANTI)) < 0) return -1;
+    for (row = 0; row < rows; row++)
+    {
+        sync = row == 0 && mode == MODE_T2 && o->sync ? 0x100 : 0;
+        if (APICALL(MH_SetMainEventFilterChannels(devidx, row, rowbits(chans, row), rowbits(o->pass, row) | sync)) < 0)
+            return -1;
+    }
+    if (APICALL(MH_EnableMainEventFilter(devidx, 1)) < 0) return -1;
+    return 0;
+}
+
+// a measurement of ms in filter test mode, then the rates at all three
+// places; the filter output goes nowhere meanwhile
+int evf_calibrate(int devidx, int mode, int syncdiv, int nchannels, int ms, evfcal_t* c)
+{
+    int ret = -1;
+
+    memset(c, 0, sizeof(*c));
+    c->nchannels = nchannels;
+    c->mode = mode;
+    c->syncdiv = syncdiv;
+    if (APICALL(MH_SetFilterTestMode(devidx, 1)) < 0) return -1;
+    if (APICALL(MH_StartMeas(devidx, ms + 1000)) < 0) goto ex;
+    mh_sleepms(ms);
+    if (APICALL(MH_GetAllCountRates(devidx, &c->syncrate[0], c->rates[0])) >= 0
+        && APICALL(MH_GetRowFilteredRates(devidx, &c->syncrate[1], c->rates[1])) >= 0
+        && APICALL(MH_GetMainFilteredRates(devidx, &c->syncrate[2], c->rates[2])) >= 0)
+        ret = 0;
+    if (APICALL(MH_StopMeas(devidx)) < 0) ret = -1;
+ex:
+    if (APICALL(MH_SetFilterTestMode(devidx, 0)) < 0) ret = -1;
+    return ret;
+}
+
+// records per second at stage s: the photons, and the sync in T2 mode
+static double records(const evfcal_t* c, int s)
+{
+    double r = c->mode == MODE_T2 ? (double)c->syncrate[s] / c->syncdiv : 0;
+    int i;
+
+    for (i = 0; i < c->nchannels; i++)
+        r += c->rates[s][i];
+    return r;
+}
+
+void evf_report(const evfcal_t* c, const char* serial, FILE* fp)
+{
+    double in = records(c, 0), out = records(c, 2);
+    int i;
+
+    fprintf(fp, "\nEvent filter of device %s, rates in filter test mode", serial);
+    fprintf(fp, "\n            input/s   row filters/s   main filter/s");
+    fprintf(fp, "\nsync  %13d %15d %15d", c->syncrate[0], c->syncrate[1], c->syncrate[2]);
+    for (i = 0; i < c->nchannels; i++)
+        if (c->rates[0][i] > 0)
+            fprintf(fp, "\nch %-2d %13d %15d %15d", i, c->rates[0][i], c->rates[1][i], c->rates[2][i]);
+    fprintf(fp, "\nrecords/s %9.0f %15.0f %15.0f%s", in, records(c, 1), out,
+        c->mode == MODE_T2 ? "" : " (T3: the sync is no record)");
+    fprintf(fp, "\nThe filter saves %1.0f records/s, %1.2f MB/s of USB transfer (%1.1f%%)",
+        in - out, (in - out) * 4 / 1e6, in > 0 ? 100 * (in - out) / in : 0);
+}
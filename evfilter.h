@@ -0,0 +1,66 @@
+/************************************************************************
+
+  Event filter presets
+
+  In T2 and T3 mode the device can drop events before they reach the
+  FIFO, so that only the ones of interest cross the USB link. Each row
+  of 8 input channels has a row filter, and behind the row filters sits
+  the main filter, which also sees the sync in T2 mode. An event on a
+  channel the filter uses passes if at least match other used events
+  lie within range ps of it (none with inverse), events on pass
+  channels always pass, the others are dropped.
+
+  The presets set those up from a few keys:
+
+    EVF_COINC     main filter: used channels that have a partner
+    EVF_ROWCOINC  the same per row, partners within the row only
+    EVF_ANTI      main filter inverse: used channels without a partner
+
+  evf_check validates a preset against the device and the limits of
+  mhdefin.h before anything is sent. evf_calibrate runs the device in
+  filter test mode, where the filter output goes nowhere, and reads the
+  rate meters in front of the filters, behind the row filters and
+  behind the main filter; evf_report shows the records and the USB
+  bandwidth the filter saves.
+
+************************************************************************/
+
+#ifndef EVFILTER_H
+#define EVFILTER_H
+
+#include <stdio.h>
+
+#include "mhdefin.h"
+
+
+#define EVF_OFF      0
+#define EVF_COINC    1
+#define EVF_ROWCOINC 2
+#define EVF_ANTI     3
+
+#define EVF_CALMS    250    // ms of filter test mode, more than one rate meter period
+
+typedef struct evfopts {
+    int preset;             // EVF_
+    unsigned long long chans;   // channels the filter uses, bit i = channel i
+    unsigned long long pass;    // channels that always pass
+    int sync;               // 1 = the sync passes the main filter in T2 mode, 0 = dropped
+    int range;              // ps
+    int match;              // other events needed within range
+} evfopts_t;
+
+typedef struct evfcal {
+    int nchannels;
+    int mode;               // MODE_T2 or MODE_T3
+    int syncdiv;            // sync records in T2 mode come at syncrate / syncdiv
+    int syncrate[3];        // in front of the filters, behind the row filters, behind the main filter
+    int rates[3][MAXINPCHAN];
+} evfcal_t;
+
+
+int evf_check(const evfopts_t* o, int mode, int nchannels, char* why, int whylen);
+int evf_apply(int devidx, const evfopts_t* o, int mode, int nchannels);
+int evf_calibrate(int devidx, int mode, int syncdiv, int nchannels, int ms, evfcal_t* c);
+void evf_report(const evfcal_t* c, const char* serial, FILE* fp);
+
+#endif
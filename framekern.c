@@ -0,0 +1,167 @@
+/************************************************************************
+
+  Per-frame kernels, see framekern.h
+
+************************************************************************/
+
+#include <string.h>
+
+#include "framekern.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FK_SSE2
+#endif
+
+
+// one body per kernel; with rows and bins compile-time constants the
+// compiler unrolls the copies and vectorizes the sum
+#define GATHER_BODY(ROWS, BINS) \
+    int r; \
+    for (r = 0; r < (ROWS); r++) \
+        memcpy(dst + (size_t)r * (BINS), src + (size_t)chans[r] * stride + start, (size_t)(BINS) * sizeof(unsigned int));
+
+#define SUM_BODY(N) \
+    unsigned long long s0 = 0, s1 = 0, s2 = 0, s3 = 0; \
+    size_t i, n = (N), n4 = n & ~(size_t)3; \
+    for (i = 0; i < n4; i += 4) \
+    { \
+        s0 += counts[i]; \
+        s1 += counts[i + 1]; \
+        s2 += counts[i + 2]; \
+        s3 += counts[i + 3]; \
+    } \
+    for (; i < n; i++) \
+        s0 += counts[i]; \
+    return s0 + s1 + s2 + s3;
+
+#ifdef FK_SSE2
+#define DIFF_BODY(N) \
+    __m128i vacc = _mm_setzero_si128(), vd; \
+    size_t i, n = (N), n4 = n & ~(size_t)3; \
+    unsigned int acc; \
+    for (i = 0; i < n4; i += 4) \
+    { \
+        vd = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(cum + i)), _mm_loadu_si128((const __m128i*)(prev + i))); \
+        _mm_storeu_si128((__m128i*)(dst + i), vd); \
+        vacc = _mm_or_si128(vacc, vd); \
+    } \
+    vacc = _mm_or_si128(vacc, _mm_shuffle_epi32(vacc, _MM_SHUFFLE(1, 0, 3, 2))); \
+    vacc = _mm_or_si128(vacc, _mm_shuffle_epi32(vacc, _MM_SHUFFLE(2, 3, 0, 1))); \
+    acc = (unsigned int)_mm_cvtsi128_si32(vacc); \
+    for (; i < n; i++) \
+        acc |= dst[i] = cum[i] - prev[i]; \
+    return acc;
+#else
+#define DIFF_BODY(N) \
+    size_t i, n = (N); \
+    unsigned int acc = 0; \
+    for (i = 0; i < n; i++) \
+        acc |= dst[i] = cum[i] - prev[i]; \
+    return acc;
+#endif
+
+#ifdef FK_SSE2
+// SSE2 has no unsigned max: compare with the sign bits flipped and select
+#define PEAK_BODY(N) \
+    const __m128i flip = _mm_set1_epi32((int)0x80000000); \
+    __m128i vmax = flip, v, gt; \
+    size_t i, n = (N), n4 = n & ~(size_t)3; \
+    unsigned int m; \
+    for (i = 0; i < n4; i += 4) \
+    { \
+        v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(counts + i)), flip); \
+        gt = _mm_cmpgt_epi32(v, vmax); \
+        vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax)); \
+    } \
+    v = _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)); \
+    gt = _mm_cmpgt_epi32(v, vmax); \
+    vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax)); \
+    v = _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)); \
+    gt = _mm_cmpgt_epi32(v, vmax); \
+    vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax)); \
+    m = (unsigned int)_mm_cvtsi128_si32(vmax) ^ 0x80000000u; \
+    for (; i < n; i++) \
+        if (counts[i] > m) \
+            m = counts[i]; \
+    return m;
+#else
+#define PEAK_BODY(N) \
+    size_t i, n = (N); \
+    unsigned int m = 0; \
+    for (i = 0; i < n; i++) \
+        if (counts[i] > m) \
+            m = counts[i]; \
+    return m;
+#endif
+
+
+static void gather_any(unsigned int* dst, const unsigned int* src, const int* chans, size_t stride, size_t start,
+    int rows, int bins)
+{
+    GATHER_BODY(rows, bins)
+}
+
+static unsigned long long sum_any(const unsigned int* counts, int rows, int bins)
+{
+    SUM_BODY((size_t)rows * bins)
+}
+
+static unsigned int diff_any(unsigned int* dst, const unsigned int* cum, const unsigned int* prev, int rows, int bins)
+{
+    DIFF_BODY((size_t)rows * bins)
+}
+
+static unsigned int peak_any(const unsigned int* counts, int rows, int bins)
+{
+    PEAK_BODY((size_t)rows * bins)
+}
+
+static const framekern_t generic = { 0, 0, gather_any, sum_any, diff_any, peak_any };
+
+
+#define FK_DEFINE(R, B) \
+    static void gather_##R##x##B(unsigned int* dst, const unsigned int* src, const int* chans, size_t stride, \
+        size_t start, int rows, int bins) \
+    { \
+        (void)rows; (void)bins; \
+        GATHER_BODY(R, B) \
+    } \
+    static unsigned long long sum_##R##x##B(const unsigned int* counts, int rows, int bins) \
+    { \
+        (void)rows; (void)bins; \
+        SUM_BODY((size_t)(R) * (B)) \
+    } \
+    static unsigned int diff_##R##x##B(unsigned int* dst, const unsigned int* cum, const unsigned int* prev, \
+        int rows, int bins) \
+    { \
+        (void)rows; (void)bins; \
+        DIFF_BODY((size_t)(R) * (B)) \
+    } \
+    static unsigned int peak_##R##x##B(const unsigned int* counts, int rows, int bins) \
+    { \
+        (void)rows; (void)bins; \
+        PEAK_BODY((size_t)(R) * (B)) \
+    }
+
+#define FK_ENTRY(R, B) { R, B, gather_##R##x##B, sum_##R##x##B, diff_##R##x##B, peak_##R##x##B },
+
+FK_GEOMETRIES(FK_DEFINE)
+
+static const framekern_t special[] = { FK_GEOMETRIES(FK_ENTRY) };
+
+
+const framekern_t* fk_select(int rows, int bins)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(special) / sizeof(special[0])); i++)
+        if (special[i].rows == rows && special[i].bins == bins)
+            return &special[i];
+    return &generic;
+}
+
+const framekern_t* fk_generic(void)
+{
+    return &generic;
+}
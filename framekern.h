@@ -0,0 +1,46 @@
+/************************************************************************
+
+  Per-frame kernels specialized for the common frame geometries
+
+  The frame geometry (channel rows x bins per row) is a runtime setting,
+  but the work done on every frame (gathering the selected rows out of
+  the device histograms, summing the counts, the frame difference of a
+  differential readout, the peak bin) runs fastest when the compiler knows the sizes.
+  fk_select returns a set of kernels compiled
+  for exactly that geometry if it is one of FK_GEOMETRIES, else the
+  generic versions that take the sizes as arguments. The kernels of a
+  set always accept the rows and bins arguments, specialized ones
+  ignore them.
+
+************************************************************************/
+
+#ifndef FRAMEKERN_H
+#define FRAMEKERN_H
+
+#include <stddef.h>
+
+
+// the geometries that get their own kernels: MultiHarp channel counts
+// at the usual histogram lengths, you can add to this
+#define FK_GEOMETRIES(X) \
+    X(4, 1024) X(4, 4096) X(8, 1024) X(8, 4096) X(16, 1024) X(16, 4096) \
+    X(16, 16384) X(16, 65536) X(32, 1024) X(32, 4096) X(64, 1024) X(64, 4096)
+
+typedef struct framekern {
+    int rows, bins;         // geometry of the specialization, 0 = generic kernels
+    // copies bins counts from src + chans[r] * stride + start to row r of dst, for every row
+    void (*gather)(unsigned int* dst, const unsigned int* src, const int* chans, size_t stride, size_t start,
+        int rows, int bins);
+    // total of all counts of a frame
+    unsigned long long (*sum)(const unsigned int* counts, int rows, int bins);
+    // dst = cum - prev over the frame, returns the OR of all differences (a bound of the largest)
+    unsigned int (*diff)(unsigned int* dst, const unsigned int* cum, const unsigned int* prev, int rows, int bins);
+    // largest count of a frame
+    unsigned int (*peak)(const unsigned int* counts, int rows, int bins);
+} framekern_t;
+
+
+const framekern_t* fk_select(int rows, int bins);
+const framekern_t* fk_generic(void);
+
+#endif
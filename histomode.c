@@ -1,7 +1,8 @@
 /************************************************************************
 
   Demo access to MultiHarp 150/160 hardware via MHLIB v 4.0
-  The program performs a measurement based on hardcoded settings.
+  The program performs a measurement based on the settings in config.h,
+  which can be changed at runtime (histomode -h).
   The resulting histogram is stored in an ASCII output file.
 
   Michael Wahl, PicoQuant GmbH, January 2025
@@ -35,105 +36,479 @@
 #include "mhdefin.h"
 #include "mhlib.h"
 #include "errorcodes.h"
+#include "pipeline.h"
+#include "acquire.h"
+#include "t3stream.h"
+#include "t2corr.h"
+#include "evfilter.h"
+#include "rtmode.h"
+#include "multidev.h"
+#include "config.h"
+#include "jobsock.h"
 
 
-#define NUMDET 16
-#define NUMBIN 4096
-#define NUMREP 100
-#define ACQTIME 100 // in ms
-#define FILEDATA "FileData.dat"
-#define FILETIME "FileTime.txt"
 #define HEADLEN	256
 
+// the file name base, with _serial before the extension if tagged
+static void filename(char* name, const char* base, const char* serial, int tagged)
+{
+    const char* ext = strrchr(base, '.');
+
+    if (!tagged)
+        strcpy(name, base);
+    else if (ext == NULL || strpbrk(ext, "/\\") != NULL)
+        sprintf(name, "%s_%s", base, serial);
+    else
+        sprintf(name, "%.*s_%s%s", (int)(ext - base), base, serial, ext);
+}
 
-unsigned int counts[NUMDET][NUMBIN];
+// prints the sync and count rates of a device from its telemetry snapshot, or
+// from one MH_GetAllCountRates call without telemetry; warnings may be NULL
+static int showrates(devrun_t* d, int nchannels, int* warnings)
+{
+    telesnap_t s;
+    int i;
 
-//AP initialise memory for histogram
-//unsigned int** counts; // counts[rep] -> flat array of [NUMDET * NUMBIN]
+    if (d->acq.tele)
+    {
+        if (tele_read(d->acq.tele, &s) < 0) return -1;
+    }
+    else if (APICALL(MH_GetAllCountRates(d->devidx, &s.syncrate, s.rates)) < 0) return -1;
+    printf("\nDevice %s Syncrate=%1d/s", d->serial, s.syncrate);
+    for (i = 0; i < nchannels; i++) // for all channels
+        printf("\nCountrate[%1d]=%1d/s", i, s.rates[i]);
+    if (warnings == NULL)
+        return 0;
+    // after getting the count rates you can check for warnings
+    if (d->acq.tele)
+        *warnings = s.warnings;
+    else if (APICALL(MH_GetWarnings(d->devidx, warnings)) < 0) return -1;
+    return 0;
+}
+
+// the sync, input and timing settings that may change between runs, through
+// the device state cache: only what differs from the device goes to it
+static int applysettings(devrun_t* d, const mhconfig_t* cfg)
+{
+    int i;
+
+    if (ds_syncdiv(&d->state, cfg->syncdiv) < 0) return -1;
+    if (ds_syncedge(&d->state, cfg->synclevel, cfg->syncedge) < 0) return -1;
+    if (ds_syncoffset(&d->state, cfg->syncoffset) < 0) return -1;
+    for (i = 0; i < d->acq.sel.numchannels; i++) // we use the same input settings for all channels
+    {
+        if (ds_inputedge(&d->state, i, cfg->inputlevel, cfg->inputedge) < 0) return -1;
+        if (ds_inputoffset(&d->state, i, cfg->inputoffset) < 0) return -1;
+    }
+    if (ds_binning(&d->state, cfg->binning) < 0) return -1;
+    if (ds_offset(&d->state, cfg->offset) < 0) return -1;
+    return 0;
+}
 
-// helper macro and associated function for API calls with error check
-// the stringize operator # makes a printable string from the macro's input argument
-#define APICALL(call) doapicall(call, #call, __LINE__)
-int doapicall(int retcode, char* callstr, int line)
+// ms from tasked, when the run was asked for, to the first MH_StartMeas of the device
+static double startlatency(const devrun_t* d, double tasked)
 {
-    if (retcode < 0)
+    if (d->mode == MODE_T3)
+        return d->t3stats.tstart - tasked;
+    if (d->mode == MODE_T2)
+        return d->t2stats.tstart - tasked;
+    return d->stats.frames > 0 ? d->tstarts[0] - tasked : 0;
+}
+
+// frames of the last run, whatever the mode
+static int runframes(const devrun_t* d)
+{
+    return d->mode == MODE_T3 ? d->t3stats.frames : d->mode == MODE_T2 ? d->t2stats.frames : d->stats.frames;
+}
+
+static double runwallms(const devrun_t* d)
+{
+    return d->mode == MODE_T3 ? d->t3stats.wallms : d->mode == MODE_T2 ? d->t2stats.wallms : d->stats.wallms;
+}
+
+// one line of the run log: the setup before the run, then what the run did
+static void logrun(devrun_t* d, const char* run, double setupms, double startms, const char* line)
+{
+    double resolution = d->mode == MODE_T2 ? d->t2.resolution : d->state.resolution;
+
+    if (d->fpruns == NULL)
+        return;
+    fprintf(d->fpruns, "%s\t%1.3f\t%1.3f\t%d\t%d\t%1.3f\t%1.1f\t%d\t%1.1f\t%s\n", run, setupms, startms,
+        d->state.calls, d->state.saved, d->state.ms, resolution, runframes(d), runwallms(d), line);
+    fflush(d->fpruns);
+}
+
+// waits for the next job of a client and returns it in job, tasked is when it
+// came in; NULL once a client sent quit. Jobs that are no run get an error back.
+static cfgrun_t* nextjob(jobsock_t* js, const mhconfig_t* base, cfgrun_t* job, double* tasked)
+{
+    char line[JOB_MAXLINE];
+    char why[CFG_MAXPATH + 8];
+    char* p;
+
+    for (;;)
+    {
+        if (jobsock_accept(js) < 0)
+        {
+            printf("\ncannot take jobs from %s", base->serve);
+            return NULL;
+        }
+        *tasked = mh_timems();
+        if (jobsock_readline(js, line, sizeof(line)) < 0)
+        {
+            jobsock_hangup(js); // connected and went away
+            continue;
+        }
+        if ((p = strchr(line, '#')) != NULL)
+            *p = 0;
+        for (p = line + strlen(line); p > line && (p[-1] == ' ' || p[-1] == '\t'); p--)
+            p[-1] = 0;
+        for (p = line; *p == ' ' || *p == '\t'; p++)
+            ;
+        if (strcmp(p, "quit") == 0)
+        {
+            jobsock_write(js, "done quit\n");
+            jobsock_hangup(js);
+            return NULL;
+        }
+        strcpy(why, "error ");
+        if (cfg_runline(base, p, job, why + 6, (int)sizeof(why) - 8) == 0)
+            return job;
+        strcat(why, "\n");
+        jobsock_write(js, why);
+        jobsock_hangup(js);
+    }
+}
+
+// opens the output files of one device, tagged with its serial number if
+// several devices run, and hands them to the device's frame pipeline;
+// frames hold rows x bins counts, full = every channel at NUMBIN bins,
+// resolution is the bin width in ps
+static int openoutput(devrun_t* d, const mhconfig_t* cfg, int tagged, int rows, int bins, int full, double resolution)
+{
+    char name[CFG_MAXPATH + 32];
+    FILE* fp;
+    int compress = cfg->compress, mapped = cfg->mapped;
+    int gates[REDUCE_MAXGATES][2];
+    int ngates = reduce_parsegates(cfg->gates, gates, REDUCE_MAXGATES); // checked in main
+    int reduced = cfg->rebin > 1 || ngates > 0 || cfg->accumulate;
+    int outbins = bins;
+
+    if (reduced)
+    {
+        if (reduce_open(&d->reduce, rows, bins, cfg->rebin, ngates, gates, cfg->accumulate) < 0) {
+            printf("\ncannot set up the frame reduction\n"); return -1;
+        }
+        outbins = d->reduce.outbins;
+    }
+    filename(name, cfg->timefile, d->serial, tagged);
+    if ((d->fptime = fopen(name, "w")) == NULL) {
+        printf("\ncannot open timing file %s\n", name); return -1;
+    }
+	fprintf(d->fptime,"Run\tStart\tEnd1\tDelta(ms)%s%s%s\n", d->acq.target ? "\tTacq(ms)\tMeasured(ms)\tPeak\tDecision" : "",
+        cfg->telemetry ? "\tTele\tSync\tRate\tFlags\tWarnings" : "", cfg->trigger != MEASCTRL_SINGLESHOT_CTC ? "\tDevStart(ps)" : "");
+    if (cfg->trace && d->mode == MODE_HIST)
+    {
+        filename(name, cfg->tracefile, d->serial, tagged);
+        if ((d->fptrace = fopen(name, "w")) == NULL) {
+            printf("\ncannot open trace file %s\n", name); return -1;
+        }
+        d->acq.trace = &d->trace; // timestamps go to memory during the run, to the file after it
+    }
+    if (cfg->moments)
+    {
+        filename(name, cfg->momentsfile, d->serial, tagged);
+        if ((d->fpmoments = fopen(name, "w")) == NULL) {
+            printf("\ncannot open moments file %s\n", name); return -1;
+        }
+    }
+    if (cfg->script[0] || cfg->serve[0])
+    {
+        filename(name, cfg->runlog, d->serial, tagged);
+        if ((d->fpruns = fopen(name, "w")) == NULL) {
+            printf("\ncannot open run log %s\n", name); return -1;
+        }
+        fprintf(d->fpruns, "Run\tSetup(ms)\tStart(ms)\tCalls\tSaved\tCalls(ms)\tResolution(ps)\tFrames\tWall(ms)\tSettings\n");
+    }
+    if (d->mode == MODE_T2)
+    {
+        // the frames hold lag bins, this says which lag each one is
+        filename(name, cfg->lagfile, d->serial, tagged);
+        if ((fp = fopen(name, "w")) == NULL) {
+            printf("\ncannot open lag file %s\n", name); return -1;
+        }
+        t2_writelags(&d->t2, fp);
+        fclose(fp);
+    }
+    if (cfg->telemetry)
+    {
+        filename(name, cfg->telefile, d->serial, tagged);
+        if ((d->fptele = fopen(name, "w")) == NULL) {
+            printf("\ncannot open telemetry file %s\n", name); return -1;
+        }
+    }
+    filename(name, cfg->datafile, d->serial, tagged);
+    if ((d->fpout = fopen(name, "wb")) == NULL){
+        printf("\ncannot open output file %s\n", name); return -1;
+    }
+    short ver_0 = - 2;
+    short ver_1 = 0;
+    short ver_sub = compress || !full || reduced ? 3 : 1; // 3: frame geometry and codec in the header
+    int sizeheader = HEADLEN; // 4 bytes everywhere, a long is 8 on Linux and shifted the header
+    unsigned long long mask = d->mode == MODE_T3 ? d->t3.chanmask : d->mode == MODE_T2 ? 0 : d->acq.sel.chanmask; // T2 rows are pairs
+    int info[8] = { compress ? CODEC_PACK : CODEC_NONE, rows, outbins, CODEC_KEYINT, // codec, rows, bins per row
+        d->mode == MODE_T3 ? d->t3.roistart : d->acq.sel.roistart, d->acq.sel.histlen, // first bin, device histogram length
+        (int)(mask & 0xFFFFFFFF), (int)(mask >> 32) }; // stored channels, bit i = channel i
+    int red[4 + 2 * REDUCE_MAXGATES] = { 0 }; // rebin, gates, accumulate, bins before reduction, gates
+    char zero[HEADLEN] = { 0 };
+    mhfhead_t h;
+    int i, row = 0;
+    if (reduced)
+    {
+        red[0] = d->reduce.rebin;
+        red[1] = ngates;
+        red[2] = cfg->accumulate;
+        red[3] = bins;
+        memcpy(red + 4, gates, ngates * sizeof(gates[0]));
+    }
+    if (cfg->container)
     {
-        char errorstring[100] = { 0 };
-        MH_GetErrorString(errorstring, retcode);
-        printf("\nThe API call %s at line %d\nreturned error %d (%s)\n", callstr, line, retcode, errorstring);
+        // version sub 4: the settings, channel map and, when closed, the frame index (mhfile.h)
+        memset(&h, 0, sizeof(h));
+        h.codec = info[0];
+        h.rows = rows;
+        h.bins = outbins;
+        h.keyint = info[3];
+        h.roistart = info[4];
+        h.histlen = info[5];
+        h.chanmask = mask;
+        h.rebin = red[0];
+        h.ngates = ngates;
+        h.accumulate = red[2];
+        h.inbins = red[3];
+        memcpy(h.gates, gates, ngates * sizeof(gates[0]));
+        h.mode = d->mode;
+        h.binning = cfg->binning;
+        h.offset = cfg->offset;
+        h.syncdiv = cfg->syncdiv;
+        h.tacq = cfg->tacq;
+        h.target = (int)cfg->target;
+        h.numchannels = d->acq.sel.numchannels;
+        h.resolution = resolution;
+        strncpy(h.serial, d->serial, sizeof(h.serial) - 1);
+        for (i = 0; i < 64; i++)
+            h.chans[i] = -1;
+        for (i = 0; i < 64 && row < rows; i++)
+            if ((mask >> i) & 1)
+                h.chans[row++] = i;
+        if (mhf_open(&d->index, d->fpout, name, &h) < 0) {
+            printf("\ncannot write output file %s\n", name); return -1;
+        }
     }
-    return retcode;
+    else
+    {
+        fwrite(&ver_0, sizeof(short), 1, d->fpout);
+        fwrite(&ver_1, sizeof(short), 1, d->fpout);
+        fwrite(&ver_sub, sizeof(short), 1, d->fpout);
+        fwrite(&sizeheader, sizeof(int), 1, d->fpout);
+        if (ver_sub == 3)
+        {
+            fwrite(info, sizeof(int), 8, d->fpout);
+            fwrite(red, sizeof(int), 4 + 2 * REDUCE_MAXGATES, d->fpout); // all zero if not reduced
+            fwrite(zero, sizeof(char), HEADLEN-2-2-2-4-32-sizeof(red), d->fpout);
+        }
+        else
+            fwrite(zero, sizeof(char), HEADLEN-2-2-2-4, d->fpout);
+    }
+
+    if (mapped)
+    {
+        // frames go straight into the mapped file behind the header, stdio is done with it
+        long headlen = ftell(d->fpout);
+        fclose(d->fpout);
+        d->fpout = NULL;
+        if (mapout_open(&d->map, name, headlen, (size_t)rows * bins * sizeof(unsigned int)) < 0) {
+            printf("\ncannot map output file %s\n", name); return -1;
+        }
+    }
+
+    // all frame buffers are allocated up front, the writer thread owns the files from here
+    if (pipe_open(&d->pipe, cfg->numbuf, rows, bins, d->fpout, d->fptime, cfg->hugepages) < 0) {
+        printf("\ncannot allocate frame buffers\n"); return -1;
+    }
+    if (cfg->hugepages)
+        printf("\nFrame buffers on %s", d->pipe.hugebytes ? "huge pages" : "normal pages, no huge pages reserved (vm.nr_hugepages)");
+    d->pipe.stamps = cfg->trigger != MEASCTRL_SINGLESHOT_CTC;
+    if (mapped)
+        d->pipe.map = &d->map;
+    if (reduced)
+        d->pipe.reduce = &d->reduce;
+    if (cfg->container)
+        d->pipe.index = &d->index;
+    if (cfg->moments)
+    {
+        if (moments_open(&d->moments, rows, bins, mask, resolution, info[4], d->fpmoments, cfg->live) < 0) {
+            printf("\ncannot allocate moments buffers\n"); return -1;
+        }
+        d->pipe.moments = &d->moments;
+    }
+    if (cfg->publish)
+    {
+        filename(name, cfg->shmname, d->serial, tagged);
+        if (shmring_create(&d->ring, name, cfg->shmslots, rows, bins, mask, resolution, info[4]) < 0) {
+            printf("\ncannot create shared memory %s\n", name); return -1;
+        }
+        d->pipe.publish = &d->ring;
+    }
+    if (compress)
+    {
+        if (codec_open(&d->codec, rows, outbins, CODEC_KEYINT) < 0) {
+            printf("\ncannot allocate codec buffers\n"); return -1;
+        }
+        d->pipe.codec = &d->codec;
+    }
+    return 0;
 }
 
 
 int main(int argc, char* argv[])
 {
 
-    //AP: for timing
-    LARGE_INTEGER freq, t_start, t_end;
-    QueryPerformanceFrequency(&freq); // get frequency once
-    struct Timimg {
-		LARGE_INTEGER start;
-		LARGE_INTEGER end1;
-		LARGE_INTEGER end2;
-		LARGE_INTEGER end3;
-		double delta1;
-	} t;
- 
-
-	//AP: allocate memory for histogram
-    //counts = (unsigned int**)malloc(NUMREP * sizeof(unsigned int*));
-    //if (counts == NULL) {
-    //    printf("Memory allocation for counts pointers failed.\n");
-    //    return 1;
-    //}
-
-    //for (int r = 0; r < NUMREP; r++) {
-    //    counts[r] = (unsigned int*)malloc(NUMDET * NUMBIN * sizeof(unsigned int));
-    //    if (counts[r] == NULL) {
-    //        printf("Memory allocation for counts[%d] failed.\n", r);
-    //        return 1;
-    //    }
-    //}
-
-    int dev[MAXDEVNUM];
+    devrun_t devs[MAXDEVNUM];
     int found = 0;
-    FILE* fpout = NULL;
-    FILE* fptime = NULL;
+    mhconfig_t cfg; // all settings, defaults in config.c, see histomode -h
+    acqopts_t acqopts;
+    ctcwait_t ctcwait = CTCWAIT_DEFAULT; // see ctcwait_t for the wait strategy
+    t3opts_t t3opts = { 0 };
+    t2opts_t t2opts = { 0 };
+    evfopts_t evfopts = { 0 };
+    evfcal_t evfcal;
+    int Rows, Full;
+    cfgrun_t* runs = NULL; // the script, if any
+    int nruns = 0, run;
+    cfgrun_t job;
+    cfgrun_t* cur; // the settings of the run, NULL = interactive
+    jobsock_t js;
+    char reply[JOB_MAXLINE];
+    char why[CFG_MAXPATH];
+    double tlaunch = mh_timems(), tasked = 0, setupms;
+    int prevdiv, prevbin, resync;
+    int Gates[REDUCE_MAXGATES][2]; // only checked here, openoutput reads them again
+    devrun_t* d;
     int retcode;
-    int ctcstatus;
     char LIB_Version[8];
     char HW_Model[32];
     char HW_Partno[8];
     char HW_Version[16];
-    char HW_Serial[32];
     char Errorstring[40];
     char debuginfobuffer[16384]; // must have 16384 bytes of text buffer
     int NumChannels;
     int HistLen;
-    int Binning = 0; // you can change this
-    int Offset = 0;
-    int Tacq = 1000; // measurement time in millisec, you can change this
-    int SyncDivider = 1; // you can change this
-
-    int SyncTiggerEdge = 0;      // 0 or 1, you can change this
-    int SyncTriggerLevel = -50;  // in mV,  you can change this
-    int InputTriggerEdge = 0;    // 0 or 1, you can change this
-    int InputTriggerLevel = -50; // in mV,  you can change this
+    int Bins = 0; // per row, set with the resolution
+    int BinSteps;
+    int RefSource;
+    autorange_t Auto;
+    int fixedlen, askbinning; // the bins and binning configured, what autorange starts from
+    int Features;
 
     double Resolution;
-    int Syncrate;
-    int Countrate;
     double Integralcount;
     int i, j;
-    int flags;
     int warnings;
     char warningstext[16384]; // must have 16384 bytes of text buffer
     char cmd = 0;
 
+    memset(devs, 0, sizeof(devs));
+    memset(&acqopts, 0, sizeof(acqopts));
+    acqopts.numrep = NUMREP;
+    acqopts.tacq = ACQTIME;
+    acqopts.wait = ctcwait;
+    jobsock_init(&js); // closed on every way out, serving or not
     memset(Errorstring, 0x00, sizeof(Errorstring));
     memset(warningstext, 0x00, sizeof(warningstext));
 
+    cfg_defaults(&cfg);
+    if ((retcode = cfg_args(&cfg, argc, argv)) != 0)
+        return retcode < 0 ? 1 : 0;
+    if (cfg.numrep < 1 || cfg.tacq < 1 || cfg.numbuf < 1 || cfg.workers < 1 || cfg.workers > T3MAXWORKERS)
+    {
+        printf("\nnumrep, tacq, numbuf and workers (up to %d) must be positive.\n", T3MAXWORKERS);
+        return 1;
+    }
+    if (cfg.target && (cfg.diffread || cfg.mode != MODE_HIST || cfg.tmin < 1 || cfg.tmax < cfg.tmin))
+    {
+        printf("\nAdaptive frames (target) need histogram mode without diffread and 1 <= tmin <= tmax.\n");
+        return 1;
+    }
+    if (cfg.trigger != MEASCTRL_SINGLESHOT_CTC && (cfg.mode != MODE_HIST || cfg.diffread || cfg.target))
+    {
+        printf("\nTriggered frames need histogram mode without diffread and target.\n");
+        return 1;
+    }
+    if (cfg.telemetry && cfg.mode != MODE_HIST)
+    {
+        printf("\nTelemetry needs histogram mode, the T2 and T3 loops read the flags themselves.\n");
+        return 1;
+    }
+    if (cfg.mode == MODE_T2 && (cfg.workers > T2MAXWORKERS || cfg.moments
+        || (t2opts.npairs = t2_parsepairs(cfg.pairs, t2opts.pairs, T2MAXPAIRS)) < 1))
+    {
+        printf("\nT2 needs pairs a:b,... (up to %d), up to %d workers and no moments.\n", T2MAXPAIRS, T2MAXWORKERS);
+        return 1;
+    }
+    if (cfg.autorange && (cfg.mode == MODE_T2 || cfg.autobins < 1 || cfg.autobins > MAXHISTLEN))
+    {
+        printf("\nautorange needs histogram or T3 mode and 1 <= autobins <= %d.\n", MAXHISTLEN);
+        return 1;
+    }
+    if (cfg.rt && (cfg.rtprio < 1 || cfg.rtprio > 99))
+    {
+        printf("\nrtprio must be 1..99.\n");
+        return 1;
+    }
+    if ((cfg.filter != EVF_OFF || cfg.filtercal) && cfg.mode == MODE_HIST)
+    {
+        printf("\nEvent filters need mode t2 or t3.\n");
+        return 1;
+    }
+    if (reduce_parsegates(cfg.gates, Gates, REDUCE_MAXGATES) < 0)
+    {
+        printf("\ngates must be start:length,... with up to %d gates.\n", REDUCE_MAXGATES);
+        return 1;
+    }
+    if (cfg.script[0] && cfg.serve[0])
+    {
+        printf("\nThe runs come either from a script or from clients (serve).\n");
+        return 1;
+    }
+    if (cfg.script[0] && (nruns = cfg_script(&cfg, cfg.script, &runs)) < 0)
+    {
+        printf("\n");
+        return 1;
+    }
+    acqopts.numrep = t3opts.numrep = t2opts.numrep = cfg.numrep;
+    acqopts.tacq = t3opts.tacq = t2opts.tacq = cfg.tacq;
+    acqopts.wait.spin = cfg.spin;
+    acqopts.diff = cfg.diffread;
+    acqopts.target = cfg.target;
+    acqopts.tmin = cfg.tmin;
+    acqopts.tmax = cfg.tmax;
+    acqopts.stamp = cfg.container;
+    acqopts.trigger = cfg.trigger;
+    acqopts.trigtimeout = cfg.trigtimeout;
+    acqopts.trigperiod = cfg.trigperiod / 1000.0;
+    t3opts.nworkers = cfg.workers;
+    t3opts.cut = cfg.cut;
+    t3opts.markermask = cfg.markermask; // rows and bins follow the channel and bin selection
+    t2opts.nworkers = cfg.workers;
+    t2opts.scale = cfg.lagscale;
+    evfopts.preset = cfg.filter;
+    evfopts.chans = cfg.filterchans;
+    evfopts.pass = cfg.filterpass;
+    evfopts.sync = cfg.filtersync;
+    evfopts.range = cfg.filterrange;
+    evfopts.match = cfg.filtermatch;
+
     printf("\nMultiHarp MHLib Demo Application                   PicoQuant GmbH, 2025");
     printf("\n~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
 
@@ -143,198 +518,437 @@ int main(int argc, char* argv[])
     if (strncmp(LIB_Version, LIB_VERSION, sizeof(LIB_VERSION)) != 0)
         printf("\nWarning: The application was built for version %s.", LIB_VERSION);
 
-    // Init File
-    if ((fptime = fopen(FILETIME, "w")) == NULL) {
-        printf("\ncannot open timing file\n"); goto ex;
-    }
-	fprintf(fptime,"Run\tStart\tEnd1\tDelta(ms)\n");
-    if ((fpout = fopen(FILEDATA, "wb")) == NULL){
-        printf("\ncannot open output file\n"); goto ex;
-    }
-    short ver_0 = - 2;
-    short ver_1 = 0;
-    short ver_sub = 1;
-	char subheader = 0;
-	long sizeheader = 256;
-    char zero = 0;
-    fwrite(&ver_0, sizeof(short), 1, fpout);
-    fwrite(&ver_1, sizeof(short), 1, fpout);
-    fwrite(&ver_sub, sizeof(short), 1, fpout);
-    fwrite(&sizeheader, sizeof(long), 1, fpout);
-    fwrite(&zero, sizeof(char), HEADLEN-2-2-2-4, fpout);
-
 
     printf("\nSearching for MultiHarp devices...");
-    printf("\nDevidx     Serial     Status");
+    found = multi_open(devs, cfg.serials); // all indices probed at once
 
-    for (i = 0; i < MAXDEVNUM; i++)
-    {
-        memset(HW_Serial, 0, sizeof(HW_Serial));
-        retcode = MH_OpenDevice(i, HW_Serial); // not using APICALL here as fails must be expected
-        if (retcode == 0) // grab any device we can open
-        {
-            printf("\n  %1d        %7s    open ok", i, HW_Serial);
-            dev[found] = i; // keep index to device(s) we want to use
-            found++;
-        }
-        else
-        {
-            if (retcode == MH_ERROR_DEVICE_OPEN_FAIL)
-                printf("\n  %1d        %7s    no device", i, HW_Serial);
-            else
-            {
-                MH_GetErrorString(Errorstring, retcode);
-                printf("\n  %1d        %7s    %s", i, HW_Serial, Errorstring);
-            }
-        }
-    }
 
-
-    // In this demo we will use the first device we find, i.e. dev[0].
-    // You could also use multiple devices in parallel.
-    // You can also check for specific serial numbers, so that you know 
-    // which physical device you are talking to.
+    // In this demo we use every device we find, each with its own
+    // acquisition thread and output files (see multidev.h).
+    // With serials=... only the devices with those serial numbers are
+    // used, so that you know which physical device you are talking to.
 
     if (found < 1)
     {
         printf("\nNo device available."); goto ex;
     }
+    if (cfg.compress && cfg.mapped) // compressed frames have no fixed place in the file
+    {
+        printf("\nMapped output needs uncompressed frames."); goto ex;
+    }
+    if (cfg.mapped && (cfg.rebin > 1 || cfg.gates[0] || cfg.accumulate)) // the mapped file holds the frames as read
+    {
+        printf("\nMapped output needs unreduced frames."); goto ex;
+    }
+    if (cfg.trigger != MEASCTRL_SINGLESHOT_CTC && found > 1 && cfg.align != ALIGN_NONE)
+    {
+        if (cfg.align == ALIGN_WR)
+        {
+            printf("\nWhite Rabbit alignment and triggered frames both need the measurement control."); goto ex;
+        }
+        cfg.align = ALIGN_NONE; // the trigger starts all devices together
+    }
 
-    printf("\nUsing device #%1d", dev[0]);
-    printf("\nInitializing the device...");
+    printf("\n\nInitializing the devices...");
     fflush(stdout);
-
-    if (APICALL(MH_Initialize(dev[0], MODE_HIST, 0)) < 0) // Histo mode with internal clock
+    setupms = mh_timems();
+    for (j = 0; j < found; j++)
+    {
+        d = &devs[j];
+        d->mode = cfg.mode; // Histo, T2 or T3 mode
+        // White Rabbit alignment: the first device is the master, the others follow it
+        RefSource = REFSRC_INTERNAL;
+        if (cfg.align == ALIGN_WR && found > 1)
+            RefSource = j == 0 ? REFSRC_WR_MASTER_MHARP : REFSRC_WR_SLAVE_MHARP;
+        d->refsource = RefSource;
+    }
+    if (multi_init(devs, found, cfg.align) < 0) // all at once
     {
-        // in case of an obscure error (a hardware error in particular) 
-        // it may be helpful to obtain debug information like so:
-        MH_GetDebugInfo(dev[0], debuginfobuffer);
-        printf("\nDEBUGINFO:\n%s", debuginfobuffer);
+        for (j = 0; j < found; j++)
+            if (devs[j].ret < 0)
+            {
+                // in case of an obscure error (a hardware error in particular) 
+                // it may be helpful to obtain debug information like so:
+                MH_GetDebugInfo(devs[j].devidx, debuginfobuffer);
+                printf("\nDEBUGINFO of device %s:\n%s", devs[j].serial, debuginfobuffer);
+            }
         goto ex;
     }
+    printf(" %1.1f ms", mh_timems() - setupms);
 
-    if (APICALL(MH_GetHardwareInfo(dev[0], HW_Model, HW_Partno, HW_Version)) < 0) goto ex;
-    else printf("\nFound Model %s Part no %s Version %s", HW_Model, HW_Partno, HW_Version);
-    if (APICALL(MH_GetNumOfInputChannels(dev[0], &NumChannels)) < 0) goto ex;
-    else printf("\nDevice has %i input channels.", NumChannels);
-    if (APICALL(MH_SetSyncDiv(dev[0], SyncDivider)) < 0) goto ex;
-    if (APICALL(MH_SetSyncEdgeTrg(dev[0], SyncTriggerLevel, SyncTiggerEdge)) < 0) goto ex;
-    if (APICALL(MH_SetSyncChannelOffset(dev[0], 0)) < 0) goto ex;
+    fixedlen = cfg.roilen;
+    askbinning = cfg.binning;
+    for (j = 0; j < found; j++)
+    {
+        d = &devs[j];
+        d->acq = acqopts;
+        d->t3 = t3opts;
+        d->t2 = t2opts;
+        d->rt.enable = cfg.rt;
+        d->rt.cpu = cfg.rtcpu >= 0 ? cfg.rtcpu + j : mh_numcpus() - 1 - j % mh_numcpus(); // the last cores see the fewest interrupts
+        d->rt.priority = cfg.rtprio;
+
+        printf("\n\nUsing device #%1d (serial %s)", d->devidx, d->serial);
+        setupms = mh_timems();
+        ds_init(&d->state, d->devidx, cfg.setcache); // Initialize has reset every setting
+        if (cfg.align == ALIGN_WR && found > 1)
+            if (APICALL(MH_SetMeasControl(d->devidx, MEASCTRL_WR_M2S, EDGE_RISING, EDGE_RISING)) < 0) goto ex;
+        if (cfg.trigger != MEASCTRL_SINGLESHOT_CTC) // frames started, gated or stopped by C1 and C2
+            if (APICALL(MH_SetMeasControl(d->devidx, cfg.trigger, cfg.trigstart, cfg.trigstop)) < 0) goto ex;
+
+        if (APICALL(MH_GetHardwareInfo(d->devidx, HW_Model, HW_Partno, HW_Version)) < 0) goto ex;
+        else printf("\nFound Model %s Part no %s Version %s", HW_Model, HW_Partno, HW_Version);
+        if (APICALL(MH_GetNumOfInputChannels(d->devidx, &NumChannels)) < 0) goto ex;
+        else printf("\nDevice has %i input channels.", NumChannels);
+        d->acq.sel.numchannels = NumChannels;
+        if (applysettings(d, &cfg) < 0) goto ex;
+        if (cfg.autorange)
+        {
+            // no bins beyond the sync period: they stay empty but would be read, stored and written
+            Sleep(150); // the sync period comes from the rate meter, valid 100 ms after init and the divider
+            if (acq_autorange(d->devidx, askbinning, cfg.offset, cfg.autobins, &Auto) < 0) goto ex;
+            if (Auto.bins < 1)
+            {
+                printf("\nNo sync period to fit the histogram to, or offset %d ns lies beyond it.", cfg.offset); goto ex;
+            }
+            if (ds_binning(&d->state, Auto.binning) < 0) goto ex;
+            printf("\nSync period %1.0lf ps, from offset %d ns on %d bins of %1.0lf ps (binning %d)",
+                Auto.period, cfg.offset, Auto.bins, Auto.baseres * (1 << Auto.binning), Auto.binning);
+            cfg.binning = Auto.binning; // for the runs and jobs too
+            cfg.roistart = 0;
+            cfg.roilen = Auto.bins;
+        }
+        for (i = 0; i < NumChannels; i++) // channels outside the mask are switched off, they cost neither counts nor transfer
+            if (ds_inputenable(&d->state, i, (int)((cfg.chanmask >> i) & 1)) < 0) goto ex;
+        d->acq.sel.chanmask = NumChannels < 64 ? cfg.chanmask & ((1ULL << NumChannels) - 1) : cfg.chanmask;
+        d->acq.sel.roistart = cfg.roistart;
+        d->acq.sel.roilen = cfg.roilen;
+        d->acq.sel.mode = cfg.readmode;
+        if ((Rows = sel_rows(&d->acq.sel)) < 1 || cfg.roistart < 0 || cfg.roilen < 1)
+        {
+            printf("\nNo channels or bins selected."); goto ex;
+        }
+        Full = Rows == NumChannels && cfg.roistart == 0 && cfg.roilen == NUMBIN;
+
+        if (cfg.mode == MODE_HIST)
+        {
+            // the shortest histogram that covers the bins of interest, less to transfer
+            int lencode = 0;
+            while ((1024 << lencode) < cfg.roistart + cfg.roilen && lencode < MAXLENCODE) ++lencode;
+            if (ds_histolen(&d->state, lencode, &HistLen) < 0) goto ex;
+            printf("\nHistogram length is %d", HistLen);
+            if (cfg.roistart + cfg.roilen > HistLen)
+            {
+                printf("\nBins %d..%d are beyond the histogram length %d.", cfg.roistart, cfg.roistart + cfg.roilen - 1, HistLen);
+                goto ex;
+            }
+            d->acq.sel.histlen = HistLen;
+            if (Full && HistLen == NUMBIN)
+                d->acq.sel.roilen = 0; // everything, MH_GetAllHistograms reads straight into the frame
+            else if (acq_choosereadout(d->devidx, &d->acq.sel) < 0)
+                goto ex;
+        }
+        else if (cfg.mode == MODE_T2)
+        {
+            // T2 records carry the arrival times, the host correlates the pairs; rows are pairs, bins lags
+            if (APICALL(MH_GetBaseResolution(d->devidx, &d->t2.resolution, &BinSteps)) < 0) goto ex;
+            if ((Bins = t2_lags(&d->t2, cfg.lagwidth, cfg.lagmax)) < 0)
+            {
+                printf("\nlagwidth %d ps and lagmax %d ps give no lag bins or more than %d.", cfg.lagwidth, cfg.lagmax, T2MAXLAGS);
+                goto ex;
+            }
+            for (i = 0; i < d->t2.npairs; i++)
+                if (!((d->acq.sel.chanmask >> d->t2.pairs[i][0]) & 1) || !((d->acq.sel.chanmask >> d->t2.pairs[i][1]) & 1))
+                {
+                    printf("\nPair %d:%d has a channel the device does not have or chanmask leaves out.",
+                        d->t2.pairs[i][0], d->t2.pairs[i][1]);
+                    goto ex;
+                }
+            Rows = d->t2.npairs;
+            Full = 0;
+            d->acq.sel.roistart = 0;
+            d->acq.sel.histlen = 0;
+        }
+        else
+        {
+            // T3 records carry the dtime, the host histograms the selected range of it
+            HistLen = cfg.roistart + cfg.roilen;
+            d->t3.numdet = Rows;
+            d->t3.numbin = cfg.roilen;
+            d->t3.chanmask = d->acq.sel.chanmask;
+            d->t3.roistart = cfg.roistart;
+            d->acq.sel.histlen = HistLen;
+            if (t3opts.cut == T3CUT_MARKER)
+            {
+                if (APICALL(MH_SetMarkerEdges(d->devidx, EDGE_RISING, EDGE_RISING, EDGE_RISING, EDGE_RISING)) < 0) goto ex;
+                if (APICALL(MH_SetMarkerEnable(d->devidx, t3opts.markermask & 1, (t3opts.markermask >> 1) & 1,
+                    (t3opts.markermask >> 2) & 1, (t3opts.markermask >> 3) & 1)) < 0) goto ex;
+            }
+        }
+        if (cfg.filter != EVF_OFF)
+        {
+            // only the events the filter keeps cross the USB link
+            if (APICALL(MH_GetFeatures(d->devidx, &Features)) < 0) goto ex;
+            if (!(Features & FEATURE_EVNT_FILT))
+            {
+                printf("\nDevice %s has no event filter.", d->serial); goto ex;
+            }
+            if (evf_check(&evfopts, cfg.mode, NumChannels, why, sizeof(why)) < 0)
+            {
+                printf("\n%s", why); goto ex;
+            }
+            if (evf_apply(d->devidx, &evfopts, cfg.mode, NumChannels) < 0) goto ex;
+        }
+        if (cfg.mode == MODE_T2)
+        {
+            Resolution = d->t2.resolution;
+            printf("\nResolution is %1.0lfps\n", Resolution);
+            printf("\nStoring %d pairs x %d lag bins and the singles per frame", Rows, Bins - 2);
+        }
+        else
+        {
+            if (ds_resolution(&d->state, &Resolution) < 0) goto ex;
+            printf("\nResolution is %1.0lfps\n", Resolution);
+            printf("\nStoring %d channels x %d bins (from bin %d) per frame", Rows, cfg.roilen, cfg.roistart);
+            Bins = cfg.roilen;
+            if (cfg.autorange)
+                printf("\nFrames of %1.0lf bytes instead of %1.0lf: %1.0lf bytes (%1.1lf%%) saved per frame",
+                    4.0 * Rows * Bins, 4.0 * Rows * fixedlen, 4.0 * Rows * (fixedlen - Bins), 100.0 * (fixedlen - Bins) / fixedlen);
+        }
+        if (openoutput(d, &cfg, found > 1, Rows, Bins, Full, Resolution) < 0) goto ex;
+        logrun(d, "init", mh_timems() - setupms, mh_timems() - tlaunch, "");
+    }
 
-    for (i = 0; i < NumChannels; i++) // we use the same input settings for all channels
+    if (cfg.rt && rt_lockmemory(why, sizeof(why)) < 0) // the frame buffers exist and are touched
+        printf("\nReal time: %s, the memory stays pageable", why);
+
+    for (run = 0; cfg.autorange && run < nruns; run++)
     {
-        if (APICALL(MH_SetInputEdgeTrg(dev[0], i, InputTriggerLevel, InputTriggerEdge)) < 0) goto ex;
-        if (APICALL(MH_SetInputChannelOffset(dev[0], i, 0)) < 0) goto ex;
-        if (APICALL(MH_SetInputChannelEnable(dev[0], i, 1)) < 0) goto ex;
+        // the runs again from their keys, so that they take the binning chosen unless they set their own
+        job = runs[run];
+        if (cfg_runline(&cfg, job.line, &runs[run], why, sizeof(why)) < 0) goto ex;
     }
-    
-    int lencode = 0, x = NUMBIN / 1024;
-    while (x >>= 1) ++lencode;
-    if (APICALL(MH_SetHistoLen(dev[0], lencode, &HistLen)) < 0) goto ex;
-    printf("\nHistogram length is %d", HistLen);
-    if (APICALL(MH_SetBinning(dev[0], Binning)) < 0) goto ex;
-    if (APICALL(MH_SetOffset(dev[0], Offset)) < 0) goto ex;
-    if (APICALL(MH_GetResolution(dev[0], &Resolution)) < 0) goto ex;
-    printf("\nResolution is %1.0lfps\n", Resolution);
 
     // after Init allow 150 ms for valid  count rate readings
     // subsequently you get new values after every 100ms
     Sleep(150);
 
-    if (APICALL(MH_GetSyncRate(dev[0], &Syncrate)) < 0) goto ex;
-    printf("\nSyncrate=%1d/s", Syncrate);
-
-    for (i = 0; i < NumChannels; i++) // for all channels
+    for (j = 0; j < found; j++)
     {
-        if (APICALL(MH_GetCountRate(dev[0], i, &Countrate)) < 0) goto ex;
-        printf("\nCountrate[%1d]=%1d/s", i, Countrate);
-    }
+        d = &devs[j];
+        if (APICALL(MH_GetNumOfInputChannels(d->devidx, &NumChannels)) < 0) goto ex;
+        if (cfg.telemetry)
+        {
+            // from here on rates, warnings and flags come from the telemetry thread
+            if (tele_start(&d->tele, d->devidx, NumChannels, d->fptele) < 0) goto ex;
+            d->acq.tele = &d->tele;
+        }
+        if (showrates(d, NumChannels, &warnings) < 0) goto ex;
 
-    printf("\n");
+        printf("\n");
 
-    // after getting the count rates you can check for warnings
-    if (APICALL(MH_GetWarnings(dev[0], &warnings)) < 0) goto ex;
-    if (warnings)
-    {
-        if (APICALL(MH_GetWarningsText(dev[0], warningstext, warnings)) < 0) goto ex;
-        printf("\n\n%s", warningstext);
-    }
+        if (warnings)
+        {
+            if (APICALL(MH_GetWarningsText(d->devidx, warningstext, warnings)) < 0) goto ex;
+            printf("\n\n%s", warningstext);
+        }
 
-    if (APICALL(MH_SetStopOverflow(dev[0], 0, 10000)) < 0) goto ex;
+        if (cfg.mode == MODE_HIST)
+            if (APICALL(MH_SetStopOverflow(d->devidx, 0, 10000)) < 0) goto ex; // no stop, diffread relies on it; adaptive runs set their own
+        if (cfg.mode == MODE_T3)
+            if (APICALL(MH_GetSyncPeriod(d->devidx, &d->t3.syncperiod)) < 0) goto ex;
+        if (cfg.filtercal)
+        {
+            if (evf_calibrate(d->devidx, cfg.mode, cfg.syncdiv, NumChannels, EVF_CALMS, &evfcal) < 0) goto ex;
+            evf_report(&evfcal, d->serial, stdout);
+        }
+    }
+    if (cfg.filtercal)
+        goto ex; // the rates were all that was asked for
 
-    while (cmd != 'q')
+    if (cfg.serve[0])
     {
-        if (APICALL(MH_ClearHistMem(dev[0])) < 0) goto ex;
-        printf("\npress RETURN to start measurement");
-        getchar();
-
-        if (APICALL(MH_GetSyncRate(dev[0], &Syncrate)) < 0)goto ex;
-        printf("\nSyncrate=%1d/s", Syncrate);
+        if (jobsock_listen(&js, cfg.serve) < 0)
+        {
+            printf("\ncannot take jobs from %s", cfg.serve); goto ex;
+        }
+        printf("\nDevices ready after %1.1f ms, taking runs from %s", mh_timems() - tlaunch, cfg.serve);
+    }
 
-        for (i = 0; i < NumChannels; i++) // for all channels
+    for (run = 0; cmd != 'q'; run++)
+    {
+        cur = NULL;
+        if (nruns > 0)
+        {
+            if (run == nruns)
+                break;
+            cur = &runs[run];
+            tasked = run ? mh_timems() : tlaunch; // the first run of a script is a cold start
+        }
+        else if (cfg.serve[0])
+        {
+            fflush(stdout);
+            if ((cur = nextjob(&js, &cfg, &job, &tasked)) == NULL)
+                break; // quit
+        }
+        resync = 0;
+        for (j = 0; j < found && cur; j++)
+        {
+            // the next run of the script or job: only the settings that changed go to the device
+            d = &devs[j];
+            setupms = mh_timems();
+            ds_resetstats(&d->state);
+            prevdiv = d->state.syncdiv;
+            prevbin = d->state.binning;
+            if (applysettings(d, &cur->cfg) < 0
+                || (cfg.mode != MODE_T2 && ds_resolution(&d->state, &Resolution) < 0)) // T2 ticks are the base resolution
+            {
+                if (!cfg.serve[0])
+                    goto ex;
+                break; // a job the device would not take, the daemon goes on
+            }
+            if (cfg.mode != MODE_T2 && d->state.binning != prevbin)
+            {
+                // FileMoments.txt and the live ring in the run's resolution
+                if (cfg.moments)
+                    moments_setres(&d->moments, Resolution, cfg.mode == MODE_T3 ? d->t3.roistart : d->acq.sel.roistart);
+                if (cfg.publish)
+                    shmring_setres(&d->ring, Resolution);
+            }
+            d->acq.numrep = d->t3.numrep = d->t2.numrep = cur->cfg.numrep;
+            d->acq.tacq = d->t3.tacq = d->t2.tacq = cur->cfg.tacq;
+            if (cfg.mode == MODE_T3 && cur->cfg.syncdiv != prevdiv)
+                resync = 1;
+            d->setupms = mh_timems() - setupms;
+        }
+        if (cur && j < found)
+        {
+            // the settings that failed are unknown to the cache now and go to the device again with the next job
+            printf("\nJob %d: %s not taken by device %s", run + 1, cur->line, devs[j].serial);
+            sprintf(reply, "error device %s did not take the settings\n", devs[j].serial);
+            jobsock_write(&js, reply);
+            jobsock_hangup(&js);
+            run--;
+            continue;
+        }
+        if (resync)
         {
-            if (APICALL(MH_GetCountRate(dev[0], i, &Countrate)) < 0) goto ex;
-            printf("\nCountrate[%1d]=%1d/s", i, Countrate);
+            // the sync period comes from the rate meter, valid 100 ms after the divider changed
+            Sleep(150);
+            for (j = 0; j < found; j++)
+                if (APICALL(MH_GetSyncPeriod(devs[j].devidx, &devs[j].t3.syncperiod)) < 0) goto ex;
+        }
+        if (cfg.mode == MODE_HIST)
+            for (j = 0; j < found; j++)
+                if (APICALL(MH_ClearHistMem(devs[j].devidx)) < 0) goto ex;
+        if (cur == NULL)
+        {
+            printf("\npress RETURN to start measurement");
+            getchar();
+
+            for (j = 0; j < found; j++)
+            {
+                d = &devs[j];
+                if (APICALL(MH_GetNumOfInputChannels(d->devidx, &NumChannels)) < 0) goto ex;
+                if (showrates(d, NumChannels, NULL) < 0) goto ex;
+            }
         }
+        else if (nruns > 0)
+            printf("\n\nRun %d of %d: %s", run + 1, nruns, cur->line);
+        else
+            printf("\n\nJob %d: %s", run + 1, cur->line);
 
         // here you could check for warnings again
 
 		//AP: start meas loop
 
-        for (int rep = 0; rep < NUMREP; rep++) {
-            if (APICALL(MH_StartMeas(dev[0], ACQTIME)) < 0) goto ex; //Tacq in ms
-            ctcstatus = 0;
-            while (ctcstatus == 0) if (APICALL(MH_CTCStatus(dev[0], &ctcstatus)) < 0) goto ex;
-            if (APICALL(MH_StopMeas(dev[0])) < 0) goto ex;
-            /*AP*/QueryPerformanceCounter(&t.start); // Start timing
-            if (APICALL(MH_GetAllHistograms(dev[0], counts)) < 0) goto ex;
-            /*AP*/QueryPerformanceCounter(&t.end1); // End timing
-            /*AP*/t.delta1 = (double)(t.end1.QuadPart - t.start.QuadPart) * 1000.0 / freq.QuadPart;
-            if (APICALL(MH_GetFlags(dev[0], &flags)) < 0) goto ex;
-            if (flags & FLAG_OVERFLOW) printf("\n  Overflow.");
-            if (APICALL(MH_ClearHistMem(dev[0])) < 0) goto ex;
-            fwrite(counts, sizeof(unsigned int), NUMDET * NUMBIN, fpout); // write binary data to file  
-			fprintf(fptime, "%d\t%lld\t%lld\t%1.0f\n", rep, t.start.QuadPart, t.end1.QuadPart, t.delta1);
+        // one acquisition thread per device, returns when all frames are on disk
+        if (multi_run(devs, found, cfg.align) < 0)
+        {
+            if (cfg.serve[0])
+            {
+                jobsock_write(&js, "error the run failed, the daemon stops\n");
+                jobsock_hangup(&js);
+            }
+            goto ex;
         }
+        multi_report(devs, found);
 
+        if (cur)
+        {
+            sprintf(Errorstring, "%d", run + 1);
+            for (j = 0; j < found; j++)
+            {
+                d = &devs[j];
+                printf("\nSetup of device %s: %1.3f ms, %d calls, %d saved, first frame %1.3f ms after the %s",
+                    d->serial, d->setupms, d->state.calls, d->state.saved, startlatency(d, tasked),
+                    nruns > 0 && run == 0 ? "launch" : nruns > 0 ? "run before" : "job came in");
+                logrun(d, Errorstring, d->setupms, startlatency(d, tasked), cur->line);
+                if (cfg.serve[0])
+                {
+                    sprintf(reply, "%s frames=%d wall=%1.1f setup=%1.3f calls=%d saved=%d start=%1.3f\n", d->serial,
+                        runframes(d), runwallms(d), d->setupms, d->state.calls, d->state.saved, startlatency(d, tasked));
+                    jobsock_write(&js, reply);
+                }
+            }
+            if (cfg.serve[0])
+            {
+                sprintf(reply, "done %d\n", run + 1);
+                jobsock_write(&js, reply);
+                jobsock_hangup(&js);
+            }
+            continue;
+        }
         printf("\nEnter c to continue or q to quit and save the count data.");
         cmd = getchar();
         getchar();
     }
 
 
-    //for (i = 0; i < NumChannels; i++)
-    //    fprintf(fpout, "  ch%02d ", i+1);
-    //fprintf(fpout, "\n");
-    //for (j = 0; j < HistLen; j++)
-    //{
-    //    for (i = 0; i < NumChannels; i++)
-    //        fprintf(fpout, "%6d ", counts[i][j]);
-    //    fprintf(fpout, "\n");
-    //}
-
 ex:
+    jobsock_close(&js);
+    for (j = 0; j < found; j++)
+        tele_stop(&devs[j].tele); // before the devices go away
     for (i = 0; i < MAXDEVNUM; i++) // no harm to close all
         MH_CloseDevice(i);
-    
-    if (fpout)
-        fclose(fpout);
-	if (fptime)
-		fclose(fptime);
-
-
-	//AP: free memory for histogram
-    //for (int r = 0; r < NUMREP; r++) {
-    //    free(counts[r]);
-    //}
-    //free(counts);
-
 
+    for (j = 0; j < found; j++)
+    {
+        d = &devs[j];
+        pipe_close(&d->pipe); // writes out whatever is still queued
+        codec_close(&d->codec);
+        reduce_close(&d->reduce);
+        moments_close(&d->moments);
+        shmring_close(&d->ring); // viewers see the ring closed
+        if (mapout_close(&d->map) < 0)
+            printf("\ncannot truncate output file of device %s", d->serial);
+        if (d->index.name[0] && mhf_finish(&d->index, d->fpout) < 0)
+            printf("\ncannot write the frame index of device %s", d->serial);
+        mhf_close(&d->index);
+        if (d->fpout)
+            fclose(d->fpout);
+        if (d->fptime)
+            fclose(d->fptime);
+        if (d->fptrace)
+            fclose(d->fptrace);
+        if (d->fpmoments)
+            fclose(d->fpmoments);
+        if (d->fptele)
+            fclose(d->fptele);
+        if (d->fpruns)
+            fclose(d->fpruns);
+        trace_close(&d->trace);
+        free(d->tstarts);
+    }
 
+    free(runs);
+    if (nruns > 0 || cfg.serve[0]) // headless
+    {
+        printf("\n");
+        return 0;
+    }
     printf("\npress RETURN to exit");
     getchar();
 
     return 0;
 }
-
-
@@ -0,0 +1,237 @@
+/************************************************************************
+
+  Local job channel of the acquisition daemon, see jobsock.h
+
+************************************************************************/
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "jobsock.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // a client that went away then raises SIGPIPE
+#endif
+
+
+// no channel, what jobsock_close may be called on without closing anything
+void jobsock_init(jobsock_t* s)
+{
+    memset(s, 0, sizeof(*s));
+#ifndef _WIN32
+    s->fd = s->listenfd = -1;
+#endif
+}
+
+#ifdef _WIN32
+
+int jobsock_listen(jobsock_t* s, const char* name)
+{
+    memset(s, 0, sizeof(*s));
+    sprintf(s->name, "\\\\.\\pipe\\%.60s", name);
+    s->server = 1;
+    s->pipe = CreateNamedPipeA(s->name, PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, JOB_MAXLINE, JOB_MAXLINE, 0, NULL);
+    if (s->pipe == INVALID_HANDLE_VALUE) // another daemon serves this name
+    {
+        s->pipe = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// waits for the next client
+int jobsock_accept(jobsock_t* s)
+{
+    s->len = 0;
+    if (ConnectNamedPipe(s->pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED)
+        return 0;
+    return -1;
+}
+
+void jobsock_hangup(jobsock_t* s)
+{
+    FlushFileBuffers(s->pipe); // the client reads the answer first
+    DisconnectNamedPipe(s->pipe);
+}
+
+int jobsock_connect(jobsock_t* s, const char* name)
+{
+    memset(s, 0, sizeof(*s));
+    sprintf(s->name, "\\\\.\\pipe\\%.60s", name);
+    if (!WaitNamedPipeA(s->name, 5000))
+        return -1;
+    s->pipe = CreateFileA(s->name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (s->pipe == INVALID_HANDLE_VALUE)
+    {
+        s->pipe = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int recvsome(jobsock_t* s, char* buf, int size)
+{
+    DWORD got = 0;
+
+    if (!ReadFile(s->pipe, buf, (DWORD)size, &got, NULL))
+        return 0; // broken pipe: the other side hung up
+    return (int)got;
+}
+
+int jobsock_write(jobsock_t* s, const char* text)
+{
+    DWORD len = (DWORD)strlen(text), put = 0;
+
+    return WriteFile(s->pipe, text, len, &put, NULL) && put == len ? 0 : -1;
+}
+
+void jobsock_close(jobsock_t* s)
+{
+    if (s->pipe)
+    {
+        if (s->server)
+            DisconnectNamedPipe(s->pipe);
+        CloseHandle(s->pipe);
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+#else
+
+int jobsock_listen(jobsock_t* s, const char* name)
+{
+    struct sockaddr_un a;
+
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->server = 1;
+    memset(&a, 0, sizeof(a));
+    a.sun_family = AF_UNIX;
+    if (strlen(name) >= sizeof(a.sun_path))
+        return -1;
+    strcpy(a.sun_path, name);
+    if ((s->listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    unlink(name); // left behind by a daemon that did not get to close it
+    if (bind(s->listenfd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(s->listenfd, 4) != 0)
+    {
+        close(s->listenfd);
+        s->listenfd = -1;
+        return -1;
+    }
+    strcpy(s->name, name);
+    return 0;
+}
+
+// waits for the next client
+int jobsock_accept(jobsock_t* s)
+{
+    s->len = 0;
+    s->fd = accept(s->listenfd, NULL, NULL);
+    return s->fd < 0 ? -1 : 0;
+}
+
+void jobsock_hangup(jobsock_t* s)
+{
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+}
+
+int jobsock_connect(jobsock_t* s, const char* name)
+{
+    struct sockaddr_un a;
+
+    memset(s, 0, sizeof(*s));
+    s->listenfd = -1;
+    memset(&a, 0, sizeof(a));
+    a.sun_family = AF_UNIX;
+    if (strlen(name) >= sizeof(a.sun_path))
+        return -1;
+    strcpy(a.sun_path, name);
+    if ((s->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(s->fd, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int recvsome(jobsock_t* s, char* buf, int size)
+{
+    int got = (int)recv(s->fd, buf, (size_t)size, 0);
+
+    return got < 0 ? 0 : got;
+}
+
+int jobsock_write(jobsock_t* s, const char* text)
+{
+    size_t len = strlen(text);
+    ssize_t put;
+
+    while (len > 0)
+    {
+        if ((put = send(s->fd, text, len, MSG_NOSIGNAL)) <= 0)
+            return -1;
+        text += put;
+        len -= (size_t)put;
+    }
+    return 0;
+}
+
+void jobsock_close(jobsock_t* s)
+{
+    jobsock_hangup(s);
+    if (s->server && s->listenfd >= 0)
+    {
+        close(s->listenfd);
+        unlink(s->name);
+    }
+    memset(s, 0, sizeof(*s));
+    s->fd = s->listenfd = -1;
+}
+
+#endif
+
+
+// the next line without its end of line, its length, or -1 once the other
+// side has hung up; longer lines are cut at size - 1
+int jobsock_readline(jobsock_t* s, char* line, int size)
+{
+    char* nl;
+    int n, got;
+
+    while ((nl = (char*)memchr(s->buf, '\n', s->len)) == NULL && s->len < (int)sizeof(s->buf))
+    {
+        if ((got = recvsome(s, s->buf + s->len, (int)sizeof(s->buf) - s->len)) <= 0)
+        {
+            if (s->len == 0)
+                return -1;
+            nl = s->buf + s->len; // the last line, without an end of line
+            break;
+        }
+        s->len += got;
+    }
+    if (nl == NULL)
+        nl = s->buf + s->len; // a line longer than the buffer
+    n = (int)(nl - s->buf);
+    got = n < size - 1 ? n : size - 1;
+    memcpy(line, s->buf, (size_t)got);
+    line[got] = 0;
+    if (got > 0 && line[got - 1] == '\r')
+        line[--got] = 0;
+    n = n < s->len ? n + 1 : n; // and the end of line
+    memmove(s->buf, s->buf + n, (size_t)(s->len - n));
+    s->len -= n;
+    return got;
+}
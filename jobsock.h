@@ -0,0 +1,62 @@
+/************************************************************************
+
+  Local job channel of the acquisition daemon
+
+  histomode serve=<name> keeps the devices open and initialized and
+  takes its runs from clients over a local channel: a Unix domain
+  socket at the path name, or the named pipe \\.\pipe\name on Windows.
+  The protocol is text, one line per message. The client sends one
+  job, a run in the script format (config.h) or quit; the daemon
+  answers with one line per device and a last line starting with done
+  or error, then hangs up. One client is served at a time.
+
+    daemon                              client (mhjob.c)
+    jobsock_listen(&s, name);           jobsock_connect(&c, name);
+    while (jobsock_accept(&s) == 0)     jobsock_write(&c, "tacq=20\n");
+    {                                   while (jobsock_readline(&c, ...) > 0)
+        jobsock_readline(&s, ...);          ...
+        ... run, jobsock_write ...      jobsock_close(&c);
+        jobsock_hangup(&s);
+    }
+    jobsock_close(&s);
+
+************************************************************************/
+
+#ifndef JOBSOCK_H
+#define JOBSOCK_H
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+#define JOB_NAME    "mhjobs"
+#define JOB_MAXLINE 512
+
+typedef struct jobsock {
+#ifdef _WIN32
+    HANDLE pipe;            // the connection, the server's instance of the pipe
+    char name[80];          // \\.\pipe\name
+#else
+    int listenfd;           // -1 on the client
+    int fd;                 // the connection, -1 = none
+    char name[108];         // socket path, the server unlinks it on close
+#endif
+    int server;
+    char buf[JOB_MAXLINE];  // received, not yet returned by jobsock_readline
+    int len;
+} jobsock_t;
+
+
+void jobsock_init(jobsock_t* s);
+int jobsock_listen(jobsock_t* s, const char* name);
+int jobsock_accept(jobsock_t* s);
+void jobsock_hangup(jobsock_t* s);
+
+int jobsock_connect(jobsock_t* s, const char* name);
+
+int jobsock_readline(jobsock_t* s, char* line, int size);
+int jobsock_write(jobsock_t* s, const char* text);
+void jobsock_close(jobsock_t* s);
+
+#endif
@@ -0,0 +1,231 @@
+/************************************************************************
+
+  Memory-mapped output file, see mapout.h
+
+************************************************************************/
+
+#ifndef _WIN32
+#define _GNU_SOURCE // sync_file_range
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mapout.h"
+
+
+#define PAGESIZE 4096 // write-back granularity, also fine where pages are larger (msync rounds)
+
+
+static void unmap(mapout_t* m)
+{
+    if (m->base == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m->base);
+    CloseHandle(m->mapping);
+    m->mapping = NULL;
+#else
+    munmap(m->base, m->size);
+#endif
+    m->base = NULL;
+}
+
+// grows the file to size bytes and maps all of it
+static int map(mapout_t* m, size_t size)
+{
+#ifdef _WIN32
+    // the mapping extends the file to its maximum size
+    m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+    if (m->mapping == NULL)
+        return -1;
+    m->base = (unsigned char*)MapViewOfFile(m->mapping, FILE_MAP_WRITE, 0, 0, size);
+    if (m->base == NULL)
+    {
+        CloseHandle(m->mapping);
+        m->mapping = NULL;
+        return -1;
+    }
+#else
+    void* p;
+    // allocate the blocks now, a full disk shows up here and not as SIGBUS during the run
+    if (posix_fallocate(m->fd, 0, (off_t)size) != 0 && ftruncate(m->fd, (off_t)size) != 0)
+        return -1;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    m->base = (unsigned char*)p;
+#endif
+    m->size = size;
+    return 0;
+}
+
+
+// opens an existing file that holds headlen bytes of header
+int mapout_open(mapout_t* m, const char* name, size_t headlen, size_t framebytes)
+{
+    memset(m, 0, sizeof(*m));
+    m->headlen = headlen;
+    m->framebytes = framebytes;
+#ifdef _WIN32
+    m->file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE)
+    {
+        m->file = NULL;
+        return -1;
+    }
+#else
+    if ((m->fd = open(name, O_RDWR)) < 0)
+        return -1;
+#endif
+    return 0;
+}
+
+
+// makes room for nframes more frames; no frame of the mapping may be in use
+int mapout_reserve(mapout_t* m, long long nframes)
+{
+    if (m->used + nframes <= m->capacity)
+        return 0;
+    unmap(m);
+    if (map(m, m->headlen + (size_t)(m->used + nframes) * m->framebytes) < 0)
+    {
+        m->capacity = 0;
+        return -1;
+    }
+    m->capacity = m->used + nframes;
+    return 0;
+}
+
+// returns the next frame of the file, NULL if the reserved frames are used up
+void* mapout_next(mapout_t* m)
+{
+    if (m->base == NULL || m->used >= m->capacity)
+        return NULL;
+    return m->base + m->headlen + (size_t)(m->used++) * m->framebytes;
+}
+
+// gives back the last frame handed out, it will not be part of the file
+void mapout_unnext(mapout_t* m, const void* frame)
+{
+    if (m->used > 0 && (const unsigned char*)frame == m->base + m->headlen + (size_t)(m->used - 1) * m->framebytes)
+        m->used--;
+}
+
+// starts writing a finished frame to disk without waiting for it; frames are
+// flushed in file order and the page a frame shares with the next one is left
+// for the next flush, a page under write-back would stall the next readout
+int mapout_flush(mapout_t* m, const void* frame)
+{
+    size_t end = (const unsigned char*)frame + m->framebytes - m->base;
+    size_t start = m->flushed;
+    int ret;
+
+    end -= end % PAGESIZE;
+    if (end <= start)
+        return 0;
+#ifdef _WIN32
+    ret = FlushViewOfFile(m->base + start, end - start) ? 0 : -1;
+#elif defined(__linux__)
+    ret = sync_file_range(m->fd, (off_t)start, (off_t)(end - start), SYNC_FILE_RANGE_WRITE);
+#else
+    ret = msync(m->base + start, end - start, MS_ASYNC);
+#endif
+    m->flushed = end;
+    return ret;
+}
+
+// unmaps and cuts the file after the last frame handed out
+int mapout_close(mapout_t* m)
+{
+    int ret = 0;
+    size_t size = m->headlen + (size_t)m->used * m->framebytes;
+
+    unmap(m);
+#ifdef _WIN32
+    if (m->file)
+    {
+        LARGE_INTEGER pos;
+        pos.QuadPart = (LONGLONG)size;
+        if (!SetFilePointerEx(m->file, pos, NULL, FILE_BEGIN) || !SetEndOfFile(m->file))
+            ret = -1;
+        CloseHandle(m->file);
+    }
+#else
+    if (m->fd > 0)
+    {
+        if (ftruncate(m->fd, (off_t)size) != 0)
+            ret = -1;
+        close(m->fd);
+    }
+#endif
+    memset(m, 0, sizeof(*m));
+    return ret;
+}
+
+
+// maps all of an existing file for reading, frames are read front to back
+int mapin_open(mapin_t* m, const char* name)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+#else
+    struct stat st;
+    void* p;
+#endif
+
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->file == INVALID_HANDLE_VALUE)
+    {
+        m->file = NULL;
+        return -1;
+    }
+    if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0)
+        goto fail;
+    m->size = (size_t)size.QuadPart;
+    if ((m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+        goto fail;
+    if ((m->base = (const unsigned char*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL)
+        goto fail;
+#else
+    if ((m->fd = open(name, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(m->fd, &st) != 0 || st.st_size == 0)
+        goto fail;
+    m->size = (size_t)st.st_size;
+    p = mmap(NULL, m->size, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED)
+        goto fail;
+    m->base = (const unsigned char*)p;
+    madvise(p, m->size, MADV_SEQUENTIAL); // every thread reads its own run of frames in order
+#endif
+    return 0;
+
+fail:
+    mapin_close(m);
+    return -1;
+}
+
+void mapin_close(mapin_t* m)
+{
+#ifdef _WIN32
+    if (m->base)
+        UnmapViewOfFile(m->base);
+    if (m->mapping)
+        CloseHandle(m->mapping);
+    if (m->file)
+        CloseHandle(m->file);
+#else
+    if (m->base)
+        munmap((void*)m->base, m->size);
+    if (m->fd > 0)
+        close(m->fd);
+#endif
+    memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,69 @@
+/************************************************************************
+
+  Memory-mapped output file
+
+  The output file is preallocated for the frames of a run and mapped
+  into memory; the frame pipeline hands out pointers into the mapping
+  so MH_GetAllHistograms (or the T3 binning) writes straight into the
+  page cache. There is no stdio buffer and no copy in fwrite; the
+  writer thread only starts the write-back of every finished frame
+  (sync_file_range on Linux, msync elsewhere, FlushViewOfFile on
+  Windows) and the kernel writes it out asynchronously.
+
+  The file must already contain its header; frames follow at offset
+  headlen, one framebytes block each, in the order they were handed out.
+  On close the file is truncated to the frames actually used.
+
+************************************************************************/
+
+#ifndef MAPOUT_H
+#define MAPOUT_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+typedef struct mapout {
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    unsigned char* base;    // mapping of the whole file, header included
+    size_t size;            // bytes mapped
+    size_t headlen;
+    size_t framebytes;
+    long long capacity;     // frames the mapping holds
+    long long used;         // frames handed out
+    size_t flushed;         // file offset up to which write-back has been started
+} mapout_t;
+
+
+int mapout_open(mapout_t* m, const char* name, size_t headlen, size_t framebytes);
+int mapout_reserve(mapout_t* m, long long nframes);
+void* mapout_next(mapout_t* m);
+void mapout_unnext(mapout_t* m, const void* frame);
+int mapout_flush(mapout_t* m, const void* frame);
+int mapout_close(mapout_t* m);
+
+
+// read-only mapping of a whole existing file, for the analysis tool (mhana.c)
+typedef struct mapin {
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    const unsigned char* base;
+    size_t size;
+} mapin_t;
+
+int mapin_open(mapin_t* m, const char* name);
+void mapin_close(mapin_t* m);
+
+#endif
@@ -0,0 +1,608 @@
+/************************************************************************
+
+  Analysis of FileData.dat runs
+
+  Reads a whole FileData.dat through a read-only mapping (mapout.h) and
+  hands contiguous runs of frames to a number of threads. Every thread
+  computes, with the kernels the writer thread uses (SSE2 where
+  available):
+
+    per frame and channel   counts, mean arrival time and its spread
+                            (moments.h)
+    per channel             the sum of all frames, 64 bit (reduce.h)
+    per frame, with -r      the frame rebinned by a power of two
+
+  and the results are written as NumPy .npy files or CSV:
+
+    <out>_frames   run, rep and record kind (mhfile.h) of every frame
+    <out>_stats    frames x channels x (counts, mean, sd), f8, ps
+    <out>_sum      channels x bins, u8
+    <out>_rebin    frames x channels x bins / rebin, u4
+
+  Raw files of every header version are understood: containers
+  (version sub 4) give the frames, timing and bin width through their
+  index, version sub 3 headers the geometry; for version sub 1 files
+  give the channels and bins with -c and -n. Compressed files must go
+  through mhdecode first. Only containers know the bin width; give it
+  for the others with -p (ps, of the device bins), or the times come
+  out in device bins.
+
+  With -B the analysis is timed instead at 1, 2, 4 ... threads up to
+  the number of CPUs, best of three, and printed as GB/s of frames.
+
+    mhana -o run1 FileData.dat
+    mhana -f csv -r 8 -o run1 FileData.dat
+    mhana -B FileData.dat
+
+  Options:
+    -t <n>      threads (default the number of CPUs)
+    -r <n>      also write every frame rebinned by n
+    -c <n>      channels of a version sub 1 file
+    -n <n>      bins of a version sub 1 file
+    -p <ps>     device bin width, where the file has none
+    -f csv      CSV instead of .npy
+    -o <base>   output file names (default FileData)
+    -B          benchmark GB/s against threads instead
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhthread.h"
+#include "mapout.h"
+#include "mhfile.h"
+#include "moments.h"
+#include "reduce.h"
+#include "codec.h"
+
+
+#define MAXTHREADS  256
+#define BENCHREPS   3
+
+typedef struct ana {
+    mapin_t map;
+    int rows, bins;
+    unsigned long long chanmask;
+    double resolution;      // width of a stored bin (ps), 0 = not in the file
+    double t0;              // time of the first stored bin, in device bins while resolution is 0
+    int filerebin;          // device bins per stored bin
+    long long frames;
+    long long* offset;      // [frames] file offset of each frame
+    int* idx;               // [frames][3] run, rep, kind
+    int rebin;              // 1 = no rebinned output
+    int outbins;
+
+    // results
+    double* stats;          // [frames][rows][MOM_FIELDS]
+    unsigned int* rebinned; // [frames][rows][outbins]
+    unsigned long long* sum;    // [rows][bins]
+} ana_t;
+
+typedef struct worker {
+    ana_t* a;
+    long long first, last;  // frames [first, last)
+    moments_t mom;
+    reduce_t acc;
+    reduce_t red;
+    mhthread_t thread;
+} worker_t;
+
+
+static int getint(const unsigned char* b, size_t off) { int v; memcpy(&v, b + off, 4); return v; }
+
+// checks the geometry against the file size, sets the frames of a file without index
+static int frameslayout(ana_t* a, size_t headlen)
+{
+    size_t framebytes = (size_t)a->rows * a->bins * sizeof(unsigned int);
+    long long i;
+
+    if (a->rows < 1 || a->rows > 64 || a->bins < 1 || a->map.size < headlen
+        || (a->map.size - headlen) % framebytes != 0)
+        return -1;
+    a->frames = (long long)((a->map.size - headlen) / framebytes);
+    a->offset = (long long*)malloc((size_t)(a->frames > 0 ? a->frames : 1) * sizeof(long long));
+    a->idx = (int*)calloc((size_t)(a->frames > 0 ? a->frames : 1) * 3, sizeof(int));
+    if (a->offset == NULL || a->idx == NULL)
+        return -1;
+    for (i = 0; i < a->frames; i++)
+    {
+        a->offset[i] = (long long)(headlen + (size_t)i * framebytes);
+        a->idx[3 * i + 1] = (int)i;
+    }
+    return 0;
+}
+
+// the frames of a container from its index, every record with payload
+static int containerlayout(ana_t* a, const char* name)
+{
+    unsigned char b[MHF_HEADLEN];
+    mhfhead_t h;
+    mhfrecord_t* rec = NULL;
+    FILE* fp;
+    long long n, i;
+    size_t framebytes;
+
+    if (a->map.size >= MHF_HEADLEN)
+        memcpy(b, a->map.base, MHF_HEADLEN);
+    if (a->map.size < MHF_HEADLEN || mhf_unpackhead(b, &h) < 0)
+    {
+        printf("%s: bad container header\n", name);
+        return -1;
+    }
+    if (h.codec != CODEC_NONE)
+    {
+        printf("%s is compressed, decode it with mhdecode first\n", name);
+        return -1;
+    }
+    a->rows = h.rows;
+    a->bins = h.bins;
+    a->chanmask = h.chanmask;
+    a->t0 = h.roistart;
+    a->filerebin = h.rebin > 1 && h.ngates == 0 ? h.rebin : 1;
+    if (h.ngates == 0 && h.resolution > 0)
+    {
+        a->resolution = h.resolution * a->filerebin;
+        a->t0 = h.roistart * h.resolution;
+    }
+    if ((fp = fopen(name, "rb")) == NULL)
+    {
+        printf("cannot open %s\n", name);
+        return -1;
+    }
+    n = mhf_readindex(fp, &h, &rec);
+    fclose(fp);
+    if (n < 0 && frameslayout(a, MHF_HEADLEN) < 0) // aborted run, the frames are all there is
+    {
+        printf("%s: no index and not made of whole frames\n", name);
+        return -1;
+    }
+    if (n < 0)
+        return 0;
+
+    framebytes = (size_t)a->rows * a->bins * sizeof(unsigned int);
+    a->offset = (long long*)malloc((size_t)(n > 0 ? n : 1) * sizeof(long long));
+    a->idx = (int*)malloc((size_t)(n > 0 ? n : 1) * 3 * sizeof(int));
+    if (a->offset == NULL || a->idx == NULL)
+    {
+        free(rec);
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (rec[i].bytes == 0)
+            continue;
+        if (rec[i].bytes != (long long)framebytes || rec[i].offset < MHF_HEADLEN
+            || (unsigned long long)rec[i].offset + framebytes > a->map.size)
+        {
+            printf("%s: record %lld does not fit the file\n", name, i);
+            free(rec);
+            return -1;
+        }
+        a->offset[a->frames] = rec[i].offset;
+        a->idx[3 * a->frames] = rec[i].run;
+        a->idx[3 * a->frames + 1] = rec[i].rep;
+        a->idx[3 * a->frames + 2] = rec[i].kind;
+        a->frames++;
+    }
+    free(rec);
+    return 0;
+}
+
+// finds the frames from the header; rows, bins for version sub 1
+static int openana(ana_t* a, const char* name, int rows, int bins)
+{
+    const unsigned char* b;
+    short ver[3];
+    size_t head, info;
+
+    if (mapin_open(&a->map, name) < 0)
+    {
+        printf("cannot map %s\n", name);
+        return -1;
+    }
+    b = a->map.base;
+    if (a->map.size < 256)
+    {
+        printf("%s: no header\n", name);
+        return -1;
+    }
+    memcpy(ver, b, sizeof(ver));
+    if (ver[0] != -2 || ver[1] != 0)
+    {
+        printf("%s: unknown header\n", name);
+        return -1;
+    }
+    if (ver[2] == MHF_VERSUB)
+        return containerlayout(a, name);
+    if (ver[2] == 3)
+    {
+        // the info follows the header length, 4 bytes, or 8 in files of older Linux builds
+        for (head = 256; head <= 260; head += 4)
+        {
+            info = head - 256 + 10;
+            a->rows = getint(b, info + 4);
+            a->bins = getint(b, info + 8);
+            a->chanmask = (unsigned int)getint(b, info + 24)
+                | (unsigned long long)(unsigned int)getint(b, info + 28) << 32;
+            a->t0 = getint(b, info + 16);
+            a->filerebin = getint(b, info + 32) > 1 && getint(b, info + 36) == 0
+                ? getint(b, info + 32) : 1;
+            if (getint(b, info) != CODEC_NONE)
+                continue;
+            if (frameslayout(a, head) == 0)
+                return 0;
+        }
+        printf("%s: compressed or truncated, decode it with mhdecode first\n", name);
+        return -1;
+    }
+    if (ver[2] == 2)
+    {
+        printf("%s is compressed, decode it with mhdecode first\n", name);
+        return -1;
+    }
+    if (rows < 1 || bins < 1)
+    {
+        printf("%s: header version sub 1 has no geometry, give -c channels and -n bins\n", name);
+        return -1;
+    }
+    a->rows = rows;
+    a->bins = bins;
+    a->chanmask = rows < 64 ? (1ULL << rows) - 1 : ~0ULL;
+    a->filerebin = 1;
+    if (frameslayout(a, 256) < 0 && frameslayout(a, 260) < 0)
+    {
+        printf("%s: is not made of %d x %d frames\n", name, rows, bins);
+        return -1;
+    }
+    return 0;
+}
+
+static void closeana(ana_t* a)
+{
+    mapin_close(&a->map);
+    free(a->offset);
+    free(a->idx);
+    free(a->stats);
+    free(a->rebinned);
+    free(a->sum);
+    memset(a, 0, sizeof(*a));
+}
+
+
+static MHTHREADFN(anathread)
+{
+    worker_t* w = (worker_t*)arg;
+    ana_t* a = w->a;
+    const unsigned int* counts;
+    const unsigned int* red;
+    size_t fields = (size_t)a->rows * MOM_FIELDS, outwords = (size_t)a->rows * a->outbins;
+    long long i;
+
+    for (i = w->first; i < w->last; i++)
+    {
+        counts = (const unsigned int*)(a->map.base + a->offset[i]);
+        moments_frame(&w->mom, counts, a->idx[3 * i + 1]);
+        memcpy(a->stats + (size_t)i * fields, w->mom.last, fields * sizeof(double));
+        reduce_frame(&w->acc, counts);
+        if (a->rebin > 1 && (red = reduce_frame(&w->red, counts)) != NULL)
+            memcpy(a->rebinned + (size_t)i * outwords, red, outwords * sizeof(unsigned int));
+    }
+    return 0;
+}
+
+// the whole analysis with n threads, returns the seconds it took or -1
+static double analyze(ana_t* a, int n)
+{
+    worker_t* w;
+    size_t words = (size_t)a->rows * a->bins, k;
+    double t0;
+    int i, started, ok = 1;
+
+    if ((w = (worker_t*)calloc((size_t)n, sizeof(worker_t))) == NULL)
+        return -1;
+    for (i = 0; i < n && ok; i++)
+    {
+        w[i].a = a;
+        w[i].first = a->frames * i / n;
+        w[i].last = a->frames * (i + 1) / n;
+        ok = moments_open(&w[i].mom, a->rows, a->bins, a->chanmask, a->resolution, 0, NULL, 0) == 0
+            && reduce_open(&w[i].acc, a->rows, a->bins, 1, 0, NULL, 1) == 0
+            && (a->rebin < 2 || reduce_open(&w[i].red, a->rows, a->bins, a->rebin, 0, NULL, 0) == 0);
+        w[i].mom.t0 = a->t0;
+    }
+
+    t0 = mh_timems();
+    for (started = 0; started < n && ok; started++)
+        if (mhthread_create(&w[started].thread, anathread, &w[started]) != 0)
+            break;
+    ok = ok && started == n;
+    for (i = 0; i < started; i++)
+        mhthread_join(w[i].thread);
+    memset(a->sum, 0, words * sizeof(unsigned long long));
+    for (i = 0; i < n && ok; i++)
+        for (k = 0; k < words; k++)
+            a->sum[k] += w[i].acc.acc[k];
+    t0 = mh_timems() - t0;
+
+    for (i = 0; i < n; i++)
+    {
+        moments_close(&w[i].mom);
+        reduce_close(&w[i].acc);
+        reduce_close(&w[i].red);
+    }
+    free(w);
+    return ok ? t0 / 1000.0 : -1;
+}
+
+
+// an .npy v1.0 file of shape s[0..dims), the header padded to 64 bytes
+static FILE* npyopen(const char* name, const char* descr, int dims, const long long* s)
+{
+    char dict[256];
+    unsigned char pre[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+    size_t len;
+    FILE* fp;
+    int i;
+
+    len = sprintf(dict, "{'descr': '%s', 'fortran_order': False, 'shape': (", descr);
+    for (i = 0; i < dims; i++)
+        len += sprintf(dict + len, "%lld,%s", s[i], i < dims - 1 ? " " : "");
+    len += sprintf(dict + len, "), }");
+    while ((sizeof(pre) + len + 1) % 64)
+        dict[len++] = ' ';
+    dict[len++] = '\n';
+    pre[8] = (unsigned char)(len & 0xFF);
+    pre[9] = (unsigned char)(len >> 8);
+    if ((fp = fopen(name, "wb")) == NULL)
+        return NULL;
+    fwrite(pre, 1, sizeof(pre), fp);
+    fwrite(dict, 1, len, fp);
+    return fp;
+}
+
+static int writenpy(const ana_t* a, const char* out)
+{
+    char name[300];
+    long long s[3];
+    long long* idx;
+    long long i;
+    FILE* fp;
+    int ret = 0;
+
+    s[0] = a->frames;
+    s[1] = 3;
+    sprintf(name, "%s_frames.npy", out);
+    if ((idx = (long long*)malloc((size_t)(a->frames > 0 ? a->frames : 1) * 3 * sizeof(long long))) == NULL
+        || (fp = npyopen(name, "<i8", 2, s)) == NULL)
+    {
+        free(idx);
+        return -1;
+    }
+    for (i = 0; i < 3 * a->frames; i++)
+        idx[i] = a->idx[i];
+    ret |= fwrite(idx, sizeof(long long), (size_t)(3 * a->frames), fp) != (size_t)(3 * a->frames);
+    ret |= fclose(fp);
+    free(idx);
+
+    s[1] = a->rows;
+    s[2] = MOM_FIELDS;
+    sprintf(name, "%s_stats.npy", out);
+    if ((fp = npyopen(name, "<f8", 3, s)) == NULL)
+        return -1;
+    ret |= fwrite(a->stats, sizeof(double), (size_t)(s[0] * s[1] * s[2]), fp) != (size_t)(s[0] * s[1] * s[2]);
+    ret |= fclose(fp);
+
+    s[0] = a->rows;
+    s[1] = a->bins;
+    sprintf(name, "%s_sum.npy", out);
+    if ((fp = npyopen(name, "<u8", 2, s)) == NULL)
+        return -1;
+    ret |= fwrite(a->sum, sizeof(unsigned long long), (size_t)(s[0] * s[1]), fp) != (size_t)(s[0] * s[1]);
+    ret |= fclose(fp);
+
+    if (a->rebin > 1)
+    {
+        s[0] = a->frames;
+        s[1] = a->rows;
+        s[2] = a->outbins;
+        sprintf(name, "%s_rebin.npy", out);
+        if ((fp = npyopen(name, "<u4", 3, s)) == NULL)
+            return -1;
+        ret |= fwrite(a->rebinned, sizeof(unsigned int), (size_t)(s[0] * s[1] * s[2]), fp)
+            != (size_t)(s[0] * s[1] * s[2]);
+        ret |= fclose(fp);
+    }
+    return ret ? -1 : 0;
+}
+
+static int writecsv(const ana_t* a, const char* out)
+{
+    char name[300];
+    const double* st;
+    const unsigned int* r;
+    int chans[64];
+    long long i;
+    FILE* fp;
+    int row = 0, ch, b, ret = 0;
+
+    for (ch = 0; ch < 64 && row < a->rows; ch++)
+        if ((a->chanmask >> ch) & 1)
+            chans[row++] = ch;
+
+    sprintf(name, "%s_stats.csv", out);
+    if ((fp = fopen(name, "w")) == NULL)
+        return -1;
+    fprintf(fp, "run,rep,kind");
+    for (row = 0; row < a->rows; row++)
+        fprintf(fp, ",n%d,mean%d,sd%d", chans[row], chans[row], chans[row]);
+    fprintf(fp, "\n");
+    for (i = 0; i < a->frames; i++)
+    {
+        fprintf(fp, "%d,%d,%d", a->idx[3 * i], a->idx[3 * i + 1], a->idx[3 * i + 2]);
+        for (row = 0, st = a->stats + (size_t)i * a->rows * MOM_FIELDS; row < a->rows; row++, st += MOM_FIELDS)
+            fprintf(fp, ",%1.0f,%1.3f,%1.3f", st[MOM_COUNTS], st[MOM_MEAN], st[MOM_SD]);
+        fprintf(fp, "\n");
+    }
+    ret |= fclose(fp);
+
+    sprintf(name, "%s_sum.csv", out);
+    if ((fp = fopen(name, "w")) == NULL)
+        return -1;
+    fprintf(fp, "bin,time");
+    for (row = 0; row < a->rows; row++)
+        fprintf(fp, ",n%d", chans[row]);
+    fprintf(fp, "\n");
+    for (b = 0; b < a->bins; b++)
+    {
+        fprintf(fp, "%d,%1.3f", b, a->t0 + b * a->resolution);
+        for (row = 0; row < a->rows; row++)
+            fprintf(fp, ",%llu", a->sum[(size_t)row * a->bins + b]);
+        fprintf(fp, "\n");
+    }
+    ret |= fclose(fp);
+
+    if (a->rebin > 1)
+    {
+        sprintf(name, "%s_rebin.csv", out);
+        if ((fp = fopen(name, "w")) == NULL)
+            return -1;
+        fprintf(fp, "run,rep,channel");
+        for (b = 0; b < a->outbins; b++)
+            fprintf(fp, ",b%d", b);
+        fprintf(fp, "\n");
+        for (i = 0; i < a->frames; i++)
+            for (row = 0; row < a->rows; row++)
+            {
+                r = a->rebinned + ((size_t)i * a->rows + row) * a->outbins;
+                fprintf(fp, "%d,%d,%d", a->idx[3 * i], a->idx[3 * i + 1], chans[row]);
+                for (b = 0; b < a->outbins; b++)
+                    fprintf(fp, ",%u", r[b]);
+                fprintf(fp, "\n");
+            }
+        ret |= fclose(fp);
+    }
+    return ret ? -1 : 0;
+}
+
+
+// GB/s of frames at 1, 2, 4 ... threads and at the number of CPUs
+static void bench(ana_t* a, int maxthreads)
+{
+    double bytes = (double)a->frames * a->rows * a->bins * sizeof(unsigned int), s, best, one = 0;
+    int n, r;
+
+    analyze(a, 1); // pages in
+    printf("Threads\tSeconds\tGB/s\tSpeedup\n");
+    for (n = 1; n <= maxthreads; n = n < maxthreads && 2 * n > maxthreads ? maxthreads : 2 * n)
+    {
+        best = -1;
+        for (r = 0; r < BENCHREPS; r++)
+            if ((s = analyze(a, n)) >= 0 && (best < 0 || s < best))
+                best = s;
+        if (best <= 0)
+            break;
+        if (n == 1)
+            one = best;
+        printf("%d\t%1.4f\t%1.3f\t%1.2f\n", n, best, bytes / best / 1e9, one / best);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    ana_t a;
+    const char* in = NULL;
+    const char* out = "FileData";
+    const char* units;
+    double s, ps = 0;
+    int threads = 0, rows = 0, bins = 0, csv = 0, benchmark = 0, status = 1, i;
+
+    memset(&a, 0, sizeof(a));
+    a.rebin = 1;
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            a.rebin = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            rows = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            bins = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            ps = atof(argv[++i]);
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            csv = strcmp(argv[++i], "csv") == 0;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out = argv[++i];
+        else if (strcmp(argv[i], "-B") == 0)
+            benchmark = 1;
+        else if (argv[i][0] != '-' && in == NULL)
+            in = argv[i];
+        else
+        {
+            in = NULL;
+            break;
+        }
+    }
+    if (in == NULL || a.rebin < 1 || (a.rebin & (a.rebin - 1)) || threads < 0)
+    {
+        printf("usage: mhana [-t threads] [-r rebin] [-c channels] [-n bins] [-p ps] [-f npy|csv] [-o out] [-B] FileData.dat\n");
+        return 1;
+    }
+    if (threads == 0)
+        threads = mh_numcpus();
+    if (threads > MAXTHREADS)
+        threads = MAXTHREADS;
+
+    if (openana(&a, in, rows, bins) < 0)
+        goto done;
+    if (a.resolution <= 0)
+    {
+        // no bin width in the file, -p gives the device's
+        a.t0 *= ps > 0 ? ps : 1;
+        a.resolution = (ps > 0 ? ps : 1) * a.filerebin;
+    }
+    if (a.rebin > a.bins)
+        a.rebin = 1;
+    a.outbins = a.bins / a.rebin;
+    a.stats = (double*)malloc((size_t)(a.frames > 0 ? a.frames : 1) * a.rows * MOM_FIELDS * sizeof(double));
+    a.sum = (unsigned long long*)malloc((size_t)a.rows * a.bins * sizeof(unsigned long long));
+    if (a.rebin > 1)
+        a.rebinned = (unsigned int*)malloc((size_t)(a.frames > 0 ? a.frames : 1) * a.rows * a.outbins
+            * sizeof(unsigned int));
+    units = ps > 0 || a.resolution != a.filerebin ? "times in ps" : "times in device bins";
+    if (a.stats == NULL || a.sum == NULL || (a.rebin > 1 && a.rebinned == NULL))
+    {
+        printf("out of memory\n");
+        goto done;
+    }
+    printf("%s: %lld frames of %d x %d bins, %s\n", in, a.frames, a.rows, a.bins,
+        units);
+
+    if (benchmark)
+    {
+        bench(&a, mh_numcpus() < MAXTHREADS ? mh_numcpus() : MAXTHREADS);
+        status = 0;
+        goto done;
+    }
+    if ((s = analyze(&a, threads)) < 0)
+    {
+        printf("analysis failed\n");
+        goto done;
+    }
+    printf("%d threads, %1.3f s, %1.3f GB/s\n", threads, s,
+        s > 0 ? (double)a.frames * a.rows * a.bins * sizeof(unsigned int) / s / 1e9 : 0);
+    if ((csv ? writecsv(&a, out) : writenpy(&a, out)) < 0)
+    {
+        printf("cannot write %s_*.%s\n", out, csv ? "csv" : "npy");
+        goto done;
+    }
+    status = 0;
+
+done:
+    closeana(&a);
+    return status;
+}
@@ -0,0 +1,706 @@
+/************************************************************************
+
+  Acquisition benchmark harness
+
+  Runs the histogramming loop of histomode against the MHLib simulator
+  (mhsim.c) over a sweep of histogram length, channel count, acquisition
+  time and number of frame buffers, and reports frames/s, dead time
+  fraction and write bandwidth for each point.
+
+  Results are printed as a tab separated table. Save one run as the
+  baseline and pass it back with -b to print the change of every later
+  build relative to it:
+
+    mhbench -o base.tsv
+    mhbench -b base.tsv
+
+  Options:
+    -r <n>      frames per sweep point (default 10)
+    -q          quick sweep (fewer points)
+    -w spin     poll MH_CTCStatus back to back instead of the sleeping waiter
+    -c          write compressed frames (codec.h), adds the ratio column
+    -d          differential readout, no MH_ClearHistMem between frames;
+                compare with -b against a table saved without -d
+    -T          rates, warnings and flags from the telemetry thread
+                (telemetry.h) instead of MH_GetFlags after every frame;
+                compare with -b against a table saved without -T
+    -W          compare the output paths instead: stdio fwrite against the
+                memory-mapped file (mapout.h), MB/s and per-frame write jitter
+    -K          compare the frame kernels instead: the ones specialized for
+                a geometry (framekern.h) against the generic ones, GB/s
+    -R          measure the frame reduction of the writer thread instead
+                (reduce.h): rebinning, gates and accumulation, GB/s of input
+    -L          measure the live frame ring instead (shmring.h): publish
+                time of the writer and the lag of a fast and a slow reader
+    -J          measure the frame start jitter instead, 1 ms frames with
+                and without the real-time mode (rtmode.h) while -l <n>
+                threads (default one per core) keep the CPUs busy;
+                -r frames per pass, at least 1000
+    -o <file>   also write the table to file
+    -b <file>   compare against a previously saved table
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhsim.h"
+#include "pipeline.h"
+#include "acquire.h"
+#include "rtmode.h"
+
+
+#define BENCHFILE "mhbench.dat"
+#define MAXBASE 256
+
+static const int binsweep[] = { 1024, 4096, 16384, 65536 };
+static const int chansweep[] = { 4, 16, 64 };
+static const int tacqsweep[] = { 10, 100 };
+static const int bufsweep[] = { 1, 8 };
+
+typedef struct benchresult {
+    int bins, channels, tacq, nbuf;
+    double fps;         // frames per second of acquisition wall time
+    double deadpct;     // dead time fraction in percent
+    double deadms;      // mean dead time per frame
+    double readms;      // mean readout time per frame
+    double writembs;    // fwrite throughput of the writer thread
+    double outmbs;      // sustained output rate including the final flush
+    double polls;       // MH_CTCStatus calls per frame
+    double latems;      // mean delay of the end detection after the predicted device end
+    double cpupct;      // CPU use of the acquisition thread
+    double ratio;       // compression ratio, 1 without -c
+} benchresult;
+
+static benchresult base[MAXBASE];
+static int nbase = 0;
+static ctcwait_t waitcfg = CTCWAIT_DEFAULT;
+static int compress = 0;
+static int diffread = 0;
+static int telemetry = 0;
+
+
+static int runpoint(int bins, int channels, int tacq, int nbuf, int reps, benchresult* r)
+{
+    mhsim_config cfg;
+    pipeline_t p = { 0 };
+    codec_t c = { 0 };
+    acqopts_t o = { 0 };
+    telemetry_t tele = { 0 };
+    acqstats_t st;
+    FILE* fp = NULL;
+    char serial[16];
+    int lencode = 0, x = bins / 1024, histlen;
+    double t0, tflushed;
+    int ret = -1;
+
+    MHSIM_GetConfig(&cfg);
+    cfg.nchannels = channels;
+    MHSIM_SetConfig(&cfg);
+
+    while (x >>= 1) ++lencode;
+    if (APICALL(MH_OpenDevice(0, serial)) < 0) return -1;
+    if (APICALL(MH_Initialize(0, MODE_HIST, 0)) < 0) goto done;
+    if (APICALL(MH_SetHistoLen(0, lencode, &histlen)) < 0) goto done;
+    if (APICALL(MH_SetStopOverflow(0, 0, 10000)) < 0) goto done;
+    if (APICALL(MH_ClearHistMem(0)) < 0) goto done;
+
+    if ((fp = fopen(BENCHFILE, "wb")) == NULL) goto done;
+    if (pipe_open(&p, nbuf, channels, histlen, fp, NULL, 0) < 0) goto done;
+    if (compress)
+    {
+        if (codec_open(&c, channels, histlen, CODEC_KEYINT) < 0) goto done;
+        p.codec = &c;
+    }
+
+    o.numrep = reps;
+    o.tacq = tacq;
+    o.wait = waitcfg;
+    o.diff = diffread;
+    if (telemetry)
+    {
+        if (tele_start(&tele, 0, channels, NULL) < 0) goto done;
+        o.tele = &tele;
+    }
+    t0 = mh_timems();
+    if (acq_histo(0, &o, &p, &st) < 0) goto done;
+    pipe_flush(&p);
+    tflushed = mh_timems();
+
+    r->bins = bins;
+    r->channels = channels;
+    r->tacq = tacq;
+    r->nbuf = nbuf;
+    r->fps = st.frames * 1000.0 / st.wallms;
+    r->deadpct = 100.0 * st.deadms / st.wallms;
+    r->deadms = st.deadms / st.frames;
+    r->readms = st.readms / st.frames;
+    r->writembs = p.writems > 0 ? p.bytes / 1e3 / p.writems : 0;
+    r->outmbs = p.bytes / 1e3 / (tflushed - t0);
+    r->polls = (double)st.ctcpolls / st.frames;
+    r->latems = st.latecount ? st.latesum / st.latecount : 0;
+    r->cpupct = 100.0 * st.cpums / st.wallms;
+    r->ratio = c.outbytes > 0 ? c.rawbytes / c.outbytes : 1;
+    ret = 0;
+
+done:
+    tele_stop(&tele);
+    pipe_close(&p);
+    codec_close(&c);
+    if (fp)
+        fclose(fp);
+    remove(BENCHFILE);
+    MH_CloseDevice(0);
+    return ret;
+}
+
+
+// output path only: the producer fills every frame like a readout would and
+// the writer thread gets it to the file with fwrite or as a mapped frame
+static int writepoint(int framewords, int mapped, int nframes)
+{
+    pipeline_t p = { 0 };
+    mapout_t m = { 0 };
+    frame_t* f;
+    FILE* fp;
+    unsigned int* src;
+    char header[256] = { 0 };
+    double t0, tp, prodms = 0, prodmax = 0, tflushed, mean;
+    int i, ret = -1;
+
+    if ((src = (unsigned int*)malloc(framewords * sizeof(unsigned int))) == NULL)
+        return -1;
+    for (i = 0; i < framewords; i++)
+        src[i] = (unsigned int)(1000.0 * exp(-(i % 4096) / 500.0)); // decay-like content
+    if ((fp = fopen(BENCHFILE, "wb")) == NULL)
+        goto done;
+    fwrite(header, 1, sizeof(header), fp);
+    if (mapped)
+    {
+        fclose(fp);
+        fp = NULL;
+        if (mapout_open(&m, BENCHFILE, sizeof(header), framewords * sizeof(unsigned int)) < 0)
+            goto done;
+    }
+    if (pipe_open(&p, 8, framewords / 4096, 4096, fp, NULL, 0) < 0)
+        goto done;
+    if (mapped)
+    {
+        p.map = &m;
+        if (pipe_reserve(&p, nframes) < 0)
+            goto done;
+    }
+
+    t0 = mh_timems();
+    for (i = 0; i < nframes; i++)
+    {
+        tp = mh_timems();
+        f = pipe_getfree(&p);
+        memcpy(f->counts, src, framewords * sizeof(unsigned int)); // stands in for MH_GetAllHistograms
+        f->rep = i;
+        pipe_submit(&p, f);
+        tp = mh_timems() - tp;
+        prodms += tp;
+        if (tp > prodmax)
+            prodmax = tp;
+    }
+    if (pipe_flush(&p) < 0)
+        goto done;
+    tflushed = mh_timems();
+
+    mean = p.writes ? p.writems / p.writes : 0;
+    printf("%d\t%s\t%d\t%1.1f\t%1.3f\t%1.3f\t%1.3f\t%1.3f\t%1.3f\n", framewords, mapped ? "mmap" : "stdio", nframes,
+        p.bytes / 1e3 / (tflushed - t0), prodms / nframes, prodmax, mean, p.writemax,
+        sqrt(p.writesq / p.writes > mean * mean ? p.writesq / p.writes - mean * mean : 0));
+    fflush(stdout);
+    ret = 0;
+
+done:
+    pipe_close(&p);
+    mapout_close(&m);
+    if (fp)
+        fclose(fp);
+    remove(BENCHFILE);
+    free(src);
+    return ret;
+}
+
+static void writebench(void)
+{
+    static const int sizes[] = { 16 * 1024, 16 * 4096, 64 * 4096, 64 * 16384 };
+    int i, mapped, nframes;
+
+    printf("words\tpath\tframes\tMB/s\tfill_ms\tfill_max_ms\twrite_ms\twrite_max_ms\twrite_sd_ms\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+        for (mapped = 0; mapped < 2; mapped++)
+        {
+            nframes = (int)(512e6 / (sizes[i] * sizeof(unsigned int))); // 512 MB per point
+            if (writepoint(sizes[i], mapped, nframes) < 0)
+                printf("%d\t%s\tfailed\n", sizes[i], mapped ? "mmap" : "stdio");
+        }
+}
+
+
+// the specialized kernels of every geometry in FK_GEOMETRIES and of two
+// that have none against the generic kernels on the same data; gather reads
+// every second channel of a twice as long histogram like a bin selection
+static void kernelbench(void)
+{
+#define GEOM(R, B) { R, B },
+    static const int geoms[][2] = { FK_GEOMETRIES(GEOM) { 12, 3000 }, { 16, 2000 } };
+#undef GEOM
+    const framekern_t* k[2];
+    unsigned int* src;
+    unsigned int* dst;
+    int chans[64];
+    double t0, gms[2], sms[2], gb;
+    volatile unsigned long long sink = 0;
+    int g, v, i, rows, bins, iters;
+
+    printf("rows\tbins\tkernel\tgather_GB/s\tsum_GB/s\tgeneric_gather_GB/s\tgeneric_sum_GB/s\n");
+    for (g = 0; g < (int)(sizeof(geoms) / sizeof(geoms[0])); g++)
+    {
+        rows = geoms[g][0];
+        bins = geoms[g][1];
+        src = (unsigned int*)mh_alignedalloc(64, (size_t)rows * 2 * bins * 2 * sizeof(unsigned int));
+        dst = (unsigned int*)mh_alignedalloc(64, (size_t)rows * bins * sizeof(unsigned int));
+        if (src == NULL || dst == NULL)
+        {
+            printf("%d\t%d\tfailed\n", rows, bins);
+            mh_alignedfree(src);
+            mh_alignedfree(dst);
+            continue;
+        }
+        for (i = 0; i < rows * 2 * bins * 2; i++)
+            src[i] = (unsigned int)(1000.0 * exp(-(i % (2 * bins)) / 500.0));
+        for (i = 0; i < rows; i++)
+            chans[i] = 2 * i;
+        gb = (double)rows * bins * sizeof(unsigned int) / 1e9;
+        iters = (int)(0.5 / gb) + 1; // 0.5 GB per measurement
+        k[0] = fk_select(rows, bins);
+        k[1] = fk_generic();
+        for (v = 0; v < 2; v++)
+        {
+            k[v]->gather(dst, src, chans, 2 * bins, bins / 2, rows, bins); // warm up
+            t0 = mh_timems();
+            for (i = 0; i < iters; i++)
+                k[v]->gather(dst, src, chans, 2 * bins, bins / 2, rows, bins);
+            gms[v] = mh_timems() - t0;
+            t0 = mh_timems();
+            for (i = 0; i < iters; i++)
+                sink += k[v]->sum(dst, rows, bins);
+            sms[v] = mh_timems() - t0;
+        }
+        printf("%d\t%d\t%s\t%1.2f\t%1.2f\t%1.2f\t%1.2f\n", rows, bins, k[0]->rows ? "special" : "generic",
+            iters * gb / gms[0] * 1e3, iters * gb / sms[0] * 1e3, iters * gb / gms[1] * 1e3, iters * gb / sms[1] * 1e3);
+        fflush(stdout);
+        mh_alignedfree(src);
+        mh_alignedfree(dst);
+    }
+}
+
+
+// a reader thread of the live ring, on its own read-only mapping like a viewer process
+typedef struct livereader {
+    int slowms;             // work per frame, 0 = none
+    long long frames;       // seen and still valid after the work
+    long long skipped, torn;
+    double lagsum, lagmax;
+    mhatomic_t ready;
+} livereader_t;
+
+static MHTHREADFN(livethread)
+{
+    livereader_t* l = (livereader_t*)arg;
+    shmring_t r;
+    shmframe_t f;
+    double lag;
+
+    if (shmring_attach(&r, "mhbench") < 0)
+    {
+        mhatomic_store(&l->ready, -1);
+        return 0;
+    }
+    mhatomic_store(&l->ready, 1);
+    while (!r.closed)
+    {
+        if (shmring_next(&r, &f, 0) == NULL)
+        {
+            mh_sleepms(0.1);
+            continue;
+        }
+        lag = mh_timems() - f.tpub;
+        if (l->slowms > 0)
+            mh_sleepms(l->slowms);
+        if (!shmring_valid(&r, &f))
+            continue;
+        l->frames++;
+        l->lagsum += lag;
+        if (lag > l->lagmax)
+            l->lagmax = lag;
+    }
+    l->skipped = r.skipped;
+    l->torn = r.torn;
+    shmring_close(&r);
+    return 0;
+}
+
+// the writer publishes a frame every 2 ms to a ring of SHM_SLOTS; a reader that
+// takes 5 ms per frame must skip, and neither may slow the writer down
+static void livebench(void)
+{
+    static const int geoms[][2] = { { 16, 1024 }, { 16, 4096 }, { 64, 4096 }, { 16, 65536 } };
+    static const int slowsweep[] = { 0, 5 };
+    shmring_t ring, pub;
+    shmframe_t f;
+    livereader_t l;
+    mhthread_t t;
+    unsigned int* src;
+    double next;
+    int g, s, i, rows, bins, nframes = 500;
+
+    printf("rows\tbins\treader_ms\tpublish_ms\tpublish_max_ms\tpublish_GB/s\tseen\tskipped\ttorn\tlag_ms\tlag_max_ms\n");
+    for (g = 0; g < (int)(sizeof(geoms) / sizeof(geoms[0])); g++)
+        for (s = 0; s < (int)(sizeof(slowsweep) / sizeof(slowsweep[0])); s++)
+        {
+            rows = geoms[g][0];
+            bins = geoms[g][1];
+            if ((src = (unsigned int*)mh_alignedalloc(64, (size_t)rows * bins * sizeof(unsigned int))) == NULL)
+                continue;
+            for (i = 0; i < rows * bins; i++)
+                src[i] = (unsigned int)(1000.0 * exp(-(i % bins) / 500.0));
+            if (shmring_create(&ring, "mhbench", SHM_SLOTS, rows, bins, ~0ULL, 5.0, 0) < 0)
+            {
+                printf("%d\t%d\tcannot create shared memory\n", rows, bins);
+                mh_alignedfree(src);
+                continue;
+            }
+            memset(&l, 0, sizeof(l));
+            l.slowms = slowsweep[s];
+            if (mhthread_create(&t, livethread, &l) != 0)
+            {
+                shmring_close(&ring);
+                mh_alignedfree(src);
+                continue;
+            }
+            while (mhatomic_load(&l.ready) == 0)
+                mh_sleepms(0.1);
+            memset(&f, 0, sizeof(f));
+            next = mh_timems();
+            for (i = 0; i < nframes && mhatomic_load(&l.ready) > 0; i++)
+            {
+                next += 2.0;
+                while (mh_timems() < next)
+                    mh_sleepms(next - mh_timems());
+                f.rep = i;
+                f.tstart = next;
+                shmring_publish(&ring, src, &f);
+            }
+            pub = ring; // the statistics, close clears them
+            shmring_close(&ring);
+            mhthread_join(t);
+            printf("%d\t%d\t%d\t%1.4f\t%1.4f\t%1.2f\t%lld\t%lld\t%lld\t%1.3f\t%1.3f\n", rows, bins, l.slowms,
+                pub.frames ? pub.pubms / pub.frames : 0, pub.pubmax,
+                pub.pubms > 0 ? pub.frames * (double)rows * bins * sizeof(unsigned int) / pub.pubms / 1e6 : 0,
+                l.frames, l.skipped, l.torn, l.frames ? l.lagsum / l.frames : 0, l.lagmax);
+            fflush(stdout);
+            mh_alignedfree(src);
+        }
+}
+
+
+// the writer reduces every frame on one core, this shows how much input it keeps up with
+static void reducebench(void)
+{
+    static const int geoms[][2] = { { 16, 4096 }, { 16, 65536 }, { 64, 4096 } };
+    static const int gates[4][2] = { { 100, 50 }, { 400, 200 }, { 1000, 24 }, { 0, 1024 } };
+    static const struct { const char* name; int rebin, ngates, accumulate; } modes[] = {
+        { "rebin2", 2, 0, 0 }, { "rebin4", 4, 0, 0 }, { "rebin16", 16, 0, 0 }, { "rebin256", 256, 0, 0 },
+        { "gates4", 1, 4, 0 }, { "accumulate", 1, 0, 1 }, { "rebin4+acc", 4, 0, 1 } };
+    reduce_t r;
+    unsigned int* src;
+    double t0, gb;
+    int g, m, i, rows, bins, iters;
+
+    printf("rows\tbins\tmode\tin_GB/s\tout/in\n");
+    for (g = 0; g < (int)(sizeof(geoms) / sizeof(geoms[0])); g++)
+    {
+        rows = geoms[g][0];
+        bins = geoms[g][1];
+        if ((src = (unsigned int*)mh_alignedalloc(64, (size_t)rows * bins * sizeof(unsigned int))) == NULL)
+            continue;
+        for (i = 0; i < rows * bins; i++)
+            src[i] = (unsigned int)(1000.0 * exp(-(i % bins) / 500.0));
+        gb = (double)rows * bins * sizeof(unsigned int) / 1e9;
+        iters = (int)(0.5 / gb) + 1; // 0.5 GB per measurement
+        for (m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])); m++)
+        {
+            if (reduce_open(&r, rows, bins, modes[m].rebin, modes[m].ngates, gates, modes[m].accumulate) < 0)
+                continue;
+            reduce_frame(&r, src); // warm up
+            reduce_resetstats(&r);
+            t0 = mh_timems();
+            for (i = 0; i < iters; i++)
+                reduce_frame(&r, src);
+            reduce_total(&r);
+            t0 = mh_timems() - t0;
+            printf("%d\t%d\t%s\t%1.2f\t%1.4f\n", rows, bins, modes[m].name, iters * gb / t0 * 1e3,
+                r.outbytes / r.inbytes);
+            fflush(stdout);
+            reduce_close(&r);
+        }
+        mh_alignedfree(src);
+    }
+}
+
+
+// the background load of the jitter benchmark: a core kept busy
+static MHTHREADFN(loadthread)
+{
+    volatile mhatomic_t* stop = (volatile mhatomic_t*)arg;
+    volatile double x = 1;
+
+    while (!mhatomic_load(stop))
+        x = x * 1.000001 + 1e-6;
+    return 0;
+}
+
+// one pass of the jitter benchmark, on a thread of its own so the real-time
+// mode does not stay with the main thread
+typedef struct jitterpass {
+    int rt;
+    const acqopts_t* o;
+    pipeline_t* p;
+    acqstats_t st;
+    char why[96];           // why the real-time mode was not had, empty = it was
+    int ret;
+} jitterpass_t;
+
+static MHTHREADFN(jitterthread)
+{
+    jitterpass_t* j = (jitterpass_t*)arg;
+
+    j->why[0] = 0;
+    if (j->rt)
+        rt_thread(mh_numcpus() - 1, RT_PRIORITY, j->why, sizeof(j->why));
+    j->ret = acq_histo(0, j->o, j->p, &j->st);
+    return 0;
+}
+
+// frame start intervals of 1 ms frames, normal and real time, under load
+static void jitterbench(int reps, int nload)
+{
+    pipeline_t p = { 0 };
+    acqopts_t o = { 0 };
+    jitterpass_t j;
+    rtjitter_t r;
+    mhthread_t t, load[256];
+    mhatomic_t stop;
+    FILE* fp = NULL;
+    char serial[16];
+    double* tstarts;
+    int histlen, pass, i, nstarted;
+
+    if (nload > 256)
+        nload = 256;
+    if ((tstarts = (double*)calloc(reps, sizeof(double))) == NULL)
+        return;
+    printf("mode\tload\tframes\tmean_ms\tsd_ms\tmedian_ms\tp99_ms\tp99.9_ms\tmax_ms\n");
+    for (pass = 0; pass < 2; pass++)
+    {
+        if (APICALL(MH_OpenDevice(0, serial)) < 0) break;
+        if (APICALL(MH_Initialize(0, MODE_HIST, 0)) < 0
+            || APICALL(MH_SetHistoLen(0, 0, &histlen)) < 0
+            || APICALL(MH_SetStopOverflow(0, 0, 10000)) < 0
+            || (fp = fopen(BENCHFILE, "wb")) == NULL
+            || pipe_open(&p, 8, 4, histlen, fp, NULL, 0) < 0)
+        {
+            MH_CloseDevice(0);
+            break;
+        }
+        o.numrep = reps;
+        o.tacq = 1;
+        o.wait = waitcfg;
+        o.tstarts = tstarts;
+        memset(&j, 0, sizeof(j));
+        j.rt = pass;
+        j.o = &o;
+        j.p = &p;
+        j.ret = -1;
+        mhatomic_store(&stop, 0);
+        for (nstarted = 0; nstarted < nload; nstarted++)
+            if (mhthread_create(&load[nstarted], loadthread, (void*)&stop) != 0)
+                break;
+        if (mhthread_create(&t, jitterthread, &j) == 0)
+            mhthread_join(t);
+        mhatomic_store(&stop, 1);
+        for (i = 0; i < nstarted; i++)
+            mhthread_join(load[i]);
+        pipe_close(&p);
+        fclose(fp);
+        remove(BENCHFILE);
+        MH_CloseDevice(0);
+        if (j.ret < 0 || rt_jitter(tstarts, j.st.frames, &r) < 0)
+            break;
+        printf("%s\t%d\t%d\t%1.4f\t%1.4f\t%1.4f\t%1.4f\t%1.4f\t%1.4f\n", pass ? "rt" : "normal", nstarted, j.st.frames,
+            r.mean, r.sd, r.p50, r.p99, r.p999, r.max);
+        if (j.why[0])
+            printf("# real time not in effect: %s\n", j.why);
+        fflush(stdout);
+    }
+    free(tstarts);
+}
+
+
+static void loadbase(const char* name)
+{
+    FILE* fp = fopen(name, "r");
+    char line[512];
+    benchresult* b;
+
+    if (fp == NULL)
+    {
+        printf("cannot open baseline %s\n", name);
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) && nbase < MAXBASE)
+    {
+        b = &base[nbase];
+        if (sscanf(line, "%d %d %d %d %lf %lf %lf %lf %lf %lf", &b->bins, &b->channels, &b->tacq, &b->nbuf,
+            &b->fps, &b->deadpct, &b->deadms, &b->readms, &b->writembs, &b->outmbs) == 10)
+            nbase++;
+    }
+    fclose(fp);
+}
+
+static const benchresult* findbase(const benchresult* r)
+{
+    int i;
+    for (i = 0; i < nbase; i++)
+        if (base[i].bins == r->bins && base[i].channels == r->channels && base[i].tacq == r->tacq && base[i].nbuf == r->nbuf)
+            return &base[i];
+    return NULL;
+}
+
+
+int main(int argc, char* argv[])
+{
+    FILE* fpres = NULL;
+    const benchresult* b;
+    benchresult r;
+    int reps = 10, quick = 0, writeonly = 0, kernelonly = 0, reduceonly = 0, liveonly = 0, jitteronly = 0;
+    int nload = mh_numcpus();
+    int ib, ic, it, in;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0)
+            quick = 1;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            waitcfg.spin = strcmp(argv[++i], "spin") == 0;
+        else if (strcmp(argv[i], "-c") == 0)
+            compress = 1;
+        else if (strcmp(argv[i], "-d") == 0)
+            diffread = 1;
+        else if (strcmp(argv[i], "-T") == 0)
+            telemetry = 1;
+        else if (strcmp(argv[i], "-W") == 0)
+            writeonly = 1;
+        else if (strcmp(argv[i], "-K") == 0)
+            kernelonly = 1;
+        else if (strcmp(argv[i], "-R") == 0)
+            reduceonly = 1;
+        else if (strcmp(argv[i], "-L") == 0)
+            liveonly = 1;
+        else if (strcmp(argv[i], "-J") == 0)
+            jitteronly = 1;
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            nload = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            if ((fpres = fopen(argv[++i], "w")) == NULL)
+            {
+                printf("cannot open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            loadbase(argv[++i]);
+        else
+        {
+            printf("usage: mhbench [-r reps] [-q] [-w spin] [-c] [-d] [-T] [-W] [-K] [-R] [-L] [-J] [-l load] [-o results.tsv] [-b baseline.tsv]\n");
+            return 1;
+        }
+    }
+    if (reps < 2)
+        reps = 2;
+    if (writeonly)
+    {
+        writebench();
+        return 0;
+    }
+    if (kernelonly)
+    {
+        kernelbench();
+        return 0;
+    }
+    if (reduceonly)
+    {
+        reducebench();
+        return 0;
+    }
+    if (liveonly)
+    {
+        livebench();
+        return 0;
+    }
+    if (jitteronly)
+    {
+        jitterbench(reps < 1000 ? 1000 : reps, nload);
+        return 0;
+    }
+
+    printf("bins\tchannels\ttacq\tnbuf\tframes/s\tdead%%\tdead_ms\tread_ms\twrite_MB/s\tout_MB/s\tpolls\tlate_ms\tcpu%%\tratio");
+    if (nbase)
+        printf("\tdead%%_base\tframes/s_change%%");
+    printf("\n");
+    if (fpres)
+        fprintf(fpres, "#bins\tchannels\ttacq\tnbuf\tframes/s\tdead%%\tdead_ms\tread_ms\twrite_MB/s\tout_MB/s\tpolls\tlate_ms\tcpu%%\tratio\n");
+
+    for (ib = 0; ib < (int)(sizeof(binsweep) / sizeof(binsweep[0])); ib++)
+        for (ic = 0; ic < (int)(sizeof(chansweep) / sizeof(chansweep[0])); ic++)
+            for (it = 0; it < (int)(sizeof(tacqsweep) / sizeof(tacqsweep[0])); it++)
+                for (in = 0; in < (int)(sizeof(bufsweep) / sizeof(bufsweep[0])); in++)
+                {
+                    if (quick && (binsweep[ib] == 1024 || binsweep[ib] == 65536 || chansweep[ic] == 4 || tacqsweep[it] == 100))
+                        continue;
+                    if (runpoint(binsweep[ib], chansweep[ic], tacqsweep[it], bufsweep[in], reps, &r) < 0)
+                    {
+                        printf("sweep point %d/%d/%d/%d failed\n", binsweep[ib], chansweep[ic], tacqsweep[it], bufsweep[in]);
+                        continue;
+                    }
+                    printf("%d\t%d\t%d\t%d\t%1.2f\t%1.2f\t%1.3f\t%1.3f\t%1.1f\t%1.1f\t%1.1f\t%1.3f\t%1.1f\t%1.2f",
+                        r.bins, r.channels, r.tacq, r.nbuf, r.fps, r.deadpct, r.deadms, r.readms, r.writembs, r.outmbs,
+                        r.polls, r.latems, r.cpupct, r.ratio);
+                    if ((b = findbase(&r)) != NULL)
+                        printf("\t%1.2f\t%+1.1f", b->deadpct, 100.0 * (r.fps - b->fps) / b->fps);
+                    printf("\n");
+                    fflush(stdout);
+                    if (fpres)
+                        fprintf(fpres, "%d\t%d\t%d\t%d\t%1.2f\t%1.2f\t%1.3f\t%1.3f\t%1.1f\t%1.1f\t%1.1f\t%1.3f\t%1.1f\t%1.2f\n",
+                            r.bins, r.channels, r.tacq, r.nbuf, r.fps, r.deadpct, r.deadms, r.readms, r.writembs, r.outmbs,
+                            r.polls, r.latems, r.cpupct, r.ratio);
+                }
+
+    if (fpres)
+        fclose(fpres);
+    return 0;
+}
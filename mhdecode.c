@@ -0,0 +1,233 @@
+/************************************************************************
+
+  Decoder for compressed FileData.dat files
+
+  Converts a file written with compress=1 (see codec.h) back to raw
+  frames: the 256 byte header followed by one rows x bins block of
+  unsigned ints per frame. Header version sub 2 files become version
+  sub 1; version sub 3 files keep their channel and bin selection and
+  reduction settings, only the codec field is cleared. Containers
+  (version sub 4, mhfile.h) keep their header and records, the index
+  is written anew for the raw frames. Raw files are copied unchanged.
+
+    mhdecode FileData.dat FileData_raw.dat
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+#include "mhfile.h"
+
+
+#define HEADLEN 256
+
+// a container: header with the codec cleared, the frames decoded in file order
+// and an index whose records differ only in where the frames are; without an
+// index (aborted run) the frames are decoded up to the end and indexed anew
+static int decodecontainer(FILE* fpin, FILE* fpout, const char* in, const char* out)
+{
+    mhfhead_t h;
+    mhfile_t m = { 0 };
+    mhfrecord_t r;
+    mhfrecord_t* rec = NULL;
+    codec_t c = { 0 };
+    unsigned int* counts = NULL;
+    char buf[4096];
+    long long n, i;
+    size_t words, len;
+    int rep, ret, frames = 0, status = 1;
+
+    if (mhf_readhead(fpin, &h) < 0)
+    {
+        printf("%s: bad container header\n", in);
+        return 1;
+    }
+    if (h.codec == CODEC_NONE)
+    {
+        rewind(fpin);
+        while ((len = fread(buf, 1, sizeof(buf), fpin)) > 0)
+            fwrite(buf, 1, len, fpout);
+        printf("%s is not compressed, copied\n", in);
+        return 0;
+    }
+    if (h.codec != CODEC_PACK || codec_open(&c, h.rows, h.bins, h.keyint) < 0)
+    {
+        printf("%s: unknown codec %d (%d x %d)\n", in, h.codec, h.rows, h.bins);
+        return 1;
+    }
+    n = mhf_readindex(fpin, &h, &rec);
+    words = (size_t)h.rows * h.bins;
+    h.codec = CODEC_NONE;
+    h.index = h.records = 0;
+    if ((counts = (unsigned int*)malloc(words * sizeof(unsigned int))) == NULL
+        || mhf_open(&m, fpout, out, &h) < 0 || fseek(fpin, MHF_HEADLEN, SEEK_SET) != 0)
+        goto done;
+
+    for (i = 0; n < 0 || i < n; i++)
+    {
+        if (n >= 0)
+            r = rec[i];
+        else
+        {
+            memset(&r, 0, sizeof(r));
+            r.kind = MHF_FRAME;
+        }
+        m.run = r.run;
+        if (r.bytes > 0 || n < 0)
+        {
+            ret = codec_readframe(&c, fpin, counts, &rep);
+            if (ret < 0 && n < 0)
+                printf("%s: the frames end in a partial frame after %d frames\n", in, frames);
+            if (ret <= 0 && n < 0)
+                break;
+            if (ret <= 0)
+            {
+                printf("%s: corrupt frame after %d frames\n", in, frames);
+                goto done;
+            }
+            if (fwrite(counts, sizeof(unsigned int), words, fpout) != words)
+            {
+                printf("%s: write error\n", out);
+                goto done;
+            }
+            if (n < 0)
+                r.rep = rep;
+            r.bytes = (long long)(words * sizeof(unsigned int));
+            r.key = 1;
+            frames++;
+        }
+        if (mhf_add(&m, &r) < 0)
+            goto done;
+    }
+    if (mhf_finish(&m, fpout) < 0)
+    {
+        printf("%s: cannot write the index\n", out);
+        goto done;
+    }
+    printf("%d frames of %d x %d bins decoded, %lld records%s\n", frames, h.rows, h.bins, m.nrec,
+        n < 0 ? " (index rebuilt)" : "");
+    status = 0;
+
+done:
+    codec_close(&c);
+    mhf_close(&m);
+    free(rec);
+    free(counts);
+    return status;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* fpin = NULL;
+    FILE* fpout = NULL;
+    codec_t c = { 0 };
+    unsigned int* counts = NULL;
+    short ver[3];
+    int sizeheader;
+    int info[8] = { 0 };       // codec, rows, bins, key interval, then (version sub 3) the selection
+    char pad[HEADLEN] = { 0 };
+    size_t padlen, n;
+    int rep, ret, frames = 0, status = 1, ninfo = 0, codec;
+
+    if (argc != 3)
+    {
+        printf("usage: mhdecode <compressed.dat> <raw.dat>\n");
+        return 1;
+    }
+    if ((fpin = fopen(argv[1], "rb")) == NULL)
+    {
+        printf("cannot open %s\n", argv[1]);
+        goto done;
+    }
+    if ((fpout = fopen(argv[2], "wb")) == NULL)
+    {
+        printf("cannot open %s\n", argv[2]);
+        goto done;
+    }
+
+    padlen = HEADLEN - 2 - 2 - 2 - 4;
+    if (fread(ver, sizeof(short), 3, fpin) != 3 || fread(&sizeheader, sizeof(int), 1, fpin) != 1)
+    {
+        printf("%s: no header\n", argv[1]);
+        goto done;
+    }
+    if (ver[2] == MHF_VERSUB)
+    {
+        status = decodecontainer(fpin, fpout, argv[1], argv[2]);
+        goto done;
+    }
+    if (ver[2] >= 2)
+    {
+        ninfo = ver[2] == 2 ? 4 : 8;
+        if (fread(info, sizeof(int), ninfo, fpin) != (size_t)ninfo)
+        {
+            printf("%s: truncated header\n", argv[1]);
+            goto done;
+        }
+        padlen -= ninfo * sizeof(int);
+    }
+    if (fread(pad, 1, padlen, fpin) != padlen)
+    {
+        printf("%s: truncated header\n", argv[1]);
+        goto done;
+    }
+
+    // the raw header, codec field cleared; the rest of a version sub 3
+    // header (the reduction settings, see reduce.h) is kept as it is
+    codec = info[0];
+    info[0] = CODEC_NONE;
+    if (ver[2] == 2)
+    {
+        ver[2] = 1;
+        memset(pad, 0, sizeof(pad));
+        padlen = HEADLEN - 2 - 2 - 2 - 4;
+    }
+    fwrite(ver, sizeof(short), 3, fpout);
+    fwrite(&sizeheader, sizeof(int), 1, fpout);
+    if (ver[2] == 3)
+        fwrite(info, sizeof(int), 8, fpout);
+    fwrite(pad, 1, padlen, fpout);
+
+    if (codec == CODEC_NONE)
+    {
+        while ((n = fread(pad, 1, sizeof(pad), fpin)) > 0)
+            fwrite(pad, 1, n, fpout);
+        printf("%s is not compressed, copied\n", argv[1]);
+        status = 0;
+        goto done;
+    }
+    if (codec != CODEC_PACK || codec_open(&c, info[1], info[2], info[3]) < 0)
+    {
+        printf("%s: unknown codec %d (%d x %d)\n", argv[1], codec, info[1], info[2]);
+        goto done;
+    }
+    if ((counts = (unsigned int*)malloc((size_t)c.numdet * c.numbin * sizeof(unsigned int))) == NULL)
+        goto done;
+
+    while ((ret = codec_readframe(&c, fpin, counts, &rep)) > 0)
+    {
+        if (fwrite(counts, sizeof(unsigned int), (size_t)c.numdet * c.numbin, fpout) != (size_t)c.numdet * c.numbin)
+        {
+            printf("%s: write error\n", argv[2]);
+            goto done;
+        }
+        frames++;
+    }
+    if (ret < 0)
+        printf("%s: corrupt frame after %d frames\n", argv[1], frames);
+    else
+        status = 0;
+    printf("%d frames of %d x %d bins decoded\n", frames, c.numdet, c.numbin);
+
+done:
+    codec_close(&c);
+    free(counts);
+    if (fpin)
+        fclose(fpin);
+    if (fpout)
+        fclose(fpout);
+    return status;
+}
@@ -0,0 +1,237 @@
+/************************************************************************
+
+  Indexed frame container, see mhfile.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhfile.h"
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+#define TRAILLEN 24         // magic, records, index offset
+
+
+static void put32(unsigned char* b, int off, int v) { memcpy(b + off, &v, 4); }
+static int get32(const unsigned char* b, int off) { int v; memcpy(&v, b + off, 4); return v; }
+static void put64(unsigned char* b, int off, long long v) { memcpy(b + off, &v, 8); }
+static long long get64(const unsigned char* b, int off) { long long v; memcpy(&v, b + off, 8); return v; }
+
+
+void mhf_packhead(unsigned char* b, const mhfhead_t* h)
+{
+    short ver[3] = { -2, 0, MHF_VERSUB };
+    int i;
+
+    memset(b, 0, MHF_HEADLEN);
+    memcpy(b + MHF_VERSION, ver, sizeof(ver));
+    put32(b, MHF_SIZEHEADER, MHF_HEADLEN);
+    put32(b, MHF_INFO, h->codec);
+    put32(b, MHF_INFO + 4, h->rows);
+    put32(b, MHF_INFO + 8, h->bins);
+    put32(b, MHF_INFO + 12, h->keyint);
+    put32(b, MHF_INFO + 16, h->roistart);
+    put32(b, MHF_INFO + 20, h->histlen);
+    put32(b, MHF_INFO + 24, (int)(h->chanmask & 0xFFFFFFFF));
+    put32(b, MHF_INFO + 28, (int)(h->chanmask >> 32));
+    put32(b, MHF_RED, h->rebin);
+    put32(b, MHF_RED + 4, h->ngates);
+    put32(b, MHF_RED + 8, h->accumulate);
+    put32(b, MHF_RED + 12, h->inbins);
+    for (i = 0; i < h->ngates && i < REDUCE_MAXGATES; i++)
+    {
+        put32(b, MHF_RED + 16 + 8 * i, h->gates[i][0]);
+        put32(b, MHF_RED + 20 + 8 * i, h->gates[i][1]);
+    }
+    put32(b, MHF_SETTINGS, h->mode);
+    put32(b, MHF_SETTINGS + 4, h->binning);
+    put32(b, MHF_SETTINGS + 8, h->offset);
+    put32(b, MHF_SETTINGS + 12, h->syncdiv);
+    put32(b, MHF_SETTINGS + 16, h->tacq);
+    put32(b, MHF_SETTINGS + 20, h->target);
+    put32(b, MHF_SETTINGS + 24, h->numchannels);
+    memcpy(b + MHF_RESOLUTION, &h->resolution, 8);
+    memcpy(b + MHF_SERIAL, h->serial, 16);
+    for (i = 0; i < 64; i++)
+        put32(b, MHF_CHANS + 4 * i, h->chans[i]);
+    put64(b, MHF_INDEX, h->index);
+    put64(b, MHF_RECORDS, h->records);
+}
+
+// returns -1 if b is not a version sub 4 header
+int mhf_unpackhead(const unsigned char* b, mhfhead_t* h)
+{
+    short ver[3];
+    int i;
+
+    memcpy(ver, b + MHF_VERSION, sizeof(ver));
+    if (ver[0] != -2 || ver[1] != 0 || ver[2] != MHF_VERSUB || get32(b, MHF_SIZEHEADER) != MHF_HEADLEN)
+        return -1;
+    memset(h, 0, sizeof(*h));
+    h->codec = get32(b, MHF_INFO);
+    h->rows = get32(b, MHF_INFO + 4);
+    h->bins = get32(b, MHF_INFO + 8);
+    h->keyint = get32(b, MHF_INFO + 12);
+    h->roistart = get32(b, MHF_INFO + 16);
+    h->histlen = get32(b, MHF_INFO + 20);
+    h->chanmask = (unsigned int)get32(b, MHF_INFO + 24) | (unsigned long long)(unsigned int)get32(b, MHF_INFO + 28) << 32;
+    h->rebin = get32(b, MHF_RED);
+    h->ngates = get32(b, MHF_RED + 4);
+    h->accumulate = get32(b, MHF_RED + 8);
+    h->inbins = get32(b, MHF_RED + 12);
+    if (h->ngates < 0 || h->ngates > REDUCE_MAXGATES || h->rows < 1 || h->rows > 64 || h->bins < 1)
+        return -1;
+    for (i = 0; i < h->ngates; i++)
+    {
+        h->gates[i][0] = get32(b, MHF_RED + 16 + 8 * i);
+        h->gates[i][1] = get32(b, MHF_RED + 20 + 8 * i);
+    }
+    h->mode = get32(b, MHF_SETTINGS);
+    h->binning = get32(b, MHF_SETTINGS + 4);
+    h->offset = get32(b, MHF_SETTINGS + 8);
+    h->syncdiv = get32(b, MHF_SETTINGS + 12);
+    h->tacq = get32(b, MHF_SETTINGS + 16);
+    h->target = get32(b, MHF_SETTINGS + 20);
+    h->numchannels = get32(b, MHF_SETTINGS + 24);
+    memcpy(&h->resolution, b + MHF_RESOLUTION, 8);
+    memcpy(h->serial, b + MHF_SERIAL, 16);
+    h->serial[15] = 0;
+    for (i = 0; i < 64; i++)
+        h->chans[i] = get32(b, MHF_CHANS + 4 * i);
+    h->index = get64(b, MHF_INDEX);
+    h->records = get64(b, MHF_RECORDS);
+    return 0;
+}
+
+// reads the header at the start of fp, returns -1 if it is not a container
+int mhf_readhead(FILE* fp, mhfhead_t* h)
+{
+    unsigned char b[MHF_HEADLEN];
+
+    if (fseek64(fp, 0, SEEK_SET) != 0 || fread(b, 1, MHF_HEADLEN, fp) != MHF_HEADLEN)
+        return -1;
+    return mhf_unpackhead(b, h);
+}
+
+// reads the index into a new array, from the header or, if that was never
+// updated, from the trailer; returns the records or -1 if there is no index
+long long mhf_readindex(FILE* fp, const mhfhead_t* h, mhfrecord_t** rec)
+{
+    unsigned char t[TRAILLEN];
+    long long index = h->index, n = h->records;
+
+    *rec = NULL;
+    if (index <= 0)
+    {
+        if (fseek64(fp, -TRAILLEN, SEEK_END) != 0 || fread(t, 1, TRAILLEN, fp) != TRAILLEN
+            || memcmp(t, MHF_MAGIC, 8) != 0)
+            return -1;
+        n = get64(t, 8);
+        index = get64(t, 16);
+    }
+    if (n < 0 || index < MHF_HEADLEN || fseek64(fp, index, SEEK_SET) != 0)
+        return -1;
+    if ((*rec = (mhfrecord_t*)malloc((size_t)(n > 0 ? n : 1) * sizeof(mhfrecord_t))) == NULL)
+        return -1;
+    if (fread(*rec, sizeof(mhfrecord_t), (size_t)n, fp) != (size_t)n)
+    {
+        free(*rec);
+        *rec = NULL;
+        return -1;
+    }
+    return n;
+}
+
+
+// writes the header to fp (if not NULL) and starts an empty index, the
+// frames follow the header; name is the file, see mhf_finish
+int mhf_open(mhfile_t* m, FILE* fp, const char* name, const mhfhead_t* h)
+{
+    unsigned char b[MHF_HEADLEN];
+
+    memset(m, 0, sizeof(*m));
+    strncpy(m->name, name, sizeof(m->name) - 1);
+    m->pos = MHF_HEADLEN;
+    if (fp)
+    {
+        mhf_packhead(b, h);
+        if (fwrite(b, 1, MHF_HEADLEN, fp) != MHF_HEADLEN)
+            return -1;
+    }
+    return 0;
+}
+
+// appends the record of the next frame, r->bytes long; fills in its offset and run
+int mhf_add(mhfile_t* m, mhfrecord_t* r)
+{
+    mhfrecord_t* grown;
+
+    if (m->nrec == m->caprec)
+    {
+        m->caprec = m->caprec ? 2 * m->caprec : 1024;
+        if ((grown = (mhfrecord_t*)realloc(m->rec, (size_t)m->caprec * sizeof(mhfrecord_t))) == NULL)
+            return -1;
+        m->rec = grown;
+    }
+    r->offset = m->pos;
+    r->run = m->run;
+    m->rec[m->nrec++] = *r;
+    m->pos += r->bytes;
+    return 0;
+}
+
+void mhf_endrun(mhfile_t* m)
+{
+    if (m->nrec > 0 && m->rec[m->nrec - 1].run == m->run)
+        m->run++;
+}
+
+// appends index and trailer to the frames and enters the index in the header;
+// fp NULL = the frames went through a mapping, the file is opened again
+int mhf_finish(mhfile_t* m, FILE* fp)
+{
+    unsigned char t[TRAILLEN] = { 0 };
+    unsigned char b[16];
+    long long index;
+    int own = fp == NULL, ret = -1;
+
+    if (own && (fp = fopen(m->name, "r+b")) == NULL)
+        return -1;
+    if (fseek64(fp, 0, SEEK_END) != 0 || (index = ftell64(fp)) < MHF_HEADLEN)
+        goto done;
+    if (index % 8 && fwrite(t, 1, (size_t)(8 - index % 8), fp) != (size_t)(8 - index % 8))
+        goto done;
+    index = (index + 7) & ~7LL;
+    if (fwrite(m->rec, sizeof(mhfrecord_t), (size_t)m->nrec, fp) != (size_t)m->nrec)
+        goto done;
+    memcpy(t, MHF_MAGIC, 8);
+    put64(t, 8, m->nrec);
+    put64(t, 16, index);
+    if (fwrite(t, 1, TRAILLEN, fp) != TRAILLEN)
+        goto done;
+    put64(b, 0, index);
+    put64(b, 8, m->nrec);
+    if (fseek64(fp, MHF_INDEX, SEEK_SET) != 0 || fwrite(b, 1, 16, fp) != 16)
+        goto done;
+    ret = fflush(fp) == 0 ? 0 : -1;
+
+done:
+    if (own)
+        fclose(fp);
+    return ret;
+}
+
+void mhf_close(mhfile_t* m)
+{
+    free(m->rec);
+    memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,109 @@
+/************************************************************************
+
+  Indexed frame container, FileData.dat version sub 4
+
+  The older headers carry only the geometry, the per-frame timing lives
+  in FileTime.txt and the only way to frame n is to read (or decode)
+  every frame before it. With container=1 the file describes itself:
+
+    header  MHF_HEADLEN bytes at the MHF_ offsets below, fixed width on
+            every platform; the first MHF_SETTINGS bytes are laid out as
+            a version sub 3 header, so older readers still find the
+            codec, geometry and reduction there
+    frames  as before, raw rows x bins blocks or codec frames (codec.h)
+    index   8-byte aligned, one mhfrecord_t per frame in file order
+    trailer MHF_MAGIC, i64 records, i64 file offset of the index
+
+  A record holds where the frame is, its device start time
+  (MH_GetStartTime), the time it measured, its flags and its run and
+  rep, so a reader seeks to any frame in O(1) and can map the file and
+  slice it. Frames of an accumulating reduction (reduce.h) get records
+  without payload, the run sum one of its own. Compressed frames decode
+  from the last record with key set.
+
+  The index is written, and its place entered in the header, when the
+  file is closed. A file whose run was aborted has 0 there and can still
+  be read frame by frame.
+
+************************************************************************/
+
+#ifndef MHFILE_H
+#define MHFILE_H
+
+#include <stdio.h>
+
+#include "reduce.h"
+
+
+#define MHF_VERSUB      4
+#define MHF_HEADLEN     1024
+#define MHF_MAGIC       "MHFINDEX"
+
+// byte offsets in the header, all values little endian
+#define MHF_VERSION     0       // i16[3] -2, 0, MHF_VERSUB
+#define MHF_SIZEHEADER  6       // i32 MHF_HEADLEN
+#define MHF_INFO        10      // i32[8] codec, rows, bins, key interval, first bin, device histogram length, chanmask lo, hi
+#define MHF_RED         42      // i32[4 + 2 * REDUCE_MAXGATES] rebin, gates, accumulate, bins before reduction, gates
+#define MHF_SETTINGS    186     // i32[8] mode, binning, offset (ns), sync divider, tacq (ms), target, device channels, 0
+#define MHF_RESOLUTION  218     // f64 bin width (ps)
+#define MHF_SERIAL      226     // char[16]
+#define MHF_CHANS       242     // i32[64] device channel of every row, -1 = none
+#define MHF_INDEX       498     // i64 file offset of the index, 0 = not written
+#define MHF_RECORDS     506     // i64 records in the index
+
+// what a record stands for
+#define MHF_FRAME       0       // a frame in the file
+#define MHF_FOLDED      1       // a frame added to the run sum, nothing in the file
+#define MHF_SUM         2       // the run sum of an accumulating reduction
+
+typedef struct mhfhead {
+    int codec, rows, bins, keyint;
+    int roistart, histlen;
+    unsigned long long chanmask;
+    int rebin, ngates, accumulate, inbins;
+    int gates[REDUCE_MAXGATES][2];
+    int mode, binning, offset, syncdiv, tacq, target, numchannels;
+    double resolution;
+    char serial[16];
+    int chans[64];
+    long long index;
+    long long records;
+} mhfhead_t;
+
+typedef struct mhfrecord {
+    long long offset;       // file offset of the frame, a codec frame's length field included
+    long long bytes;        // its length in the file, 0 = none
+    unsigned long long tdev;    // device start time (ps, MH_GetStartTime), 0 = not read
+    double tstart;          // host time of MH_StartMeas (ms)
+    double tmeas;           // acquisition time it really measured (ms), 0 = unknown
+    int run;                // measurement run within the file, from 0
+    int rep;                // frame within the run
+    int flags;              // device flags after the frame
+    int tacq;               // acquisition time it was started with (ms)
+    int kind;               // MHF_FRAME, MHF_FOLDED or MHF_SUM
+    int key;                // 1 = decodes on its own (raw, or a codec key frame)
+} mhfrecord_t;              // 64 bytes, no padding on any target
+
+// the index while the file is written
+typedef struct mhfile {
+    char name[300];         // reopened by mhf_finish if the frames went through a mapping
+    long long pos;          // file offset of the next frame
+    int run;
+    mhfrecord_t* rec;
+    long long nrec;
+    long long caprec;
+} mhfile_t;
+
+
+void mhf_packhead(unsigned char* b, const mhfhead_t* h);
+int mhf_unpackhead(const unsigned char* b, mhfhead_t* h);
+int mhf_readhead(FILE* fp, mhfhead_t* h);
+long long mhf_readindex(FILE* fp, const mhfhead_t* h, mhfrecord_t** rec);
+
+int mhf_open(mhfile_t* m, FILE* fp, const char* name, const mhfhead_t* h);
+int mhf_add(mhfile_t* m, mhfrecord_t* r);
+void mhf_endrun(mhfile_t* m);
+int mhf_finish(mhfile_t* m, FILE* fp);
+void mhf_close(mhfile_t* m);
+
+#endif
@@ -0,0 +1,76 @@
+/************************************************************************
+
+  Client of the acquisition daemon
+
+  Sends one job to histomode serve=<name> (jobsock.h) and prints the
+  answer: one line per device with the frames, wall time, setup time,
+  setter calls issued and saved and the time from the job coming in to
+  the first MH_StartMeas, then done or error. The keys of a job are
+  those of a script line (config.h), without keys the run has the
+  daemon's settings.
+
+    mhjob numrep=50 tacq=20         a run on the daemon at mhjobs
+    mhjob -n /tmp/lab1 binning=1    another daemon
+    mhjob quit                      stops the daemon
+
+  The exit code is 0 after done, 1 after an error or without answer.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhthread.h"
+#include "jobsock.h"
+
+
+int main(int argc, char* argv[])
+{
+    jobsock_t s;
+    const char* name = JOB_NAME;
+    char job[JOB_MAXLINE] = "";
+    char line[JOB_MAXLINE];
+    double t0;
+    int i, ret = 1;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            name = argv[++i];
+        else if (argv[i][0] == '-' || strlen(job) + strlen(argv[i]) + 2 >= sizeof(job))
+        {
+            printf("usage: mhjob [-n name] [key=value ...] | quit\n");
+            return 1;
+        }
+        else
+        {
+            if (job[0])
+                strcat(job, " ");
+            strcat(job, argv[i]);
+        }
+    }
+
+    t0 = mh_timems();
+    if (jobsock_connect(&s, name) < 0)
+    {
+        printf("no daemon at %s\n", name);
+        return 1;
+    }
+    strcat(job, "\n");
+    if (jobsock_write(&s, job) < 0)
+    {
+        printf("cannot send the job to %s\n", name);
+        jobsock_close(&s);
+        return 1;
+    }
+    while (jobsock_readline(&s, line, sizeof(line)) >= 0)
+    {
+        printf("%s\n", line);
+        if (strncmp(line, "done", 4) == 0)
+            ret = 0;
+    }
+    jobsock_close(&s);
+    printf("job took %1.1f ms\n", mh_timems() - t0);
+    return ret;
+}
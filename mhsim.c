@@ -0,0 +1,1404 @@
+/************************************************************************
+
+  MHLib simulator, see mhsim.h
+
+  Implements every function declared in mhlib.h. Device state is kept
+  per device index and protected by a per-device lock, so several
+  threads may drive different devices (or poll the same one) at once.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhthread.h"
+#include "mhsim.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+#define SIMBASERES   5.0      // ps
+#define SIMFIFODEPTH 8388608  // records the device FIFO can hold
+#define SIMT0        1000.0   // ps, position of the decay onset within the sync period
+#define SIMTAU       1500.0   // ps, decay time
+#define SIMBKG       0.02     // uniform background fraction
+#define SIMPAIRDELAY 2000.0   // ps, delay of the correlated partner photon
+#define SIMPAIRJIT   50.0     // ps, rms jitter of the partner photon
+#define SIMFILTQ     262144   // events waiting for the filter decisions, a power of two
+#define SIMRATEWIN   20e9     // ps of events the filtered rate meters are estimated from
+
+#define T2WRAP 33554432
+#define T3WRAP 1024
+
+
+// an event filter: row filter r has its channels in use[r] and pass[r], the main
+// filter those of all rows with the sync as bit 8 of row 0
+typedef struct simfilter {
+    int enable;
+    int range;                // ps
+    int match;                // other events needed within range
+    int inverse;
+    int use[ROWIDXMAX + 1];   // channels that count and are filtered
+    int pass[ROWIDXMAX + 1];  // channels that pass unconditionally, the rest is dropped
+} simfilter;
+
+typedef struct simevent {
+    double t;                 // ps since measurement start
+    int ch;                   // input channel of a photon
+    int special;              // 0 = photon, 1 = marker, 2 = sync
+    int pass1;                // made it through the row filter
+} simevent;
+
+typedef struct simdev {
+    int open;
+    int initialized;
+    int mode;
+    int refsource;
+    char serial[16];
+    mhmutex_t lock;
+
+    int nchannels;
+    int syncdiv;
+    int syncenable;
+    int enabled[MAXINPCHAN];
+    int lencode;
+    int histlen;
+    int binning;
+    int offset;
+    int stopovfl;
+    unsigned int stopcount;
+    int measctrl;
+    int startedge;
+    int stopedge;
+    int markeren[4];
+
+    int running;
+    double tstart;            // host ms at MH_StartMeas
+    double tend;              // host ms at which the measurement ends by itself
+    double tstop;             // host ms at which the measurement actually ended
+    int tacq;
+    int flags;
+    unsigned int starttime[3];
+
+    unsigned int* hist;       // nchannels * MAXHISTLEN
+    double* weight;           // expected counts per second per bin
+    double peakrate;          // highest entry of weight
+    int weightdirty;
+    double tfolded;           // measurement time in ms already in hist
+
+    // TTTR generator state, times in ps since measurement start
+    double tnext;             // next photon
+    double tpair;             // pending partner photon, <0 if none
+    int pairch;
+    double tmarker;
+    double tsync;
+    long long ofl;            // wraparounds already reported
+    unsigned long long rng;
+
+    // event filters, time tagging modes only: events wait in fq until every
+    // neighbour within the filter ranges is known, then pass or are dropped
+    simfilter rowfilt[ROWIDXMAX + 1];
+    simfilter mainfilt;
+    int filtertest;           // 1 = the filter output goes nowhere
+    simevent* fq;             // SIMFILTQ events, NULL until a filter is used
+    long long fqhead, fqdec2, fqdec1, fqtail;   // oldest kept, next main and row decision, next free
+    long long fcount[3][MAXINPCHAN + 1];    // events, after the row and the main filter; sync last
+} simdev;
+
+
+static simdev sims[MAXDEVNUM];
+static mhsim_config simcfg;
+static int configured = 0;
+static double simt0;        // host ms at the first API call, origin of the rate swing
+
+
+static double envdouble(const char* name, double def)
+{
+    char* v = getenv(name);
+    return v ? atof(v) : def;
+}
+
+static void siminit(void)
+{
+    int i;
+
+    if (configured)
+        return;
+    configured = 1;
+    simcfg.ndevices = (int)envdouble("MHSIM_DEVICES", 1);
+    simcfg.nchannels = (int)envdouble("MHSIM_CHANNELS", 16);
+    simcfg.syncrate = envdouble("MHSIM_SYNCRATE", 40e6);
+    simcfg.countrate = envdouble("MHSIM_COUNTRATE", 1e5);
+    simcfg.pairfrac = envdouble("MHSIM_PAIRFRAC", 0.05);
+    simcfg.markerrate = envdouble("MHSIM_MARKERRATE", 0);
+    simcfg.calllat_us = envdouble("MHSIM_CALLLAT_US", 100);
+    simcfg.usb_mbps = envdouble("MHSIM_USB_MBPS", 200);
+    simcfg.seed = (unsigned int)envdouble("MHSIM_SEED", 1);
+    simcfg.rateswing = envdouble("MHSIM_RATESWING", 1);
+    simcfg.rateperiod = envdouble("MHSIM_RATEPERIOD", 10);
+    simcfg.openms = envdouble("MHSIM_OPENMS", 0);
+    simcfg.initms = envdouble("MHSIM_INITMS", 0);
+    simcfg.trigrate = envdouble("MHSIM_TRIGRATE", 0);
+    simcfg.trigduty = envdouble("MHSIM_TRIGDUTY", 0.5);
+    simt0 = mh_timems();
+    if (simcfg.nchannels < 1 || simcfg.nchannels > MAXINPCHAN)
+        simcfg.nchannels = 16;
+    for (i = 0; i < MAXDEVNUM; i++)
+        mhmutex_init(&sims[i].lock);
+}
+
+void MHSIM_SetConfig(const mhsim_config* cfg)
+{
+    siminit();
+    simcfg = *cfg;
+    if (simcfg.nchannels < 1 || simcfg.nchannels > MAXINPCHAN)
+        simcfg.nchannels = 16;
+}
+
+void MHSIM_GetConfig(mhsim_config* cfg)
+{
+    siminit();
+    *cfg = simcfg;
+}
+
+
+// random numbers, xorshift64*
+
+static double urand(simdev* d)
+{
+    d->rng ^= d->rng >> 12;
+    d->rng ^= d->rng << 25;
+    d->rng ^= d->rng >> 27;
+    return (double)((d->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double erand(simdev* d)
+{
+    return -log(1.0 - urand(d));
+}
+
+static double nrand(simdev* d)
+{
+    double u = urand(d), v = urand(d);
+    return sqrt(-2.0 * log(1.0 - u)) * cos(6.283185307179586 * v);
+}
+
+static unsigned int poisson(simdev* d, double lambda)
+{
+    double l, p, x;
+    unsigned int k;
+
+    if (lambda <= 0)
+        return 0;
+    if (lambda < 12) // Knuth
+    {
+        l = exp(-lambda);
+        k = 0;
+        p = urand(d);
+        while (p > l)
+        {
+            k++;
+            p *= urand(d);
+        }
+        return k;
+    }
+    x = floor(lambda + sqrt(lambda) * nrand(d) + 0.5); // normal approximation
+    return x < 0 ? 0 : (unsigned int)x;
+}
+
+
+// timing model: every call costs the control latency, bulk data the USB time
+
+static void waituntil(double tms)
+{
+    double left;
+
+    for (;;)
+    {
+        left = tms - mh_timems();
+        if (left <= 0)
+            return;
+        if (left > 0.2)
+        {
+#ifdef _WIN32
+            Sleep(left > 2 ? (DWORD)(left - 1) : 0);
+#else
+            usleep((useconds_t)((left - 0.1) * 1000));
+#endif
+        }
+    }
+}
+
+static double bulkms(double bytes)
+{
+    return simcfg.usb_mbps > 0 ? bytes / (simcfg.usb_mbps * 1e3) : 0;
+}
+
+static double callstart(void)
+{
+    return mh_timems() + simcfg.calllat_us / 1000.0;
+}
+
+
+#define GETDEV(devidx) \
+    simdev* d; \
+    if ((devidx) < 0 || (devidx) >= MAXDEVNUM) return MH_ERROR_INVALID_ARGUMENT; \
+    siminit(); \
+    d = &sims[devidx]; \
+    if (!d->open) return MH_ERROR_DEVICE_NOT_OPEN;
+
+#define GETINIT(devidx) \
+    GETDEV(devidx) \
+    if (!d->initialized) return MH_ERROR_NOT_INITIALIZED;
+
+
+// histogram model
+
+static double resolution(simdev* d)
+{
+    return SIMBASERES * (double)(1 << d->binning);
+}
+
+static void updateweights(simdev* d)
+{
+    double tl = 1e12 / simcfg.syncrate; // laser period in ps
+    double res = resolution(d);
+    double norm = 1.0 - exp(-(tl - SIMT0) / SIMTAU);
+    double t, x, f;
+    int i;
+
+    d->peakrate = 0;
+    for (i = 0; i < d->histlen; i++)
+    {
+        t = d->offset * 1000.0 + (i + 0.5) * res;
+        if (t >= tl * d->syncdiv)
+        {
+            d->weight[i] = 0; // beyond the next divided sync
+            continue;
+        }
+        x = fmod(t, tl);
+        f = SIMBKG;
+        if (x >= SIMT0)
+            f += (1.0 - SIMBKG) * tl / SIMTAU * exp(-(x - SIMT0) / SIMTAU) / norm;
+        d->weight[i] = simcfg.countrate / d->syncdiv * res / tl * f;
+        if (d->weight[i] > d->peakrate)
+            d->peakrate = d->weight[i];
+    }
+    d->weightdirty = 0;
+}
+
+static double chanscale(int ch)
+{
+    return 1.0 - 0.01 * (ch % 16); // make the channels distinguishable
+}
+
+// factor on the histogram count rates at host time tms, see MHSIM_RATESWING
+static double rateswing(double tms)
+{
+    if (simcfg.rateswing <= 1 || simcfg.rateperiod <= 0)
+        return 1;
+    return pow(simcfg.rateswing, 0.5 * sin(2 * 3.14159265358979 * (tms - simt0) / (simcfg.rateperiod * 1000)));
+}
+
+// the first edge of the C1 signal after host time t (ms): a square wave of
+// MHSIM_TRIGRATE that is high for MHSIM_TRIGDUTY of its period from simt0;
+// a very late time if there is no C1 signal
+static double nexttrig(int edge, double t)
+{
+    double period, first;
+
+    if (simcfg.trigrate <= 0)
+        return 1e300;
+    period = 1000.0 / simcfg.trigrate;
+    first = simt0 + (edge == EDGE_RISING ? 0 : simcfg.trigduty * period);
+    return t <= first ? first : first + ceil((t - first) / period) * period;
+}
+
+// measurement end (host ms) as seen at time now, the start while it waits for C1
+static double measnow(simdev* d, double now)
+{
+    if (!d->running)
+        return d->tstop;
+    if (now < d->tstart)
+        return d->tstart;
+    return now < d->tend ? now : d->tend;
+}
+
+// adds the counts of the measurement time not yet in hist
+static void fold(simdev* d, double now)
+{
+    double upto = measnow(d, now) - d->tstart;
+    double dt = (upto - d->tfolded) / 1000.0;
+    double first = 1; // earliest stop count crossing, as a fraction of this time
+    unsigned int* h;
+    unsigned int c;
+    int i, ch;
+
+    if (d->mode != MODE_HIST || dt <= 0)
+        return;
+    if (d->weightdirty)
+        updateweights(d);
+    dt *= rateswing(d->tstart + (d->tfolded + upto) / 2); // the swing is slow, its middle value will do
+    if (d->measctrl == MEASCTRL_C1_GATED)
+        dt *= simcfg.trigrate > 0 ? simcfg.trigduty : 0; // counting only while the gate is open
+    for (ch = 0; ch < d->nchannels; ch++)
+    {
+        if (!d->enabled[ch])
+            continue;
+        h = d->hist + (size_t)ch * MAXHISTLEN;
+        for (i = 0; i < d->histlen; i++)
+        {
+            c = poisson(d, d->weight[i] * chanscale(ch) * dt);
+            if ((unsigned long long)h[i] + c >= d->stopcount && d->stopovfl)
+            {
+                if (c > 0 && (double)(d->stopcount - h[i]) / c < first)
+                    first = (double)(d->stopcount - h[i]) / c;
+                h[i] = d->stopcount;
+                d->flags |= FLAG_OVERFLOW;
+            }
+            else if ((unsigned long long)h[i] + c > 0xFFFFFFFFu)
+            {
+                h[i] = 0xFFFFFFFFu;
+                d->flags |= FLAG_OVERFLOW;
+            }
+            else
+                h[i] += c;
+        }
+    }
+    if (first < 1)
+    {
+        // the prediction in MH_StartMeas missed a fluctuation, the measurement ended here
+        upto = d->tfolded + first * (upto - d->tfolded);
+        d->tend = d->tstart + upto;
+        if (!d->running && d->tstop > d->tend)
+            d->tstop = d->tend;
+    }
+    d->tfolded = upto;
+}
+
+static unsigned int peakbin(simdev* d)
+{
+    unsigned int m = 0;
+    unsigned int* h;
+    int i, ch;
+
+    for (ch = 0; ch < d->nchannels; ch++)
+    {
+        h = d->hist + (size_t)ch * MAXHISTLEN;
+        for (i = 0; i < d->histlen; i++)
+            if (h[i] > m)
+                m = h[i];
+    }
+    return m;
+}
+
+
+// TTTR model
+
+static int nenabled(simdev* d)
+{
+    int i, n = 0;
+    for (i = 0; i < d->nchannels; i++)
+        n += d->enabled[i] != 0;
+    return n;
+}
+
+static void ttreset(simdev* d)
+{
+    int n = nenabled(d);
+    d->tnext = n > 0 ? erand(d) * 1e12 / (simcfg.countrate * n) : 1e300;
+    d->tpair = -1;
+    d->tmarker = simcfg.markerrate > 0 && d->markeren[0] ? 1e12 / simcfg.markerrate : 1e300;
+    d->tsync = d->syncenable ? 0 : 1e300;
+    d->ofl = 0;
+    d->fqhead = d->fqdec2 = d->fqdec1 = d->fqtail = 0;
+}
+
+// appends overflow records until the wraparound counter covers ticks
+static int ttoverflow(simdev* d, unsigned int* buf, int n, int max, long long ticks, long long wrap)
+{
+    long long k;
+
+    while (ticks - d->ofl * wrap >= wrap && n < max)
+    {
+        k = ticks / wrap - d->ofl;
+        if (k > 1023 && wrap == T3WRAP) k = 1023;
+        if (k > T2WRAP - 1) k = T2WRAP - 1;
+        buf[n++] = 0x80000000u | (0x3Fu << 25) | (unsigned int)k;
+        d->ofl += k;
+    }
+    return n;
+}
+
+// takes the earliest pending event if it is not later than upto (ps)
+static int nextevent(simdev* d, double upto, int nen, simevent* ev)
+{
+    double t = d->tnext;
+    int ch = -1, special = 0, en;
+
+    if (d->tpair >= 0 && d->tpair < t) { t = d->tpair; ch = d->pairch; }
+    if (d->tmarker < t) { t = d->tmarker; special = 1; }
+    if (d->mode == MODE_T2 && d->tsync < t) { t = d->tsync; special = 2; }
+    if (t > upto)
+        return 0;
+
+    if (special == 1)
+        d->tmarker += 1e12 / simcfg.markerrate;
+    else if (special == 2)
+        d->tsync += 1e12 / simcfg.syncrate * d->syncdiv;
+    else if (ch >= 0)
+        d->tpair = -1;
+    else
+    {
+        en = (int)(urand(d) * nen);
+        for (ch = 0; ch < d->nchannels; ch++)
+            if (d->enabled[ch] && en-- == 0)
+                break;
+        d->tnext += erand(d) * 1e12 / (simcfg.countrate * nen);
+        if (d->tpair < 0 && urand(d) < simcfg.pairfrac && (ch ^ 1) < d->nchannels && d->enabled[ch ^ 1])
+        {
+            d->pairch = ch ^ 1;
+            d->tpair = t + SIMPAIRDELAY + SIMPAIRJIT * nrand(d);
+            if (d->tpair < t) d->tpair = t;
+        }
+    }
+    ev->t = t;
+    ev->ch = ch;
+    ev->special = special;
+    ev->pass1 = 1;
+    return 1;
+}
+
+// appends the record of one event, with the overflows before it
+static int ttrecord(simdev* d, unsigned int* buf, int n, int max, const simevent* ev)
+{
+    double tl = 1e12 / simcfg.syncrate, tsyncdiv = tl * d->syncdiv;
+    double res, x;
+    long long ticks, nsync;
+    int dtime;
+
+    if (d->mode == MODE_T2)
+    {
+        ticks = (long long)(ev->t / SIMBASERES);
+        n = ttoverflow(d, buf, n, max, ticks, T2WRAP);
+        ticks -= d->ofl * T2WRAP;
+        if (ev->special == 1)
+            buf[n++] = 0x80000000u | (1u << 25) | (unsigned int)ticks;
+        else if (ev->special == 2)
+            buf[n++] = 0x80000000u | (unsigned int)ticks;
+        else
+            buf[n++] = ((unsigned int)ev->ch << 25) | (unsigned int)ticks;
+    }
+    else
+    {
+        res = resolution(d);
+        nsync = (long long)(ev->t / tsyncdiv);
+        n = ttoverflow(d, buf, n, max, nsync, T3WRAP);
+        nsync -= d->ofl * T3WRAP;
+        if (ev->special == 1)
+            buf[n++] = 0x80000000u | (1u << 25) | (unsigned int)nsync;
+        else
+        {
+            // arrival within the divided sync period follows the decay model
+            x = urand(d) < SIMBKG ? urand(d) * tl : SIMT0 + SIMTAU * erand(d);
+            x = fmod(x, tl) + tl * (int)(urand(d) * d->syncdiv);
+            dtime = (int)(x / res);
+            if (dtime <= 32767)
+                buf[n++] = ((unsigned int)ev->ch << 25) | ((unsigned int)dtime << 10) | (unsigned int)nsync;
+        }
+    }
+    return n;
+}
+
+// whether event e counts for filter f: a channel in use, behind the row
+// filters for the main filter; the sync is bit 8 of row 0 and only seen by
+// the main filter in T2 mode, markers are never filtered
+static int filterused(simdev* d, const simfilter* f, int stage, const simevent* e)
+{
+    if (e->special == 1 || (e->special == 2 && (stage == 1 || d->mode != MODE_T2)))
+        return 0;
+    if (stage == 2 && !e->pass1)
+        return 0;
+    if (e->special == 2)
+        return (f->use[0] >> 8) & 1;
+    return (f->use[e->ch / 8] >> (e->ch % 8)) & 1;
+}
+
+// decides on queued event i: pass channels pass, channels not in use are
+// dropped, the others pass if enough other events in use lie within the range
+static int filterpass(simdev* d, const simfilter* f, int stage, long long i)
+{
+    const simevent* e = &d->fq[i & (SIMFILTQ - 1)];
+    const simevent* o;
+    long long j;
+    int row = e->special == 2 ? 0 : e->ch / 8, bit = e->special == 2 ? 8 : e->ch % 8;
+    int count = 0;
+
+    if (e->special == 1 || (e->special == 2 && (stage == 1 || d->mode != MODE_T2)))
+        return 1;
+    if ((f->pass[row] >> bit) & 1)
+        return 1;
+    if (!((f->use[row] >> bit) & 1))
+        return 0;
+    for (j = i - 1; j >= d->fqhead; j--)
+    {
+        o = &d->fq[j & (SIMFILTQ - 1)];
+        if (o->t < e->t - f->range)
+            break;
+        count += filterused(d, f, stage, o);
+    }
+    for (j = i + 1; j < d->fqtail; j++)
+    {
+        o = &d->fq[j & (SIMFILTQ - 1)];
+        if (o->t > e->t + f->range)
+            break;
+        count += filterused(d, f, stage, o);
+    }
+    return (count >= f->match) != f->inverse;
+}
+
+static int filtering(simdev* d)
+{
+    int r;
+
+    if (d->mainfilt.enable || d->filtertest)
+        return 1;
+    for (r = 0; r <= ROWIDXMAX; r++)
+        if (d->rowfilt[r].enable)
+            return 1;
+    return 0;
+}
+
+// ttgenerate with the event filters: an event is decided by the row filter
+// of its row once every event within that range is known, and by the main
+// filter once every row decision within the main range is made
+static int ttfiltered(simdev* d, unsigned int* buf, int max, double upto, int nen)
+{
+    double r1 = 0, r2 = d->mainfilt.enable ? d->mainfilt.range : 0;
+    simevent *e, *o;
+    int r, n = 0, idx;
+
+    for (r = 0; r <= ROWIDXMAX; r++)
+        if (d->rowfilt[r].enable && d->rowfilt[r].range > r1)
+            r1 = d->rowfilt[r].range;
+    while (n < max - 2)
+    {
+        // everything the next main decision depends on, unless the queue is full
+        while (d->fqtail - d->fqhead < SIMFILTQ
+            && (d->fqtail == d->fqdec2 || d->fq[(d->fqtail - 1) & (SIMFILTQ - 1)].t <= d->fq[d->fqdec2 & (SIMFILTQ - 1)].t + r1 + r2)
+            && nextevent(d, upto + r1 + r2, nen, &d->fq[d->fqtail & (SIMFILTQ - 1)]))
+            d->fqtail++;
+        if (d->fqdec2 == d->fqtail || d->fq[d->fqdec2 & (SIMFILTQ - 1)].t > upto)
+            break;
+        e = &d->fq[d->fqdec2 & (SIMFILTQ - 1)];
+
+        // row decisions as far as the main filter looks ahead
+        while (d->fqdec1 < d->fqtail && d->fq[d->fqdec1 & (SIMFILTQ - 1)].t <= e->t + r2)
+        {
+            o = &d->fq[d->fqdec1 & (SIMFILTQ - 1)];
+            if (o->special == 0 && d->rowfilt[o->ch / 8].enable)
+                o->pass1 = filterpass(d, &d->rowfilt[o->ch / 8], 1, d->fqdec1);
+            if (o->special != 1)
+            {
+                idx = o->special == 2 ? MAXINPCHAN : o->ch;
+                d->fcount[0][idx]++;
+                d->fcount[1][idx] += o->pass1;
+            }
+            d->fqdec1++;
+        }
+        if (e->pass1 && (!d->mainfilt.enable || filterpass(d, &d->mainfilt, 2, d->fqdec2)))
+        {
+            if (e->special != 1)
+                d->fcount[2][e->special == 2 ? MAXINPCHAN : e->ch]++;
+            if (!d->filtertest)
+                n = ttrecord(d, buf, n, max, e);
+        }
+        d->fqdec2++;
+
+        // drop what no later decision looks back at
+        while (d->fqhead < d->fqdec2 && d->fq[d->fqhead & (SIMFILTQ - 1)].t < e->t - r1 - r2)
+            d->fqhead++;
+    }
+    return n;
+}
+
+// generates the records between the last call and measurement time upto (ps)
+static int ttgenerate(simdev* d, unsigned int* buf, int max, double upto)
+{
+    simevent ev;
+    int n = 0, nen = nenabled(d);
+
+    if (d->fq && (filtering(d) || d->fqdec2 < d->fqtail))
+        return ttfiltered(d, buf, max, upto, nen);
+    while (n < max - 2 && nextevent(d, upto, nen, &ev)) // leave room for an overflow record
+        n = ttrecord(d, buf, n, max, &ev);
+    return n;
+}
+
+
+// library and device handling
+
+int MH_GetLibraryVersion(char* vers)
+{
+    siminit(); // the first call of a program, before it starts threads
+    strcpy(vers, LIB_VERSION);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetErrorString(char* errstring, int errcode)
+{
+    const char* s;
+
+    switch (errcode)
+    {
+    case MH_ERROR_NONE: s = "No error"; break;
+    case MH_ERROR_DEVICE_OPEN_FAIL: s = "Cannot open device"; break;
+    case MH_ERROR_DEVICE_BUSY: s = "Device busy"; break;
+    case MH_ERROR_DEVICE_NOT_OPEN: s = "Device not open"; break;
+    case MH_ERROR_INSTANCE_RUNNING: s = "Measurement running"; break;
+    case MH_ERROR_INVALID_ARGUMENT: s = "Invalid argument"; break;
+    case MH_ERROR_INVALID_MODE: s = "Invalid mode"; break;
+    case MH_ERROR_INVALID_OPTION: s = "Invalid option"; break;
+    case MH_ERROR_NOT_INITIALIZED: s = "Not initialized"; break;
+    case MH_ERROR_UNSUPPORTED_FUNCTION: s = "Function not supported (simulator)"; break;
+    default: s = "Unknown error (simulator)"; break;
+    }
+    sprintf(errstring, "%s", s);
+    return MH_ERROR_NONE;
+}
+
+int MH_OpenDevice(int devidx, char* serial)
+{
+    simdev* d;
+
+    if (devidx < 0 || devidx >= MAXDEVNUM)
+        return MH_ERROR_INVALID_ARGUMENT;
+    siminit();
+    d = &sims[devidx];
+    if (devidx >= simcfg.ndevices)
+    {
+        waituntil(mh_timems() + simcfg.openms); // probing an empty index costs the same
+        return MH_ERROR_DEVICE_OPEN_FAIL;
+    }
+    mhmutex_lock(&d->lock);
+    waituntil(callstart() + simcfg.openms);
+    if (!d->open)
+    {
+        d->open = 1;
+        d->initialized = 0;
+        sprintf(d->serial, "%08d", 1040000 + devidx);
+    }
+    strcpy(serial, d->serial);
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_CloseDevice(int devidx)
+{
+    simdev* d;
+
+    if (devidx < 0 || devidx >= MAXDEVNUM)
+        return MH_ERROR_INVALID_ARGUMENT;
+    siminit();
+    d = &sims[devidx];
+    mhmutex_lock(&d->lock);
+    d->open = 0;
+    d->initialized = 0;
+    d->running = 0;
+    free(d->hist);
+    free(d->weight);
+    free(d->fq);
+    d->hist = NULL;
+    d->weight = NULL;
+    d->fq = NULL;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_Initialize(int devidx, int mode, int refsource)
+{
+    int i;
+    GETDEV(devidx)
+
+    if (mode != MODE_HIST && mode != MODE_T2 && mode != MODE_T3)
+        return MH_ERROR_INVALID_MODE;
+    if (refsource < REFSRC_INTERNAL || refsource > REFSRC_WR_GRANDM_MHARP)
+        return MH_ERROR_INVALID_ARGUMENT;
+    mhmutex_lock(&d->lock);
+    waituntil(callstart() + 50 * simcfg.calllat_us / 1000.0 + simcfg.initms); // init is a long sequence of transactions
+    free(d->hist);
+    free(d->weight);
+    free(d->fq);
+    d->nchannels = simcfg.nchannels;
+    d->hist = (unsigned int*)calloc((size_t)d->nchannels * MAXHISTLEN, sizeof(unsigned int));
+    d->weight = (double*)calloc(MAXHISTLEN, sizeof(double));
+    d->fq = mode == MODE_HIST ? NULL : (simevent*)malloc(SIMFILTQ * sizeof(simevent));
+    memset(d->rowfilt, 0, sizeof(d->rowfilt));
+    memset(&d->mainfilt, 0, sizeof(d->mainfilt));
+    d->filtertest = 0;
+    if (!d->hist || !d->weight || (mode != MODE_HIST && !d->fq))
+    {
+        mhmutex_unlock(&d->lock);
+        return MH_ERROR_INVALID_MEMORY;
+    }
+    d->mode = mode;
+    d->refsource = refsource;
+    d->syncdiv = 1;
+    d->syncenable = 1;
+    for (i = 0; i < MAXINPCHAN; i++)
+        d->enabled[i] = 1;
+    d->lencode = MAXLENCODE;
+    d->histlen = 1024 << MAXLENCODE;
+    d->binning = 0;
+    d->offset = 0;
+    d->stopovfl = 1;
+    d->stopcount = (unsigned int)STOPCNTMAX;
+    d->measctrl = MEASCTRL_SINGLESHOT_CTC;
+    memset(d->markeren, 0, sizeof(d->markeren));
+    d->running = 0;
+    d->flags = 0;
+    d->tfolded = 0;
+    d->tstart = d->tend = d->tstop = 0;
+    d->weightdirty = 1;
+    d->rng = 0x9E3779B97F4A7C15ULL * (simcfg.seed + 1) + (unsigned long long)devidx * 0x2545F4914F6CDD1DULL;
+    d->initialized = 1;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+
+// generic setter: applies one assignment under the device lock after the call latency
+#define SETTER(devidx, check, body) \
+    GETINIT(devidx) \
+    if (!(check)) return MH_ERROR_INVALID_ARGUMENT; \
+    mhmutex_lock(&d->lock); \
+    waituntil(callstart()); \
+    body; \
+    mhmutex_unlock(&d->lock); \
+    return MH_ERROR_NONE;
+
+int MH_GetHardwareInfo(int devidx, char* model, char* partno, char* version)
+{
+    GETINIT(devidx)
+    strcpy(model, "MultiHarp 160 (sim)");
+    strcpy(partno, "930043");
+    strcpy(version, "2.0");
+    return MH_ERROR_NONE;
+}
+
+int MH_GetSerialNumber(int devidx, char* serial)
+{
+    GETINIT(devidx)
+    strcpy(serial, d->serial);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetFeatures(int devidx, int* features)
+{
+    GETINIT(devidx)
+    *features = FEATURE_DLL | FEATURE_TTTR | FEATURE_MARKERS | FEATURE_LOWRES | FEATURE_TRIGOUT
+        | FEATURE_PROG_TD | FEATURE_PROG_HYST | FEATURE_EVNT_FILT;
+    return MH_ERROR_NONE;
+}
+
+int MH_GetBaseResolution(int devidx, double* resolution, int* binsteps)
+{
+    GETINIT(devidx)
+    *resolution = SIMBASERES;
+    *binsteps = MAXBINSTEPS;
+    return MH_ERROR_NONE;
+}
+
+int MH_GetNumOfInputChannels(int devidx, int* nchannels)
+{
+    GETINIT(devidx)
+    *nchannels = d->nchannels;
+    return MH_ERROR_NONE;
+}
+
+int MH_SetSyncDiv(int devidx, int div)
+{
+    SETTER(devidx, div >= SYNCDIVMIN && div <= SYNCDIVMAX, d->syncdiv = div; d->weightdirty = 1)
+}
+
+int MH_SetSyncEdgeTrg(int devidx, int level, int edge)
+{
+    SETTER(devidx, level >= TRGLVLMIN && level <= TRGLVLMAX && (edge == 0 || edge == 1), (void)0)
+}
+
+int MH_SetSyncChannelOffset(int devidx, int value)
+{
+    SETTER(devidx, value >= CHANOFFSMIN && value <= CHANOFFSMAX, (void)0)
+}
+
+int MH_SetSyncChannelEnable(int devidx, int enable)
+{
+    SETTER(devidx, enable == 0 || enable == 1, d->syncenable = enable)
+}
+
+int MH_SetSyncDeadTime(int devidx, int on, int deadtime)
+{
+    SETTER(devidx, !on || (deadtime >= EXTDEADMIN && deadtime <= EXTDEADMAX), (void)0)
+}
+
+int MH_SetInputEdgeTrg(int devidx, int channel, int level, int edge)
+{
+    SETTER(devidx, channel >= 0 && channel < d->nchannels && level >= TRGLVLMIN && level <= TRGLVLMAX, (void)edge)
+}
+
+int MH_SetInputChannelOffset(int devidx, int channel, int value)
+{
+    SETTER(devidx, channel >= 0 && channel < d->nchannels && value >= CHANOFFSMIN && value <= CHANOFFSMAX, (void)0)
+}
+
+int MH_SetInputDeadTime(int devidx, int channel, int on, int deadtime)
+{
+    SETTER(devidx, channel >= 0 && channel < d->nchannels && (!on || (deadtime >= EXTDEADMIN && deadtime <= EXTDEADMAX)), (void)0)
+}
+
+int MH_SetInputHysteresis(int devidx, int hystcode)
+{
+    SETTER(devidx, hystcode >= HYSTCODEMIN && hystcode <= HYSTCODEMAX, (void)0)
+}
+
+int MH_SetInputChannelEnable(int devidx, int channel, int enable)
+{
+    SETTER(devidx, channel >= 0 && channel < d->nchannels && (enable == 0 || enable == 1), d->enabled[channel] = enable)
+}
+
+int MH_SetStopOverflow(int devidx, int stop_ovfl, unsigned int stopcount)
+{
+    SETTER(devidx, stopcount >= STOPCNTMIN, d->stopovfl = stop_ovfl; d->stopcount = stopcount)
+}
+
+int MH_SetBinning(int devidx, int binning)
+{
+    SETTER(devidx, binning >= 0 && binning < MAXBINSTEPS, d->binning = binning; d->weightdirty = 1)
+}
+
+int MH_SetOffset(int devidx, int offset)
+{
+    SETTER(devidx, offset >= OFFSETMIN && offset <= OFFSETMAX, d->offset = offset; d->weightdirty = 1)
+}
+
+int MH_SetHistoLen(int devidx, int lencode, int* actuallen)
+{
+    SETTER(devidx, lencode >= MINLENCODE && lencode <= MAXLENCODE,
+        d->lencode = lencode; d->histlen = 1024 << lencode; *actuallen = d->histlen; d->weightdirty = 1;
+        memset(d->hist, 0, (size_t)d->nchannels * MAXHISTLEN * sizeof(unsigned int)))
+}
+
+int MH_SetMeasControl(int devidx, int control, int startedge, int stopedge)
+{
+    SETTER(devidx, control >= MEASCTRL_SINGLESHOT_CTC && control <= MEASCTRL_SW_START_SW_STOP,
+        d->measctrl = control; d->startedge = startedge; d->stopedge = stopedge)
+}
+
+int MH_SetTriggerOutput(int devidx, int period)
+{
+    SETTER(devidx, period >= TRIGOUTMIN && period <= TRIGOUTMAX, (void)0)
+}
+
+
+// measurement
+
+int MH_ClearHistMem(int devidx)
+{
+    double now;
+    int ch;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    now = callstart();
+    waituntil(now);
+    if (d->tstart > 0)
+        d->tfolded = measnow(d, now) - d->tstart; // counts up to now are discarded with the rest
+    for (ch = 0; ch < d->nchannels; ch++)
+        memset(d->hist + (size_t)ch * MAXHISTLEN, 0, d->histlen * sizeof(unsigned int));
+    d->flags &= ~FLAG_OVERFLOW;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_StartMeas(int devidx, int tacq)
+{
+    double now, tovfl;
+    unsigned long long ps;
+    int i;
+    GETINIT(devidx)
+
+    if (tacq < ACQTMIN || tacq > ACQTMAX)
+        return MH_ERROR_INVALID_ARGUMENT;
+    mhmutex_lock(&d->lock);
+    if (d->running)
+    {
+        mhmutex_unlock(&d->lock);
+        return MH_ERROR_INSTANCE_RUNNING;
+    }
+    now = callstart();
+    waituntil(now);
+    d->running = 1;
+    d->tacq = tacq;
+    if (d->mode == MODE_HIST && (d->measctrl == MEASCTRL_C1_START_CTC_STOP || d->measctrl == MEASCTRL_C1_START_C2_STOP))
+        now = nexttrig(d->startedge, now); // armed, the measurement starts with C1
+    d->tstart = now;
+    d->tend = now + tacq;
+    if (d->mode == MODE_HIST && d->measctrl == MEASCTRL_C1_START_C2_STOP && simcfg.trigrate > 0
+        && simcfg.trigduty * 1000.0 / simcfg.trigrate < tacq)
+        d->tend = now + simcfg.trigduty * 1000.0 / simcfg.trigrate; // C2 is C1 delayed by the high time
+    d->tfolded = 0;
+    d->flags &= ~(FLAG_FIFOFULL | FLAG_CNTS_DROPPED);
+    if (d->mode == MODE_HIST)
+    {
+        // the hardware stops by itself when a bin reaches the stop count
+        if (d->weightdirty)
+            updateweights(d);
+        if (d->stopovfl && d->peakrate > 0)
+        {
+            // fold counts at the swing of the middle of the time, so look for the stop the same way
+            tovfl = ((double)d->stopcount - peakbin(d)) / (d->peakrate * rateswing(now)) * 1000.0;
+            for (i = 0; i < 4 && tovfl > 0 && tovfl < tacq; i++)
+                tovfl = ((double)d->stopcount - peakbin(d)) / (d->peakrate * rateswing(now + tovfl / 2)) * 1000.0;
+            if (d->measctrl == MEASCTRL_C1_GATED)
+                tovfl = simcfg.trigrate > 0 ? tovfl / simcfg.trigduty : tacq;
+            if (now + tovfl < d->tend)
+                d->tend = now + (tovfl > 0 ? tovfl : 0);
+        }
+    }
+    else
+        ttreset(d);
+    ps = now < 1e12 ? (unsigned long long)(now * 1e9) : 0; // 0 until a trigger, if ever
+    d->starttime[0] = (unsigned int)ps;
+    d->starttime[1] = (unsigned int)(ps >> 32);
+    d->starttime[2] = 0;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_StopMeas(int devidx)
+{
+    double now;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    now = callstart();
+    waituntil(now);
+    if (d->running)
+    {
+        d->tstop = measnow(d, now);
+        d->running = 0;
+    }
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_CTCStatus(int devidx, int* ctcstatus)
+{
+    double now;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    now = callstart();
+    waituntil(now);
+    if (d->running && d->stopovfl)
+        fold(d, now); // a bin may reach the stop count earlier than predicted
+    *ctcstatus = !d->running || now >= d->tend;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+static int readhist(simdev* d, unsigned int* chcount, int ch0, int nch)
+{
+    double t0 = callstart();
+    int ch;
+
+    fold(d, t0);
+    for (ch = ch0; ch < ch0 + nch; ch++)
+        memcpy(chcount + (size_t)(ch - ch0) * d->histlen, d->hist + (size_t)ch * MAXHISTLEN,
+            d->histlen * sizeof(unsigned int));
+    waituntil(t0 + bulkms((double)nch * d->histlen * sizeof(unsigned int)));
+    return MH_ERROR_NONE;
+}
+
+int MH_GetHistogram(int devidx, unsigned int* chcount, int channel)
+{
+    int ret;
+    GETINIT(devidx)
+
+    if (d->mode != MODE_HIST)
+        return MH_ERROR_INVALID_MODE;
+    if (channel < 0 || channel >= d->nchannels || d->lencode < 2)
+        return MH_ERROR_INVALID_ARGUMENT;
+    mhmutex_lock(&d->lock);
+    ret = readhist(d, chcount, channel, 1);
+    mhmutex_unlock(&d->lock);
+    return ret;
+}
+
+int MH_GetAllHistograms(int devidx, unsigned int* chcount)
+{
+    int ret;
+    GETINIT(devidx)
+
+    if (d->mode != MODE_HIST)
+        return MH_ERROR_INVALID_MODE;
+    mhmutex_lock(&d->lock);
+    ret = readhist(d, chcount, 0, d->nchannels);
+    mhmutex_unlock(&d->lock);
+    return ret;
+}
+
+int MH_GetResolution(int devidx, double* resolution)
+{
+    GETINIT(devidx)
+    *resolution = SIMBASERES * (double)(1 << d->binning);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetSyncPeriod(int devidx, double* period)
+{
+    GETINIT(devidx)
+    *period = simcfg.syncrate > 0 ? d->syncdiv / simcfg.syncrate : 0;
+    return MH_ERROR_NONE;
+}
+
+int MH_GetSyncRate(int devidx, int* syncrate)
+{
+    GETINIT(devidx)
+    mhmutex_lock(&d->lock);
+    waituntil(callstart());
+    *syncrate = d->syncenable ? (int)simcfg.syncrate : 0;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+static int countrate(simdev* d, int ch)
+{
+    double rate = simcfg.countrate * rateswing(mh_timems());
+
+    if (!d->enabled[ch])
+        return 0;
+    return (int)(rate * chanscale(ch) + sqrt(rate) * nrand(d));
+}
+
+int MH_GetCountRate(int devidx, int channel, int* cntrate)
+{
+    GETINIT(devidx)
+    if (channel < 0 || channel >= d->nchannels)
+        return MH_ERROR_INVALID_ARGUMENT;
+    mhmutex_lock(&d->lock);
+    waituntil(callstart());
+    *cntrate = countrate(d, channel);
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetAllCountRates(int devidx, int* syncrate, int* cntrates)
+{
+    int i;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    waituntil(callstart());
+    *syncrate = d->syncenable ? (int)simcfg.syncrate : 0;
+    for (i = 0; i < d->nchannels; i++)
+        cntrates[i] = countrate(d, i);
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetFlags(int devidx, int* flags)
+{
+    double now;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    now = callstart();
+    waituntil(now);
+    fold(d, now);
+    *flags = d->flags;
+    if (d->running && now < d->tend)
+        *flags |= FLAG_ACTIVE;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetElapsedMeasTime(int devidx, double* elapsed)
+{
+    double now;
+    GETINIT(devidx)
+
+    mhmutex_lock(&d->lock);
+    now = callstart();
+    waituntil(now);
+    *elapsed = d->tstart > 0 ? measnow(d, now) - d->tstart : 0;
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetStartTime(int devidx, unsigned int* timedw2, unsigned int* timedw1, unsigned int* timedw0)
+{
+    GETINIT(devidx)
+    mhmutex_lock(&d->lock);
+    waituntil(callstart());
+    *timedw2 = d->starttime[2];
+    *timedw1 = d->starttime[1];
+    *timedw0 = d->starttime[0];
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetWarnings(int devidx, int* warnings)
+{
+    GETINIT(devidx)
+    *warnings = 0;
+    if (simcfg.syncrate <= 0)
+        *warnings |= WARNING_SYNC_RATE_ZERO;
+    if (simcfg.countrate <= 0)
+        *warnings |= WARNING_INPT_RATE_ZERO;
+    return MH_ERROR_NONE;
+}
+
+int MH_GetWarningsText(int devidx, char* text, int warnings)
+{
+    GETINIT(devidx)
+    text[0] = 0;
+    if (warnings & WARNING_SYNC_RATE_ZERO)
+        strcat(text, "\nSync rate is zero (simulator configuration).");
+    if (warnings & WARNING_INPT_RATE_ZERO)
+        strcat(text, "\nInput rate is zero (simulator configuration).");
+    return MH_ERROR_NONE;
+}
+
+
+// time tagging modes
+
+int MH_SetOflCompression(int devidx, int holdtime)
+{
+    SETTER(devidx, holdtime >= HOLDTIMEMIN && holdtime <= HOLDTIMEMAX, (void)0)
+}
+
+int MH_SetMarkerHoldoffTime(int devidx, int holdofftime)
+{
+    SETTER(devidx, holdofftime >= HOLDOFFMIN && holdofftime <= HOLDOFFMAX, (void)0)
+}
+
+int MH_SetMarkerEdges(int devidx, int me1, int me2, int me3, int me4)
+{
+    SETTER(devidx, (me1 | me2 | me3 | me4) <= 1, (void)0)
+}
+
+int MH_SetMarkerEnable(int devidx, int en1, int en2, int en3, int en4)
+{
+    SETTER(devidx, 1, d->markeren[0] = en1; d->markeren[1] = en2; d->markeren[2] = en3; d->markeren[3] = en4)
+}
+
+int MH_ReadFiFo(int devidx, unsigned int* buffer, int* nactual)
+{
+    double t0, upto, backlog;
+    GETINIT(devidx)
+
+    if (d->mode == MODE_HIST)
+        return MH_ERROR_INVALID_MODE;
+    mhmutex_lock(&d->lock);
+    t0 = callstart();
+    *nactual = 0;
+    if (d->tstart > 0)
+    {
+        upto = (measnow(d, t0) - d->tstart) * 1e9; // ps
+        backlog = (upto - d->tnext) * 1e-12 * simcfg.countrate * nenabled(d);
+        if (backlog > SIMFIFODEPTH && d->running)
+        {
+            // the host did not keep up, the device stops like the real one does
+            upto = d->tnext + SIMFIFODEPTH / (simcfg.countrate * nenabled(d)) * 1e12;
+            d->flags |= FLAG_FIFOFULL;
+            d->tstop = d->tstart + upto * 1e-9;
+            d->running = 0;
+        }
+        *nactual = ttgenerate(d, buffer, TTREADMAX, upto);
+    }
+    waituntil(t0 + bulkms(*nactual * 4.0));
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+
+// event filtering
+
+static void setfilter(simfilter* f, int timerange, int matchcnt, int inverse)
+{
+    f->range = timerange;
+    f->match = matchcnt;
+    f->inverse = inverse;
+}
+
+static void setchannels(simfilter* f, int rowidx, int usechannels, int passchannels)
+{
+    int sync = rowidx == 0 ? 0x100 : 0; // the sync only belongs to row 0
+
+    f->use[rowidx] = usechannels & (0xFF | sync);
+    f->pass[rowidx] = passchannels & (0xFF | sync);
+}
+
+int MH_SetRowEventFilter(int devidx, int rowidx, int timerange, int matchcnt, int inverse, int usechannels, int passchannels)
+{
+    SETTER(devidx, rowidx >= ROWIDXMIN && rowidx < (d->nchannels + 7) / 8 && timerange >= TIMERANGEMIN && timerange <= TIMERANGEMAX
+        && matchcnt >= MATCHCNTMIN && matchcnt <= MATCHCNTMAX && inverse >= INVERSEMIN && inverse <= INVERSEMAX
+        && usechannels >= USECHANSMIN && usechannels <= USECHANSMAX && passchannels >= PASSCHANSMIN && passchannels <= PASSCHANSMAX,
+        setfilter(&d->rowfilt[rowidx], timerange, matchcnt, inverse);
+        setchannels(&d->rowfilt[rowidx], rowidx, usechannels & 0xFF, passchannels & 0xFF))
+}
+
+int MH_EnableRowEventFilter(int devidx, int rowidx, int enable)
+{
+    SETTER(devidx, rowidx >= ROWIDXMIN && rowidx < (d->nchannels + 7) / 8 && (enable == 0 || enable == 1),
+        d->rowfilt[rowidx].enable = enable)
+}
+
+int MH_SetMainEventFilterParams(int devidx, int timerange, int matchcnt, int inverse)
+{
+    SETTER(devidx, timerange >= TIMERANGEMIN && timerange <= TIMERANGEMAX && matchcnt >= MATCHCNTMIN && matchcnt <= MATCHCNTMAX
+        && inverse >= INVERSEMIN && inverse <= INVERSEMAX, setfilter(&d->mainfilt, timerange, matchcnt, inverse))
+}
+
+int MH_SetMainEventFilterChannels(int devidx, int rowidx, int usechannels, int passchannels)
+{
+    SETTER(devidx, rowidx >= ROWIDXMIN && rowidx < (d->nchannels + 7) / 8 && usechannels >= USECHANSMIN && usechannels <= USECHANSMAX
+        && passchannels >= PASSCHANSMIN && passchannels <= PASSCHANSMAX, setchannels(&d->mainfilt, rowidx, usechannels, passchannels))
+}
+
+int MH_EnableMainEventFilter(int devidx, int enable)
+{
+    SETTER(devidx, enable == 0 || enable == 1, d->mainfilt.enable = enable)
+}
+
+int MH_SetFilterTestMode(int devidx, int testmode)
+{
+    SETTER(devidx, testmode == 0 || testmode == 1, d->filtertest = testmode)
+}
+
+// the rate meters behind the row filters (stage 1) or the main filter
+// (stage 2): the plain rates times the fraction of the events that get
+// through, found by running the filters over SIMRATEWIN of a copy of the
+// event stream
+static int filteredrates(int devidx, int stage, int* syncrate, int* cntrates)
+{
+    simdev s;
+    int i;
+    GETINIT(devidx)
+
+    if (d->mode == MODE_HIST)
+        return MH_ERROR_INVALID_MODE;
+    mhmutex_lock(&d->lock);
+    waituntil(callstart());
+    s = *d;
+    s.fq = (simevent*)malloc(SIMFILTQ * sizeof(simevent));
+    if (!s.fq)
+    {
+        mhmutex_unlock(&d->lock);
+        return MH_ERROR_INVALID_MEMORY;
+    }
+    s.filtertest = 1; // decisions only, no records
+    if (stage == 1)
+        s.mainfilt.enable = 0;
+    memset(s.fcount, 0, sizeof(s.fcount));
+    ttreset(&s);
+    ttfiltered(&s, NULL, 3, SIMRATEWIN, nenabled(&s));
+    *syncrate = d->syncenable ? (int)simcfg.syncrate : 0;
+    if (s.fcount[0][MAXINPCHAN] > 0)
+        *syncrate = (int)(*syncrate * (double)s.fcount[stage][MAXINPCHAN] / s.fcount[0][MAXINPCHAN]);
+    for (i = 0; i < d->nchannels; i++)
+    {
+        cntrates[i] = countrate(d, i);
+        if (s.fcount[0][i] > 0)
+            cntrates[i] = (int)(cntrates[i] * (double)s.fcount[stage][i] / s.fcount[0][i]);
+    }
+    free(s.fq);
+    mhmutex_unlock(&d->lock);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetRowFilteredRates(int devidx, int* syncrate, int* cntrates)
+{
+    return filteredrates(devidx, 1, syncrate, cntrates);
+}
+
+int MH_GetMainFilteredRates(int devidx, int* syncrate, int* cntrates)
+{
+    return filteredrates(devidx, 2, syncrate, cntrates);
+}
+
+
+// debugging
+
+int MH_GetDebugInfo(int devidx, char* debuginfo)
+{
+    GETDEV(devidx)
+    sprintf(debuginfo, "MHLib simulator, device %d serial %s, mode %d, %d channels\n",
+        devidx, d->serial, d->mode, d->nchannels);
+    return MH_ERROR_NONE;
+}
+
+int MH_GetNumOfModules(int devidx, int* nummod)
+{
+    GETINIT(devidx)
+    *nummod = 1 + (d->nchannels + 7) / 8;
+    return MH_ERROR_NONE;
+}
+
+int MH_GetModuleInfo(int devidx, int modidx, int* modelcode, int* versioncode)
+{
+    GETINIT(devidx)
+    (void)modidx;
+    *modelcode = 0;
+    *versioncode = 0;
+    return MH_ERROR_NONE;
+}
+
+int MH_SaveDebugDump(int devidx, char* filepath)
+{
+    FILE* fp;
+    GETDEV(devidx)
+
+    if ((fp = fopen(filepath, "w")) == NULL)
+        return MH_ERROR_FILEOPEN_FAIL;
+    fprintf(fp, "MHLib simulator, device %d serial %s\n", devidx, d->serial);
+    fclose(fp);
+    return MH_ERROR_NONE;
+}
+
+
+// White Rabbit and external FPGA are not simulated
+
+int MH_WRabbitGetMAC(int devidx, unsigned char* mac_addr) { (void)devidx; (void)mac_addr; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitSetMAC(int devidx, unsigned char* mac_addr) { (void)devidx; (void)mac_addr; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitGetInitScript(int devidx, char* initscript) { (void)devidx; (void)initscript; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitSetInitScript(int devidx, char* initscript) { (void)devidx; (void)initscript; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitGetSFPData(int devidx, char* sfpnames, int* dTxs, int* dRxs, int* alphas)
+{ (void)devidx; (void)sfpnames; (void)dTxs; (void)dRxs; (void)alphas; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitSetSFPData(int devidx, char* sfpnames, int* dTxs, int* dRxs, int* alphas)
+{ (void)devidx; (void)sfpnames; (void)dTxs; (void)dRxs; (void)alphas; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitInitLink(int devidx, int link_on) { (void)devidx; (void)link_on; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitSetMode(int devidx, int bootfromscript, int reinit_with_mode, int mode)
+{ (void)devidx; (void)bootfromscript; (void)reinit_with_mode; (void)mode; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitSetTime(int devidx, unsigned int timehidw, unsigned int timelodw)
+{ (void)devidx; (void)timehidw; (void)timelodw; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitGetTime(int devidx, unsigned int* timehidw, unsigned int* timelodw, unsigned int* subsec16ns)
+{ (void)devidx; (void)timehidw; (void)timelodw; (void)subsec16ns; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_WRabbitGetStatus(int devidx, int* wrstatus) { (void)devidx; *wrstatus = 0; return MH_ERROR_NONE; }
+int MH_WRabbitGetTermOutput(int devidx, char* buffer, int* nchar) { (void)devidx; (void)buffer; *nchar = 0; return MH_ERROR_NONE; }
+
+int MH_ExtFPGAInitLink(int devidx, int linknumber, int on) { (void)devidx; (void)linknumber; (void)on; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_ExtFPGAGetLinkStatus(int devidx, int linknumber, unsigned int* status)
+{ (void)devidx; (void)linknumber; (void)status; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_ExtFPGASetMode(int devidx, int mode, int loopback) { (void)devidx; (void)mode; (void)loopback; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_ExtFPGAResetStreamFifos(int devidx) { (void)devidx; return MH_ERROR_UNSUPPORTED_FUNCTION; }
+int MH_ExtFPGAUserCommand(int devidx, int write, unsigned int addr, unsigned int* data)
+{ (void)devidx; (void)write; (void)addr; (void)data; return MH_ERROR_UNSUPPORTED_FUNCTION; }
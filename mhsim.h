@@ -0,0 +1,80 @@
+/************************************************************************
+
+  MHLib simulator
+
+  mhsim.c implements the complete API of mhlib.h without hardware so
+  that the acquisition code can be built, profiled and regression
+  tested on any build box. Link it instead of MHLib64.lib.
+
+  Histograms are Poisson distributed around an exponential decay that
+  repeats with the sync period; T2/T3 records are generated from a
+  Poisson photon stream with optional correlated pairs and markers.
+  Every call costs a configurable control latency and bulk reads are
+  paced to a configurable USB bandwidth.
+
+  The defaults can be changed with environment variables (read at the
+  first API call) or from code with MHSIM_SetConfig():
+
+    MHSIM_DEVICES     number of devices that can be opened   (1)
+    MHSIM_CHANNELS    input channels per device              (16)
+    MHSIM_SYNCRATE    sync rate in Hz                        (40e6)
+    MHSIM_COUNTRATE   count rate per channel in cps          (1e5)
+    MHSIM_PAIRFRAC    fraction of photons with a partner     (0.05)
+    MHSIM_MARKERRATE  marker 1 rate in Hz, 0 = off           (0)
+    MHSIM_CALLLAT_US  latency of every device call in us     (100)
+    MHSIM_USB_MBPS    bulk transfer bandwidth in MB/s        (200)
+    MHSIM_SEED        random seed                            (1)
+    MHSIM_RATESWING   highest / lowest histogram count rate  (1)
+    MHSIM_RATEPERIOD  period of that swing in s              (10)
+    MHSIM_OPENMS      extra ms of MH_OpenDevice, also of a
+                      probe that finds no device              (0)
+    MHSIM_INITMS      extra ms of MH_Initialize              (0)
+    MHSIM_TRIGRATE    rate of the C1 square wave in Hz, 0 = none (0)
+    MHSIM_TRIGDUTY    fraction of its period C1 is high      (0.5)
+
+  With a swing above 1 the histogram count rates (and what the rate
+  meters show) follow rate * swing^(sin(2 pi t / period) / 2), a scan
+  across a signal that varies a lot. The T2/T3 streams keep the base rate.
+
+  The C1 signal drives the MH_SetMeasControl modes of histogram mode:
+  C1_START_CTC_STOP starts an armed measurement on the next C1 edge,
+  C1_START_C2_STOP also ends it when C1 has been high for its high time
+  (C2 is C1 delayed), C1_GATED counts only for the high part of the time.
+
+  The event filters of T2/T3 mode act on the generated stream: a row
+  filter sees the photons of its 8 channels, the main filter what the
+  row filters let through plus the sync in T2. Pass channels always
+  get through, channels not in use never do, the others when at least
+  matchcnt other events in use lie within timerange (or fewer, with
+  inverse). Fewer records then cross the simulated USB link, and
+  MH_GetRowFilteredRates / MH_GetMainFilteredRates estimate the rates
+  behind the filters from a stretch of the stream.
+
+************************************************************************/
+
+#ifndef MHSIM_H
+#define MHSIM_H
+
+typedef struct mhsim_config {
+    int ndevices;
+    int nchannels;
+    double syncrate;
+    double countrate;
+    double pairfrac;
+    double markerrate;
+    double calllat_us;
+    double usb_mbps;
+    unsigned int seed;
+    double rateswing;
+    double rateperiod;
+    double openms;
+    double initms;
+    double trigrate;
+    double trigduty;
+} mhsim_config;
+
+// must be called before the first MH_OpenDevice to take effect for that device
+void MHSIM_SetConfig(const mhsim_config* cfg);
+void MHSIM_GetConfig(mhsim_config* cfg);
+
+#endif
@@ -0,0 +1,249 @@
+/************************************************************************
+
+  Minimal portability layer for the acquisition tools:
+  threads, mutex/condition variable, 64 bit atomics, a monotonic
+  millisecond clock, sub-millisecond sleep, thread CPU time,
+  aligned allocation, the number of CPUs and a thread barrier.
+
+  Works with MinGW-W64, MS Visual C++ (C mode) and gcc on Linux.
+
+************************************************************************/
+
+#ifndef MHTHREAD_H
+#define MHTHREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#endif
+
+
+#ifdef _WIN32
+
+typedef HANDLE mhthread_t;
+typedef CRITICAL_SECTION mhmutex_t;
+typedef CONDITION_VARIABLE mhcond_t;
+typedef LPTHREAD_START_ROUTINE mhthreadfunc;
+
+// thread functions must be declared as MHTHREADFN(name) and return 0
+#define MHTHREADFN(name) DWORD WINAPI name(LPVOID arg)
+
+static inline int mhthread_create(mhthread_t* t, mhthreadfunc fn, void* arg)
+{
+    *t = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *t ? 0 : -1;
+}
+static inline void mhthread_join(mhthread_t t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+static inline void mhmutex_init(mhmutex_t* m) { InitializeCriticalSection(m); }
+static inline void mhmutex_free(mhmutex_t* m) { DeleteCriticalSection(m); }
+static inline void mhmutex_lock(mhmutex_t* m) { EnterCriticalSection(m); }
+static inline void mhmutex_unlock(mhmutex_t* m) { LeaveCriticalSection(m); }
+
+static inline void mhcond_init(mhcond_t* c) { InitializeConditionVariable(c); }
+static inline void mhcond_free(mhcond_t* c) { (void)c; }
+static inline void mhcond_wait(mhcond_t* c, mhmutex_t* m) { SleepConditionVariableCS(c, m, INFINITE); }
+static inline void mhcond_broadcast(mhcond_t* c) { WakeAllConditionVariable(c); }
+
+typedef volatile LONG64 mhatomic_t;
+static inline long long mhatomic_load(mhatomic_t* p) { return InterlockedCompareExchange64(p, 0, 0); }
+static inline void mhatomic_store(mhatomic_t* p, long long v) { InterlockedExchange64(p, v); }
+static inline long long mhatomic_add(mhatomic_t* p, long long v) { return InterlockedExchangeAdd64(p, v) + v; }
+// a load that never writes, for read-only shared memory (the compare-exchange above would fault there)
+static inline long long mhatomic_read(const mhatomic_t* p) { long long v = *p; MemoryBarrier(); return v; }
+static inline void mhatomic_fence(void) { MemoryBarrier(); }
+
+static inline double mh_timems(void)
+{
+    static LARGE_INTEGER freq = { 0 };
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+}
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleep() has the 15.6 ms tick, a high resolution timer gets well below 1 ms
+static inline void mh_sleepms(double ms)
+{
+    HANDLE timer;
+    LARGE_INTEGER due;
+
+    if (ms <= 0)
+        return;
+    timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (timer == NULL)
+    {
+        Sleep((DWORD)(ms + 0.5));
+        return;
+    }
+    due.QuadPart = -(LONGLONG)(ms * 10000.0); // relative, in 100 ns units
+    SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE);
+    WaitForSingleObject(timer, INFINITE);
+    CloseHandle(timer);
+}
+
+static inline double mh_threadcpums(void)
+{
+    FILETIME c, e, k, u;
+    if (!GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u))
+        return 0;
+    return ((double)(((ULONGLONG)k.dwHighDateTime << 32) | k.dwLowDateTime)
+        + (double)(((ULONGLONG)u.dwHighDateTime << 32) | u.dwLowDateTime)) / 10000.0;
+}
+
+static inline void* mh_alignedalloc(size_t align, size_t size) { return _aligned_malloc(size, align); }
+static inline void mh_alignedfree(void* p) { _aligned_free(p); }
+
+static inline int mh_numcpus(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+}
+
+#else
+
+typedef pthread_t mhthread_t;
+typedef pthread_mutex_t mhmutex_t;
+typedef pthread_cond_t mhcond_t;
+typedef void* (*mhthreadfunc)(void*);
+
+#define MHTHREADFN(name) void* name(void* arg)
+
+static inline int mhthread_create(mhthread_t* t, mhthreadfunc fn, void* arg)
+{
+    return pthread_create(t, NULL, fn, arg) == 0 ? 0 : -1;
+}
+static inline void mhthread_join(mhthread_t t) { pthread_join(t, NULL); }
+
+static inline void mhmutex_init(mhmutex_t* m) { pthread_mutex_init(m, NULL); }
+static inline void mhmutex_free(mhmutex_t* m) { pthread_mutex_destroy(m); }
+static inline void mhmutex_lock(mhmutex_t* m) { pthread_mutex_lock(m); }
+static inline void mhmutex_unlock(mhmutex_t* m) { pthread_mutex_unlock(m); }
+
+static inline void mhcond_init(mhcond_t* c) { pthread_cond_init(c, NULL); }
+static inline void mhcond_free(mhcond_t* c) { pthread_cond_destroy(c); }
+static inline void mhcond_wait(mhcond_t* c, mhmutex_t* m) { pthread_cond_wait(c, m); }
+static inline void mhcond_broadcast(mhcond_t* c) { pthread_cond_broadcast(c); }
+
+typedef volatile long long mhatomic_t;
+static inline long long mhatomic_load(mhatomic_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void mhatomic_store(mhatomic_t* p, long long v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline long long mhatomic_add(mhatomic_t* p, long long v) { return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL); }
+static inline long long mhatomic_read(const mhatomic_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void mhatomic_fence(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+static inline double mh_timems(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec * 1e-6;
+}
+
+static inline void mh_sleepms(double ms)
+{
+    struct timespec ts;
+
+    if (ms <= 0)
+        return;
+    ts.tv_sec = (time_t)(ms / 1000.0);
+    ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1e6);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+static inline double mh_threadcpums(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec * 1e-6;
+}
+
+static inline void* mh_alignedalloc(size_t align, size_t size)
+{
+    void* p;
+    return posix_memalign(&p, align, size) == 0 ? p : NULL;
+}
+static inline void mh_alignedfree(void* p) { free(p); }
+
+static inline int mh_numcpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+#endif
+
+
+// reusable barrier for n threads; after mhbarrier_break every wait returns -1
+// so a thread that fails cannot leave the others waiting forever
+
+typedef struct mhbarrier {
+    mhmutex_t lock;
+    mhcond_t cond;
+    int n;
+    int waiting;
+    int generation;
+    int broken;
+} mhbarrier_t;
+
+static inline void mhbarrier_init(mhbarrier_t* b, int n)
+{
+    mhmutex_init(&b->lock);
+    mhcond_init(&b->cond);
+    b->n = n;
+    b->waiting = 0;
+    b->generation = 0;
+    b->broken = 0;
+}
+
+static inline void mhbarrier_free(mhbarrier_t* b)
+{
+    mhcond_free(&b->cond);
+    mhmutex_free(&b->lock);
+}
+
+static inline int mhbarrier_wait(mhbarrier_t* b)
+{
+    int gen, ret;
+
+    mhmutex_lock(&b->lock);
+    gen = b->generation;
+    if (!b->broken && ++b->waiting == b->n)
+    {
+        b->waiting = 0;
+        b->generation++;
+        mhcond_broadcast(&b->cond);
+    }
+    else
+        while (gen == b->generation && !b->broken)
+            mhcond_wait(&b->cond, &b->lock);
+    ret = b->broken ? -1 : 0;
+    mhmutex_unlock(&b->lock);
+    return ret;
+}
+
+static inline void mhbarrier_break(mhbarrier_t* b)
+{
+    mhmutex_lock(&b->lock);
+    b->broken = 1;
+    mhcond_broadcast(&b->cond);
+    mhmutex_unlock(&b->lock);
+}
+
+#endif
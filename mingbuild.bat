@@ -1,2 +1,12 @@
 rem Building this demo with MingW compiler
-gcc histomode.c mhlib64.lib -o histomode.exe
+gcc histomode.c config.c pipeline.c framekern.c trace.c reduce.c mhfile.c moments.c adapt.c telemetry.c codec.c mapout.c shmring.c devstate.c jobsock.c acquire.c t3stream.c t2corr.c evfilter.c rtmode.c multidev.c mhlib64.lib -o histomode.exe
+rem Benchmark harness, runs against the MHLib simulator
+gcc -O2 mhbench.c pipeline.c framekern.c trace.c reduce.c mhfile.c moments.c adapt.c telemetry.c codec.c mapout.c shmring.c rtmode.c acquire.c mhsim.c -o mhbench.exe
+rem Decoder for compressed FileData.dat files
+gcc -O2 mhdecode.c codec.c mhfile.c -o mhdecode.exe
+rem Multithreaded analysis of FileData.dat
+gcc -O2 mhana.c mhfile.c moments.c reduce.c mapout.c -o mhana.exe
+rem Live frame viewer, reads what histomode publishes with publish=1
+gcc -O2 shmview.c shmring.c -o shmview.exe
+rem Client of the acquisition daemon, histomode serve=<name>
+gcc -O2 mhjob.c jobsock.c -o mhjob.exe
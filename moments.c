@@ -0,0 +1,168 @@
+/************************************************************************
+
+  Per-channel photon statistics of every frame, see moments.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhthread.h"
+#include "moments.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MOMENTS_SSE2
+#endif
+
+#define LIVEROWS 8          // channels shown on the console line
+
+
+// s[0] = sum c, s[1] = sum c t, s[2] = sum c t^2 over n bins
+static void dot3(const unsigned int* c, const double* t, int n, double* s)
+{
+    double n0 = 0, s1 = 0, s2 = 0, ct;
+    int i = 0;
+
+#ifdef MOMENTS_SSE2
+    // counts are unsigned: flip the sign bit, convert signed and add 2^31 back
+    const __m128i flip = _mm_set1_epi32((int)0x80000000);
+    const __m128d bias = _mm_set1_pd(2147483648.0);
+    __m128d a0 = _mm_setzero_pd(), a1 = a0, b0 = a0, b1 = a0, c0 = a0, c1 = a0;
+    __m128d lo, hi, tlo, thi;
+    __m128i v;
+    double r[2];
+
+    for (; i + 4 <= n; i += 4)
+    {
+        v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(c + i)), flip);
+        lo = _mm_add_pd(_mm_cvtepi32_pd(v), bias);
+        hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), bias);
+        tlo = _mm_loadu_pd(t + i);
+        thi = _mm_loadu_pd(t + i + 2);
+        a0 = _mm_add_pd(a0, lo);
+        a1 = _mm_add_pd(a1, hi);
+        lo = _mm_mul_pd(lo, tlo);
+        hi = _mm_mul_pd(hi, thi);
+        b0 = _mm_add_pd(b0, lo);
+        b1 = _mm_add_pd(b1, hi);
+        c0 = _mm_add_pd(c0, _mm_mul_pd(lo, tlo));
+        c1 = _mm_add_pd(c1, _mm_mul_pd(hi, thi));
+    }
+    _mm_storeu_pd(r, _mm_add_pd(a0, a1));
+    n0 = r[0] + r[1];
+    _mm_storeu_pd(r, _mm_add_pd(b0, b1));
+    s1 = r[0] + r[1];
+    _mm_storeu_pd(r, _mm_add_pd(c0, c1));
+    s2 = r[0] + r[1];
+#endif
+    for (; i < n; i++)
+    {
+        n0 += c[i];
+        ct = c[i] * t[i];
+        s1 += ct;
+        s2 += ct * t[i];
+    }
+    s[0] = n0;
+    s[1] = s1;
+    s[2] = s2;
+}
+
+
+int moments_open(moments_t* m, int rows, int bins, unsigned long long chanmask, double resolution, int roistart,
+    FILE* fp, int live)
+{
+    int ch, row = 0;
+
+    memset(m, 0, sizeof(*m));
+    if (rows < 1 || rows > 64 || bins < 1)
+        return -1;
+    m->rows = rows;
+    m->bins = bins;
+    for (ch = 0; ch < 64 && row < rows; ch++)
+        if ((chanmask >> ch) & 1)
+            m->chans[row++] = ch;
+    m->t = (double*)mh_alignedalloc(64, bins * sizeof(double));
+    m->last = (double*)calloc((size_t)rows * MOM_FIELDS, sizeof(double));
+    if (m->t == NULL || m->last == NULL)
+    {
+        moments_close(m);
+        return -1;
+    }
+    moments_setres(m, resolution, roistart);
+    m->fp = fp;
+    m->live = live;
+    if (fp)
+    {
+        fprintf(fp, "Run");
+        for (row = 0; row < rows; row++)
+            fprintf(fp, "\tN%d\tMean%d(ps)\tSD%d(ps)", m->chans[row], m->chans[row], m->chans[row]);
+        fprintf(fp, "\n");
+    }
+    return 0;
+}
+
+// the statistics of one frame, to the side file and, now and then, the console
+void moments_frame(moments_t* m, const unsigned int* counts, int rep)
+{
+    double t0 = mh_timems(), s[3], mean, var;
+    double* l;
+    int row;
+
+    for (row = 0; row < m->rows; row++)
+    {
+        dot3(counts + (size_t)row * m->bins, m->t, m->bins, s);
+        l = m->last + row * MOM_FIELDS;
+        l[MOM_COUNTS] = s[0];
+        mean = s[0] > 0 ? s[1] / s[0] : 0;
+        var = s[0] > 0 ? s[2] / s[0] - mean * mean : 0;
+        l[MOM_MEAN] = s[0] > 0 ? m->t0 + mean : 0;
+        l[MOM_SD] = var > 0 ? sqrt(var) : 0;
+    }
+    m->lastrep = rep;
+    if (m->fp)
+    {
+        fprintf(m->fp, "%d", rep);
+        for (row = 0, l = m->last; row < m->rows; row++, l += MOM_FIELDS)
+            fprintf(m->fp, "\t%1.0f\t%1.1f\t%1.1f", l[MOM_COUNTS], l[MOM_MEAN], l[MOM_SD]);
+        fprintf(m->fp, "\n");
+    }
+    if (m->live > 0 && t0 - m->tlive >= m->live)
+    {
+        m->tlive = t0;
+        printf("\nLive %d:", rep);
+        for (row = 0, l = m->last; row < m->rows && row < LIVEROWS; row++, l += MOM_FIELDS)
+            printf(" %d: %1.0f @ %1.0f+-%1.0f ps", m->chans[row], l[MOM_COUNTS], l[MOM_MEAN], l[MOM_SD]);
+        if (m->rows > LIVEROWS)
+            printf(" ...");
+        fflush(stdout);
+    }
+    m->ms += mh_timems() - t0;
+    m->frames++;
+}
+
+// the bin times for a new resolution, between runs that change the binning
+void moments_setres(moments_t* m, double resolution, int roistart)
+{
+    int b;
+
+    m->t0 = roistart * resolution;
+    for (b = 0; b < m->bins; b++)
+        m->t[b] = b * resolution;
+}
+
+void moments_resetstats(moments_t* m)
+{
+    m->ms = 0;
+    m->frames = 0;
+}
+
+void moments_close(moments_t* m)
+{
+    if (m->t)
+        mh_alignedfree(m->t);
+    free(m->last);
+    memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,58 @@
+/************************************************************************
+
+  Per-channel photon statistics of every frame
+
+  Time-domain work mostly needs three numbers per detector channel and
+  frame: the total counts, the mean photon arrival time and its
+  spread. The writer thread computes them from each frame as it goes
+  past, as dot products of the channel row with the bin time vector
+  (bin index times the resolution from MH_GetResolution), so nobody
+  has to read FileData.dat again after the run:
+
+    N     = sum c[b]
+    mean  = t0 + sum c[b] t[b] / N
+    sd    = sqrt(sum c[b] t[b]^2 / N - (sum c[b] t[b] / N)^2)
+
+  with t[b] the time of bin b from the first stored bin, t0 the time of
+  that bin. One line per frame goes to a side file, and at most every
+  `live` ms a short line to the console. The last frame's values stay
+  in `last` for anyone who wants to show them elsewhere.
+
+************************************************************************/
+
+#ifndef MOMENTS_H
+#define MOMENTS_H
+
+#include <stdio.h>
+
+
+#define MOM_COUNTS 0        // fields of a row of moments_t.last
+#define MOM_MEAN   1        // ps
+#define MOM_SD     2        // ps
+#define MOM_FIELDS 3
+
+typedef struct moments {
+    int rows, bins;         // frame geometry
+    int chans[64];          // device channel of every row
+    double t0;              // time of the first stored bin (ps)
+    double* t;              // [bins] bin times from t0 (ps)
+    double* last;           // [rows][MOM_FIELDS] of the last frame
+    int lastrep;            // rep of the last frame
+    FILE* fp;               // NULL or the side file
+    int live;               // ms between console lines, 0 = none
+    double tlive;           // time of the last console line
+
+    // statistics, reset by moments_resetstats()
+    double ms;              // time spent computing
+    int frames;             // frames done
+} moments_t;
+
+
+int moments_open(moments_t* m, int rows, int bins, unsigned long long chanmask, double resolution, int roistart,
+    FILE* fp, int live);
+void moments_setres(moments_t* m, double resolution, int roistart);
+void moments_frame(moments_t* m, const unsigned int* counts, int rep);
+void moments_resetstats(moments_t* m);
+void moments_close(moments_t* m);
+
+#endif
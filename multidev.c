@@ -0,0 +1,293 @@
+/************************************************************************
+
+  Parallel acquisition on several MultiHarps, see multidev.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhthread.h"
+#include "multidev.h"
+
+
+static MHTHREADFN(devthread)
+{
+    devrun_t* d = (devrun_t*)arg;
+
+    d->rtwhy[0] = 0;
+    if (d->rt.enable)
+        rt_thread(d->rt.cpu, d->rt.priority, d->rtwhy, sizeof(d->rtwhy)); // the run goes on without, multi_report says so
+    if (d->mode == MODE_T3)
+        d->ret = t3_run(d->devidx, &d->t3, &d->pipe, &d->t3stats);
+    else if (d->mode == MODE_T2)
+        d->ret = t2_run(d->devidx, &d->t2, &d->pipe, &d->t2stats);
+    else
+        d->ret = acq_histo(d->devidx, &d->acq, &d->pipe, &d->stats);
+    if (d->ret < 0 && d->acq.align)
+        mhbarrier_break(d->acq.align); // release the devices waiting for this one
+    return 0;
+}
+
+
+typedef struct probe {
+    int devidx;
+    char serial[32];
+    int ret;
+    double ms;
+    mhthread_t thread;
+    int started;
+} probe_t;
+
+static MHTHREADFN(openthread)
+{
+    probe_t* p = (probe_t*)arg;
+    double t0 = mh_timems();
+
+    p->ret = MH_OpenDevice(p->devidx, p->serial); // not using APICALL here as fails must be expected
+    p->ms = mh_timems() - t0;
+    return 0;
+}
+
+// 1 if serial is in the comma separated list, or the list is empty
+static int wanted(const char* serials, const char* serial)
+{
+    size_t len = strlen(serial);
+    const char* p;
+
+    if (!serials[0])
+        return 1;
+    for (p = serials; *p; p += strcspn(p, ","), p += *p == ',')
+        if (strcspn(p, ",") == len && strncmp(p, serial, len) == 0)
+            return 1;
+    return 0;
+}
+
+// opens the devices at every index at once, a USB probe each, and keeps
+// those whose serial is in serials (all if empty) in d, closing the others;
+// returns how many were kept
+int multi_open(devrun_t* d, const char* serials)
+{
+    probe_t p[MAXDEVNUM];
+    char Errorstring[40];
+    double t0 = mh_timems();
+    int i, found = 0;
+
+    for (i = 0; i < MAXDEVNUM; i++)
+    {
+        memset(&p[i], 0, sizeof(p[i]));
+        p[i].devidx = i;
+        if (mhthread_create(&p[i].thread, openthread, &p[i]) == 0)
+            p[i].started = 1;
+        else
+            openthread(&p[i]); // then this one in turn
+    }
+    for (i = 0; i < MAXDEVNUM; i++)
+        if (p[i].started)
+            mhthread_join(p[i].thread);
+
+    printf("\nDevidx     Serial     Status");
+    for (i = 0; i < MAXDEVNUM; i++)
+    {
+        if (p[i].ret == 0 && wanted(serials, p[i].serial)) // grab any device we can open, or the ones asked for
+        {
+            printf("\n  %1d        %7s    open ok", i, p[i].serial);
+            d[found].devidx = i; // keep index to device(s) we want to use
+            strncpy(d[found].serial, p[i].serial, sizeof(d[found].serial) - 1);
+            found++;
+        }
+        else if (p[i].ret == 0)
+        {
+            printf("\n  %1d        %7s    not in serials", i, p[i].serial);
+            MH_CloseDevice(i);
+        }
+        else if (p[i].ret == MH_ERROR_DEVICE_OPEN_FAIL)
+            printf("\n  %1d        %7s    no device", i, p[i].serial);
+        else
+        {
+            MH_GetErrorString(Errorstring, p[i].ret);
+            printf("\n  %1d        %7s    %s", i, p[i].serial, Errorstring);
+        }
+    }
+    printf("\nOpening took %1.1f ms", mh_timems() - t0);
+    return found;
+}
+
+
+static MHTHREADFN(initthread)
+{
+    devrun_t* d = (devrun_t*)arg;
+
+    d->ret = APICALL(MH_Initialize(d->devidx, d->mode, d->refsource));
+    return 0;
+}
+
+// MH_Initialize on all ndev devices at once, in d->mode and d->refsource;
+// with White Rabbit the master comes first. Returns -1 if any failed, d->ret
+// tells which.
+int multi_init(devrun_t* d, int ndev, int align)
+{
+    int started[MAXDEVNUM] = { 0 };
+    int i, first = 0, ret = 0;
+
+    if (align == ALIGN_WR && ndev > 1)
+    {
+        initthread(&d[0]); // the slaves lock to its clock
+        if (d[0].ret < 0)
+            return -1;
+        first = 1;
+    }
+    for (i = first; i < ndev; i++)
+        if (mhthread_create(&d[i].thread, initthread, &d[i]) == 0)
+            started[i] = 1;
+        else
+            initthread(&d[i]); // then this one in turn
+    for (i = first; i < ndev; i++)
+    {
+        if (started[i])
+            mhthread_join(d[i].thread);
+        if (d[i].ret < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+
+// runs one measurement on all ndev devices in parallel and waits until
+// every frame is on disk, returns -1 if any device failed
+int multi_run(devrun_t* d, int ndev, int align)
+{
+    mhbarrier_t barrier;
+    int nstarted = 0, ret = 0;
+    int i;
+
+    if (align != ALIGN_NONE && ndev > 1)
+        mhbarrier_init(&barrier, ndev);
+    for (i = 0; i < ndev; i++)
+    {
+        free(d[i].tstarts);
+        d[i].tstarts = (double*)calloc(d[i].acq.numrep > 0 ? d[i].acq.numrep : 1, sizeof(double));
+        d[i].acq.tstarts = d[i].tstarts;
+        d[i].acq.align = d[i].t3.align = d[i].t2.align = align != ALIGN_NONE && ndev > 1 ? &barrier : NULL;
+        d[i].acq.armfirst = d[i].t3.armfirst = d[i].t2.armfirst = align == ALIGN_WR && i > 0;
+        d[i].ret = -1;
+        d[i].pipe.trace = d[i].acq.trace;
+        if (d[i].acq.trace && trace_open(d[i].acq.trace, d[i].acq.numrep) < 0)
+        {
+            printf("\ncannot allocate the trace of device %s\n", d[i].serial);
+            ret = -1;
+        }
+        pipe_resetstats(&d[i].pipe);
+        if (pipe_reserve(&d[i].pipe, d[i].acq.numrep) < 0) // the same for every mode
+        {
+            printf("\ncannot extend the output file of device %s\n", d[i].serial);
+            ret = -1;
+        }
+    }
+    if (ret < 0)
+        goto done;
+    for (i = 0; i < ndev; i++)
+    {
+        if (mhthread_create(&d[i].thread, devthread, &d[i]) != 0)
+        {
+            printf("\ncannot start acquisition thread for device %d\n", d[i].devidx);
+            if (d[i].acq.align)
+                mhbarrier_break(d[i].acq.align);
+            ret = -1;
+            break;
+        }
+        nstarted++;
+    }
+    for (i = 0; i < nstarted; i++)
+    {
+        mhthread_join(d[i].thread);
+        if (d[i].ret < 0)
+            ret = -1;
+        if (pipe_flush(&d[i].pipe) < 0)
+            printf("\nError writing output file of device %s.", d[i].serial);
+        if (d[i].acq.trace && d[i].fptrace)
+            trace_write(d[i].acq.trace, d[i].fptrace);
+    }
+done:
+    if (align != ALIGN_NONE && ndev > 1)
+        mhbarrier_free(&barrier);
+    for (i = 0; i < ndev; i++)
+        d[i].acq.align = d[i].t3.align = d[i].t2.align = NULL;
+    return ret;
+}
+
+
+void multi_report(const devrun_t* d, int ndev)
+{
+    double fps, total = 0, skew, skewsum, skewmax;
+    rtjitter_t jit;
+    int frames, i, r, n;
+
+    for (i = 0; i < ndev; i++)
+    {
+        printf("\n\nDevice %d (serial %s):", d[i].devidx, d[i].serial);
+        if (d[i].mode == MODE_T3)
+        {
+            t3_report(&d[i].t3stats, &d[i].pipe);
+            frames = d[i].t3stats.frames;
+            fps = d[i].t3stats.wallms > 0 ? frames * 1000.0 / d[i].t3stats.wallms : 0;
+        }
+        else if (d[i].mode == MODE_T2)
+        {
+            t2_report(&d[i].t2stats, &d[i].pipe);
+            frames = d[i].t2stats.frames;
+            fps = d[i].t2stats.wallms > 0 ? frames * 1000.0 / d[i].t2stats.wallms : 0;
+        }
+        else
+        {
+            acq_report(&d[i].stats, &d[i].pipe);
+            if (d[i].acq.trace)
+                trace_report(d[i].acq.trace);
+            if (d[i].acq.tele)
+                tele_report(d[i].acq.tele);
+            frames = d[i].stats.frames;
+            fps = d[i].stats.wallms > 0 ? frames * 1000.0 / d[i].stats.wallms : 0;
+        }
+        total += fps;
+        printf("\nFrame rate: %1.2f frames/s", fps);
+        if (d[i].mode == MODE_HIST && rt_jitter(d[i].tstarts, frames, &jit) == 0)
+            printf("\nFrame start interval: median %1.3f ms, p99 %1.3f ms, p99.9 %1.3f ms, max %1.3f ms",
+                jit.p50, jit.p99, jit.p999, jit.max);
+        if (d[i].rt.enable && d[i].rtwhy[0])
+            printf("\nReal time not in effect: %s", d[i].rtwhy);
+        else if (d[i].rt.enable)
+            printf("\nReal time: core %d, priority %d", d[i].rt.cpu, d[i].rt.priority);
+        if (i == 0)
+            continue;
+
+        // start skew against the first device, frame by frame
+        if (d[i].mode == MODE_T3)
+        {
+            printf(", start skew %+1.3f ms", d[i].t3stats.tstart - d[0].t3stats.tstart);
+            continue;
+        }
+        if (d[i].mode == MODE_T2)
+        {
+            printf(", start skew %+1.3f ms", d[i].t2stats.tstart - d[0].t2stats.tstart);
+            continue;
+        }
+        n = frames < d[0].stats.frames ? frames : d[0].stats.frames;
+        skewsum = skewmax = 0;
+        for (r = 0; r < n; r++)
+        {
+            skew = d[i].tstarts[r] - d[0].tstarts[r];
+            skewsum += skew;
+            if (fabs(skew) > fabs(skewmax))
+                skewmax = skew;
+        }
+        if (n > 0)
+            printf(", start skew %+1.3f ms mean, %+1.3f ms max", skewsum / n, skewmax);
+    }
+    if (ndev > 1)
+        printf("\n\nAll %d devices: %1.2f frames/s", ndev, total);
+}
@@ -0,0 +1,77 @@
+/************************************************************************
+
+  Parallel acquisition on several MultiHarps.
+
+  Every device gets its own acquisition thread, its own frame pipeline
+  (buffer pool, writer thread, output files) and its own statistics, so
+  the devices share nothing but the optional start barrier and scale
+  with the number of USB links and cores.
+
+  The devices are opened and initialized in parallel too, USB probes
+  and MH_Initialize of one device do not wait for the others.
+
+  Frame starts are aligned with a host barrier before every
+  MH_StartMeas (ALIGN_HOST). With ALIGN_WR the devices are also White
+  Rabbit linked: the first device is the master, the others are armed
+  with MH_StartMeas before the barrier and started by the master
+  (MEASCTRL_WR_M2S), so their clocks and starts are locked in hardware.
+
+************************************************************************/
+
+#ifndef MULTIDEV_H
+#define MULTIDEV_H
+
+#include "pipeline.h"
+#include "acquire.h"
+#include "t3stream.h"
+#include "t2corr.h"
+#include "devstate.h"
+#include "rtmode.h"
+
+
+#define ALIGN_NONE 0        // devices run freely
+#define ALIGN_HOST 1        // host barrier before every MH_StartMeas
+#define ALIGN_WR   2        // White Rabbit master/slave start, see above
+
+typedef struct devrun {
+    int devidx;
+    char serial[16];
+    int mode;               // MODE_HIST, MODE_T2 or MODE_T3
+    int refsource;          // REFSRC_ of MH_Initialize
+    acqopts_t acq;
+    t3opts_t t3;
+    t2opts_t t2;
+    pipeline_t pipe;
+    codec_t codec;          // used if pipe.codec points here
+    mapout_t map;           // used if pipe.map points here
+    reduce_t reduce;        // used if pipe.reduce points here
+    mhfile_t index;         // used if pipe.index points here, written out after the last run
+    FILE* fpout;
+    FILE* fptime;
+    FILE* fptrace;          // NULL or the file the phase trace goes to after every run
+    trace_t trace;          // used if acq.trace points here
+    FILE* fpmoments;        // NULL or the file the per-frame moments go to
+    moments_t moments;      // used if pipe.moments points here
+    FILE* fptele;           // NULL or the telemetry log
+    telemetry_t tele;       // used if acq.tele points here
+    shmring_t ring;         // used if pipe.publish points here
+    devstate_t state;       // what was last set on the device
+    double setupms;         // time the settings of the last run took
+    FILE* fpruns;           // NULL or the run log of a script
+    acqstats_t stats;
+    t3stats_t t3stats;
+    t2stats_t t2stats;
+    double* tstarts;        // acq.numrep host start times, for the skew and jitter report
+    rtopts_t rt;            // real-time mode of the acquisition thread
+    char rtwhy[96];         // why the last run did not get it, empty = it did
+    mhthread_t thread;
+    int ret;
+} devrun_t;
+
+
+int multi_open(devrun_t* d, const char* serials);
+int multi_init(devrun_t* d, int ndev, int align);
+int multi_run(devrun_t* d, int ndev, int align);
+void multi_report(const devrun_t* d, int ndev);
+
+#endif
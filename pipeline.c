@@ -0,0 +1,389 @@
+/************************************************************************
+
+  Frame pipeline for the histogramming demo, see pipeline.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pipeline.h"
+#include "rtmode.h"
+#include "adapt.h"
+
+
+#define ARENAALIGN 4096 // every frame starts on a page
+
+// writes a frame of the output geometry, raw or encoded; returns the bytes written, len the bytes it should be
+static size_t writeframe(pipeline_t* p, const unsigned int* counts, int rep, size_t* len)
+{
+    size_t words = p->reduce ? p->reduce->outwords : p->framewords;
+
+    if (p->codec)
+    {
+        *len = codec_encode(p->codec, counts, rep);
+        return fwrite(p->codec->out, 1, *len, p->fpout);
+    }
+    *len = words * sizeof(unsigned int);
+    return fwrite(counts, sizeof(unsigned int), words, p->fpout) * sizeof(unsigned int);
+}
+
+// the container record of frame f, bytes long in the file; f = NULL is the run
+// sum of an accumulating reduction, it starts with the run's first frame and
+// measured what all of them did
+static void indexframe(pipeline_t* p, const frame_t* f, size_t bytes)
+{
+    mhfile_t* m = p->index;
+    mhfrecord_t r;
+    long long i;
+
+    memset(&r, 0, sizeof(r));
+    r.bytes = (long long)bytes;
+    r.key = p->codec == NULL || bytes == 0 || p->codec->sincekey == 0;
+    if (f)
+    {
+        r.kind = bytes > 0 ? MHF_FRAME : MHF_FOLDED;
+        r.tdev = f->tdev;
+        r.tstart = f->tstart;
+        r.tmeas = f->tmeas;
+        r.rep = f->rep;
+        r.flags = f->flags;
+        r.tacq = f->tacq;
+    }
+    else
+    {
+        r.kind = MHF_SUM;
+        r.rep = p->lastrep;
+        for (i = m->nrec - 1; i >= 0 && m->rec[i].run == m->run; i--)
+        {
+            r.tdev = m->rec[i].tdev;
+            r.tstart = m->rec[i].tstart;
+            r.tmeas += m->rec[i].tmeas;
+            r.flags |= m->rec[i].flags;
+        }
+    }
+    if (mhf_add(m, &r) < 0)
+        p->error = 1;
+}
+
+// the frame as read from the device, before any reduction, for live viewers
+static void publishframe(shmring_t* r, const frame_t* f)
+{
+    shmframe_t h;
+
+    memset(&h, 0, sizeof(h));
+    h.rep = f->rep;
+    h.flags = f->flags;
+    h.tstart = f->tstart;
+    h.tdev = f->tdev;
+    h.tmeas = f->tmeas;
+    h.tacq = f->tacq;
+    shmring_publish(r, f->counts, &h);
+}
+
+static MHTHREADFN(writerthread)
+{
+    pipeline_t* p = (pipeline_t*)arg;
+    frame_t* f;
+    const unsigned int* out;
+    double t0;
+    size_t n, len;
+
+    for (;;)
+    {
+        mhmutex_lock(&p->lock);
+        while (p->nfull == 0 && !p->quit)
+            mhcond_wait(&p->cond, &p->lock);
+        if (p->nfull == 0) // quit requested and nothing left to write
+        {
+            mhmutex_unlock(&p->lock);
+            break;
+        }
+        f = &p->frames[p->fullq[p->fullhead]];
+        p->fullhead = (p->fullhead + 1) % p->nframes;
+        p->nfull--;
+        p->busy = 1;
+        mhmutex_unlock(&p->lock);
+
+        if (!p->error)
+        {
+            t0 = mh_timems();
+            if (p->moments)
+                moments_frame(p->moments, f->counts, f->rep);
+            if (p->publish)
+                publishframe(p->publish, f);
+            if (p->map)
+            {
+                // the frame is already in the file, only start its write-back
+                len = n = p->framewords * sizeof(unsigned int);
+                if (f->counts == f->own || mapout_flush(p->map, f->counts) < 0)
+                    n = 0;
+            }
+            else if ((out = p->reduce ? reduce_frame(p->reduce, f->counts) : f->counts) == NULL)
+                len = n = 0; // accumulated, pipe_flush writes the sum
+            else
+                n = writeframe(p, out, f->rep, &len);
+            if (n != len)
+                p->error = 1;
+            if (p->index)
+                indexframe(p, f, len);
+            if (p->fptime)
+            {
+                fprintf(p->fptime, "%d\t%1.3f\t%1.3f\t%1.3f", f->rep, f->tread0, f->tread1, f->tread1 - f->tread0);
+                if (f->why != ADAPT_FIXED)
+                    fprintf(p->fptime, "\t%d\t%1.3f\t%u\t%s", f->tacq, f->tmeas, f->peak, adapt_name(f->why));
+                if (f->teleseq > 0)
+                    fprintf(p->fptime, "\t%lld\t%d\t%1.0f\t0x%X\t0x%X", f->teleseq, f->syncrate, f->rate, f->flags,
+                        f->warnings);
+                if (p->stamps)
+                    fprintf(p->fptime, "\t%llu", f->tdev);
+                fprintf(p->fptime, "\n");
+            }
+            t0 = trace_lap(p->trace, f->rep, PH_WRITE, t0) - t0;
+            p->writems += t0;
+            p->writesq += t0 * t0;
+            if (t0 > p->writemax)
+                p->writemax = t0;
+            p->writes++;
+            p->bytes += (double)n;
+            p->total += (double)p->kern->sum(f->counts, p->rows, p->bins);
+            p->lastrep = f->rep;
+        }
+
+        mhmutex_lock(&p->lock);
+        p->freeq[p->nfree++] = (int)(f - p->frames);
+        p->busy = 0;
+        mhcond_broadcast(&p->cond);
+        mhmutex_unlock(&p->lock);
+    }
+    return 0;
+}
+
+
+// hugepages = 1 puts the frame buffers on huge pages if any are reserved
+int pipe_open(pipeline_t* p, int nframes, int rows, int bins, FILE* fpout, FILE* fptime, int hugepages)
+{
+    size_t framewords = (size_t)rows * bins;
+    size_t stride = (framewords * sizeof(unsigned int) + ARENAALIGN - 1) / ARENAALIGN * ARENAALIGN;
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    p->nframes = nframes;
+    p->rows = rows;
+    p->bins = bins;
+    p->framewords = framewords;
+    p->kern = fk_select(rows, bins);
+    p->fpout = fpout;
+    p->fptime = fptime;
+
+    p->frames = (frame_t*)calloc(nframes, sizeof(frame_t));
+    p->fullq = (int*)calloc(nframes, sizeof(int));
+    p->freeq = (int*)calloc(nframes, sizeof(int));
+    if (hugepages)
+        p->arena = (unsigned char*)rt_hugealloc(stride * nframes, &p->hugebytes);
+    if (!p->arena)
+        p->arena = (unsigned char*)mh_alignedalloc(ARENAALIGN, stride * nframes);
+    if (!p->frames || !p->fullq || !p->freeq || !p->arena)
+        goto fail;
+
+    // touch every page now so the first frames do not pay for page faults
+    memset(p->arena, 0, stride * nframes);
+    for (i = 0; i < nframes; i++)
+    {
+        p->frames[i].counts = p->frames[i].own = (unsigned int*)(p->arena + stride * i);
+        p->freeq[p->nfree++] = nframes - 1 - i;
+    }
+
+    mhmutex_init(&p->lock);
+    mhcond_init(&p->cond);
+    if (mhthread_create(&p->writer, writerthread, p) != 0)
+    {
+        mhcond_free(&p->cond);
+        mhmutex_free(&p->lock);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (p->hugebytes)
+        rt_hugefree(p->arena, p->hugebytes);
+    else if (p->arena)
+        mh_alignedfree(p->arena);
+    free(p->frames);
+    free(p->fullq);
+    free(p->freeq);
+    memset(p, 0, sizeof(*p));
+    return -1;
+}
+
+
+// returns the next free frame buffer, blocks while the writer is behind
+frame_t* pipe_getfree(pipeline_t* p)
+{
+    frame_t* f;
+
+    mhmutex_lock(&p->lock);
+    if (p->nfree == 0)
+        p->stalls++;
+    while (p->nfree == 0)
+        mhcond_wait(&p->cond, &p->lock);
+    f = &p->frames[p->freeq[--p->nfree]];
+    if (p->map)
+    {
+        // the next frame of the file; past the reserved frames it is lost, see pipe_reserve
+        if ((f->counts = (unsigned int*)mapout_next(p->map)) == NULL)
+        {
+            f->counts = f->own;
+            p->error = 1;
+        }
+    }
+    mhmutex_unlock(&p->lock);
+    return f;
+}
+
+
+// hands a full frame to the writer thread
+void pipe_submit(pipeline_t* p, frame_t* f)
+{
+    mhmutex_lock(&p->lock);
+    p->fullq[(p->fullhead + p->nfull) % p->nframes] = (int)(f - p->frames);
+    p->nfull++;
+    if (p->nfull > p->maxqueued)
+        p->maxqueued = p->nfull;
+    mhcond_broadcast(&p->cond);
+    mhmutex_unlock(&p->lock);
+}
+
+
+// returns a frame obtained with pipe_getfree without writing it
+void pipe_release(pipeline_t* p, frame_t* f)
+{
+    mhmutex_lock(&p->lock);
+    if (p->map && f->counts != f->own)
+        mapout_unnext(p->map, f->counts);
+    p->freeq[p->nfree++] = (int)(f - p->frames);
+    mhcond_broadcast(&p->cond);
+    mhmutex_unlock(&p->lock);
+}
+
+
+// makes sure the mapped output file holds nframes more frames, call between runs
+int pipe_reserve(pipeline_t* p, int nframes)
+{
+    int ret = 0;
+
+    if (p->map == NULL)
+        return 0;
+    mhmutex_lock(&p->lock);
+    if (mapout_reserve(p->map, nframes) < 0)
+        ret = -1;
+    mhmutex_unlock(&p->lock);
+    return ret;
+}
+
+
+// waits until every submitted frame is on disk, then writes the sum of an
+// accumulating reduction; returns -1 after a write error
+int pipe_flush(pipeline_t* p)
+{
+    const unsigned int* sum;
+    size_t n, len;
+
+    mhmutex_lock(&p->lock);
+    while (p->nfull > 0 || p->busy)
+        mhcond_wait(&p->cond, &p->lock);
+    mhmutex_unlock(&p->lock);
+    // the writer is idle until the next submit
+    if (p->reduce && !p->error && (sum = reduce_total(p->reduce)) != NULL)
+    {
+        n = writeframe(p, sum, p->lastrep, &len);
+        if (n != len)
+            p->error = 1;
+        p->bytes += (double)n;
+        if (p->index)
+            indexframe(p, NULL, len);
+    }
+    if (p->index)
+        mhf_endrun(p->index);
+    if (p->fpout)
+        fflush(p->fpout);
+    if (p->fptime)
+        fflush(p->fptime);
+    if (p->moments && p->moments->fp)
+        fflush(p->moments->fp);
+    return p->error ? -1 : 0;
+}
+
+
+void pipe_resetstats(pipeline_t* p)
+{
+    mhmutex_lock(&p->lock);
+    p->stalls = 0;
+    p->maxqueued = 0;
+    p->writems = 0;
+    p->writemax = 0;
+    p->writesq = 0;
+    p->writes = 0;
+    p->bytes = 0;
+    p->total = 0;
+    if (p->codec)
+        codec_resetstats(p->codec);
+    if (p->reduce)
+        reduce_resetstats(p->reduce);
+    if (p->moments)
+        moments_resetstats(p->moments);
+    if (p->publish)
+        shmring_resetstats(p->publish);
+    mhmutex_unlock(&p->lock);
+}
+
+
+void pipe_report(const pipeline_t* p)
+{
+    double mean = p->writes ? p->writems / p->writes : 0;
+
+    printf("\nWriter: %1.1f MB in %1.1f ms, max %d frames queued, %d stalls",
+        p->bytes / 1e6, p->writems, p->maxqueued, p->stalls);
+    if (p->writes)
+        printf("\nCounts: %1.0f per frame", p->total / p->writes);
+    if (p->writes)
+        printf("\nWrite latency: %1.3f ms/frame, max %1.3f ms, jitter (sd) %1.3f ms", mean, p->writemax,
+            sqrt(p->writesq / p->writes > mean * mean ? p->writesq / p->writes - mean * mean : 0));
+    if (p->codec && p->codec->rawbytes > 0)
+        printf("\nCodec: %1.1f MB -> %1.1f MB, ratio %1.2f, encoding %1.0f MB/s",
+            p->codec->rawbytes / 1e6, p->codec->outbytes / 1e6, p->codec->rawbytes / p->codec->outbytes,
+            p->codec->ms > 0 ? p->codec->rawbytes / 1e3 / p->codec->ms : 0);
+    if (p->reduce && p->reduce->inbytes > 0)
+        printf("\nReduce: %1.1f MB -> %1.3f MB, %1.0f MB/s",
+            p->reduce->inbytes / 1e6, p->reduce->outbytes / 1e6,
+            p->reduce->ms > 0 ? p->reduce->inbytes / 1e3 / p->reduce->ms : 0);
+    if (p->moments && p->moments->frames)
+        printf("\nMoments: %1.3f ms/frame", p->moments->ms / p->moments->frames);
+    if (p->publish && p->publish->frames)
+        printf("\nPublish: %1.3f ms/frame, max %1.3f ms", p->publish->pubms / p->publish->frames, p->publish->pubmax);
+}
+
+
+void pipe_close(pipeline_t* p)
+{
+    if (p->frames == NULL)
+        return;
+    mhmutex_lock(&p->lock);
+    p->quit = 1;
+    mhcond_broadcast(&p->cond);
+    mhmutex_unlock(&p->lock);
+    mhthread_join(p->writer);
+
+    mhcond_free(&p->cond);
+    mhmutex_free(&p->lock);
+    if (p->hugebytes)
+        rt_hugefree(p->arena, p->hugebytes);
+    else
+        mh_alignedfree(p->arena);
+    free(p->frames);
+    free(p->fullq);
+    free(p->freeq);
+    memset(p, 0, sizeof(*p));
+}
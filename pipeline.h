@@ -0,0 +1,112 @@
+/************************************************************************
+
+  Frame pipeline for the histogramming demo.
+
+  A fixed pool of preallocated frame buffers is cycled between the
+  acquisition loop (producer) and a writer thread (consumer).
+  The acquisition loop only starts, reads out and clears the device;
+  the writer thread drains full frames to disk in submit order.
+  The buffers come from one page aligned arena, one frame per page run,
+  optionally on huge pages (rtmode.h), touched before the first frame.
+  The writer can reduce frames before writing them (see reduce.h); an
+  accumulated run sum is written by pipe_flush. With an indexed
+  container (mhfile.h) the writer also keeps a record of every frame,
+  and it can publish every frame to shared memory for live viewers
+  (shmring.h).
+
+************************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "mhthread.h"
+#include "codec.h"
+#include "mapout.h"
+#include "framekern.h"
+#include "trace.h"
+#include "reduce.h"
+#include "moments.h"
+#include "mhfile.h"
+#include "shmring.h"
+
+
+typedef struct frame {
+    int rep;                // repetition index within the run
+    int flags;              // result of MH_GetFlags after the frame
+    double tstart;          // host time of MH_StartMeas (ms)
+    unsigned long long tdev;    // device start time (ps, MH_GetStartTime), 0 = not read
+    double tread0;          // host time readout started (ms)
+    double tread1;          // host time readout finished (ms)
+    double tready;          // host time frame was handed to the writer (ms)
+    int tacq;               // acquisition time the frame was started with (ms)
+    double tmeas;           // time it really measured (ms), shorter if it stopped on the stop count
+    unsigned int peak;      // largest bin, adaptive frames only
+    int why;                // ADAPT_ reason for tacq (adapt.h), ADAPT_FIXED = the configured tacq
+    long long teleseq;      // telemetry snapshot of the frame (telemetry.h), 0 = none
+    int syncrate;           // from that snapshot
+    double rate;            // counts/s over the stored channels
+    int warnings;
+    unsigned int* counts;   // histogram block, one row of bins per stored channel
+    unsigned int* own;      // the frame's own buffer, counts points into the file when mapped
+} frame_t;
+
+typedef struct pipeline {
+    frame_t* frames;
+    int nframes;
+    int rows, bins;         // frame geometry
+    size_t framewords;      // rows * bins
+    unsigned char* arena;   // the frame buffers, page aligned
+    size_t hugebytes;       // arena size if it is on huge pages, 0 = normal pages
+    const framekern_t* kern;    // kernels for this geometry
+
+    int* fullq;             // ring of indices of full frames, in submit order
+    int fullhead;
+    int nfull;
+    int* freeq;             // stack of indices of free frames
+    int nfree;
+    int busy;               // writer is processing a frame
+
+    mhmutex_t lock;
+    mhcond_t cond;
+    mhthread_t writer;
+    int quit;
+    int error;
+
+    FILE* fpout;
+    FILE* fptime;
+    codec_t* codec;         // NULL = raw frames, else frames are encoded by the writer thread
+    mapout_t* map;          // NULL = fwrite to fpout, else frames are read straight into the mapped file
+    trace_t* trace;         // NULL or the table the writer adds its write phase to
+    reduce_t* reduce;       // NULL = frames written as they are, else reduced by the writer thread first
+    moments_t* moments;     // NULL or the per-channel statistics the writer thread computes of every frame
+    int lastrep;            // rep of the last frame written, tags the run sum of an accumulating reduction
+    mhfile_t* index;        // NULL or the container index every frame gets a record in (mhfile.h)
+    shmring_t* publish;     // NULL or the shared-memory ring every frame is also copied to
+    int stamps;             // 1 = the timing file has the device start of every frame
+
+    // statistics, reset by pipe_resetstats()
+    int stalls;             // times the producer found no free buffer
+    int maxqueued;          // high water mark of full frames waiting
+    double writems;         // time spent in fwrite
+    double writemax;        // longest write of a single frame (ms)
+    double writesq;         // sum of squared write times, for the jitter
+    int writes;             // frames written
+    double bytes;           // bytes written
+    double total;           // counts in the frames written
+} pipeline_t;
+
+
+int pipe_open(pipeline_t* p, int nframes, int rows, int bins, FILE* fpout, FILE* fptime, int hugepages);
+frame_t* pipe_getfree(pipeline_t* p);
+void pipe_submit(pipeline_t* p, frame_t* f);
+void pipe_release(pipeline_t* p, frame_t* f);
+int pipe_reserve(pipeline_t* p, int nframes);
+int pipe_flush(pipeline_t* p);
+void pipe_resetstats(pipeline_t* p);
+void pipe_report(const pipeline_t* p);
+void pipe_close(pipeline_t* p);
+
+#endif
@@ -0,0 +1,236 @@
+/************************************************************************
+
+  On-the-fly frame reduction, see reduce.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhthread.h"
+#include "reduce.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REDUCE_SSE2
+#endif
+
+
+// sums of rebin neighbouring bins, bins is a multiple of rebin
+static void rebinrow(unsigned int* out, const unsigned int* in, int bins, int rebin)
+{
+    int n = bins / rebin, o = 0, i, k;
+    unsigned int s;
+
+#ifdef REDUCE_SSE2
+    if (rebin == 2)
+    {
+        // even and odd bins side by side, then one add gives four sums
+        __m128 a, b;
+        for (; o + 4 <= n; o += 4)
+        {
+            a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(in + 2 * o)));
+            b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(in + 2 * o + 4)));
+            _mm_storeu_si128((__m128i*)(out + o), _mm_add_epi32(
+                _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)))));
+        }
+    }
+    else if (rebin >= 4)
+    {
+        // four partial sums per output, then a transposing add of four outputs
+        __m128i v[4], lo, hi;
+        int j;
+        for (; o + 4 <= n; o += 4)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                const unsigned int* p = in + (size_t)(o + j) * rebin;
+                v[j] = _mm_loadu_si128((const __m128i*)p);
+                for (k = 4; k < rebin; k += 4)
+                    v[j] = _mm_add_epi32(v[j], _mm_loadu_si128((const __m128i*)(p + k)));
+            }
+            lo = _mm_add_epi32(_mm_unpacklo_epi32(v[0], v[1]), _mm_unpackhi_epi32(v[0], v[1]));
+            hi = _mm_add_epi32(_mm_unpacklo_epi32(v[2], v[3]), _mm_unpackhi_epi32(v[2], v[3]));
+            _mm_storeu_si128((__m128i*)(out + o), _mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi)));
+        }
+    }
+#endif
+    for (; o < n; o++)
+    {
+        for (i = o * rebin, s = 0, k = 0; k < rebin; k++)
+            s += in[i + k];
+        out[o] = s;
+    }
+}
+
+static unsigned int rangesum(const unsigned int* in, int n)
+{
+    unsigned int s = 0;
+    int i = 0;
+
+#ifdef REDUCE_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4)
+        acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(in + i)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    s = (unsigned int)_mm_cvtsi128_si32(acc);
+#endif
+    for (; i < n; i++)
+        s += in[i];
+    return s;
+}
+
+// acc += x, widened to 64 bit
+static void accumulate(unsigned long long* acc, const unsigned int* x, size_t n)
+{
+    size_t i = 0;
+
+#ifdef REDUCE_SSE2
+    __m128i zero = _mm_setzero_si128(), v;
+    for (; i + 4 <= n; i += 4)
+    {
+        v = _mm_loadu_si128((const __m128i*)(x + i));
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(acc + i)),
+            _mm_unpacklo_epi32(v, zero)));
+        _mm_storeu_si128((__m128i*)(acc + i + 2), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(acc + i + 2)),
+            _mm_unpackhi_epi32(v, zero)));
+    }
+#endif
+    for (; i < n; i++)
+        acc[i] += x[i];
+}
+
+
+// reads "start:length,start:length,..." into gates, returns the number of gates or -1
+int reduce_parsegates(const char* spec, int gates[][2], int max)
+{
+    const char* p = spec;
+    char* end;
+    int n = 0;
+
+    while (*p)
+    {
+        if (n == max)
+            return -1;
+        gates[n][0] = (int)strtol(p, &end, 10);
+        if (end == p || *end != ':')
+            return -1;
+        p = end + 1;
+        gates[n][1] = (int)strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != 0))
+            return -1;
+        p = *end ? end + 1 : end;
+        n++;
+    }
+    return n;
+}
+
+
+int reduce_open(reduce_t* r, int rows, int bins, int rebin, int ngates, const int gates[][2], int accumulate)
+{
+    int i;
+
+    memset(r, 0, sizeof(*r));
+    if (rebin < 1 || (rebin & (rebin - 1)) != 0 || bins % rebin != 0)
+    {
+        printf("\nrebin must be a power of two that divides %d bins", bins);
+        return -1;
+    }
+    if (ngates < 0 || ngates > REDUCE_MAXGATES)
+        return -1;
+    for (i = 0; i < ngates; i++)
+        if (gates[i][0] < 0 || gates[i][1] < 1 || gates[i][0] + gates[i][1] > bins)
+        {
+            printf("\ngate %d:%d is outside the %d stored bins", gates[i][0], gates[i][1], bins);
+            return -1;
+        }
+    r->rows = rows;
+    r->bins = bins;
+    r->rebin = ngates ? 1 : rebin;
+    r->ngates = ngates;
+    memcpy(r->gates, gates, ngates * sizeof(gates[0]));
+    r->accumulate = accumulate;
+    r->outbins = ngates ? ngates : bins / rebin;
+    r->outwords = (size_t)rows * r->outbins;
+    r->out = (unsigned int*)mh_alignedalloc(64, r->outwords * sizeof(unsigned int));
+    if (accumulate)
+        r->acc = (unsigned long long*)mh_alignedalloc(64, r->outwords * sizeof(unsigned long long));
+    if (r->out == NULL || (accumulate && r->acc == NULL))
+    {
+        reduce_close(r);
+        return -1;
+    }
+    if (accumulate)
+        memset(r->acc, 0, r->outwords * sizeof(unsigned long long));
+    return 0;
+}
+
+// reduces one frame, returns the frame to write or NULL while accumulating
+const unsigned int* reduce_frame(reduce_t* r, const unsigned int* counts)
+{
+    const unsigned int* in;
+    const unsigned int* red = counts;
+    unsigned int* o;
+    double t0 = mh_timems();
+    int row, g;
+
+    if (r->ngates || r->rebin > 1)
+    {
+        for (row = 0; row < r->rows; row++)
+        {
+            in = counts + (size_t)row * r->bins;
+            o = r->out + (size_t)row * r->outbins;
+            if (r->ngates)
+                for (g = 0; g < r->ngates; g++)
+                    o[g] = rangesum(in + r->gates[g][0], r->gates[g][1]);
+            else
+                rebinrow(o, in, r->bins, r->rebin);
+        }
+        red = r->out;
+    }
+    r->inbytes += (double)r->rows * r->bins * sizeof(unsigned int);
+    if (r->accumulate)
+    {
+        accumulate(r->acc, red, r->outwords);
+        r->accframes++;
+        red = NULL;
+    }
+    else
+        r->outbytes += (double)r->outwords * sizeof(unsigned int);
+    r->ms += mh_timems() - t0;
+    return red;
+}
+
+// the sum of the frames accumulated since the last call, NULL if there were none
+const unsigned int* reduce_total(reduce_t* r)
+{
+    size_t i;
+
+    if (!r->accumulate || r->accframes == 0)
+        return NULL;
+    for (i = 0; i < r->outwords; i++)
+        r->out[i] = r->acc[i] > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)r->acc[i];
+    memset(r->acc, 0, r->outwords * sizeof(unsigned long long));
+    r->accframes = 0;
+    r->outbytes += (double)r->outwords * sizeof(unsigned int);
+    return r->out;
+}
+
+void reduce_resetstats(reduce_t* r)
+{
+    r->inbytes = 0;
+    r->outbytes = 0;
+    r->ms = 0;
+}
+
+void reduce_close(reduce_t* r)
+{
+    if (r->out)
+        mh_alignedfree(r->out);
+    if (r->acc)
+        mh_alignedfree(r->acc);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,57 @@
+/************************************************************************
+
+  On-the-fly frame reduction
+
+  Many scans need only coarser bins, the counts in a few time gates or
+  the sum over all frames of a run, not every full frame. The writer
+  thread can reduce each frame before it is written:
+
+    rebin       sums every rebin neighbouring bins (a power of two)
+    gates       per channel row, the sum over each gate window
+                (start:length in bins of the stored range); replaces the bins
+    accumulate  adds the reduced frames up and writes only their sum,
+                once per run (reduce_total)
+
+  The reduced frame has the same row order as the input, rebinned bins
+  or gate sums per row. Sums are 32 bit like the device bins, the
+  accumulation is 64 bit and clamped to 32 bit when written. The kernels
+  use SSE2 where available and plain C elsewhere.
+
+************************************************************************/
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+
+
+#define REDUCE_MAXGATES 16
+
+typedef struct reduce {
+    int rows;               // input frame geometry
+    int bins;
+    int rebin;              // 1 = bins kept as they are
+    int ngates;             // 0 = no gates
+    int gates[REDUCE_MAXGATES][2];  // start, length
+    int accumulate;         // 1 = only the sum of all frames is written
+    int outbins;            // values per row of the reduced frame
+    size_t outwords;        // rows * outbins
+    unsigned int* out;      // last reduced frame
+    unsigned long long* acc;    // running sum, accumulate only
+    int accframes;          // frames in acc
+
+    // statistics, reset by reduce_resetstats()
+    double inbytes;         // bytes reduced
+    double outbytes;        // bytes handed on for writing
+    double ms;              // time spent reducing
+} reduce_t;
+
+
+int reduce_parsegates(const char* spec, int gates[][2], int max);
+int reduce_open(reduce_t* r, int rows, int bins, int rebin, int ngates, const int gates[][2], int accumulate);
+const unsigned int* reduce_frame(reduce_t* r, const unsigned int* counts);
+const unsigned int* reduce_total(reduce_t* r);
+void reduce_resetstats(reduce_t* r);
+void reduce_close(reduce_t* r);
+
+#endif
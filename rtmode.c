@@ -0,0 +1,165 @@
+/************************************************************************
+
+  Real-time acquisition mode, see rtmode.h
+
+************************************************************************/
+
+#ifndef _WIN32
+#define _GNU_SOURCE         // CPU_SET and pthread_setaffinity_np
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#include "mhthread.h"
+#include "rtmode.h"
+
+#define RT_HUGEPAGE ((size_t)2 << 20)
+
+
+// pins the calling thread to cpu (-1 = anywhere) and gives it priority
+// (0 = normal scheduling); 0, or -1 with the reason in why
+int rt_thread(int cpu, int priority, char* why, int whylen)
+{
+#ifdef _WIN32
+    if (cpu >= 0 && (cpu >= (int)(8 * sizeof(DWORD_PTR)) || !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu)))
+    {
+        snprintf(why, whylen, "cannot pin the thread to core %d", cpu);
+        return -1;
+    }
+    if (priority > 0 && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    {
+        snprintf(why, whylen, "cannot raise the thread to time critical priority");
+        return -1;
+    }
+#else
+    cpu_set_t set;
+    struct sched_param sp;
+    int err;
+
+    if (cpu >= 0)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if ((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+        {
+            snprintf(why, whylen, "cannot pin the thread to core %d: %s", cpu, strerror(err));
+            return -1;
+        }
+    }
+    if (priority > 0)
+    {
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = priority;
+        if ((err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) != 0)
+        {
+            snprintf(why, whylen, "no SCHED_FIFO priority %d: %s", priority, strerror(err));
+            return -1;
+        }
+    }
+#endif
+    return 0;
+}
+
+// locks what the process has in memory now, and later pages once they are
+// touched, so the frame buffers and stacks are never paged out
+int rt_lockmemory(char* why, int whylen)
+{
+#ifdef _WIN32
+    snprintf(why, whylen, "memory locking is not available on Windows");
+    return -1;
+#else
+#ifdef MCL_ONFAULT
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) == 0)
+        return 0;
+#endif
+    // without MCL_ONFAULT a future thread stack would be locked in full, current pages will do
+    if (mlockall(MCL_CURRENT) != 0)
+    {
+        snprintf(why, whylen, "mlockall failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+// size bytes on huge pages, NULL if there are none reserved (or on
+// Windows); mapped is what rt_hugefree needs back
+void* rt_hugealloc(size_t size, size_t* mapped)
+{
+#if defined(_WIN32) || !defined(MAP_HUGETLB)
+    (void)size;
+    *mapped = 0;
+    return NULL;
+#else
+    void* p;
+
+    size = (size + RT_HUGEPAGE - 1) / RT_HUGEPAGE * RT_HUGEPAGE;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        *mapped = 0;
+        return NULL;
+    }
+    *mapped = size;
+    return p;
+#endif
+}
+
+void rt_hugefree(void* p, size_t mapped)
+{
+#if defined(_WIN32) || !defined(MAP_HUGETLB)
+    (void)p;
+    (void)mapped;
+#else
+    if (p)
+        munmap(p, mapped);
+#endif
+}
+
+
+static int cmpdouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// statistics of the n - 1 intervals between n frame starts (ms)
+int rt_jitter(const double* tstarts, int n, rtjitter_t* j)
+{
+    double* d;
+    double sum = 0, sq = 0;
+    int i;
+
+    memset(j, 0, sizeof(*j));
+    if (n < 2)
+        return -1;
+    if ((d = (double*)malloc((size_t)(n - 1) * sizeof(double))) == NULL)
+        return -1;
+    for (i = 0; i < n - 1; i++)
+    {
+        d[i] = tstarts[i + 1] - tstarts[i];
+        sum += d[i];
+        sq += d[i] * d[i];
+    }
+    qsort(d, (size_t)(n - 1), sizeof(double), cmpdouble);
+    j->n = n - 1;
+    j->mean = sum / j->n;
+    j->sd = sqrt(fmax(sq / j->n - j->mean * j->mean, 0));
+    j->p50 = d[(j->n - 1) / 2];
+    j->p99 = d[(int)ceil(0.99 * j->n) - 1];
+    j->p999 = d[(int)ceil(0.999 * j->n) - 1];
+    j->min = d[0];
+    j->max = d[j->n - 1];
+    free(d);
+    return 0;
+}
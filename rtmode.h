@@ -0,0 +1,53 @@
+/************************************************************************
+
+  Real-time acquisition mode
+
+  The frame starts of histogram mode come from the acquisition thread,
+  so whatever else the OS runs on its core shows up as outliers in the
+  frame timing. With rt=1 the acquisition thread of every device is
+  pinned to a core of its own and runs under SCHED_FIFO, the memory
+  of the process is locked (mlockall) once the frame buffers exist,
+  and with hugepages=1 the frame buffers sit on huge pages. The frame
+  buffers are allocated and touched when the pipeline opens, so no
+  frame pays for a page fault.
+
+  This needs CAP_SYS_NICE and CAP_IPC_LOCK (or root, or matching
+  rtprio and memlock limits) and huge pages reserved with
+  vm.nr_hugepages. What cannot be had is reported, the run goes on
+  without it. On Windows the thread is pinned and raised to time
+  critical priority; memory locking and huge pages are Linux only here.
+
+  rt_jitter summarizes the intervals between frame starts, the numbers
+  the mode is meant to improve (mhbench -J compares both under load).
+
+************************************************************************/
+
+#ifndef RTMODE_H
+#define RTMODE_H
+
+#include <stddef.h>
+
+
+#define RT_PRIORITY 50      // SCHED_FIFO priority, above every normal thread, below the kernel's own
+
+typedef struct rtopts {
+    int enable;             // 1 = the acquisition thread runs real time
+    int cpu;                // core of the first device's thread, the next device gets the next; -1 = last cores
+    int priority;           // SCHED_FIFO priority 1..99
+} rtopts_t;
+
+typedef struct rtjitter {
+    int n;                  // intervals
+    double mean, sd;        // ms
+    double p50, p99, p999;  // ms, percentiles
+    double min, max;        // ms
+} rtjitter_t;
+
+
+int rt_thread(int cpu, int priority, char* why, int whylen);
+int rt_lockmemory(char* why, int whylen);
+void* rt_hugealloc(size_t size, size_t* mapped);
+void rt_hugefree(void* p, size_t mapped);
+int rt_jitter(const double* tstarts, int n, rtjitter_t* j);
+
+#endif
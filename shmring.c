@@ -0,0 +1,247 @@
+/************************************************************************
+
+  Live frames in shared memory, see shmring.h
+
+************************************************************************/
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "shmring.h"
+
+
+#define FRAMEHEAD 64        // shmframe_t, padded
+
+static shmframe_t* slot(const shmring_t* r, long long n)
+{
+    return (shmframe_t*)(r->base + SHM_HEADLEN + (size_t)((n - 1) % r->head->slots) * (size_t)r->head->slotbytes);
+}
+
+#ifdef _WIN32
+static void mapname(char* buf, const char* name) { sprintf(buf, "Local\\%.60s", name); }
+#endif
+
+
+// creates the ring under name (replacing one left behind by a crashed run) for frames of rows x bins
+int shmring_create(shmring_t* r, const char* name, int slots, int rows, int bins, unsigned long long chanmask,
+    double resolution, int roistart)
+{
+    long long slotbytes = (FRAMEHEAD + (long long)rows * bins * sizeof(unsigned int) + 63) & ~63LL;
+#ifdef _WIN32
+    char buf[80];
+#endif
+
+    memset(r, 0, sizeof(*r));
+    if (slots < 2 || rows < 1 || bins < 1)
+        return -1;
+    r->size = SHM_HEADLEN + (size_t)(slots * slotbytes);
+    r->writer = 1;
+#ifdef _WIN32
+    mapname(buf, name);
+    r->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)r->size >> 32),
+        (DWORD)(r->size & 0xFFFFFFFF), buf);
+    if (r->mapping == NULL || GetLastError() == ERROR_ALREADY_EXISTS) // another run publishes under this name
+        goto fail;
+    if ((r->base = (unsigned char*)MapViewOfFile(r->mapping, FILE_MAP_ALL_ACCESS, 0, 0, r->size)) == NULL)
+        goto fail;
+#else
+    snprintf(r->name, sizeof(r->name), "/%s", name);
+    shm_unlink(r->name);
+    if ((r->fd = shm_open(r->name, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0)
+        return -1;
+    if (ftruncate(r->fd, (off_t)r->size) != 0)
+        goto fail;
+    r->base = (unsigned char*)mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->base == (unsigned char*)MAP_FAILED)
+    {
+        r->base = NULL;
+        goto fail;
+    }
+#endif
+    memset(r->base, 0, r->size);
+    r->head = (shmhead_t*)r->base;
+    r->head->headlen = SHM_HEADLEN;
+    r->head->slots = slots;
+    r->head->rows = rows;
+    r->head->bins = bins;
+    r->head->slotbytes = slotbytes;
+    r->head->chanmask = chanmask;
+    r->head->resolution = resolution;
+    r->head->roistart = roistart;
+    mhatomic_store(&r->head->open, 1);
+    mhatomic_fence();
+    memcpy(r->head->magic, SHM_MAGIC, 8); // readers attach only from here on
+    return 0;
+
+fail:
+    shmring_close(r);
+    return -1;
+}
+
+// frame n + 1 into its slot; the slot's seq is 0 meanwhile, readers never hold it up
+void shmring_publish(shmring_t* r, const unsigned int* counts, const shmframe_t* f)
+{
+    double t0 = mh_timems();
+    long long n = mhatomic_load(&r->head->published) + 1; // only this thread changes it
+    shmframe_t* s = slot(r, n);
+
+    mhatomic_store(&s->seq, 0);
+    mhatomic_fence(); // a reader that sees the new counts also sees the 0
+    s->rep = f->rep;
+    s->flags = f->flags;
+    s->tstart = f->tstart;
+    s->tdev = f->tdev;
+    s->tmeas = f->tmeas;
+    s->tacq = f->tacq;
+    memcpy((unsigned char*)s + FRAMEHEAD, counts, (size_t)r->head->rows * r->head->bins * sizeof(unsigned int));
+    s->tpub = mh_timems();
+    mhatomic_store(&s->seq, n);
+    mhatomic_store(&r->head->published, n);
+
+    t0 = s->tpub - t0;
+    r->pubms += t0;
+    if (t0 > r->pubmax)
+        r->pubmax = t0;
+    r->frames++;
+}
+
+// a new bin width, between runs that change the binning; readers take it
+// from the header with the next frame
+void shmring_setres(shmring_t* r, double resolution)
+{
+    r->head->resolution = resolution;
+    mhatomic_fence();
+}
+
+void shmring_resetstats(shmring_t* r)
+{
+    r->frames = 0;
+    r->pubms = 0;
+    r->pubmax = 0;
+}
+
+
+// maps the ring of a running writer read-only; the first frame is the newest one
+int shmring_attach(shmring_t* r, const char* name)
+{
+#ifdef _WIN32
+    MEMORY_BASIC_INFORMATION mi;
+    char buf[80];
+#else
+    struct stat st;
+    char buf[64];
+#endif
+    const shmhead_t* h;
+
+    memset(r, 0, sizeof(*r));
+#ifdef _WIN32
+    mapname(buf, name);
+    if ((r->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, buf)) == NULL)
+        return -1;
+    if ((r->base = (unsigned char*)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL
+        || VirtualQuery(r->base, &mi, sizeof(mi)) == 0)
+        goto fail;
+    r->size = mi.RegionSize;
+#else
+    snprintf(buf, sizeof(buf), "/%s", name);
+    if ((r->fd = shm_open(buf, O_RDONLY, 0)) < 0)
+        return -1;
+    if (fstat(r->fd, &st) != 0 || (size_t)st.st_size < SHM_HEADLEN)
+        goto fail;
+    r->size = (size_t)st.st_size;
+    r->base = (unsigned char*)mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (r->base == (unsigned char*)MAP_FAILED)
+    {
+        r->base = NULL;
+        goto fail;
+    }
+#endif
+    h = (const shmhead_t*)r->base;
+    mhatomic_fence();
+    if (memcmp(h->magic, SHM_MAGIC, 8) != 0 || h->headlen != SHM_HEADLEN || h->slots < 2
+        || h->slotbytes < FRAMEHEAD + (long long)h->rows * h->bins * (long long)sizeof(unsigned int)
+        || r->size < SHM_HEADLEN + (size_t)(h->slots * h->slotbytes))
+        goto fail;
+    r->head = (shmhead_t*)r->base;
+    r->last = mhatomic_read(&r->head->published) - 1;
+    if (r->last < 0)
+        r->last = 0;
+    return 0;
+
+fail:
+    shmring_close(r);
+    return -1;
+}
+
+// the counts of the next frame, or with newest set of the newest one, in
+// place; NULL if there is no new frame yet (closed is set once there will
+// be none). f gets the frame's header.
+const unsigned int* shmring_next(shmring_t* r, shmframe_t* f, int newest)
+{
+    const shmframe_t* s;
+    long long n, want;
+
+    for (;;)
+    {
+        n = mhatomic_read(&r->head->published);
+        if (n <= r->last)
+        {
+            r->closed = !mhatomic_read(&r->head->open) && n == mhatomic_read(&r->head->published);
+            return NULL;
+        }
+        want = newest ? n : r->last + 1;
+        if (n - want >= r->head->slots / 2) // half a ring behind: skip to the newest before the writer comes round
+            want = n;
+        s = slot(r, want);
+        if (mhatomic_read(&s->seq) != want)
+            continue; // overwritten since published was read
+        memcpy(f, (const void*)s, sizeof(*f));
+        f->seq = want;
+        if (mhatomic_read(&s->seq) != want)
+            continue;
+        r->skipped += want - r->last - 1;
+        r->last = want;
+        return (const unsigned int*)((const unsigned char*)s + FRAMEHEAD);
+    }
+}
+
+// 1 if the counts shmring_next returned for f are still that frame, after the caller used them
+int shmring_valid(shmring_t* r, const shmframe_t* f)
+{
+    mhatomic_fence();
+    if (mhatomic_read(&slot(r, f->seq)->seq) == f->seq)
+        return 1;
+    r->torn++;
+    return 0;
+}
+
+
+void shmring_close(shmring_t* r)
+{
+    if (r->writer && r->head)
+    {
+        mhatomic_store(&r->head->open, 0);
+        mhatomic_fence();
+    }
+#ifdef _WIN32
+    if (r->base)
+        UnmapViewOfFile(r->base);
+    if (r->mapping)
+        CloseHandle(r->mapping);
+#else
+    if (r->base)
+        munmap(r->base, r->size);
+    if (r->fd > 0)
+        close(r->fd);
+    if (r->writer && r->name[0])
+        shm_unlink(r->name); // readers still attached keep their mapping
+#endif
+    memset(r, 0, sizeof(*r));
+}
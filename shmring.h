@@ -0,0 +1,119 @@
+/************************************************************************
+
+  Live frames in shared memory
+
+  Without it the only way to look at a run while it goes on is to read
+  FileData.dat behind the writer. With publish=1 the writer thread also
+  copies every frame, as it was read from the device, into a ring of
+  shared memory (POSIX shm_open, a named mapping on Windows) that any
+  local process can map read-only and read in place:
+
+    header  SHM_HEADLEN bytes, shmhead_t: geometry, slots, the number of
+            frames published so far and whether the run is still open
+    slots   slots x (shmframe_t + rows x bins unsigned ints), 64 byte aligned
+
+  Frame n (from 1) goes to slot (n - 1) % slots. The writer clears the
+  slot's seq, fills in the frame and sets seq to n, then advances
+  published; it never looks at the readers. A reader takes the newest
+  frame, or the next one while it keeps up, uses the counts where they
+  are and checks with shmring_valid afterwards that seq did not change
+  meanwhile; a reader that fell half a ring behind skips to the newest
+  frame and counts the frames it missed.
+
+    shmring_t r;
+    const unsigned int* counts;
+    shmframe_t f;
+    shmring_attach(&r, SHM_NAME);
+    while (!r.closed)
+        if ((counts = shmring_next(&r, &f, 0)) != NULL)
+        {
+            ... use counts ...
+            if (!shmring_valid(&r, &f))
+                ... the frame changed meanwhile, drop the result ...
+        }
+
+  shmview.c is a complete reader.
+
+************************************************************************/
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+
+#include "mhthread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+#define SHM_MAGIC   "MHLIVE01"
+#define SHM_HEADLEN 256
+#define SHM_SLOTS   8
+#define SHM_NAME    "mhlive"
+
+typedef struct shmhead {
+    char magic[8];          // SHM_MAGIC
+    int headlen;            // SHM_HEADLEN
+    int slots;
+    int rows, bins;         // frame geometry, one row of bins per stored channel
+    long long slotbytes;    // sizeof(shmframe_t) + frame, rounded up to 64
+    unsigned long long chanmask;    // stored channels, bit i = channel i
+    double resolution;      // bin width (ps)
+    int roistart;           // first stored bin
+    int pad;
+    mhatomic_t open;        // 0 once the writer has closed the ring
+    mhatomic_t published;   // frames published, the newest is in slot (published - 1) % slots
+} shmhead_t;
+
+typedef struct shmframe {
+    mhatomic_t seq;         // frame number from 1 when complete, 0 while it is written
+    int rep;                // within the run
+    int flags;              // MH_GetFlags after the frame
+    double tstart;          // host time of MH_StartMeas (ms)
+    unsigned long long tdev;    // device start time (ps), 0 = not read
+    double tmeas;           // time it measured (ms)
+    double tpub;            // host time it was published (ms), the same clock in every process
+    int tacq;               // ms it was started with
+    int pad;
+} shmframe_t;               // 56 bytes, the counts start at 64
+
+typedef struct shmring {
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    int fd;
+    char name[64];          // "/name", the writer unlinks it on close
+#endif
+    unsigned char* base;
+    size_t size;
+    shmhead_t* head;
+    int writer;             // 1 = this side publishes
+
+    // reader
+    long long last;         // frame number of the last frame returned
+    long long skipped;      // frames the reader never saw
+    long long torn;         // frames overwritten while they were read
+    int closed;             // the writer has closed the ring
+
+    // writer statistics, reset by shmring_resetstats()
+    long long frames;
+    double pubms;           // time spent copying
+    double pubmax;
+} shmring_t;
+
+
+int shmring_create(shmring_t* r, const char* name, int slots, int rows, int bins, unsigned long long chanmask,
+    double resolution, int roistart);
+void shmring_publish(shmring_t* r, const unsigned int* counts, const shmframe_t* f);
+void shmring_setres(shmring_t* r, double resolution);
+void shmring_resetstats(shmring_t* r);
+
+int shmring_attach(shmring_t* r, const char* name);
+const unsigned int* shmring_next(shmring_t* r, shmframe_t* f, int newest);
+int shmring_valid(shmring_t* r, const shmframe_t* f);
+
+void shmring_close(shmring_t* r);
+
+#endif
@@ -0,0 +1,103 @@
+/************************************************************************
+
+  Live frame viewer
+
+  A minimal reader of the frames histomode publishes with publish=1
+  (shmring.h). It waits for the ring to appear, then follows it without
+  copying the frames: for every frame it sees it adds up the counts
+  of each channel in place and prints one line with the rep, the total,
+  the busiest channel and how long ago the frame was published. When
+  the run closes the ring it prints how many frames it saw, skipped or
+  lost to the writer, and the lag after publishing (mean and max).
+
+    shmview                 follow every frame of the ring mhlive
+    shmview -n shmname      another ring, e.g. mhlive_<serial>
+    shmview -s 50           take 50 ms per frame, to see a slow reader skip
+    shmview -q              only the summary
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhthread.h"
+#include "shmring.h"
+
+
+int main(int argc, char* argv[])
+{
+    shmring_t r;
+    shmframe_t f;
+    const unsigned int* counts;
+    const char* name = SHM_NAME;
+    double lag, lagsum = 0, lagmax = 0, total, best, t;
+    long long frames = 0;
+    int quiet = 0, slow = 0, waited = 0, i, row, bestrow, bins;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            name = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            slow = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0)
+            quiet = 1;
+        else
+        {
+            printf("usage: shmview [-n shmname] [-s ms] [-q]\n");
+            return 1;
+        }
+    }
+
+    while (shmring_attach(&r, name) < 0)
+    {
+        if (!waited++)
+            printf("waiting for %s ...\n", name);
+        mh_sleepms(100);
+    }
+    bins = r.head->bins;
+    printf("%s: %d channels x %d bins, %d slots\n", name, r.head->rows, bins, r.head->slots);
+
+    while (!r.closed)
+    {
+        if ((counts = shmring_next(&r, &f, 0)) == NULL)
+        {
+            mh_sleepms(1);
+            continue;
+        }
+        lag = mh_timems() - f.tpub;
+        total = 0;
+        best = -1;
+        bestrow = 0;
+        for (row = 0; row < r.head->rows; row++)
+        {
+            for (i = 0, t = 0; i < bins; i++)
+                t += counts[(size_t)row * bins + i];
+            total += t;
+            if (t > best)
+            {
+                best = t;
+                bestrow = row;
+            }
+        }
+        if (slow > 0)
+            mh_sleepms(slow);
+        if (!shmring_valid(&r, &f))
+            continue; // overwritten while we read it
+        frames++;
+        lagsum += lag;
+        if (lag > lagmax)
+            lagmax = lag;
+        if (!quiet)
+            printf("%lld\trep %d\t%1.0f counts\trow %d: %1.0f\tflags 0x%X\tlag %1.3f ms\n", f.seq, f.rep, total,
+                bestrow, best, f.flags, lag);
+    }
+
+    printf("%lld frames seen, %lld skipped, %lld overwritten while read", frames, r.skipped, r.torn);
+    if (frames)
+        printf(", lag %1.3f ms (max %1.3f)", lagsum / frames, lagmax);
+    printf("\n");
+    shmring_close(&r);
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/sh
+# Building the demo and the benchmark harness against the MHLib simulator (gcc, Linux)
+gcc -O2 histomode.c config.c pipeline.c framekern.c trace.c reduce.c mhfile.c moments.c adapt.c telemetry.c codec.c mapout.c shmring.c devstate.c jobsock.c acquire.c t3stream.c t2corr.c evfilter.c rtmode.c multidev.c mhsim.c -o histomode -lpthread -lm
+gcc -O2 mhbench.c pipeline.c framekern.c trace.c reduce.c mhfile.c moments.c adapt.c telemetry.c codec.c mapout.c shmring.c rtmode.c acquire.c mhsim.c -o mhbench -lpthread -lm
+gcc -O2 mhdecode.c codec.c mhfile.c -o mhdecode
+gcc -O2 mhana.c mhfile.c moments.c reduce.c mapout.c -o mhana -lpthread -lm
+gcc -O2 shmview.c shmring.c -o shmview -lpthread
+gcc -O2 mhjob.c jobsock.c -o mhjob
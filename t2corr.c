@@ -0,0 +1,668 @@
+/************************************************************************
+
+  T2 streaming correlator, see t2corr.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "t2corr.h"
+
+
+#define T2WRAPAROUND 33554432
+
+#define T2RINGWORDS  ((long long)T2RINGBLOCKS * TTREADMAX)     // a power of two
+#define T2LOOKBACK   ((long long)TTREADMAX)    // records a worker may walk back for the history of a block
+#define T2MAXBLOCKS  1024   // blocks published and not merged yet
+#define T2MINBLOCK   65536  // records a block collects before it is published,
+#define T2BLOCKMS    10     // or ms it collects them at low rates
+#define T2HISTMASK   (T2HISTLEN - 1)
+
+#define REC(e, pos)  ((e)->ring[(pos) & (T2RINGWORDS - 1)])
+#define OVERFLOW(r)  (((r) >> 25) == 0x7F)     // special bit and channel 0x3F
+
+typedef struct t2block {
+    long long start;        // ring position (records since MH_StartMeas) of the first record
+    int n;                  // records
+    int frame;
+    long long ofl;          // overflow ticks before the first record
+    long long tfirst;       // ticks of the first timed record, -1 = none
+    int done;               // merged into its frame
+} t2block;
+
+typedef struct t2active {
+    long long index;        // frame number held in this slot, -1 = free
+    frame_t* frame;
+} t2active;
+
+typedef struct t2role {
+    int row;                // pair the channel is in
+    int other;              // history of the partner channel
+    int isb;                // 1 = the channel is b of the pair, the partner came first at positive lags
+} t2role;
+
+typedef struct t2hist {
+    long long t[T2HISTLEN]; // ticks, oldest first from head - count
+    int head;               // next slot to write
+    int count;
+} t2hist;
+
+typedef struct t2engine t2engine;
+
+typedef struct t2worker {
+    t2engine* e;
+    int id;
+    mhthread_t thread;
+    unsigned int* partial;  // rows x bins of the block in hand
+    t2hist* hist;           // one per channel of the pairs
+    long long blocks;
+    long long photons;
+    long long coincidences;
+    long long lost;
+} t2worker;
+
+struct t2engine {
+    const t2opts_t* o;
+    pipeline_t* p;
+    unsigned int* ring;                     // T2RINGWORDS records plus TTREADMAX overhang
+    t2block blocks[T2MAXBLOCKS];
+    long long published;                    // blocks handed over by the reader
+    long long claimed;                      // blocks taken by a worker
+    long long merged;                       // blocks before this one are all merged
+    long long nextemit;                     // first frame not handed to the pipeline yet
+    int framesdone;
+    int eof;                                // reader will publish no more blocks
+    t2active act[T2ACTIVE];
+    mhmutex_t lock;                         // guards everything above but the ring contents
+    mhatomic_t flags;                       // device flags seen so far
+    t2worker workers[T2MAXWORKERS];
+    int slot[64];                           // history of every channel, -1 = in no pair
+    int nchan;                              // channels in pairs
+    t2role roles[2 * T2MAXPAIRS][2 * T2MAXPAIRS];   // what a photon of a channel counts in
+    int nroles[2 * T2MAXPAIRS];
+    long long frameticks;
+    double t0;                              // host time of MH_StartMeas
+};
+
+
+int t2_parsepairs(const char* spec, int pairs[][2], int max)
+{
+    const char* p = spec;
+    char* end;
+    int n = 0;
+
+    while (*p)
+    {
+        if (n == max)
+            return -1;
+        pairs[n][0] = (int)strtol(p, &end, 10);
+        if (end == p || *end != ':' || pairs[n][0] < 0 || pairs[n][0] > 63)
+            return -1;
+        p = end + 1;
+        pairs[n][1] = (int)strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != 0) || pairs[n][1] < 0 || pairs[n][1] > 63)
+            return -1;
+        p = *end ? end + 1 : end;
+        n++;
+    }
+    return n;
+}
+
+
+// lag bin of the lag magnitude u >= 0 on one side, counted outwards from lag 0
+static int lagindex(const t2opts_t* o, long long u)
+{
+    long long w = o->lagwidth, lo = T2PERLEVEL * w;
+    int l;
+
+    if (o->scale == T2LAG_LINEAR || u < lo)
+        return u / w > T2MAXLAGS ? T2MAXLAGS : (int)(u / w);
+    for (l = 1; u >= 2 * lo; l++)
+        lo *= 2;
+    return T2PERLEVEL + (l - 1) * (T2PERLEVEL / 2) + (int)((u - lo) / (w << l));
+}
+
+// lower edge and width in ticks of lag bin i of one side
+static long long lagedge(const t2opts_t* o, int i, long long* width)
+{
+    long long w = o->lagwidth;
+    int l;
+
+    if (o->scale == T2LAG_LINEAR || i < T2PERLEVEL)
+    {
+        *width = w;
+        return i * w;
+    }
+    l = (i - T2PERLEVEL) / (T2PERLEVEL / 2) + 1;
+    *width = w << l;
+    return T2PERLEVEL * (w << (l - 1)) + ((i - T2PERLEVEL) % (T2PERLEVEL / 2)) * *width;
+}
+
+// bin of lag tau (ticks) in a row, bin nhalf starts at lag 0
+static int lagbin(const t2opts_t* o, long long tau)
+{
+    return tau >= 0 ? o->nhalf + lagindex(o, tau) : o->nhalf - 1 - lagindex(o, -tau - 1);
+}
+
+// lag bins for lagwidth and lagmax in ps, needs resolution; bins per row or -1
+int t2_lags(t2opts_t* o, double lagwidth, double lagmax)
+{
+    long long width, maxticks;
+    int top;
+
+    if (o->resolution <= 0 || lagwidth <= 0 || lagmax < lagwidth)
+        return -1;
+    o->lagwidth = (long long)(lagwidth / o->resolution + 0.5);
+    if (o->lagwidth < 1)
+        o->lagwidth = 1;
+    maxticks = (long long)(lagmax / o->resolution + 0.5);
+    if (maxticks < o->lagwidth)
+        maxticks = o->lagwidth;
+    if ((top = lagindex(o, maxticks - 1)) >= T2MAXLAGS)
+        return -1;
+    o->nhalf = top + 1;
+    o->lagspan = lagedge(o, top, &width) + width;
+    return 2 * o->nhalf + 2; // and the singles
+}
+
+// the lag axis of the rows, for the lag file
+void t2_writelags(const t2opts_t* o, FILE* fp)
+{
+    long long lo, width;
+    int b, i;
+
+    fprintf(fp, "# one row per pair a:b, lag = time of b - time of a:");
+    for (i = 0; i < o->npairs; i++)
+        fprintf(fp, " %d:%d", o->pairs[i][0], o->pairs[i][1]);
+    fprintf(fp, "\n# bins %d and %d of a row are the singles of a and of b in the frame\n", 2 * o->nhalf, 2 * o->nhalf + 1);
+    fprintf(fp, "Bin\tLag(ps)\tWidth(ps)\n");
+    for (b = 0; b < 2 * o->nhalf; b++)
+    {
+        if (b >= o->nhalf)
+            lo = lagedge(o, b - o->nhalf, &width);
+        else
+            lo = -lagedge(o, o->nhalf - 1 - b, &width) - width;
+        fprintf(fp, "%d\t%1.1f\t%1.1f\n", b, lo * o->resolution, width * o->resolution);
+    }
+}
+
+
+// a cleared frame f from the pool, under the lock
+static frame_t* newframe(t2engine* e, long long f)
+{
+    frame_t* fr = pipe_getfree(e->p);
+
+    memset(fr->counts, 0, e->p->framewords * sizeof(unsigned int));
+    fr->rep = (int)f;
+    fr->flags = 0;
+    fr->tstart = e->t0 + (double)f * e->o->tacq;
+    fr->tacq = e->o->tacq;
+    fr->tmeas = fr->tacq;
+    return fr;
+}
+
+// hands on every frame no block still to come can add to, under the lock so frames leave in order
+static void emitframes(t2engine* e)
+{
+    t2active* a;
+    frame_t* fr;
+    long long limit;
+
+    while (e->merged < e->published && e->blocks[e->merged % T2MAXBLOCKS].done)
+        e->merged++;
+    if (e->merged < e->published)
+        limit = e->blocks[e->merged % T2MAXBLOCKS].frame; // the oldest block not merged yet
+    else if (e->eof)
+        limit = e->o->numrep;
+    else
+        limit = e->published > 0 ? e->blocks[(e->published - 1) % T2MAXBLOCKS].frame : 0; // more of it may come
+    if (limit > e->o->numrep)
+        limit = e->o->numrep;
+    for (; e->nextemit < limit; e->nextemit++)
+    {
+        a = &e->act[e->nextemit % T2ACTIVE];
+        fr = a->index == e->nextemit ? a->frame : newframe(e, e->nextemit); // frames without photons are still emitted
+        fr->flags = (int)mhatomic_load(&e->flags);
+        fr->tread0 = fr->tread1 = fr->tready = mh_timems();
+        pipe_submit(e->p, fr);
+        e->framesdone++;
+        a->index = -1;
+        a->frame = NULL;
+    }
+}
+
+// adds the partial histograms of block k to its frame
+static void mergeblock(t2engine* e, t2worker* w, long long k)
+{
+    t2block* b = &e->blocks[k % T2MAXBLOCKS];
+    t2active* a = &e->act[b->frame % T2ACTIVE];
+    size_t i;
+
+    mhmutex_lock(&e->lock);
+    emitframes(e);
+    // the oldest block never waits here: every frame before its own has been emitted
+    while (b->frame >= e->nextemit + T2ACTIVE)
+    {
+        mhmutex_unlock(&e->lock);
+        mh_sleepms(0.02);
+        mhmutex_lock(&e->lock);
+        emitframes(e);
+    }
+    if (a->index != b->frame)
+    {
+        a->frame = newframe(e, b->frame);
+        a->index = b->frame;
+    }
+    for (i = 0; i < e->p->framewords; i++)
+        a->frame->counts[i] += w->partial[i];
+    b->done = 1;
+    emitframes(e);
+    mhmutex_unlock(&e->lock);
+    memset(w->partial, 0, e->p->framewords * sizeof(unsigned int));
+}
+
+
+// adds a photon of history s, forgetting those out of the lag range
+static void push(t2worker* w, int s, long long t)
+{
+    t2hist* h = &w->hist[s];
+    long long oldest = t - w->e->o->lagspan;
+
+    while (h->count > 0 && h->t[(h->head - h->count) & T2HISTMASK] < oldest)
+        h->count--;
+    h->t[h->head] = t;
+    h->head = (h->head + 1) & T2HISTMASK;
+    if (h->count < T2HISTLEN)
+        h->count++;
+    else
+        w->lost++; // the oldest one is overwritten
+}
+
+// counts a photon of history s at t against the photons before it, then keeps it
+static void photon(t2worker* w, int s, long long t)
+{
+    t2engine* e = w->e;
+    const t2opts_t* o = e->o;
+    const t2role* r;
+    const t2hist* h;
+    unsigned int* row;
+    long long d;
+    int i, k;
+
+    for (k = 0; k < e->nroles[s]; k++)
+    {
+        r = &e->roles[s][k];
+        row = w->partial + (size_t)r->row * e->p->bins;
+        row[2 * o->nhalf + r->isb]++;
+        h = &w->hist[r->other];
+        for (i = 1; i <= h->count; i++)
+        {
+            d = t - h->t[(h->head - i) & T2HISTMASK]; // the history is older, newest first
+            if (r->isb ? d >= o->lagspan : d > o->lagspan)
+                break;
+            row[lagbin(o, r->isb ? d : -d)]++;
+            w->coincidences++;
+        }
+    }
+    push(w, s, t);
+}
+
+// the photons before block b within the lag range of its first record go to the history
+static void warmup(t2worker* w, const t2block* b)
+{
+    t2engine* e = w->e;
+    long long pos = b->start, lim = b->start - T2LOOKBACK, ofl = b->ofl;
+    unsigned int rec, tag;
+
+    if (lim < 0)
+        lim = 0;
+    for (; pos > lim; pos--) // back, the overflow ticks undone on the way
+    {
+        rec = REC(e, pos - 1);
+        tag = rec & 0x1FFFFFF;
+        if (OVERFLOW(rec))
+            ofl -= T2WRAPAROUND * (long long)(tag ? tag : 1);
+        else if (ofl + tag < b->tfirst - e->o->lagspan)
+            break;
+    }
+    if (pos == lim && lim > 0)
+        w->lost++; // the ring no longer holds the start of the lag range
+    for (; pos < b->start; pos++)
+    {
+        rec = REC(e, pos);
+        tag = rec & 0x1FFFFFF;
+        if (OVERFLOW(rec))
+            ofl += T2WRAPAROUND * (long long)(tag ? tag : 1);
+        else if (!(rec & 0x80000000u) && e->slot[rec >> 25] >= 0)
+            push(w, e->slot[rec >> 25], ofl + tag);
+    }
+}
+
+static void correlate(t2worker* w, const t2block* b)
+{
+    t2engine* e = w->e;
+    long long pos, end = b->start + b->n, ofl = b->ofl;
+    unsigned int rec, tag;
+    int s;
+
+    for (s = 0; s < e->nchan; s++)
+        w->hist[s].count = 0;
+    w->blocks++;
+    if (b->tfirst < 0)
+        return; // overflows only
+    warmup(w, b);
+    for (pos = b->start; pos < end; pos++)
+    {
+        rec = REC(e, pos);
+        tag = rec & 0x1FFFFFF;
+        if (OVERFLOW(rec))
+            ofl += T2WRAPAROUND * (long long)(tag ? tag : 1);
+        else if (!(rec & 0x80000000u) && (s = e->slot[rec >> 25]) >= 0) // sync and markers are not correlated
+        {
+            photon(w, s, ofl + tag);
+            w->photons++;
+        }
+    }
+}
+
+static MHTHREADFN(workerthread)
+{
+    t2worker* w = (t2worker*)arg;
+    t2engine* e = w->e;
+    t2block b;
+    long long k;
+
+    for (;;)
+    {
+        mhmutex_lock(&e->lock);
+        k = e->claimed < e->published ? e->claimed++ : -1;
+        if (k >= 0)
+            b = e->blocks[k % T2MAXBLOCKS];
+        else if (e->eof)
+        {
+            mhmutex_unlock(&e->lock);
+            break;
+        }
+        mhmutex_unlock(&e->lock);
+        if (k < 0)
+        {
+            mh_sleepms(0.05);
+            continue;
+        }
+        correlate(w, &b);
+        mergeblock(e, w, k);
+    }
+    return 0;
+}
+
+
+// hands block b to the workers and starts the next one at ring position start
+static void publish(t2engine* e, t2block* b, long long start, int frame, long long ofl)
+{
+    if (b->n > 0)
+    {
+        mhmutex_lock(&e->lock);
+        while (e->published - e->merged >= T2MAXBLOCKS)
+        {
+            mhmutex_unlock(&e->lock);
+            mh_sleepms(0.05);
+            mhmutex_lock(&e->lock);
+        }
+        b->done = 0;
+        e->blocks[e->published % T2MAXBLOCKS] = *b;
+        e->published++;
+        mhmutex_unlock(&e->lock);
+    }
+    b->start = start;
+    b->n = 0;
+    b->frame = frame;
+    b->ofl = ofl;
+    b->tfirst = -1;
+}
+
+// ring position the workers may still look back to
+static long long needed(t2engine* e, const t2block* cur)
+{
+    long long pos;
+
+    mhmutex_lock(&e->lock);
+    pos = e->merged < e->published ? e->blocks[e->merged % T2MAXBLOCKS].start : cur->start;
+    mhmutex_unlock(&e->lock);
+    return pos - T2LOOKBACK;
+}
+
+
+int t2_run(int devidx, const t2opts_t* opts, pipeline_t* p, t2stats_t* st)
+{
+    t2engine* e;
+    t2opts_t o = *opts;
+    t2block cur;
+    t2role* r;
+    long long written = 0, end, ofl = 0, t, f;
+    size_t pos;
+    unsigned int rec, tag;
+    double now, tprev, tflags, tblock, totalms;
+    int ctcstatus, ctcdone = 0, flags, n, waiting, over = 0;
+    int nstarted = 0;
+    int ret = -1;
+    int i, j, a, b;
+
+    memset(st, 0, sizeof(*st));
+    memset(&cur, 0, sizeof(cur));
+    if ((e = (t2engine*)calloc(1, sizeof(t2engine))) == NULL)
+        return -1;
+    if (o.nworkers < 1) o.nworkers = 1;
+    if (o.nworkers > T2MAXWORKERS) o.nworkers = T2MAXWORKERS;
+    if (p->nframes <= T2ACTIVE)
+    {
+        printf("\nThe T2 correlator needs more than %d frame buffers.", T2ACTIVE);
+        free(e);
+        return -1;
+    }
+    e->o = &o;
+    e->p = p;
+    e->frameticks = (long long)(o.tacq * 1e9 / o.resolution + 0.5);
+    if (e->frameticks < 1 || o.nhalf < 1 || o.npairs < 1 || p->rows != o.npairs || p->bins != 2 * o.nhalf + 2)
+    {
+        printf("\nNo lag bins or pairs, or frames of another size.");
+        free(e);
+        return -1;
+    }
+    for (i = 0; i < 64; i++)
+        e->slot[i] = -1;
+    for (i = 0; i < o.npairs; i++)
+        for (j = 0; j < 2; j++)
+            if (e->slot[o.pairs[i][j]] < 0)
+                e->slot[o.pairs[i][j]] = e->nchan++;
+    for (i = 0; i < o.npairs; i++)
+    {
+        a = e->slot[o.pairs[i][0]];
+        b = e->slot[o.pairs[i][1]];
+        r = &e->roles[b][e->nroles[b]++]; // a photon of b looks back at a: positive lags
+        r->row = i;
+        r->other = a;
+        r->isb = 1;
+        r = &e->roles[a][e->nroles[a]++];
+        r->row = i;
+        r->other = b;
+        r->isb = 0;
+    }
+    for (i = 0; i < T2ACTIVE; i++)
+        e->act[i].index = -1;
+    if ((e->ring = (unsigned int*)mh_alignedalloc(4096, (size_t)(T2RINGWORDS + TTREADMAX) * sizeof(unsigned int))) == NULL)
+    {
+        printf("\ncannot allocate T2 ring\n");
+        goto done;
+    }
+    mhmutex_init(&e->lock);
+
+    e->t0 = mh_timems(); // refined at MH_StartMeas
+    for (i = 0; i < o.nworkers; i++)
+    {
+        e->workers[i].e = e;
+        e->workers[i].id = i;
+        e->workers[i].partial = (unsigned int*)calloc(p->framewords, sizeof(unsigned int));
+        e->workers[i].hist = (t2hist*)calloc((size_t)e->nchan, sizeof(t2hist));
+        if (e->workers[i].partial == NULL || e->workers[i].hist == NULL
+            || mhthread_create(&e->workers[i].thread, workerthread, &e->workers[i]) != 0)
+            break;
+        nstarted++;
+    }
+    if (nstarted < o.nworkers)
+    {
+        printf("\ncannot start T2 workers\n");
+        goto eof;
+    }
+
+    publish(e, &cur, 0, 0, 0); // nothing to publish, starts the first block
+    totalms = (double)o.numrep * o.tacq;
+    if (totalms > ACQTMAX) totalms = ACQTMAX;
+    if (o.align && o.armfirst)
+    {
+        if (APICALL(MH_StartMeas(devidx, (int)totalms)) < 0) goto stop; // armed, waits for the master
+        if (mhbarrier_wait(o.align) < 0) goto stop;
+        e->t0 = tprev = tflags = tblock = st->tstart = mh_timems();
+    }
+    else
+    {
+        if (o.align && mhbarrier_wait(o.align) < 0) goto stop; // another device failed
+        e->t0 = tprev = tflags = tblock = st->tstart = mh_timems();
+        if (APICALL(MH_StartMeas(devidx, (int)totalms)) < 0) goto stop;
+    }
+
+    while (!over)
+    {
+        // reader: wait until a full read fits, then read straight into the ring
+        waiting = 0;
+        while (written + TTREADMAX - needed(e, &cur) > T2RINGWORDS)
+        {
+            if (!waiting) st->ringfull++;
+            waiting = 1;
+            mh_sleepms(0.05);
+        }
+        pos = (size_t)(written & (T2RINGWORDS - 1));
+        if (APICALL(MH_ReadFiFo(devidx, e->ring + pos, &n)) < 0) goto stop;
+        now = mh_timems();
+        if (n > 0)
+        {
+            // records that landed in the overhang continue at the start of the ring
+            if (pos + n > (size_t)T2RINGWORDS)
+                memcpy(e->ring, e->ring + T2RINGWORDS, (pos + n - (size_t)T2RINGWORDS) * sizeof(unsigned int));
+            st->records += n;
+            st->reads++;
+            if (now > tprev && n * 1000.0 / (now - tprev) > st->maxrate)
+                st->maxrate = n * 1000.0 / (now - tprev);
+
+            // cut into blocks at frame ends and every T2MINBLOCK records
+            for (end = written + n; written < end; written++)
+            {
+                rec = REC(e, written);
+                tag = rec & 0x1FFFFFF;
+                if (OVERFLOW(rec))
+                    ofl += T2WRAPAROUND * (long long)(tag ? tag : 1);
+                else
+                {
+                    t = ofl + tag;
+                    if (t >= (cur.frame + 1) * e->frameticks)
+                    {
+                        f = t / e->frameticks;
+                        publish(e, &cur, written, (int)f, ofl);
+                        if (f >= o.numrep)
+                        {
+                            over = 1; // the run is over in device time
+                            break;
+                        }
+                    }
+                    if (cur.tfirst < 0)
+                        cur.tfirst = t;
+                }
+                if (++cur.n == T2MINBLOCK)
+                    publish(e, &cur, written + 1, cur.frame, ofl);
+            }
+        }
+        if (cur.n == 0)
+            tblock = now;
+        else if (now - tblock > T2BLOCKMS)
+        {
+            publish(e, &cur, written, cur.frame, ofl);
+            tblock = now;
+        }
+        tprev = now;
+
+        if (n == 0 || now - tflags > 100)
+        {
+            if (APICALL(MH_GetFlags(devidx, &flags)) < 0) goto stop;
+            mhatomic_store(&e->flags, mhatomic_load(&e->flags) | flags);
+            tflags = now;
+            if (flags & FLAG_FIFOFULL)
+            {
+                st->fifofull++;
+                printf("\nFiFo Overrun!");
+                break; // the device has stopped, what is in the ring is still correlated
+            }
+        }
+        if (n == 0)
+        {
+            if (ctcdone)
+                break; // measurement over and the FIFO is empty
+            if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) goto stop;
+            ctcdone = ctcstatus;
+            if (!ctcdone)
+                mh_sleepms(0.2); // nothing to read yet
+        }
+    }
+    ret = 0;
+
+stop:
+    APICALL(MH_StopMeas(devidx));
+    publish(e, &cur, written, cur.frame, ofl); // past the run it is empty
+eof:
+    mhmutex_lock(&e->lock);
+    e->eof = 1;
+    mhmutex_unlock(&e->lock);
+    for (i = 0; i < nstarted; i++)
+    {
+        mhthread_join(e->workers[i].thread);
+        st->blocks += e->workers[i].blocks;
+        st->photons += e->workers[i].photons;
+        st->coincidences += e->workers[i].coincidences;
+        st->lost += e->workers[i].lost;
+    }
+    if (ret == 0)
+    {
+        mhmutex_lock(&e->lock);
+        emitframes(e); // the rest of the run, frames without photons too
+        mhmutex_unlock(&e->lock);
+    }
+    for (i = 0; i < T2ACTIVE; i++)
+        if (e->act[i].frame)
+            pipe_release(p, e->act[i].frame);
+    st->frames = e->framesdone;
+    st->wallms = mh_timems() - e->t0;
+    mhmutex_free(&e->lock);
+    for (i = 0; i < T2MAXWORKERS; i++)
+    {
+        free(e->workers[i].partial);
+        free(e->workers[i].hist);
+    }
+done:
+    mh_alignedfree(e->ring);
+    free(e);
+    return ret;
+}
+
+
+void t2_report(const t2stats_t* st, const pipeline_t* p)
+{
+    printf("\nT2: %d frames, %lld records in %1.1f ms = %1.2f Mrecords/s sustained (peak read %1.2f Mrecords/s)",
+        st->frames, st->records, st->wallms, st->records / st->wallms / 1e3, st->maxrate / 1e6);
+    printf("\nT2: %lld photons in %lld blocks, %lld coincidences, %lld lost, %d FIFO full events, %d ring full waits",
+        st->photons, st->blocks, st->coincidences, st->lost, st->fifofull, st->ringfull);
+    pipe_report(p);
+}
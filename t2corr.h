@@ -0,0 +1,87 @@
+/************************************************************************
+
+  T2 streaming correlator
+
+  Runs the device continuously in MODE_T2 and histograms the arrival
+  time differences of selected channel pairs (g2) on the host, while
+  the measurement runs.
+
+  One reader thread drains MH_ReadFiFo straight into a record ring,
+  follows the overflows and cuts the stream into blocks that never
+  span a frame boundary. The workers take whole blocks, each into its
+  own partial histograms, so any number of workers shares the load of a
+  single pair. A block is correlated against the photons of the blocks
+  before it: the worker first walks back in the ring as far as the lag
+  range reaches and loads those photons into its history without
+  counting them, then counts every pair at the later of its two
+  photons, so no pair is lost or counted twice at block borders. The
+  partial histograms are merged into the frame of the block, and a
+  frame leaves through the frame pipeline once every block before its
+  end is merged.
+
+  A frame is one snapshot of tacq ms of device time with one row per
+  channel pair: the lag bins from -lagmax to +lagmax, lag = time of b
+  minus time of a, then the singles of a and of b in the frame, which
+  is what g2 is normalised with. The lag bins are linear or multi-tau
+  (T2LAG_LOG: T2PERLEVEL bins of lagwidth, then levels of
+  T2PERLEVEL / 2 bins, each level twice as wide as the one before).
+
+************************************************************************/
+
+#ifndef T2CORR_H
+#define T2CORR_H
+
+#include <stdio.h>
+
+#include "pipeline.h"
+
+
+#define T2MAXWORKERS 16
+#define T2MAXPAIRS   16
+#define T2MAXLAGS    65536  // lag bins per sign
+#define T2RINGBLOCKS 8      // ring size in units of TTREADMAX records
+#define T2ACTIVE     4      // frames that may be open at once, pool must be larger
+#define T2PERLEVEL   16     // multi-tau bins of the first level
+#define T2HISTLEN    4096   // photons per channel a worker keeps within the lag range
+
+#define T2LAG_LINEAR 0
+#define T2LAG_LOG    1
+
+typedef struct t2opts {
+    int nworkers;           // correlator threads, 1..T2MAXWORKERS
+    int npairs;             // rows per frame
+    int pairs[T2MAXPAIRS][2];   // channels a and b of every row
+    int scale;              // T2LAG_LINEAR or T2LAG_LOG
+    long long lagwidth;     // ticks, bin width, of the first level for T2LAG_LOG; set by t2_lags
+    long long lagspan;      // ticks, upper edge of the outermost lag bin; set by t2_lags
+    int nhalf;              // lag bins per sign; set by t2_lags
+    int numrep;             // frames to produce
+    int tacq;               // frame length in ms of device time, run timeout is numrep*tacq
+    double resolution;      // ps per tick, MH_GetBaseResolution
+    mhbarrier_t* align;     // NULL or barrier all devices pass before MH_StartMeas
+    int armfirst;           // 1 = call MH_StartMeas before the barrier (White Rabbit slave)
+} t2opts_t;
+
+typedef struct t2stats {
+    int frames;             // frames handed to the pipeline
+    int reads;              // MH_ReadFiFo calls that returned data
+    int ringfull;           // times the reader had to wait for the workers
+    int fifofull;           // FLAG_FIFOFULL events
+    long long records;      // records read
+    long long blocks;       // blocks correlated
+    long long photons;      // photons on the channels of the pairs
+    long long coincidences; // pairs of photons within the lag range
+    long long lost;         // photons a full history or the look back did not keep
+    double tstart;          // host time of MH_StartMeas
+    double wallms;          // measurement start to last frame
+    double maxrate;         // highest records/s of a single read interval
+} t2stats_t;
+
+
+int t2_parsepairs(const char* spec, int pairs[][2], int max);
+int t2_lags(t2opts_t* o, double lagwidth, double lagmax);
+void t2_writelags(const t2opts_t* o, FILE* fp);
+int t2_run(int devidx, const t2opts_t* o, pipeline_t* p, t2stats_t* st);
+void t2_report(const t2stats_t* st, const pipeline_t* p);
+
+#endif
@@ -0,0 +1,385 @@
+/************************************************************************
+
+  T3 streaming engine, see t3stream.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "t3stream.h"
+
+
+#define T3WRAPAROUND 1024
+
+#define T3RINGWORDS  ((size_t)T3RINGBLOCKS * TTREADMAX)
+
+typedef struct t3active {
+    long long index;        // frame number held in this slot, -1 = free
+    frame_t* frame;
+    int pending;            // workers that have not finished the frame yet
+} t3active;
+
+typedef struct t3engine t3engine;
+
+typedef struct t3worker {
+    t3engine* e;
+    int id;
+    mhthread_t thread;
+    long long photons;
+    long long dropped;
+} t3worker;
+
+struct t3engine {
+    const t3opts_t* o;
+    pipeline_t* p;
+    unsigned int* ring;                     // T3RINGWORDS records plus TTREADMAX overhang
+    mhatomic_t written;                     // records published by the reader
+    mhatomic_t consumed[T3MAXWORKERS];      // records every worker is done with
+    mhatomic_t eof;                         // reader will publish no more blocks
+    mhatomic_t flags;                       // device flags seen so far
+    mhatomic_t framesdone;
+    t3active act[T3ACTIVE];
+    mhmutex_t lock;                         // guards act[] and frame hand-over only
+    t3worker workers[T3MAXWORKERS];
+    long long syncsperframe;
+    double t0;                              // host time of MH_StartMeas
+};
+
+
+// returns frame f, the first worker to get there takes a buffer from the pool
+static frame_t* getframe(t3engine* e, long long f)
+{
+    t3active* a = &e->act[f % T3ACTIVE];
+    frame_t* fr;
+
+    for (;;)
+    {
+        mhmutex_lock(&e->lock);
+        if (a->index == f)
+        {
+            fr = a->frame;
+            mhmutex_unlock(&e->lock);
+            return fr;
+        }
+        if (a->index < 0)
+        {
+            // the pool holds more than T3ACTIVE frames, so this cannot wait on another worker
+            fr = pipe_getfree(e->p);
+            memset(fr->counts, 0, e->p->framewords * sizeof(unsigned int));
+            fr->rep = (int)f;
+            fr->flags = 0;
+            fr->tstart = e->o->cut == T3CUT_TIME ? e->t0 + (double)f * e->o->tacq : mh_timems();
+            fr->tacq = e->o->cut == T3CUT_TIME ? e->o->tacq : 0; // a marker frame lasts until the next marker
+            fr->tmeas = fr->tacq;
+            a->index = f;
+            a->frame = fr;
+            a->pending = e->o->nworkers;
+            mhmutex_unlock(&e->lock);
+            return fr;
+        }
+        mhmutex_unlock(&e->lock);
+        mh_sleepms(0.02); // slot still held by frame f - T3ACTIVE, a slower worker is behind
+    }
+}
+
+// the last worker to finish a frame hands it on, under the lock so frames leave in order
+static void finishframe(t3engine* e, long long f, int discard)
+{
+    t3active* a = &e->act[f % T3ACTIVE];
+    frame_t* fr;
+
+    mhmutex_lock(&e->lock);
+    if (--a->pending == 0)
+    {
+        fr = a->frame;
+        if (discard)
+            pipe_release(e->p, fr);
+        else
+        {
+            fr->flags = (int)mhatomic_load(&e->flags);
+            fr->tread0 = fr->tread1 = fr->tready = mh_timems();
+            pipe_submit(e->p, fr);
+            mhatomic_add(&e->framesdone, 1);
+        }
+        a->index = -1;
+        a->frame = NULL;
+    }
+    mhmutex_unlock(&e->lock);
+}
+
+
+static MHTHREADFN(workerthread)
+{
+    t3worker* w = (t3worker*)arg;
+    t3engine* e = w->e;
+    const t3opts_t* o = e->o;
+    unsigned int* rows[64];
+    unsigned int* buf;
+    unsigned int rec, ch, dtime, nsync;
+    long long cursor = 0, written, ofl = 0, cur, f;
+    frame_t* fr = NULL;
+    int mine[64];
+    int rowof[64];          // frame row of every channel, -1 = not stored
+    int c, i, n;
+
+    for (i = 0, n = 0; i < 64; i++)
+    {
+        mine[i] = i % o->nworkers == w->id;
+        if (o->chanmask ? (o->chanmask >> i) & 1 : i < o->numdet)
+            rowof[i] = n++;
+        else
+            rowof[i] = -1;
+    }
+
+    // in marker mode everything before the first marker belongs to no frame
+    cur = o->cut == T3CUT_TIME ? 0 : -1;
+
+#define SETFRAME(k) do { \
+        cur = (k); \
+        fr = cur >= 0 && cur < o->numrep ? getframe(e, cur) : NULL; \
+        for (c = 0; c < 64; c++) \
+            rows[c] = fr && mine[c] && rowof[c] >= 0 && rowof[c] < o->numdet ? fr->counts + (size_t)rowof[c] * o->numbin : NULL; \
+    } while (0)
+
+    SETFRAME(cur);
+    for (;;)
+    {
+        written = mhatomic_load(&e->written);
+        if (cursor == written)
+        {
+            if (mhatomic_load(&e->eof) && cursor == mhatomic_load(&e->written))
+                break;
+            mh_sleepms(0.05);
+            continue;
+        }
+        // contiguous part of the published records
+        buf = e->ring + cursor % T3RINGWORDS;
+        n = (int)(written - cursor);
+        if ((size_t)n > T3RINGWORDS - cursor % T3RINGWORDS)
+            n = (int)(T3RINGWORDS - cursor % T3RINGWORDS);
+        for (i = 0; i < n; i++)
+        {
+            rec = buf[i];
+            ch = (rec >> 25) & 0x3F;
+            nsync = rec & 0x3FF;
+            if (rec & 0x80000000u)
+            {
+                if (ch == 0x3F) // sync overflow, nsync holds the number of overflows
+                    ofl += T3WRAPAROUND * (long long)(nsync ? nsync : 1);
+                else if (o->cut == T3CUT_MARKER && (ch & o->markermask))
+                {
+                    if (fr) finishframe(e, cur, 0);
+                    SETFRAME(cur + 1);
+                }
+                continue;
+            }
+            if (o->cut == T3CUT_TIME)
+            {
+                f = (ofl + nsync) / e->syncsperframe;
+                while (cur < f && cur < o->numrep) // frames without events are still emitted
+                {
+                    finishframe(e, cur, 0);
+                    SETFRAME(cur + 1);
+                }
+            }
+            if (!mine[ch])
+                continue;
+            dtime = ((rec >> 10) & 0x7FFF) - (unsigned int)o->roistart; // wraps below the window
+            if (rows[ch] && dtime < (unsigned int)o->numbin)
+            {
+                rows[ch][dtime]++;
+                w->photons++;
+            }
+            else if (fr)
+                w->dropped++;
+        }
+        cursor += n;
+        mhatomic_store(&e->consumed[w->id], cursor);
+    }
+
+    // end of stream: time mode emits the rest of the run, a marker frame without its end marker is dropped
+    if (o->cut == T3CUT_TIME)
+    {
+        while (cur < o->numrep)
+        {
+            finishframe(e, cur, 0);
+            SETFRAME(cur + 1);
+        }
+    }
+    else if (fr)
+        finishframe(e, cur, 1);
+#undef SETFRAME
+    return 0;
+}
+
+
+static long long minconsumed(t3engine* e)
+{
+    long long m = mhatomic_load(&e->consumed[0]), c;
+    int i;
+    for (i = 1; i < e->o->nworkers; i++)
+        if ((c = mhatomic_load(&e->consumed[i])) < m)
+            m = c;
+    return m;
+}
+
+
+int t3_run(int devidx, const t3opts_t* opts, pipeline_t* p, t3stats_t* st)
+{
+    t3engine* e;
+    t3opts_t o = *opts;
+    long long written;
+    size_t pos;
+    double now, tprev, tflags, totalms;
+    int ctcstatus, ctcdone = 0, flags, n, waiting;
+    int nstarted = 0;
+    int ret = -1;
+    int i;
+
+    memset(st, 0, sizeof(*st));
+    if ((e = (t3engine*)calloc(1, sizeof(t3engine))) == NULL)
+        return -1;
+    if (o.nworkers < 1) o.nworkers = 1;
+    if (o.nworkers > T3MAXWORKERS) o.nworkers = T3MAXWORKERS;
+    if (p->nframes <= T3ACTIVE)
+    {
+        printf("\nT3 streaming needs more than %d frame buffers.", T3ACTIVE);
+        free(e);
+        return -1;
+    }
+    e->o = &o;
+    e->p = p;
+    e->syncsperframe = (long long)(o.tacq / 1000.0 / o.syncperiod + 0.5);
+    if (o.cut == T3CUT_TIME && e->syncsperframe < 1)
+    {
+        printf("\nNo sync period, cannot cut frames by time.");
+        free(e);
+        return -1;
+    }
+    for (i = 0; i < T3ACTIVE; i++)
+        e->act[i].index = -1;
+    if ((e->ring = (unsigned int*)mh_alignedalloc(4096, (T3RINGWORDS + TTREADMAX) * sizeof(unsigned int))) == NULL)
+    {
+        printf("\ncannot allocate T3 ring\n");
+        goto done;
+    }
+    mhmutex_init(&e->lock);
+
+    e->t0 = mh_timems(); // refined at MH_StartMeas, workers open frame 0 right away
+    for (i = 0; i < o.nworkers; i++)
+    {
+        e->workers[i].e = e;
+        e->workers[i].id = i;
+        if (mhthread_create(&e->workers[i].thread, workerthread, &e->workers[i]) != 0)
+            break;
+        nstarted++;
+    }
+    if (nstarted < o.nworkers)
+    {
+        printf("\ncannot start T3 workers\n");
+        mhatomic_store(&e->eof, 1);
+        goto join;
+    }
+
+    totalms = (double)o.numrep * o.tacq;
+    if (totalms > ACQTMAX) totalms = ACQTMAX;
+    if (o.align && o.armfirst)
+    {
+        if (APICALL(MH_StartMeas(devidx, (int)totalms)) < 0) goto stop; // armed, waits for the master
+        if (mhbarrier_wait(o.align) < 0) goto stop;
+        e->t0 = tprev = tflags = st->tstart = mh_timems();
+    }
+    else
+    {
+        if (o.align && mhbarrier_wait(o.align) < 0) goto stop; // another device failed
+        e->t0 = tprev = tflags = st->tstart = mh_timems();
+        if (APICALL(MH_StartMeas(devidx, (int)totalms)) < 0) goto stop;
+    }
+
+    for (;;)
+    {
+        // reader: wait until a full read fits, then read straight into the ring
+        written = mhatomic_load(&e->written);
+        waiting = 0;
+        while (written + TTREADMAX - minconsumed(e) > (long long)T3RINGWORDS)
+        {
+            if (!waiting) st->ringfull++;
+            waiting = 1;
+            mh_sleepms(0.05);
+        }
+        pos = (size_t)(written % T3RINGWORDS);
+        if (APICALL(MH_ReadFiFo(devidx, e->ring + pos, &n)) < 0) goto stop;
+        now = mh_timems();
+        if (n > 0)
+        {
+            // records that landed in the overhang continue at the start of the ring
+            if (pos + n > T3RINGWORDS)
+                memcpy(e->ring, e->ring + T3RINGWORDS, (pos + n - T3RINGWORDS) * sizeof(unsigned int));
+            mhatomic_store(&e->written, written + n);
+            st->records += n;
+            st->reads++;
+            if (now > tprev && n * 1000.0 / (now - tprev) > st->maxrate)
+                st->maxrate = n * 1000.0 / (now - tprev);
+        }
+        tprev = now;
+
+        if (n == 0 || now - tflags > 100)
+        {
+            if (APICALL(MH_GetFlags(devidx, &flags)) < 0) goto stop;
+            mhatomic_store(&e->flags, mhatomic_load(&e->flags) | flags);
+            tflags = now;
+            if (flags & FLAG_FIFOFULL)
+            {
+                st->fifofull++;
+                printf("\nFiFo Overrun!");
+                break; // the device has stopped, what is in the ring is still binned
+            }
+        }
+        if (o.cut == T3CUT_MARKER && mhatomic_load(&e->framesdone) >= o.numrep)
+            break;
+        if (n == 0)
+        {
+            if (ctcdone)
+                break; // measurement over and the FIFO is empty
+            if (APICALL(MH_CTCStatus(devidx, &ctcstatus)) < 0) goto stop;
+            ctcdone = ctcstatus;
+            if (!ctcdone)
+                mh_sleepms(0.2); // nothing to read yet
+        }
+    }
+    ret = 0;
+
+stop:
+    APICALL(MH_StopMeas(devidx));
+    mhatomic_store(&e->eof, 1);
+join:
+    for (i = 0; i < nstarted; i++)
+    {
+        mhthread_join(e->workers[i].thread);
+        st->photons += e->workers[i].photons;
+        st->dropped += e->workers[i].dropped;
+    }
+    st->frames = (int)mhatomic_load(&e->framesdone);
+    st->wallms = mh_timems() - e->t0;
+    mhmutex_free(&e->lock);
+done:
+    mh_alignedfree(e->ring);
+    free(e);
+    return ret;
+}
+
+
+void t3_report(const t3stats_t* st, const pipeline_t* p)
+{
+    printf("\nT3: %d frames, %lld records in %1.1f ms = %1.2f Mrecords/s sustained (peak read %1.2f Mrecords/s)",
+        st->frames, st->records, st->wallms, st->records / st->wallms / 1e3, st->maxrate / 1e6);
+    printf("\nT3: %lld photons binned, %lld outside the frame, %d FIFO full events, %d ring full waits",
+        st->photons, st->dropped, st->fifofull, st->ringfull);
+    pipe_report(p);
+}
@@ -0,0 +1,65 @@
+/************************************************************************
+
+  T3 streaming engine
+
+  Runs the device continuously in MODE_T3 and builds the histogram
+  frames on the host instead of one MH_StartMeas / MH_StopMeas /
+  MH_ClearHistMem round trip per frame.
+
+  One reader thread drains MH_ReadFiFo straight into a lock-free record
+  ring (single producer, every worker a consumer with its own cursor).
+  Every worker thread walks the whole stream in
+  order, tracks sync overflows and frame boundaries itself, and bins
+  only the photons of its own channels (ch % nworkers == worker), so
+  the workers never write to the same memory. Frames are cut by device
+  time (sync count) or by marker events and leave through the frame
+  pipeline in the same layout histogram mode writes.
+
+************************************************************************/
+
+#ifndef T3STREAM_H
+#define T3STREAM_H
+
+#include "pipeline.h"
+
+
+#define T3MAXWORKERS 16
+#define T3RINGBLOCKS 8      // ring size in units of TTREADMAX records
+#define T3ACTIVE     4      // frames that may be open at once, pool must be larger
+
+#define T3CUT_TIME   0      // a new frame every tacq ms of device time
+#define T3CUT_MARKER 1      // a new frame at every marker in markermask
+
+typedef struct t3opts {
+    int nworkers;           // binning threads, 1..T3MAXWORKERS
+    int cut;                // T3CUT_TIME or T3CUT_MARKER
+    int markermask;         // marker channels (bit 0 = marker 1) that start a frame
+    int numdet;             // channel rows per frame, photons on other channels are dropped
+    int numbin;             // bins per row, dtimes outside roistart..roistart+numbin-1 are dropped
+    int numrep;             // frames to produce
+    int tacq;               // frame length in ms for T3CUT_TIME, run timeout is numrep*tacq
+    double syncperiod;      // s, from MH_GetSyncPeriod
+    mhbarrier_t* align;     // NULL or barrier all devices pass before MH_StartMeas
+    int armfirst;           // 1 = call MH_StartMeas before the barrier (White Rabbit slave)
+    unsigned long long chanmask;    // channels stored, one row each in channel order, 0 = the first numdet
+    int roistart;           // dtime of the first bin stored
+} t3opts_t;
+
+typedef struct t3stats {
+    int frames;             // frames handed to the pipeline
+    int reads;              // MH_ReadFiFo calls that returned data
+    int ringfull;           // times the reader had to wait for the workers
+    int fifofull;           // FLAG_FIFOFULL events
+    long long records;      // records read
+    long long photons;      // photons binned
+    long long dropped;      // photons outside numdet x numbin
+    double tstart;          // host time of MH_StartMeas
+    double wallms;          // measurement start to last frame
+    double maxrate;         // highest records/s of a single read interval
+} t3stats_t;
+
+
+int t3_run(int devidx, const t3opts_t* o, pipeline_t* p, t3stats_t* st);
+void t3_report(const t3stats_t* st, const pipeline_t* p);
+
+#endif
@@ -0,0 +1,172 @@
+/************************************************************************
+
+  Background telemetry of one device, see telemetry.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "acquire.h"
+#include "telemetry.h"
+
+
+// one batch of device calls into the next slot, then publish it
+static int poll(telemetry_t* t, int deferred)
+{
+    long long n = mhatomic_load(&t->seq); // only this thread changes it
+    const telesnap_t* last = n > 0 ? &t->slot[(n - 1) % TELE_SLOTS] : NULL;
+    telesnap_t* s = &t->slot[n % TELE_SLOTS];
+    double t0 = mh_timems();
+    int ret = 0, ch;
+
+    if (last)
+        memcpy(s, last, sizeof(*s));
+    else
+        memset(s, 0, sizeof(*s));
+    // the warnings need the count rates read first
+    if (APICALL(MH_GetAllCountRates(t->devidx, &s->syncrate, s->rates)) < 0
+        || APICALL(MH_GetWarnings(t->devidx, &s->warnings)) < 0
+        || APICALL(MH_GetFlags(t->devidx, &s->flags)) < 0)
+    {
+        s->errors++;
+        ret = -1;
+    }
+    s->seq = n + 1;
+    s->tpoll = t0;
+    s->pollms = mh_timems() - t0;
+    s->polls++;
+    s->deferred += deferred;
+    s->pollsum += s->pollms;
+    if (s->pollms > s->pollmax)
+        s->pollmax = s->pollms;
+    mhatomic_store(&t->seq, n + 1);
+
+    if (t->fp)
+    {
+        fprintf(t->fp, "%lld\t%1.3f\t%1.3f\t%d\t0x%X\t0x%X", s->seq, s->tpoll, s->pollms, s->syncrate,
+            s->flags, s->warnings);
+        for (ch = 0; ch < t->nchannels; ch++)
+            fprintf(t->fp, "\t%d", s->rates[ch]);
+        fprintf(t->fp, "\n");
+    }
+    return ret;
+}
+
+static MHTHREADFN(telethread)
+{
+    telemetry_t* t = (telemetry_t*)arg;
+    double next = mh_timems() + TELE_PERIOD, now, quiet, need = 1.0;
+    int deferred = 0;
+
+    while (!mhatomic_load(&t->quit))
+    {
+        now = mh_timems();
+        if (now < next)
+        {
+            mh_sleepms(next - now < 20 ? next - now : 20); // tele_stop waits at most this long
+            continue;
+        }
+        // the whole batch must fit before the loop talks to the device again
+        quiet = (double)mhatomic_load(&t->quiet) / 1000.0;
+        if (now < next + TELE_PERIOD && (quiet < 0 || (quiet > 0 && quiet - now < need)))
+        {
+            deferred = 1;
+            mh_sleepms(0.5);
+            continue;
+        }
+        poll(t, deferred);
+        need = 2 * t->slot[(mhatomic_load(&t->seq) - 1) % TELE_SLOTS].pollms + 0.5;
+        deferred = 0;
+        next += TELE_PERIOD;
+        if (next < now)
+            next = now + TELE_PERIOD;
+    }
+    return 0;
+}
+
+
+// reads the first snapshot right away, then polls every TELE_PERIOD in the background
+int tele_start(telemetry_t* t, int devidx, int nchannels, FILE* fp)
+{
+    memset(t, 0, sizeof(*t));
+    t->devidx = devidx;
+    t->nchannels = nchannels < MAXINPCHAN ? nchannels : MAXINPCHAN;
+    t->fp = fp;
+    if (fp)
+    {
+        int ch;
+        fprintf(fp, "Seq\tTime\tPoll(ms)\tSync\tFlags\tWarnings");
+        for (ch = 0; ch < t->nchannels; ch++)
+            fprintf(fp, "\tRate%d", ch);
+        fprintf(fp, "\n");
+    }
+    if (poll(t, 0) < 0)
+        return -1;
+    if (mhthread_create(&t->thread, telethread, t) != 0)
+        return -1;
+    t->running = 1;
+    return 0;
+}
+
+void tele_stop(telemetry_t* t)
+{
+    if (!t->running)
+        return;
+    mhatomic_store(&t->quit, 1);
+    mhthread_join(t->thread);
+    t->running = 0;
+    if (t->fp)
+        fflush(t->fp);
+}
+
+
+// copies the newest snapshot, returns -1 if there is none
+int tele_read(telemetry_t* t, telesnap_t* s)
+{
+    long long n;
+
+    for (;;)
+    {
+        n = mhatomic_load(&t->seq);
+        if (n == 0)
+            return -1;
+        memcpy(s, &t->slot[(n - 1) % TELE_SLOTS], sizeof(*s));
+        // the add orders the copy before the check; had the writer started on this
+        // slot again, the count would have moved on by TELE_SLOTS - 1
+        if (mhatomic_add(&t->seq, 0) - n < TELE_SLOTS - 1)
+            return 0;
+    }
+}
+
+// until > 0: the loop leaves the device alone until that host time (ms), else TELE_IDLE or TELE_BUSY
+void tele_quiet(telemetry_t* t, double until)
+{
+    if (t)
+        mhatomic_store(&t->quiet, until > 0 ? (long long)(until * 1000.0) : (long long)until);
+}
+
+// sum of the rates of the channels in chanmask
+double tele_rate(const telesnap_t* s, unsigned long long chanmask)
+{
+    double r = 0;
+    int ch;
+
+    for (ch = 0; ch < MAXINPCHAN && ch < 64; ch++)
+        if ((chanmask >> ch) & 1)
+            r += s->rates[ch];
+    return r;
+}
+
+void tele_report(telemetry_t* t)
+{
+    telesnap_t s;
+
+    if (tele_read(t, &s) < 0 || s.polls < 1)
+        return;
+    printf("\nTelemetry: %d batches, %1.3f ms each (max %1.3f), %d waited for a quiet window, %d failed",
+        s.polls, s.pollsum / s.polls, s.pollmax, s.deferred, s.errors);
+}
@@ -0,0 +1,79 @@
+/************************************************************************
+
+  Background telemetry of one device
+
+  Count rates, warnings and flags used to be read call by call on the
+  acquisition thread, every call a device transaction the measurement
+  waits for. A telemetry thread instead reads them in one batch
+  (MH_GetAllCountRates, MH_GetWarnings, MH_GetFlags) every rate meter
+  period of 100 ms and publishes the result as a snapshot.
+
+  Snapshots go round a ring of TELE_SLOTS slots: the telemetry thread
+  fills the next slot and only then advances the published count, a
+  reader copies the newest slot and checks afterwards that the writer
+  has not come round to it meanwhile. Readers never block and never
+  make the writer wait.
+
+  Device transactions are serialized, so a batch that overlaps a call
+  of the acquisition loop would still delay it. The loop therefore
+  tells the thread with tele_quiet when it sleeps in the completion
+  wait and until when; batches run only in such windows (or between
+  runs), and are deferred by up to one period otherwise. Every batch
+  goes to a log file, and the histogramming loop stores the snapshot
+  of every frame with the frame's timing line.
+
+************************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+
+#include "mhdefin.h"
+#include "mhthread.h"
+
+
+#define TELE_SLOTS  4
+#define TELE_PERIOD 100.0   // ms, the rate meter period
+
+#define TELE_IDLE   0.0     // no acquisition, poll any time
+#define TELE_BUSY   -1.0    // the loop is talking to the device, do not poll
+
+typedef struct telesnap {
+    long long seq;          // number of the batch, from 1
+    double tpoll;           // host time of the batch (ms)
+    double pollms;          // how long it took
+    int syncrate;
+    int rates[MAXINPCHAN];  // per input channel (cps)
+    int warnings;           // MH_GetWarnings
+    int flags;              // MH_GetFlags
+
+    // running totals of the thread
+    int polls;
+    int deferred;           // batches that waited for a quiet window
+    int errors;             // batches that failed
+    double pollsum;
+    double pollmax;
+} telesnap_t;
+
+typedef struct telemetry {
+    int devidx;
+    int nchannels;
+    FILE* fp;               // NULL or the log of every batch
+    telesnap_t slot[TELE_SLOTS];
+    mhatomic_t seq;         // snapshots published, the newest is slot[(seq - 1) % TELE_SLOTS]
+    mhatomic_t quiet;       // us of host time until which polling is safe, or TELE_IDLE / TELE_BUSY
+    mhatomic_t quit;
+    mhthread_t thread;
+    int running;
+} telemetry_t;
+
+
+int tele_start(telemetry_t* t, int devidx, int nchannels, FILE* fp);
+void tele_stop(telemetry_t* t);
+int tele_read(telemetry_t* t, telesnap_t* s);
+void tele_quiet(telemetry_t* t, double until);
+double tele_rate(const telesnap_t* s, unsigned long long chanmask);
+void tele_report(telemetry_t* t);
+
+#endif
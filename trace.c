@@ -0,0 +1,98 @@
+/************************************************************************
+
+  Per-phase latency tracer, see trace.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+
+static const char* phasename[PH_COUNT] = {
+    "buffer", "start", "wait", "stop", "readout", "flags", "clear", "submit", "write"
+};
+
+
+// (re)allocates the table for a run of nframes frames, all phases zero
+int trace_open(trace_t* t, int nframes)
+{
+    trace_close(t);
+    if (nframes < 1)
+        return 0;
+    if ((t->ms = (float*)calloc((size_t)nframes * PH_COUNT, sizeof(float))) == NULL)
+        return -1;
+    t->cap = nframes;
+    return 0;
+}
+
+void trace_close(trace_t* t)
+{
+    free(t->ms);
+    memset(t, 0, sizeof(*t));
+}
+
+
+static int cmpfloat(const void* a, const void* b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return x < y ? -1 : x > y;
+}
+
+// min, median, p99 and max of every phase, and how the dead time splits up;
+// the dead time is everything but the acquisition time of the wait phase
+void trace_report(const trace_t* t)
+{
+    float* v;
+    double sum, dead = 0, phsum[PH_COUNT];
+    int n = t->frames < t->cap ? t->frames : t->cap;
+    int ph, i;
+
+    if (t->ms == NULL || n < 1 || (v = (float*)malloc(n * sizeof(float))) == NULL)
+        return;
+    for (ph = 0; ph < PH_COUNT; ph++)
+    {
+        for (i = 0, sum = 0; i < n; i++)
+            sum += v[i] = t->ms[i * PH_COUNT + ph];
+        phsum[ph] = ph == PH_WAIT ? sum - t->acqms : sum;
+        if (ph != PH_WRITE) // the writer runs in parallel, it is only dead time when the pool runs dry (buffer)
+            dead += phsum[ph];
+    }
+    printf("\nPhase      min_ms   median_ms  p99_ms     max_ms     %%dead");
+    for (ph = 0; ph < PH_COUNT; ph++)
+    {
+        for (i = 0; i < n; i++)
+            v[i] = t->ms[i * PH_COUNT + ph];
+        qsort(v, n, sizeof(float), cmpfloat);
+        printf("\n%-10s %-10.3f %-10.3f %-10.3f %-10.3f ", phasename[ph], v[0], v[n / 2], v[(int)(0.99 * (n - 1))], v[n - 1]);
+        if (ph == PH_WRITE)
+            printf("-");
+        else
+            printf("%1.1f", dead > 0 ? 100.0 * phsum[ph] / dead : 0);
+    }
+    printf("\nDead time: %1.3f ms/frame, %1.1f%% of the frame period (wait counted beyond the acquisition time, %1.1f ms/frame)",
+        dead / n, 100.0 * dead / (dead + t->acqms), t->acqms / n);
+    free(v);
+}
+
+// one line per frame, the phase durations in ms
+void trace_write(const trace_t* t, FILE* fp)
+{
+    int n = t->frames < t->cap ? t->frames : t->cap;
+    int ph, i;
+
+    fprintf(fp, "Run");
+    for (ph = 0; ph < PH_COUNT; ph++)
+        fprintf(fp, "\t%s", phasename[ph]);
+    fprintf(fp, "\n");
+    for (i = 0; i < n; i++)
+    {
+        fprintf(fp, "%d", i);
+        for (ph = 0; ph < PH_COUNT; ph++)
+            fprintf(fp, "\t%1.4f", t->ms[i * PH_COUNT + ph]);
+        fprintf(fp, "\n");
+    }
+    fflush(fp);
+}
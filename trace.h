@@ -0,0 +1,57 @@
+/************************************************************************
+
+  Per-phase latency tracer for the histogramming loop
+
+  Every frame passes through the same phases, from waiting for a free
+  buffer to the writer thread getting it to disk. The acquisition
+  thread stamps the end of each phase with trace_lap, which stores the
+  time since the previous stamp in a table preallocated for the whole
+  run, one row per frame. The writer thread fills in only the write
+  column of a row, so nobody takes a lock and nothing is printed or
+  written while the run is on. trace_report and trace_write evaluate
+  the table after the run.
+
+************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#include "mhthread.h"
+
+
+#define PH_BUFFER   0       // pipe_getfree, waiting for a free frame buffer
+#define PH_START    1       // start barrier and MH_StartMeas
+#define PH_WAIT     2       // completion wait, includes the acquisition time
+#define PH_STOP     3       // MH_StopMeas
+#define PH_READ     4       // histogram readout
+#define PH_FLAGS    5       // MH_GetFlags, MH_GetStartTime, and the next duration of an adaptive run
+#define PH_CLEAR    6       // MH_ClearHistMem
+#define PH_SUBMIT   7       // handing the frame to the writer thread
+#define PH_WRITE    8       // writer thread: encode, write, timing line
+#define PH_COUNT    9
+
+typedef struct trace {
+    float* ms;              // [cap][PH_COUNT] phase durations
+    int cap;                // frames the table holds
+    int frames;             // rows filled in, set by the loop after the run
+    double acqms;           // acquisition time of those frames, set with frames
+} trace_t;
+
+
+// stores the time since `since` as phase ph of frame rep and returns the time now
+static inline double trace_lap(trace_t* t, int rep, int ph, double since)
+{
+    double now = mh_timems();
+    if (t && rep < t->cap)
+        t->ms[rep * PH_COUNT + ph] = (float)(now - since);
+    return now;
+}
+
+int trace_open(trace_t* t, int nframes);
+void trace_report(const trace_t* t);
+void trace_write(const trace_t* t, FILE* fp);
+void trace_close(trace_t* t);
+
+#endif